@@ -0,0 +1,57 @@
+-- Small object allocation: tables, closures, strings and cdata.
+-- Usage: luajit alloc.lua [objects per test]
+-- Compare builds with and without -DLUAJIT_ENABLE_SLAB.
+
+local N = tonumber(arg and arg[1]) or 4000000
+local RING = 4096  -- Keep objects alive for a while, like a real program.
+
+local ok, ffi = pcall(require, "ffi")
+if not ok then ffi = nil end
+
+local tests = {
+  {"table", function(i) return {i, i} end},
+  {"closure", function(i) return function() return i end end},
+  {"string", function(i) return "s"..i end},
+}
+if ffi then
+  local ct = ffi.typeof("struct { double x, y; }")
+  tests[#tests+1] = {"cdata", function(i) return ct(i, i) end}
+end
+
+local function check(name, o, i)
+  if name == "table" then return o[1] == i and o[2] == i
+  elseif name == "closure" then return o() == i
+  elseif name == "string" then return o == "s"..i
+  else return o.x == i and o.y == i end
+end
+
+-- Check that objects survive GC cycles and that freed memory is reused.
+for _, t in ipairs(tests) do
+  local name, new = t[1], t[2]
+  local keep = {}
+  for i = 1, 100000 do keep[i] = new(i) end
+  collectgarbage()
+  for i = 1, 100000, 2 do keep[i] = false end
+  collectgarbage()
+  local c0 = collectgarbage("count")
+  for i = 1, 100000, 2 do keep[i] = new(i) end
+  for i = 1, 100000 do assert(check(name, keep[i], i), name.." corrupted") end
+  assert(collectgarbage("count") < c0 * 2)
+  keep = nil
+  collectgarbage()
+  assert(collectgarbage("trim") >= 0)
+end
+
+for _, t in ipairs(tests) do
+  local name, new = t[1], t[2]
+  local ring = {}
+  collectgarbage()
+  local best = math.huge
+  for _ = 1, 3 do
+    local t0 = os.clock()
+    for i = 1, N do ring[i % RING + 1] = new(i) end
+    local t = os.clock() - t0
+    if t < best then best = t end
+  end
+  io.write(string.format("%-8s %6.1f ns/object\n", name, best*1e9/N))
+end
@@ -0,0 +1,79 @@
+-- Big strings from I/O and concatenation.
+-- Usage: luajit bigstring.lua [size in KB] [rounds]
+-- Compare builds with and without -DLUAJIT_ENABLE_LAZYSTR.
+
+local SIZE = (tonumber(arg and arg[1]) or 1024) * 1024
+local ROUNDS = tonumber(arg and arg[2]) or 200
+
+local chunk = {}
+for i = 1, 1024 do chunk[i] = string.char(32 + (i * 7) % 95) end
+chunk = table.concat(chunk)
+local parts = {}
+for i = 1, SIZE / 1024 do parts[i] = chunk end
+
+-- Check that big strings behave like any other string, whether they are
+-- created by table.concat, string.rep, I/O or a string buffer. Equal big
+-- strings are different objects, if they are lazy.
+do
+  local a = table.concat(parts)
+  local b = string.rep(chunk, #parts)
+  local c = chunk:rep(#parts - 1)..chunk
+  assert(#a == SIZE and a == b and b == c and a == c)
+  assert(not (a ~= b) and a <= b and not (a < b))
+  local d = chunk:rep(#parts - 1).."x"..chunk:sub(2)
+  assert(a ~= d and a < d and #d == SIZE)
+  local t = {[a] = 1, [d] = 2}
+  assert(t[b] == 1 and t[c] == 1 and t[d] == 2)
+  t[c] = 3
+  assert(t[a] == 3 and t[b] == 3)
+  local n = 0
+  for k in pairs(t) do n = n + 1 end
+  assert(n == 2, "equal strings used as different keys")
+  for i = 1, 200 do  -- Same on trace.
+    local x = i % 2 == 0 and b or d
+    assert((x == a) == (i % 2 == 0))
+    assert(t[x] == (i % 2 == 0 and 3 or 2))
+  end
+  local ok, buffer = pcall(require, "string.buffer")
+  if ok then assert(buffer.new():put(a):tostring() == c) end
+  assert(a:sub(1, 1024) == chunk and a:sub(-1024) == chunk)
+  assert(a:find(chunk, SIZE - 1024, true) == SIZE - 1023)
+end
+
+-- Every round creates a different string. Otherwise an interning build
+-- would only find the same string again and skip the allocation.
+local count = 0
+local function bench(name, f)
+  collectgarbage()
+  local best = math.huge
+  for _ = 1, 3 do
+    local t0 = os.clock()
+    for _ = 1, ROUNDS do count = count + 1; f(count) end
+    local t = os.clock() - t0
+    if t < best then best = t end
+  end
+  io.write(string.format("%-10s %8.3fms\n", name, best*1000/ROUNDS))
+end
+
+local fname = os.tmpname()
+local fp = assert(io.open(fname, "wb"))
+fp:write(table.concat(parts))
+fp:close()
+
+io.write(SIZE/1024, " KB\n")
+bench("read *a", function(n)
+  local fp = assert(io.open(fname, "rb"))
+  fp:seek("set", n % 4096)
+  local s = fp:read("*a")
+  fp:close()
+  assert(#s == SIZE - n % 4096)
+end)
+bench("concat", function(n)
+  parts[1] = string.format("%08d", n)..chunk:sub(9)
+  assert(#table.concat(parts) == SIZE)
+end)
+bench("rep", function(n)
+  local c = string.format("%08d", n)..chunk:sub(9)
+  assert(#c:rep(#parts) == SIZE)
+end)
+os.remove(fname)
@@ -0,0 +1,135 @@
+-- Functional-style code: callbacks, closure iterators, partial application.
+-- Usage: luajit closure.lua [iterations]
+
+local N = tonumber(arg and arg[1]) or 200000
+
+local function map(t, f)
+  local r = {}
+  for i = 1, #t do r[i] = f(t[i]) end
+  return r
+end
+
+local function reduce(t, f, acc)
+  for i = 1, #t do acc = f(acc, t[i]) end
+  return acc
+end
+
+-- Stateless iterator with a closure over immutable locals.
+local function mapped(t, f)
+  return function(_, i)
+    i = i + 1
+    local v = t[i]
+    if v ~= nil then return i, f(v) end
+  end, nil, 0
+end
+
+local function partial(f, a)
+  return function(b) return f(a, b) end
+end
+
+local function add(a, b) return a + b end
+local function mul(a, b) return a * b end
+
+local data = {}
+for i = 1, 16 do data[i] = i end
+
+local function callbacks(n)
+  local s = 0
+  for k = 1, n do
+    local r = map(data, function(x) return x * k end)
+    s = s + reduce(r, function(a, b) return a + b end, 0)
+  end
+  return s
+end
+
+local function iterators(n)
+  local s = 0
+  for k = 1, n do
+    for _, v in mapped(data, function(x) return x + k end) do s = s + v end
+  end
+  return s
+end
+
+local function partials(n)
+  local s = 0
+  for k = 1, n do
+    local f, g = partial(add, k), partial(mul, 3)
+    s = s + g(f(1)) + f(g(2))
+  end
+  return s
+end
+
+-- Closure creation must behave like the interpreter.
+do
+  -- A fresh upvalue per iteration. Closures of the same instance share it.
+  local fs, gs = {}, {}
+  for i = 1, 300 do
+    local j = i * 2
+    fs[i] = function() return j end
+    gs[i] = function() return j + 1 end
+  end
+  for i = 1, 300 do
+    assert(fs[i]() == i*2 and gs[i]() == i*2+1)
+    assert(debug.upvalueid(fs[i], 1) == debug.upvalueid(gs[i], 1))
+    assert(i == 1 or debug.upvalueid(fs[i], 1) ~= debug.upvalueid(fs[i-1], 1))
+  end
+  local v = 0
+  local inc = function() v = v + 1 end
+  for _ = 1, 300 do inc() end
+  assert(v == 300)
+end
+
+-- A later local in the same slot doesn't keep a loop from compiling.
+if jit and jit.attach and jit.status() then
+  local naborts = 0
+  local function onabort(what)
+    if what == "abort" then naborts = naborts + 1 end
+  end
+  local function slotreuse()
+    local fs = {}
+    for i = 1, 300 do local j = i*2 fs[i] = function() return j end end
+    for i = 1, 3 do local j = i; local g = function() return j end end
+    return fs
+  end
+  jit.attach(onabort, "trace")
+  local fs = slotreuse()
+  jit.attach(onabort)
+  assert(fs[300]() == 600)
+  assert(naborts == 0, "closure loop doesn't compile")
+end
+
+local NDATA = #data
+local SUM = NDATA*(NDATA+1)/2
+assert(callbacks(N) == SUM * N*(N+1)/2)
+assert(iterators(N) == N*SUM + NDATA*N*(N+1)/2)
+assert(partials(N) == 3*N*(N+1)/2 + 3*N + N*(N+1)/2 + 6*N)
+
+local function bench(f)
+  local best = math.huge
+  for _ = 1, 3 do
+    local t0 = os.clock()
+    f(N)
+    local t = os.clock() - t0
+    if t < best then best = t end
+  end
+  return best
+end
+
+local tests = {
+  {"callbacks", callbacks}, {"iterators", iterators}, {"partials", partials},
+}
+for _, test in ipairs(tests) do
+  local name, f = test[1], test[2]
+  local tjit = bench(f)
+  local toff
+  if jit then
+    jit.off() jit.flush()
+    toff = bench(f)
+    jit.on()
+  end
+  io.write(string.format("%-9s %8.1f ns/iter", name, tjit*1e9/N))
+  if toff then
+    io.write(string.format("  -joff %8.1f ns/iter", toff*1e9/N))
+  end
+  io.write("\n")
+end
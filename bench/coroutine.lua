@@ -0,0 +1,73 @@
+-- Coroutine switches: a generator-style iterator and a ping-pong pipeline.
+-- Usage: luajit coroutine.lua [switches]
+
+local wrap, yield, resume, create, status =
+  coroutine.wrap, coroutine.yield, coroutine.resume, coroutine.create,
+  coroutine.status
+local N = tonumber(arg and arg[1]) or 1000000
+
+local function gen(n)
+  return wrap(function()
+    for i = 1, n do yield(i) end
+  end)
+end
+
+local function generator(n)
+  local s = 0
+  for x in gen(n) do s = s + x end
+  return s
+end
+
+local function pingpong(n)
+  local consumer = create(function(x)
+    local acc = 0
+    while true do acc = acc + x; x = yield(acc) end
+  end)
+  local acc
+  for i = 1, n do
+    local ok
+    ok, acc = resume(consumer, i)
+    assert(ok and status(consumer) == "suspended")
+  end
+  return acc
+end
+
+assert(generator(N) == N*(N+1)/2)
+assert(pingpong(N) == N*(N+1)/2)
+do  -- Errors and dead coroutines behave like the interpreter.
+  for i = 1, 100 do
+    local co = create(function(x) yield(x) error("boom", 0) end)
+    assert(select(2, resume(co, i)) == i)
+    local ok, err = resume(co)
+    assert(not ok and err == "boom" and status(co) == "dead")
+    ok, err = resume(co)
+    assert(not ok and err == "cannot resume dead coroutine")
+  end
+end
+
+local function bench(f)
+  local best = math.huge
+  for _ = 1, 3 do
+    local t0 = os.clock()
+    f(N)
+    local t = os.clock() - t0
+    if t < best then best = t end
+  end
+  return best
+end
+
+for _, test in ipairs{{"generator", generator}, {"pingpong", pingpong}} do
+  local name, f = test[1], test[2]
+  local tjit = bench(f)
+  local toff
+  if jit then
+    jit.off() jit.flush()
+    toff = bench(f)
+    jit.on()
+  end
+  io.write(string.format("%-9s %6.1f ns/switch", name, tjit*1e9/N))
+  if toff then
+    io.write(string.format("  -joff %6.1f ns/switch", toff*1e9/N))
+  end
+  io.write("\n")
+end
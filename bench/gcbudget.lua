@@ -0,0 +1,72 @@
+-- GC step pauses with and without a time budget.
+-- Usage: luajit gcbudget.lua [budget_us] [big table size] [rounds]
+
+local BUDGET = tonumber(arg and arg[1]) or 100
+local NBIG = tonumber(arg and arg[2]) or 2000000
+local ROUNDS = tonumber(arg and arg[3]) or 5000
+
+local function histsum(h)
+  local n = 0
+  for i = 1, #h do n = n + h[i] end
+  return n
+end
+
+-- Returns the upper bound of the highest non-empty pause bucket in us.
+local function maxpause(h0, h)
+  for i = #h, 1, -1 do
+    if h[i] > h0[i] then return i == #h and math.huge or 2^(i-1) end
+  end
+  return 0
+end
+
+-- Returns the number of pauses of 1ms or more.
+local function longpauses(h0, h)
+  local n = 0
+  for i = 12, #h do n = n + h[i] - h0[i] end
+  return n
+end
+
+-- Check the budget setting, the histogram and chunked table traversal.
+do
+  local prev = collectgarbage("budget", 50)
+  assert(type(prev) == "number")
+  assert(collectgarbage("stats").budget == 50)
+  assert(collectgarbage("budget", 0) == 50)
+  assert(collectgarbage("stats").budget == 0)
+  local st0 = collectgarbage("stats")
+  assert(#st0.hist == 20)
+  collectgarbage("budget", 1)
+  local big, hbig, ring = {}, {}, {}
+  for i = 1, 200000 do big[i] = {i}; hbig["k"..i] = {i} end
+  for r = 1, 2000 do  -- Mutate the big tables while they are traversed.
+    local i = r * 97 % 200000 + 1
+    big[i] = {i}
+    hbig["k"..i] = {i}
+    for k = 1, 100 do ring[k] = {r} end
+  end
+  collectgarbage()
+  for i = 1, 200000 do
+    assert(big[i][1] == i and hbig["k"..i][1] == i, "object lost")
+  end
+  assert(histsum(collectgarbage("stats").hist) > histsum(st0.hist))
+  collectgarbage("budget", prev)
+end
+
+local big, ring = {}, {}
+for i = 1, NBIG do big[i] = {i} end
+
+for _, budget in ipairs{0, BUDGET} do
+  collectgarbage("budget", budget)
+  collectgarbage()
+  local st0 = collectgarbage("stats")
+  local t0 = os.clock()
+  for r = 1, ROUNDS do
+    for i = 1, 1000 do ring[i] = {r, i} end  -- Keep the JIT from sinking.
+  end
+  local t = os.clock() - t0
+  local st = collectgarbage("stats")
+  io.write(string.format(
+    "budget %4dus  %.3fs  %d pauses, %d >= 1ms, max < %gus\n",
+    budget, t, histsum(st.hist) - histsum(st0.hist),
+    longpauses(st0.hist, st.hist), maxpause(st0.hist, st.hist)))
+end
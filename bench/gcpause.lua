@@ -0,0 +1,63 @@
+-- GC pauses with a large long-lived heap and short-lived temporaries.
+-- Usage: luajit gcpause.lua [incremental|generational] [old] [rounds]
+
+local mode = arg and arg[1] or "generational"
+local NOLD = tonumber(arg and arg[2]) or 1000000
+local ROUNDS = tonumber(arg and arg[3]) or 2000
+
+-- Check mode switches, stats and the barriers of the generational mode.
+do
+  local prev = collectgarbage("generational")
+  assert(prev == "incremental" or prev == "generational")
+  assert(collectgarbage("stats").mode == "generational")
+  assert(collectgarbage("generational") == "generational")
+  local st0 = collectgarbage("stats")
+  local keep = {}
+  for i = 1, 100 do keep[i] = {i} end
+  collectgarbage()  -- Now old.
+  local weak = setmetatable({}, {__mode = "k"})
+  local fin = 0
+  for r = 1, 200 do
+    for i = 1, 1000 do local t = {r, i} end
+    keep[r % 100 + 1][2] = {r}  -- Young object stored into an old one.
+    weak[{}] = r
+    newproxy(true)  -- Garbage with a finalizer.
+    getmetatable(newproxy(true)).__gc = function() fin = fin + 1 end
+    collectgarbage("step")
+  end
+  collectgarbage()
+  for i = 1, 100 do
+    local t = keep[i]
+    assert(t[1] == i and type(t[2]) == "table")
+    assert(t[2][1] % 100 + 1 == i)
+  end
+  assert(next(weak) == nil, "weak keys not collected")
+  assert(fin == 200, "finalizers not run")
+  local st = collectgarbage("stats")
+  assert(st.minor > st0.minor and st.major > st0.major)
+  assert(st.minortime >= st0.minortime and st.minormax >= 0)
+  assert(collectgarbage("incremental") == "generational")
+  assert(collectgarbage("stats").mode == "incremental")
+  collectgarbage()
+end
+
+collectgarbage(mode)
+local old = {}
+for i = 1, NOLD do old[i] = {i, tostring(i)} end
+
+local t0 = os.clock()
+for r = 1, ROUNDS do
+  local tmp = {}
+  for i = 1, 1000 do tmp[i] = {r, i} end
+  old[(r * 7919) % NOLD + 1][3] = tmp[r % 1000 + 1]
+end
+local t = os.clock() - t0
+for r = 1, ROUNDS do
+  local o = old[(r * 7919) % NOLD + 1]
+  assert(o[3] and o[3][1] <= r, "young object lost")
+end
+
+local st = collectgarbage("stats")
+io.write(string.format(
+  "%s %.3fs  minor %d (max %.0fus)  major %d (max %.0fus)\n",
+  st.mode, t, st.minor, st.minormax, st.major, st.majormax))
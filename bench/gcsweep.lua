@@ -0,0 +1,111 @@
+-- Full GC cycles over a big heap with parallel sweep threads.
+-- Usage: luajit gcsweep.lua [strings] [threads ...]
+-- Needs a build with -DLUAJIT_ENABLE_PSWEEP to use more than 0 threads.
+
+local NSTR = tonumber(arg and arg[1]) or 4000000
+
+local threads = {}
+for i = 2, arg and #arg or 0 do threads[#threads+1] = tonumber(arg[i]) end
+if #threads == 0 then threads = {0, 1, 2, 4, 8} end
+
+-- os.clock() adds up the CPU time of all threads, so use the wall clock.
+local clock = os.clock
+local ok, ffi = pcall(require, "ffi")
+if ok and ffi.os ~= "Windows" then
+  ffi.cdef[[
+  typedef struct { long tv_sec, tv_nsec; } bench_timespec;
+  int clock_gettime(int clk, bench_timespec *ts);
+  ]]
+  local ts = ffi.new("bench_timespec")
+  local CLOCK_MONOTONIC = ffi.os == "OSX" and 6 or 1
+  clock = function()
+    ffi.C.clock_gettime(CLOCK_MONOTONIC, ts)
+    return tonumber(ts.tv_sec) + tonumber(ts.tv_nsec)*1e-9
+  end
+end
+
+-- Check the setting and that sweeping keeps live strings and frees dead ones.
+do
+  local prev = collectgarbage("sweepthreads", 2)
+  local psweep = collectgarbage("sweepthreads", 1000) == 2
+  assert(collectgarbage("sweepthreads", 0) == (psweep and 64 or 0))
+  if not psweep then io.write("no parallel sweep in this build\n") end
+  collectgarbage("sweepthreads", psweep and 4 or 0)
+  local keep, weak = {}, setmetatable({}, {__mode = "k"})
+  for i = 1, 100000 do
+    keep["live"..i] = i
+    local s = "dead"..i
+    weak[{}] = s
+  end
+  local c0 = collectgarbage("count")
+  collectgarbage()
+  assert(collectgarbage("count") < c0, "nothing freed")
+  assert(next(weak) == nil)
+  for i = 1, 100000 do assert(keep["live"..i] == i, "live string lost") end
+  -- Repeated full GCs split the root list at the survivors of the last one.
+  -- Mixes all kinds of objects, including threads with open upvalues and
+  -- userdata with finalizers.
+  local nudata, nfin = 0, 0
+  local function new(i)
+    local k = i % 5
+    if k == 0 then return {i}
+    elseif k == 1 then return function() return i end
+    elseif k == 2 then
+      local co = coroutine.create(function(x)
+	coroutine.yield(function() return x end)
+      end)
+      local _, f = coroutine.resume(co, i)
+      return {co, f}
+    elseif k == 3 then
+      local u = newproxy(true)
+      nudata = nudata + 1
+      getmetatable(u).__gc = function() nfin = nfin + 1 end
+      return u
+    end
+    return "obj"..i
+  end
+  local objs = {}
+  for round = 1, 8 do
+    local wobjs = setmetatable({}, {__mode = "v"})
+    for i = 1, 20000 do
+      if round == 1 or (i + round) % 3 == 0 then objs[i] = new(i) end
+      wobjs[i] = new(i)
+    end
+    collectgarbage()
+    collectgarbage()
+    for i = 1, 20000 do
+      local o, k = objs[i], i % 5
+      if k == 0 then assert(o[1] == i, "live table lost")
+      elseif k == 1 then assert(o() == i, "live closure lost")
+      elseif k == 2 then assert(o[2]() == i, "live upvalue lost")
+      elseif k == 4 then assert(o == "obj"..i, "live string lost") end
+    end
+    for i in pairs(wobjs) do assert(i % 5 == 4, "dead object kept") end
+  end
+  objs = nil
+  collectgarbage()
+  collectgarbage()
+  assert(nfin == nudata, "missing finalizers")
+  collectgarbage("sweepthreads", prev)
+end
+
+-- Strings in the string table, tables in the root list.
+local strs, tabs = {}, {}
+for i = 1, NSTR do strs[i] = "str"..i end
+for i = 1, NSTR/4 do tabs[i] = {} end
+
+for _, n in ipairs(threads) do
+  collectgarbage("sweepthreads", n)
+  collectgarbage()
+  local best = math.huge
+  for _ = 1, 5 do
+    for i = 1, NSTR, 2 do strs[i] = "tmp"..i end  -- Half of them die.
+    for i = 1, NSTR/4, 2 do tabs[i] = {} end
+    local t0 = clock()
+    collectgarbage()
+    local t = clock() - t0
+    if t < best then best = t end
+    for i = 1, NSTR, 2 do strs[i] = "str"..i end
+  end
+  io.write(string.format("%2d threads  %7.2fms per full GC\n", n, best*1000))
+end
@@ -0,0 +1,61 @@
+-- Random access to a large heap with and without transparent huge pages.
+-- Usage: luajit hugepage.lua [tables] [steps]
+-- Runs itself in child processes with and without LUAJIT_HUGEPAGE set.
+-- Uses perf to count dTLB misses, if it's available. Linux only.
+
+local NTAB = tonumber(arg and arg[1]) or 4000000
+local NSTEP = tonumber(arg and arg[2]) or 5000000
+
+if arg and arg[1] == "run" then
+  local n, steps = tonumber(arg[2]), tonumber(arg[3])
+  local tabs = {}
+  for i = 1, n do tabs[i] = {next = (i * 7919) % n + 1, val = i} end
+  local t0 = os.clock()
+  local j, sum = 1, 0
+  for _ = 1, steps do  -- Chase pointers all over the heap.
+    local t = tabs[j]
+    sum = sum + t.val
+    j = (t.next + sum) % n + 1
+  end
+  local t = os.clock() - t0
+  local huge = 0
+  local fp = io.open("/proc/self/smaps_rollup")
+  if fp then
+    huge = tonumber(fp:read("*a"):match("AnonHugePages:%s*(%d+)")) or 0
+    fp:close()
+  end
+  io.write(string.format("%.3f %.0f %d\n", t*1000, sum, huge))
+  return
+end
+
+local luajit = arg and arg[-1] or "luajit"
+local script = arg and arg[0] or "hugepage.lua"
+local perf = os.execute("perf --version >/dev/null 2>&1")
+perf = perf == 0 or perf == true
+
+local res
+local function run(env)
+  local cmd = env..luajit.." "..script.." run "..NTAB.." "..NSTEP
+  if perf then cmd = "perf stat -x, -e dTLB-load-misses "..cmd end
+  local fp = io.popen(cmd.." 2>&1")
+  local out = fp:read("*a")
+  fp:close()
+  local t, sum, huge = out:match("^([%d.]+) (%d+) (%d+)")
+  assert(t, "benchmark run failed: "..out)
+  assert(not res or sum == res, "wrong result")
+  res = sum
+  local misses = perf and out:match("\n(%d+),[^\n]*dTLB") or "-"
+  io.write(string.format("%-10s %9.2fms  %8d kB huge pages  %s dTLB misses\n",
+			 env == "" and "default" or "hugepage",
+			 tonumber(t), tonumber(huge), misses))
+  return tonumber(huge)
+end
+
+run("")
+local huge = run("LUAJIT_HUGEPAGE=1 ")
+local fp = io.open("/sys/kernel/mm/transparent_hugepage/enabled")
+if fp then  -- Check that the heap got huge pages, if THP are enabled.
+  local s = fp:read("*a")
+  fp:close()
+  assert(huge > 0 or s:match("%[never%]"), "no huge pages used")
+end
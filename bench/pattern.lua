@@ -0,0 +1,168 @@
+-- Lua pattern matching with string.find, match, gmatch and gsub.
+-- Usage: luajit pattern.lua [lines] [rounds]
+
+local NLINE = tonumber(arg and arg[1]) or 2000
+local ROUNDS = tonumber(arg and arg[2]) or 50
+
+-- Subject, pattern, init and the expected results of find, match, gmatch
+-- and gsub with "<%0>". These come from the recursive matcher, which was
+-- used for all patterns before they were compiled.
+local cases = {
+  {"hello world", "o w", nil, {5, 7}, {"o w"}, {{"o w", nil}},
+    {"hell<o w>orld", 1}},
+  {"hello world", "^h", nil, {1, 1}, {"h"}, {}, {"<h>ello world", 1}},
+  {"hello world", "d$", nil, {11, 11}, {"d"}, {{"d", nil}}, {"hello worl<d>",
+    1}},
+  {"hello world", "^(%a+)", nil, {1, 5, "hello"}, {"hello"}, {},
+    {"<hello> world", 1}},
+  {"hello world", "(%a+)$", nil, {7, 11, "world"}, {"world"}, {{"world", nil}},
+    {"hello <world>", 1}},
+  {"key = value", "(%w+)%s*=%s*(%w+)", nil, {1, 11, "key", "value"}, {"key",
+    "value"}, {{"key", "value"}}, {"<key = value>", 1}},
+  {"  trim  ", "^%s*(.-)%s*$", nil, {1, 8, "trim"}, {"trim"}, {},
+    {"<  trim  >", 1}},
+  {"a,b,,c", "([^,]*)", nil, {1, 1, "a"}, {"a"}, {{"a", nil}, {"", nil}, {"b",
+    nil}, {"", nil}, {"", nil}, {"c", nil}, {"", nil}},
+    {"<a><>,<b><>,<>,<c><>", 7}},
+  {"2024-01-15", "(%d+)-(%d+)-(%d+)", nil, {1, 10, "2024", "01", "15"},
+    {"2024", "01", "15"}, {{"2024", "01"}}, {"<2024-01-15>", 1}},
+  {"THE (quick) fox", "%((%a+)%)", nil, {5, 11, "quick"}, {"quick"}, {{"quick",
+    nil}}, {"THE <(quick)> fox", 1}},
+  {"f(a(b)c)d", "%b()", nil, {2, 8}, {"(a(b)c)"}, {{"(a(b)c)", nil}},
+    {"f<(a(b)c)>d", 1}},
+  {"THE (quick) fox", "%f[%a]%a+", nil, {1, 3}, {"THE"}, {{"THE", nil},
+    {"quick", nil}, {"fox", nil}}, {"<THE> (<quick>) <fox>", 3}},
+  {"abcabc", "()b()", nil, {2, 2, 2, 3}, {2, 3}, {{2, 3}, {5, 6}},
+    {"a<b>ca<b>c", 2}},
+  {"aaa", "a-b", nil, {nil}, {nil}, {}, {"aaa", 0}},
+  {"aaab", "a-b", nil, {1, 4}, {"aaab"}, {{"aaab", nil}}, {"<aaab>", 1}},
+  {"aaab", "a*", nil, {1, 3}, {"aaa"}, {{"aaa", nil}, {"", nil}, {"", nil}},
+    {"<aaa><>b<>", 3}},
+  {"aaab", "a+b", nil, {1, 4}, {"aaab"}, {{"aaab", nil}}, {"<aaab>", 1}},
+  {"ab", "a?b", nil, {1, 2}, {"ab"}, {{"ab", nil}}, {"<ab>", 1}},
+  {"b", "a?b", nil, {1, 1}, {"b"}, {{"b", nil}}, {"<b>", 1}},
+  {"xyz", "[x-z]+", nil, {1, 3}, {"xyz"}, {{"xyz", nil}}, {"<xyz>", 1}},
+  {"x]y", "[]]", nil, {2, 2}, {"]"}, {{"]", nil}}, {"x<]>y", 1}},
+  {"x-y", "[a%-]", nil, {2, 2}, {"-"}, {{"-", nil}}, {"x<->y", 1}},
+  {"a.b", "%.", nil, {2, 2}, {"."}, {{".", nil}}, {"a<.>b", 1}},
+  {"abba", "(a)(b)%2%1", nil, {1, 4, "a", "b"}, {"a", "b"}, {{"a", "b"}},
+    {"<abba>", 1}},
+  {"abc", "", nil, {1, 0}, {""}, {{"", nil}, {"", nil}, {"", nil}, {"", nil}},
+    {"<>a<>b<>c<>", 4}},
+  {"", "^$", nil, {1, 0}, {""}, {}, {"<>", 1}},
+  {"abc", "^$", nil, {nil}, {nil}, {}, {"abc", 0}},
+  {"\000a\000", "%z", nil, {1, 1}, {"\000"}, {{"\000", nil}, {"\000", nil}},
+    {"<\000>a<\000>", 2}},
+  {"a\nb", "[^\n]+$", nil, {3, 3}, {"b"}, {{"b", nil}}, {"a\n<b>", 1}},
+  {"alo xyzK", "(%w+)K", nil, {5, 8, "xyz"}, {"xyz"}, {{"xyz", nil}},
+    {"alo <xyzK>", 1}},
+  {"254 K", "(%d*)K", nil, {5, 5, ""}, {""}, {{"", nil}}, {"254 <K>", 1}},
+  {"alo ", "(%w*)$", nil, {5, 4, ""}, {""}, {{"", nil}}, {"alo <>", 1}},
+  {"alo ", "(%w+)$", nil, {nil}, {nil}, {}, {"alo ", 0}},
+  {"[[]] [][] [[[[", "%[%[(.-)%]%]", nil, {1, 4, ""}, {""}, {{"", nil}},
+    {"<[[]]> [][] [[[[", 1}},
+  {"10.0.0.1 - - [10/Oct/2000:13:55:36 -0700"
+    .."] \"GET /a.gif HTTP/1.0\" 200 2326",
+    "^(%S+) %S+ %S+ %[([^%]]+)%] \"(%u+) (%S+)".." [^\"]*\" (%d+) (%d+)$", nil,
+    {1, 72, "10.0.0.1", "10/Oct/2000:13:55:36 -0700", "GET", "/a.gif", "200",
+    "2326"}, {"10.0.0.1", "10/Oct/2000:13:55:36 -0700", "GET", "/a.gif", "200",
+    "2326"}, {}, {"<10.0.0.1 - - [10/Oct/2000:13:55:36 -070"
+    .."0] \"GET /a.gif HTTP/1.0\" 200 2326>", 1}},
+  {"level=info msg=\"started\" dur=12ms", "(%w+)=(\"?)([^\" ]*)%2", nil, {1,
+    10, "level", "", "info"}, {"level", "", "info"}, {{"level", ""}, {"msg",
+    "\""}, {"dur", ""}}, {"<level=info> <msg=\"started\"> <dur=12ms>", 3}},
+  {"GET /index.html?x=1&y=2 HTTP/1.1", "%?(.*) ", nil, {16, 24, "x=1&y=2"},
+    {"x=1&y=2"}, {{"x=1&y=2", nil}}, {"GET /index.html<?x=1&y=2 >HTTP/1.1",
+    1}},
+  {"abc", "%w%w%w%w", nil, {nil}, {nil}, {}, {"abc", 0}},
+  {"aXb", "%u", nil, {2, 2}, {"X"}, {{"X", nil}}, {"a<X>b", 1}},
+  {"a1b2", "%d()", nil, {2, 2, 3}, {3}, {{3, nil}, {5, nil}}, {"a<1>b<2>", 2}},
+  {"\206\177\206\178", "[\128-\255]+", nil, {1, 4}, {"\206\177\206\178"},
+    {{"\206\177\206\178", nil}}, {"<\206\177\206\178>", 1}},
+  {"a b\tc", "%s", nil, {2, 2}, {" "}, {{" ", nil}, {"\t", nil}},
+    {"a< >b<\t>c", 2}},
+  {"x=1, y=2", "(%a)=(%d)", 3, {6, 8, "y", "2"}, {"y", "2"}, {{"x", "1"}, {"y",
+    "2"}}, {"<x=1>, <y=2>", 2}},
+  {"x=1, y=2", "(%a)=(%d)", -3, {6, 8, "y", "2"}, {"y", "2"}, {{"x", "1"},
+    {"y", "2"}}, {"<x=1>, <y=2>", 2}},
+  {"abc", "b", 10, {nil}, {nil}, {{"b", nil}}, {"a<b>c", 1}},
+}
+
+local function pack(...) return {n = select("#", ...), ...} end
+
+local function same(a, b)
+  if type(a) ~= "table" then return a == b end
+  for i = 1, math.max(a.n or #a, b.n or #b) do
+    if not same(a[i], b[i]) then return false end
+  end
+  return true
+end
+
+-- Check all cases. Each case is run in a loop, which is compiled and
+-- specialized to its pattern.
+for _, c in ipairs(cases) do
+  local s, p, init = c[1], c[2], c[3]
+  for _ = 1, 100 do
+    local gm = {}
+    for a, b in s:gmatch(p) do
+      gm[#gm+1] = {a, b}
+      if #gm > 20 then break end
+    end
+    assert(same(pack(s:find(p, init)), c[4]), p)
+    assert(same(pack(s:match(p, init)), c[5]), p)
+    assert(same(gm, c[6]), p)
+    assert(same(pack(s:gsub(p, "<%0>")), c[7]), p)
+  end
+end
+
+-- Log lines in the common log format, plus key=value pairs.
+local lines = {}
+for i = 1, NLINE do
+  lines[i] = string.format(
+    "10.0.%d.%d - - [%02d/Oct/2000:13:%02d:36 -0700] \"%s /p/%d.gif "..
+    "HTTP/1.0\" %d %d user=u%d dur=%dms", i % 256, i % 100, i % 28 + 1,
+    i % 60, i % 5 == 0 and "POST" or "GET", i, i % 7 == 0 and 404 or 200,
+    i * 37 % 10000, i % 100, i % 900)
+end
+
+local function bench(name, f)
+  local best, res = math.huge
+  for _ = 1, 3 do
+    local t0 = os.clock()
+    for _ = 1, ROUNDS do res = f() end
+    local t = os.clock() - t0
+    if t < best then best = t end
+  end
+  io.write(string.format("%-8s %7.1f ns/line  (%s)\n",
+			 name, best*1e9/(ROUNDS*NLINE), tostring(res)))
+end
+
+bench("match", function()
+  local n = 0
+  for i = 1, NLINE do
+    local ip, st, sz = lines[i]:match(
+      "^(%S+) %S+ %S+ %[[^%]]+%] \"%u+ %S+ [^\"]*\" (%d+) (%d+)")
+    if st == "404" then n = n + #ip + #sz end
+  end
+  return n
+end)
+bench("find", function()
+  local n = 0
+  for i = 1, NLINE do
+    local a, b = lines[i]:find("dur=%d+ms")
+    if a then n = n + b - a end
+  end
+  return n
+end)
+bench("gsub", function()
+  local n = 0
+  for i = 1, NLINE do n = n + #lines[i]:gsub("%d+", "#") end
+  return n
+end)
+bench("gmatch", function()
+  local n = 0
+  for i = 1, NLINE do
+    for k, v in lines[i]:gmatch("(%w+)=(%w+)") do n = n + #k + #v end
+  end
+  return n
+end)
@@ -0,0 +1,113 @@
+-- table.sort with the default order and with Lua comparators.
+-- Usage: luajit sort.lua [elements]
+
+local N = tonumber(arg and arg[1]) or 1000000
+
+local seed = 1
+local function rnd()
+  seed = (seed * 1103515245 + 12345) % 2147483648
+  return seed
+end
+
+local function sorted(t, lt)
+  for i = 2, #t do
+    if lt(t[i], t[i-1]) then return false end
+  end
+  return true
+end
+
+local function lt(a, b) return a < b end
+local function gt(a, b) return a > b end
+local function lt1(a, b) return a[1] < b[1] end
+
+-- Check all orders, element kinds and sizes around the insertion sort
+-- cutoff, including runs of equal elements. Also check the errors.
+do
+  local sum = 0
+  for n = 0, 200 do
+    for kind = 1, 5 do
+      local t, s = {}, 0
+      for i = 1, n do
+	local x = rnd() % (kind == 5 and 4 or 1000)
+	s = s + x
+	t[i] = kind == 2 and string.format("%05d", x) or
+	       kind == 3 and {x} or x
+      end
+      if kind == 1 then table.sort(t)
+      elseif kind == 2 then table.sort(t)
+      elseif kind == 3 then table.sort(t, lt1)
+      elseif kind == 4 then table.sort(t, gt)
+      else table.sort(t, lt) end
+      assert(#t == n)
+      if kind == 3 then
+	for i = 2, n do assert(t[i-1][1] <= t[i][1]) end
+	for i = 1, n do s = s - t[i][1] end
+      elseif kind == 4 then
+	assert(sorted(t, gt))
+	for i = 1, n do s = s - t[i] end
+      else
+	assert(sorted(t, lt))
+	for i = 1, n do s = s - tonumber(t[i]) end
+      end
+      assert(s == 0, "elements lost")
+    end
+  end
+  local mt = {__lt = function(a, b) return a.v < b.v end}
+  local t = {}
+  for i = 1, 100 do t[i] = setmetatable({v = rnd() % 50}, mt) end
+  table.sort(t)
+  for i = 2, 100 do assert(t[i-1].v <= t[i].v) end
+  t = {3, 1, 2.5, -0.5, 1/0, -1/0}
+  table.sort(t)
+  assert(t[1] == -1/0 and t[2] == -0.5 and t[6] == 1/0)
+  assert(not pcall(table.sort, {1, "x", 2}))
+  -- Like Lua 5.1: an inconsistent order is an error from 4 slots up.
+  for n = 1, 40 do
+    local t = {}
+    for i = 1, n do t[i] = i end
+    local ok, err = pcall(table.sort, t, function(a, b) return true end)
+    if n <= 3 then
+      assert(ok)
+    else
+      assert(not ok and err:match("invalid order function"), n)
+    end
+  end
+end
+-- The sort loops are shared by all comparators. Don't time the side traces
+-- for the comparators used above.
+if jit then jit.flush() end
+
+local function bench(name, make, cmp)
+  local best = math.huge
+  for _ = 1, 3 do
+    seed = 1
+    local t = make()
+    collectgarbage()
+    local t0 = os.clock()
+    table.sort(t, cmp)
+    local tm = os.clock() - t0
+    if tm < best then best = tm end
+  end
+  io.write(string.format("%-20s %8.1fms\n", name, best*1000))
+end
+
+local function numbers()
+  local t = {}
+  for i = 1, N do t[i] = rnd() / 3 end
+  return t
+end
+local function strings()
+  local t = {}
+  for i = 1, N do t[i] = tostring(rnd()) end
+  return t
+end
+local function records()
+  local t = {}
+  for i = 1, N do t[i] = {id = i, key = rnd()} end
+  return t
+end
+
+bench("numbers, default", numbers)
+bench("strings, default", strings)
+bench("numbers, closure", numbers, function(a, b) return a > b end)
+bench("records by field", records, function(a, b) return a.key < b.key end)
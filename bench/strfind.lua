@@ -0,0 +1,66 @@
+-- Plain substring search with string.find(s, p, init, true).
+-- Usage: luajit strfind.lua [finds per test]
+
+local N = tonumber(arg and arg[1]) or 200000
+
+local function text(len, seed, nchar)
+  local t, x = {}, seed
+  for i = 1, len do
+    x = (x * 1103515245 + 12345) % 2147483648
+    t[i] = string.char(97 + math.floor(x / 65536) % nchar)
+  end
+  return table.concat(t)
+end
+
+-- Reference implementation.
+local function naive(s, p, init)
+  local ls, lp = #s, #p
+  if init < 0 then init = ls + init + 1 end
+  if init < 1 then init = 1 end
+  if init > ls + 1 then init = ls + 1 end
+  for i = init, ls - lp + 1 do
+    if s:sub(i, i + lp - 1) == p then return i, i + lp - 1 end
+  end
+end
+
+-- Check against the reference with small alphabets, where partial matches
+-- are common, and at every alignment. Run it often enough to compile it.
+do
+  local find = string.find
+  for k = 1, 300 do
+    local s = text(k % 97 + 1, k, 1 + k % 3)
+    for _, p in ipairs{"", "a", "ab", "ba", "aab", "abab", text(5, k, 2),
+		       text(17, k, 2), text(40, k, 3), s, s.."a"} do
+      for _, init in ipairs{1, 2, 3, -1, -5, 0, #s, #s + 1, #s + 2} do
+	local a, b = find(s, p, init, true)
+	local c, d = naive(s, p, init)
+	assert(a == c and b == d, "bad find")
+      end
+    end
+  end
+end
+
+local function bench(name, hay, needle)
+  local find, n = string.find, 0
+  local best = math.huge
+  for _ = 1, 3 do
+    local t0 = os.clock()
+    for i = 1, N do
+      local a = find(hay, needle, i % 64 + 1, true)
+      if a then n = n + 1 end
+    end
+    local t = os.clock() - t0
+    if t < best then best = t end
+  end
+  io.write(string.format("%-36s %9.1fns\n", name, best*1e9/N))
+end
+
+for _, len in ipairs{64, 1024, 16384} do
+  local hay = text(len, 1, 26)
+  local tail = hay:sub(-20)
+  bench(len.." bytes, 2 byte needle, miss", hay, "#!")
+  bench(len.." bytes, 4 byte needle, at end", hay, tail:sub(-4))
+  bench(len.." bytes, 20 byte needle, at end", hay, tail)
+  local header = ("x-header: value\r\n"):rep(len/16)
+  bench(len.." bytes, header lines, miss", header, "\r\nhost:")
+end
@@ -0,0 +1,51 @@
+-- String interning throughput for different string lengths.
+-- Usage: luajit strhash.lua [strings per length]
+
+local N = tonumber(arg and arg[1]) or 1000000
+
+-- Pseudo-random text. Every substring of it is a distinct new string.
+local function text(len)
+  local t, x = {}, 1
+  for i = 1, len do
+    x = (x * 1103515245 + 12345) % 2147483648
+    t[i] = string.char(97 + math.floor(x / 65536) % 26)
+  end
+  return table.concat(t)
+end
+
+-- Check that equal strings built in different ways are interned once,
+-- and that strings differing only in a few middle bytes stay distinct.
+do
+  local t = {}
+  for len = 1, 300 do
+    local s = string.rep("x", len)
+    local s2 = table.concat{string.rep("x", len-1), "x"}
+    assert(s == s2 and rawequal(s, s2))
+    t[s] = len
+  end
+  for len = 1, 300 do assert(t[string.rep("x", len)] == len) end
+  local keys, pre, post = {}, string.rep("a", 96), string.rep("b", 96)
+  for i = 1, 20000 do
+    local s = pre..string.format("%08x", i)..post
+    assert(keys[s] == nil, "string interned twice")
+    keys[s] = i
+  end
+  for i = 1, 20000 do
+    assert(keys[pre..string.format("%08x", i)..post] == i)
+  end
+end
+
+-- Time the creation of new strings and the lookup of interned strings.
+local buf = text(N + 256)
+for _, len in ipairs{8, 16, 32, 64, 128, 256} do
+  local keep, sub = {}, string.sub
+  collectgarbage()
+  local t0 = os.clock()
+  for i = 1, N do keep[i] = sub(buf, i, i+len-1) end
+  local tnew = os.clock() - t0
+  t0 = os.clock()
+  for i = 1, N do keep[i] = sub(buf, i, i+len-1) end
+  local thit = os.clock() - t0
+  io.write(string.format("%4d bytes  new %6.1fns  hit %6.1fns\n",
+			 len, tnew*1e9/N, thit*1e9/N))
+end
@@ -0,0 +1,148 @@
+-- Native table.move, table.clone and table.fill against Lua loops.
+-- Usage: luajit tablemove.lua [elements] [rounds]
+
+local N = tonumber(arg and arg[1]) or 100000
+local ROUNDS = tonumber(arg and arg[2]) or 200
+
+local clone = require("table.clone")
+local fill = require("table.fill")
+
+-- The Lua implementations which were replaced.
+local function lmove(a1, f, e, t, a2)
+  if a2 == nil then a2 = a1 end
+  if e >= f then
+    local d = t - f
+    if t > e or t <= f or a2 ~= a1 then
+      for i = f, e do a2[i+d] = a1[i] end
+    else
+      for i = e, f, -1 do a2[i+d] = a1[i] end
+    end
+  end
+  return a2
+end
+
+local function lclone(t)
+  local c = {}
+  for k, v in pairs(t) do c[k] = v end
+  return c
+end
+
+local function lfill(t, v, i, j)
+  for k = i or 1, j or #t do rawset(t, k, v) end
+  return t
+end
+
+local function same(a, b)
+  for k, v in pairs(a) do if b[k] ~= v then return false end end
+  for k, v in pairs(b) do if a[k] ~= v then return false end end
+  return true
+end
+
+local seed = 1
+local function rnd(n)
+  seed = (seed * 1103515245 + 12345) % 2147483648
+  return seed % n
+end
+
+-- Tables with an array part, holes, a hash part and string keys.
+local function maketab()
+  local t = {}
+  for i = 1, rnd(40) do t[i] = i * 10 end
+  for _ = 1, rnd(4) do t[rnd(60) - 5] = nil end
+  for _ = 1, rnd(8) do t[rnd(80) - 10] = rnd(1000) end
+  if rnd(2) == 0 then t.x = "x" end
+  return t
+end
+
+-- Check against the Lua implementations for random ranges, overlapping in
+-- both directions, into other tables and across the array/hash boundary.
+-- The loop is compiled after a few rounds, so the recorded calls are
+-- checked, too.
+for _ = 1, 3000 do
+  local a, b = maketab(), maketab()
+  local f, e, t = rnd(50) - 5, rnd(50) - 5, rnd(50) - 5
+  local a1, b1 = lclone(a), lclone(b)
+  local a2, b2 = lclone(a), lclone(b)
+  assert(lmove(a1, f, e, t) == a1 and table.move(a2, f, e, t) == a2)
+  assert(same(a1, a2), "move within table")
+  assert(lmove(a1, f, e, t, b1) == b1 and table.move(a2, f, e, t, b2) == b2)
+  assert(same(a1, a2) and same(b1, b2), "move to other table")
+  local c = clone(a)
+  assert(c ~= a and same(c, a), "clone")
+  c[1] = "changed"
+  assert(a[1] ~= "changed")
+  local i, j = rnd(50) - 5, rnd(50) - 5
+  a1, a2 = lclone(a), lclone(a)
+  assert(lfill(a1, "v", i, j) == a1 and fill(a2, "v", i, j) == a2)
+  assert(same(a1, a2), "fill range")
+  a1, a2 = lclone(a), lclone(a)
+  lfill(a1, false)
+  fill(a2, false)
+  assert(same(a1, a2), "fill default range")
+end
+
+-- Metamethods are called like by the Lua implementation. Frozen tables
+-- can be read, but not written. Run often enough to be compiled, too.
+local freeze = require("table.freeze")
+local idx = {__index = function(t, k) return k * 2 end}
+local plain = {__tostring = function() return "plain" end}
+for _ = 1, 200 do
+  local log = {}
+  local src = setmetatable({}, idx)
+  local dst = setmetatable({}, {__newindex = function(t, k, v)
+    log[#log+1] = k; rawset(t, k, v)
+  end})
+  assert(table.move(src, 1, 3, 5, dst) == dst)
+  assert(dst[5] == 2 and dst[6] == 4 and dst[7] == 6 and #log == 3)
+  table.move({7, 8}, 1, 2, 5, dst)
+  assert(dst[5] == 7 and #log == 3)
+  local a = setmetatable({1, 2, 3}, plain)
+  assert(table.move(a, 1, 3, 2)[4] == 3 and a[2] == 1)
+  local fr = freeze({1, 2, 3, x = 4})
+  local b = table.move(fr, 1, 3, 2, {})
+  assert(b[1] == nil and b[2] == 1 and b[4] == 3)
+  assert(not pcall(table.move, {1}, 1, 1, 1, fr))
+  local c = clone(setmetatable({1, 2, a = 3}, plain))
+  assert(getmetatable(c) == nil and c[1] == 1 and c[2] == 2 and c.a == 3)
+  local t = setmetatable({}, {__newindex = function() error("called") end})
+  assert(fill(t, 1, 1, 3) == t and t[1] == 1 and t[3] == 1)
+  assert(fill({}, nil, 1, 3)[2] == nil)
+  assert(#fill({}, 0, 1, 100) == 100)
+  assert(not pcall(table.move, {}, 1, 2))
+  assert(not pcall(table.move, {}, 1, 2, 3, 4))
+  assert(not pcall(clone, nil))
+  assert(not pcall(fill, {}))
+  assert(not pcall(fill, fr, 0))
+end
+
+-- The traces of the checks above don't fit the benchmarks.
+jit.flush()
+
+local sink = {}
+local function bench(name, f, ...)
+  local best = math.huge
+  for _ = 1, 3 do
+    local t0 = os.clock()
+    for r = 1, ROUNDS do sink[r % 4] = f(...) end
+    local t = os.clock() - t0
+    if t < best then best = t end
+  end
+  io.write(string.format("%-14s %8.1fus\n", name, best*1e6/ROUNDS))
+end
+
+local src, dst = {}, {}
+for i = 1, N do src[i] = {i}; dst[i] = false end
+local h = {}
+for i = 1, N do h["k"..i] = i end
+local empty = {}
+
+bench("move", table.move, src, 1, N, 1, dst)
+bench("move (Lua)", lmove, src, 1, N, 1, dst)
+bench("move overlap", table.move, dst, 1, N - 1, 2)
+bench("move ov. (Lua)", lmove, dst, 1, N - 1, 2)
+bench("clone", clone, src)
+bench("clone (Lua)", lclone, src)
+bench("clone hash", clone, h)
+bench("clone h. (Lua)", lclone, h)
+bench("fill", fill, dst, empty)
+bench("fill (Lua)", lfill, dst, empty)
@@ -0,0 +1,128 @@
+-- Tables presized from allocation site feedback.
+-- Usage: luajit tabsite.lua [keys] [tables]
+
+local N = tonumber(arg and arg[1]) or 64
+local NTAB = tonumber(arg and arg[2]) or 20000
+
+local tabstats = require("jit.util").tabstats
+
+if tabstats().learned == nil then
+  print("Allocation site feedback is disabled.")
+  return
+end
+
+-- The GC forgets the recent allocations, so don't let it run in between.
+local function delta(f, ...)
+  collectgarbage()
+  collectgarbage("stop")
+  local a = tabstats()
+  local r = f(...)
+  local b = tabstats()
+  collectgarbage("restart")
+  return r, b.learned - a.learned, b.presized - a.presized,
+	 b.avoided - a.avoided
+end
+
+-- Only the interpreter tracks allocations.
+local function grow(n)
+  local t = {}
+  for i = 1, n do t[i] = i; t["k"..i] = i end
+  return t
+end
+jit.off(grow)
+
+local function tdup(n)
+  local t = {x = 1, y = 2, [3] = "three"}
+  for i = 1, n do t["k"..i] = i end
+  return t
+end
+jit.off(tdup)
+
+local function tdupnil()
+  local t = {[5] = nil, a = nil, x = 1}
+  for i = 1, 40 do t["k"..i] = i end
+  return t
+end
+jit.off(tdupnil)
+
+local function check(t, n, tmpl)
+  local cnt = 0
+  for _ in pairs(t) do cnt = cnt + 1 end
+  for i = 1, n do assert(t["k"..i] == i) end
+  if tmpl then
+    assert(t.x == 1 and t.y == 2 and t[3] == "three" and cnt == n + 3)
+  else
+    for i = 1, n do assert(t[i] == i) end
+    assert(cnt == 2*n)
+  end
+end
+
+-- The first table of a site grows and the site learns its size. Later
+-- tables from the same site are presized and don't grow anymore. Smaller
+-- tables still have the right contents, and so have tables from TDUP
+-- templates, which must not keep any keys that were added.
+for _, f in ipairs({grow, tdup}) do
+  local tmpl = f == tdup
+  local t, learned, presized, avoided = delta(f, 100)
+  check(t, 100, tmpl)
+  assert(learned >= 1 and presized == 0 and avoided == 0)
+  for _ = 1, 3 do
+    t, learned, presized, avoided = delta(f, 100)
+    check(t, 100, tmpl)
+    assert(learned == 0 and presized == 1 and avoided >= 1)
+  end
+  t, learned, presized = delta(f, 3)
+  check(t, 3, tmpl)
+  assert(learned == 0 and presized == 1)
+  t = delta(f, 0)
+  check(t, 0, tmpl)
+end
+
+-- Nil-valued keys of a TDUP template stay nil, e.g. {[5]=nil, x=1}.
+for _ = 1, 4 do
+  local t = tdupnil()
+  assert(t[5] == nil and t.a == nil and t.x == 1 and t.k40 == 40)
+  local cnt = 0
+  for _ in pairs(t) do cnt = cnt + 1 end
+  assert(cnt == 41)
+end
+
+-- Benchmark: fresh copies of a function have sites which haven't learned
+-- anything, yet. Versus the same function, after it has learned.
+local src = [[
+local n = ...
+local t = {}
+for i = 1, n do t["k"..i] = i end
+return t
+]]
+local cold = {}
+for i = 1, NTAB do cold[i] = load(src, "=site") end
+local warm = cold[1]
+
+-- Every allocation from a learned site counts as presized, also on trace.
+local function bench(name, f, presized)
+  local a = tabstats()
+  local t0 = os.clock()
+  f()
+  local t = os.clock() - t0
+  local b = tabstats()
+  io.write(string.format("%-22s %8.1f ns/table, %d learned, %d presized\n",
+			 name, t*1e9/NTAB, b.learned - a.learned,
+			 b.presized - a.presized))
+  assert(b.presized - a.presized == presized)
+end
+
+-- Sites learn in the interpreter. Traces only pick up the learned sizes.
+local keep = {}
+jit.off()
+bench("interpreter, cold site", function()
+  for i = 1, NTAB do keep[i % 16] = cold[i](N) end
+end, 0)
+bench("interpreter, learned", function()
+  for i = 1, NTAB do keep[i % 16] = warm(N) end
+end, NTAB)
+jit.on()
+jit.flush()
+bench("JIT, learned", function()
+  for i = 1, NTAB do keep[i % 16] = warm(N) end
+end, NTAB)
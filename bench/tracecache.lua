@@ -0,0 +1,115 @@
+-- Full trace cache: evicting cold traces vs flushing all traces.
+-- Usage: luajit tracecache.lua [rounds] [maxtrace]
+
+local ROUNDS = tonumber(arg and arg[1]) or 3000
+local MAXTRACE = tonumber(arg and arg[2]) or 200
+
+local tracestats = require("jit.util").tracestats
+
+-- Functions with a hot loop, which each compile to their own root trace.
+local nfunc = 0
+local function newfunc()
+  nfunc = nfunc + 1
+  return load("local n = ... local s = 0 for i = 1, n do s = s + i*"..nfunc..
+	      " end return s", "=f"..nfunc), nfunc
+end
+
+local function run(f, c)
+  assert(f(100) == c*5050)
+end
+
+local function stats()
+  local st = tracestats()
+  collectgarbage()  -- Dead traces are freed by the GC.
+  return st
+end
+
+-- Fields and flushes.
+do
+  local st = tracestats()
+  for _, k in ipairs({"evicted", "rerecorded", "flushed", "mcode",
+		      "mcodefree"}) do
+    assert(type(st[k]) == "number" and st[k] >= 0, k)
+  end
+  run(newfunc())
+  assert(tracestats().mcode > 0)
+  local n = tracestats().flushed
+  jit.flush()
+  assert(tracestats().flushed == n + 1)
+end
+
+-- Too many traces evict some of them, but don't flush. Or flush, with
+-- evict=0. The results are the same either way.
+for _, evict in ipairs({25, 0}) do
+  jit.flush()
+  jit.opt.start("maxtrace=50", "evict="..evict)
+  local fs, cs = {}, {}
+  for i = 1, 200 do fs[i], cs[i] = newfunc() end
+  local a = stats()
+  for i = 1, 200 do run(fs[i], cs[i]) end
+  for i = 1, 200 do run(fs[i], cs[i]) end
+  local b = stats()
+  if evict > 0 then
+    assert(b.evicted > a.evicted and b.flushed == a.flushed)
+  else
+    assert(b.evicted == a.evicted and b.flushed > a.flushed)
+  end
+end
+
+-- A trace evicted too early is counted when it's recorded again.
+do
+  jit.flush()
+  jit.opt.start("maxtrace=50", "evict=25")
+  local f, c = newfunc()
+  local a = stats()
+  run(f, c)
+  for _ = 1, 60 do run(newfunc()) end
+  run(f, c)
+  local b = stats()
+  assert(b.evicted > a.evicted and b.rerecorded > a.rerecorded)
+end
+
+-- Too much machine code. Free ranges of evicted traces are reused, so the
+-- total size stays within maxmcode, without a flush.
+do
+  jit.flush()
+  jit.opt.start("maxtrace=2000", "evict=25", "sizemcode=16", "maxmcode=32")
+  local a = stats()
+  for _ = 1, 1000 do
+    run(newfunc())
+    local st = tracestats()
+    assert(st.mcode <= 32*1024 and st.mcodefree < st.mcode)
+  end
+  local b = stats()
+  assert(b.evicted > a.evicted and b.flushed == a.flushed)
+end
+
+-- Benchmark: a few hot functions are called every round, next to a cold
+-- function which is only called once. The cold traces fill the cache.
+local hot, hotc = {}, {}
+for i = 1, 20 do hot[i], hotc[i] = newfunc() end
+local cold, coldc = {}, {}
+for i = 1, ROUNDS do cold[i], coldc[i] = newfunc() end
+
+local ntrace = 0
+jit.attach(function(what) if what == "stop" then ntrace = ntrace + 1 end end,
+	   "trace")
+
+for _, evict in ipairs({0, 25}) do
+  jit.flush()
+  jit.opt.start("maxtrace="..MAXTRACE, "maxmcode=512", "sizemcode=32",
+		"evict="..evict)
+  collectgarbage()
+  local a, n = stats(), ntrace
+  local t0 = os.clock()
+  for r = 1, ROUNDS do
+    for i = 1, #hot do run(hot[i], hotc[i]) end
+    run(cold[r], coldc[r])
+  end
+  local t = os.clock() - t0
+  local b = stats()
+  io.write(string.format("evict=%-3d %6.1f us/round, %d traces, %d evicted,"..
+			 " %d flushes, %d rerecorded\n", evict, t*1e6/ROUNDS,
+			 ntrace - n, b.evicted - a.evicted,
+			 b.flushed - a.flushed, b.rerecorded - a.rerecorded))
+end
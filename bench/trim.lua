@@ -0,0 +1,119 @@
+-- Returning free heap memory to the OS.
+-- Usage: luajit trim.lua [objects]
+
+local N = tonumber(arg and arg[1]) or 1000000
+
+-- Resident set size in KBytes or nil.
+local function rss()
+  local f = io.open("/proc/self/statm")
+  if not f then return nil end
+  local _, r = f:read("*n", "*n")
+  f:close()
+  return r * 4
+end
+
+local function fill(t, i, j)
+  for k = i, j do t[k] = {k, k+1, k+2} end
+end
+
+local function check(t, i, j)
+  for k = i, j do
+    local v = t[k]
+    assert(v[1] == k and v[2] == k+1 and v[3] == k+2, "corrupted")
+  end
+end
+
+-- Statistics of the bundled allocator. All 0 with a custom allocator.
+local st = collectgarbage("stats")
+for _, k in ipairs({"mapped", "released", "retained"}) do
+  assert(type(st[k]) == "number" and st[k] >= 0, k)
+end
+if st.mapped == 0 then
+  print("The bundled allocator is not used.")
+  return
+end
+
+-- A trim releases free memory and keeps live objects. Released memory is
+-- reused afterwards. Small objects live in slab pages, big strings in
+-- chunks of their own.
+do
+  local keep, strs = {}, {}
+  fill(keep, 1, N)
+  for i = 1, 200 do strs[i] = string.rep(string.char(i % 256), 65536+i) end
+  collectgarbage()
+  local r0 = rss()
+  for i = N/4+1, N do keep[i] = nil end
+  for i = 1, 200, 2 do strs[i] = false end
+  collectgarbage()  -- Trims on its own, since most of the heap is free.
+  local kb = collectgarbage("trim")  -- Releases little or nothing more.
+  st = collectgarbage("stats")
+  assert(kb >= 0 and st.released > 0 and st.released <= st.mapped)
+  assert(st.released / 1024 >= kb - 1)
+  if r0 then assert(rss() < r0 / 2, "memory not returned") end
+  check(keep, 1, N/4)
+  for i = 2, 200, 2 do
+    assert(strs[i] == string.rep(string.char(i % 256), 65536+i))
+  end
+  fill(keep, N/4+1, N)
+  check(keep, 1, N)
+  assert(collectgarbage("trim") >= 0)  -- Nothing much to release.
+  check(keep, 1, N)
+end
+
+-- A full GC trims on its own, if most of the heap is free. Released pages
+-- are counted once and no longer count as released once they are reused,
+-- so the next automatic trim isn't held off.
+do
+  local big = {}
+  fill(big, 1, N)
+  collectgarbage()
+  big = nil
+  collectgarbage()
+  local rel = collectgarbage("stats").released
+  assert(rel > 0, "no automatic trim")
+  assert(collectgarbage("trim") * 1024 < rel / 100, "released twice")
+  assert(collectgarbage("stats").released >= rel * 0.99)
+  big = {}
+  fill(big, 1, N)
+  check(big, 1, N)
+  collectgarbage()
+  local r0 = rss()
+  assert(collectgarbage("stats").released < rel / 2, "stale released bytes")
+  big = nil
+  collectgarbage()
+  assert(collectgarbage("stats").released >= rel / 2, "no automatic trim")
+  if r0 then assert(rss() < r0 / 2, "memory not returned") end
+end
+
+-- Benchmark: refill a freed part of the heap, with the memory retained by
+-- the allocator or released by a trim.
+local function bench(name, trim)
+  local keep = {}
+  fill(keep, 1, N)
+  collectgarbage()
+  local best, bestt, kb = math.huge, math.huge, 0
+  for _ = 1, 3 do
+    for i = 1, N*2/5 do keep[i] = nil end
+    collectgarbage()  -- Less than half of the heap is free, so no trim.
+    if trim then
+      local t0 = os.clock()
+      kb = collectgarbage("trim")
+      local t = os.clock() - t0
+      if t < bestt then bestt = t end
+    end
+    local t0 = os.clock()
+    fill(keep, 1, N*2/5)
+    local t = os.clock() - t0
+    if t < best then best = t end
+  end
+  check(keep, 1, N)
+  io.write(string.format("%-9s refill %6.1f ns/table", name,
+			 best*1e9/(N*2/5)))
+  if trim then
+    io.write(string.format(", trim %.1f ms for %d KB", bestt*1e3, kb))
+  end
+  io.write("\n")
+end
+
+bench("retained", false)
+bench("trimmed", true)
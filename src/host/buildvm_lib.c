@@ -393,6 +393,8 @@ void emit_lib(BuildCtx *ctx)
 	  ok = LJ_HASFFI;
 	else if (!strcmp(buf, "#if LJ_HASBUFFER"))
 	  ok = LJ_HASBUFFER;
+	else if (!strcmp(buf, "#if LJ_HASFROZEN"))
+	  ok = LJ_HASFROZEN;
 	if (!ok) {
 	  int lvl = 1;
 	  while (fgets(buf, sizeof(buf), fp) != NULL) {
@@ -3,7 +3,6 @@
 static const int libbc_endian = 0;
 
 static const uint8_t libbc_code[] = {
-#if LJ_FR2
 /* math.deg */ 0,1,2,0,0,1,2,BC_MULVN,1,0,0,BC_RET1,1,2,0,241,135,158,166,3,
 220,203,178,130,4,
 /* math.rad */ 0,1,2,0,0,1,2,BC_MULVN,1,0,0,BC_RET1,1,2,0,243,244,148,165,20,
@@ -25,45 +24,39 @@ BC_ISGT,3,1,0,BC_JMP,3,14,128,BC_ISGT,1,2,0,BC_JMP,3,12,128,BC_TGETR,3,1,0,
 BC_ADDVN,4,1,1,BC_MOV,5,2,0,BC_KSHORT,6,1,0,BC_FORI,4,4,128,BC_SUBVN,8,1,7,
 BC_TGETR,9,7,0,BC_TSETR,9,8,0,BC_FORL,4,252,127,BC_KPRI,4,0,0,BC_TSETR,4,2,0,
 BC_RET1,3,2,0,BC_RET0,0,1,0,0,2,
-/* table.move */ 0,5,12,0,0,0,35,BC_ISTYPE,0,12,0,BC_ISTYPE,1,14,0,BC_ISTYPE,
-2,14,0,BC_ISTYPE,3,14,0,BC_ISNEP,4,0,0,BC_JMP,5,1,128,BC_MOV,4,0,0,BC_ISTYPE,
-4,12,0,BC_ISGT,1,2,0,BC_JMP,5,24,128,BC_SUBVV,5,1,3,BC_ISLT,2,3,0,BC_JMP,6,4,
-128,BC_ISLE,3,1,0,BC_JMP,6,2,128,BC_ISEQV,4,0,0,BC_JMP,6,9,128,BC_MOV,6,1,0,
-BC_MOV,7,2,0,BC_KSHORT,8,1,0,BC_FORI,6,4,128,BC_ADDVV,10,5,9,BC_TGETR,11,9,0,
-BC_TSETR,11,10,4,BC_FORL,6,252,127,BC_JMP,6,8,128,BC_MOV,6,2,0,BC_MOV,7,1,0,
-BC_KSHORT,8,255,255,BC_FORI,6,4,128,BC_ADDVV,10,5,9,BC_TGETR,11,9,0,BC_TSETR,
-11,10,4,BC_FORL,6,252,127,BC_RET1,4,2,0,
-#else
-/* math.deg */ 0,1,2,0,0,1,2,BC_MULVN,1,0,0,BC_RET1,1,2,0,241,135,158,166,3,
-220,203,178,130,4,
-/* math.rad */ 0,1,2,0,0,1,2,BC_MULVN,1,0,0,BC_RET1,1,2,0,243,244,148,165,20,
-198,190,199,252,3,
-/* string.len */ 0,1,2,0,0,0,3,BC_ISTYPE,0,5,0,BC_LEN,1,0,0,BC_RET1,1,2,0,
-/* table.foreachi */ 0,2,9,0,0,0,15,BC_ISTYPE,0,12,0,BC_ISTYPE,1,9,0,
-BC_KSHORT,2,1,0,BC_LEN,3,0,0,BC_KSHORT,4,1,0,BC_FORI,2,8,128,BC_MOV,6,1,0,
-BC_MOV,7,5,0,BC_TGETR,8,5,0,BC_CALL,6,3,2,BC_ISEQP,6,0,0,BC_JMP,7,1,128,
-BC_RET1,6,2,0,BC_FORL,2,248,127,BC_RET0,0,1,0,
-/* table.foreach */ 0,2,10,0,0,1,16,BC_ISTYPE,0,12,0,BC_ISTYPE,1,9,0,BC_KPRI,
-2,0,0,BC_MOV,3,0,0,BC_KNUM,4,0,0,BC_JMP,5,7,128,BC_MOV,7,1,0,BC_MOV,8,5,0,
-BC_MOV,9,6,0,BC_CALL,7,3,2,BC_ISEQP,7,0,0,BC_JMP,8,1,128,BC_RET1,7,2,0,
-BC_ITERN,5,3,3,BC_ITERL,5,247,127,BC_RET0,0,1,0,1,255,255,249,255,15,
-/* table.getn */ 0,1,2,0,0,0,3,BC_ISTYPE,0,12,0,BC_LEN,1,0,0,BC_RET1,1,2,0,
-/* table.remove */ 0,2,10,0,0,2,30,BC_ISTYPE,0,12,0,BC_LEN,2,0,0,BC_ISNEP,1,0,
-0,BC_JMP,3,7,128,BC_ISEQN,2,0,0,BC_JMP,3,23,128,BC_TGETR,3,2,0,BC_KPRI,4,0,0,
-BC_TSETR,4,2,0,BC_RET1,3,2,0,BC_JMP,3,18,128,BC_ISTYPE,1,14,0,BC_KSHORT,3,1,0,
-BC_ISGT,3,1,0,BC_JMP,3,14,128,BC_ISGT,1,2,0,BC_JMP,3,12,128,BC_TGETR,3,1,0,
-BC_ADDVN,4,1,1,BC_MOV,5,2,0,BC_KSHORT,6,1,0,BC_FORI,4,4,128,BC_SUBVN,8,1,7,
-BC_TGETR,9,7,0,BC_TSETR,9,8,0,BC_FORL,4,252,127,BC_KPRI,4,0,0,BC_TSETR,4,2,0,
-BC_RET1,3,2,0,BC_RET0,0,1,0,0,2,
-/* table.move */ 0,5,12,0,0,0,35,BC_ISTYPE,0,12,0,BC_ISTYPE,1,14,0,BC_ISTYPE,
-2,14,0,BC_ISTYPE,3,14,0,BC_ISNEP,4,0,0,BC_JMP,5,1,128,BC_MOV,4,0,0,BC_ISTYPE,
-4,12,0,BC_ISGT,1,2,0,BC_JMP,5,24,128,BC_SUBVV,5,1,3,BC_ISLT,2,3,0,BC_JMP,6,4,
-128,BC_ISLE,3,1,0,BC_JMP,6,2,128,BC_ISEQV,4,0,0,BC_JMP,6,9,128,BC_MOV,6,1,0,
-BC_MOV,7,2,0,BC_KSHORT,8,1,0,BC_FORI,6,4,128,BC_ADDVV,10,5,9,BC_TGETR,11,9,0,
-BC_TSETR,11,10,4,BC_FORL,6,252,127,BC_JMP,6,8,128,BC_MOV,6,2,0,BC_MOV,7,1,0,
-BC_KSHORT,8,255,255,BC_FORI,6,4,128,BC_ADDVV,10,5,9,BC_TGETR,11,9,0,BC_TSETR,
-11,10,4,BC_FORL,6,252,127,BC_RET1,4,2,0,
-#endif
+/* table.sort */ 0,2,17,1,0,3,158,1,BC_ISTYPE,0,12,0,BC_LEN,2,0,0,BC_ISNEP,1,
+0,0,BC_JMP,3,4,128,BC_UGET,3,0,0,BC_MOV,5,0,0,BC_MOV,6,2,0,BC_CALLT,3,3,0,
+BC_ISTYPE,1,9,0,BC_TNEW,3,0,0,BC_KSHORT,4,0,0,BC_KSHORT,5,1,0,BC_MOV,6,2,0,
+BC_LOOP,7,143,128,BC_SUBVV,7,5,6,BC_KSHORT,8,3,0,BC_ISGE,7,8,0,BC_JMP,7,32,
+128,BC_ADDVN,7,0,5,BC_MOV,8,6,0,BC_KSHORT,9,1,0,BC_FORI,7,19,128,BC_TGETR,11,
+10,0,BC_SUBVN,12,0,10,BC_ISGT,5,12,0,BC_JMP,13,12,128,BC_MOV,13,1,0,BC_MOV,15,
+11,0,BC_TGETR,16,12,0,BC_CALL,13,3,2,BC_ISF,0,13,0,BC_JMP,14,6,128,BC_LOOP,13,
+5,128,BC_ADDVN,13,0,12,BC_TGETR,14,12,0,BC_TSETR,14,13,0,BC_SUBVN,12,0,12,
+BC_JMP,13,242,127,BC_ADDVN,13,0,12,BC_TSETR,11,13,0,BC_FORL,7,237,127,
+BC_ISNEN,4,1,0,BC_JMP,7,1,128,BC_RET0,0,1,0,BC_SUBVN,7,0,4,BC_TGETV,7,7,3,
+BC_TGETV,6,4,3,BC_MOV,5,7,0,BC_SUBVN,4,2,4,BC_JMP,7,219,127,BC_ADDVV,7,6,5,
+BC_MODVN,8,2,7,BC_SUBVV,8,8,7,BC_DIVVN,7,2,8,BC_TGETR,8,5,0,BC_TGETR,9,6,0,
+BC_MOV,10,1,0,BC_MOV,12,9,0,BC_MOV,13,8,0,BC_CALL,10,3,2,BC_ISF,0,10,0,BC_JMP,
+11,2,128,BC_TSETR,9,5,0,BC_TSETR,8,6,0,BC_TGETR,10,7,0,BC_TGETR,9,5,0,BC_MOV,
+8,10,0,BC_MOV,10,1,0,BC_MOV,12,8,0,BC_MOV,13,9,0,BC_CALL,10,3,2,BC_ISF,0,10,0,
+BC_JMP,11,3,128,BC_TSETR,9,7,0,BC_TSETR,8,5,0,BC_JMP,10,9,128,BC_TGETR,9,6,0,
+BC_MOV,10,1,0,BC_MOV,12,9,0,BC_MOV,13,8,0,BC_CALL,10,3,2,BC_ISF,0,10,0,BC_JMP,
+11,2,128,BC_TSETR,9,7,0,BC_TSETR,8,6,0,BC_TGETR,10,7,0,BC_SUBVN,11,0,6,
+BC_TGETR,12,11,0,BC_TSETR,12,7,0,BC_TSETR,10,11,0,BC_MOV,7,5,0,BC_LOOP,12,42,
+128,BC_ADDVN,7,0,7,BC_MOV,12,1,0,BC_TGETR,14,7,0,BC_MOV,15,10,0,BC_CALL,12,3,
+2,BC_ISF,0,12,0,BC_JMP,13,10,128,BC_LOOP,12,9,128,BC_ISGT,6,7,0,BC_JMP,12,5,
+128,BC_UGET,12,0,0,BC_MOV,14,0,0,BC_MOV,15,2,0,BC_MOV,16,1,0,BC_CALLT,12,4,0,
+BC_ADDVN,7,0,7,BC_JMP,12,240,127,BC_SUBVN,11,0,11,BC_MOV,12,1,0,BC_MOV,14,10,
+0,BC_TGETR,15,11,0,BC_CALL,12,3,2,BC_ISF,0,12,0,BC_JMP,13,10,128,BC_LOOP,12,9,
+128,BC_ISGT,11,5,0,BC_JMP,12,5,128,BC_UGET,12,0,0,BC_MOV,14,0,0,BC_MOV,15,2,0,
+BC_MOV,16,1,0,BC_CALLT,12,4,0,BC_SUBVN,11,0,11,BC_JMP,12,240,127,BC_ISGE,11,7,
+0,BC_JMP,12,1,128,BC_JMP,12,5,128,BC_TGETR,8,7,0,BC_TGETR,12,11,0,BC_TSETR,12,
+7,0,BC_TSETR,8,11,0,BC_JMP,12,213,127,BC_SUBVN,12,0,6,BC_TGETR,13,7,0,
+BC_TSETR,13,12,0,BC_TSETR,10,7,0,BC_SUBVV,12,5,7,BC_SUBVV,13,7,6,BC_ISGE,12,
+13,0,BC_JMP,12,7,128,BC_ADDVN,12,0,4,BC_ADDVN,13,0,7,BC_TSETV,13,12,3,
+BC_ADDVN,12,2,4,BC_TSETV,6,12,3,BC_SUBVN,6,0,7,BC_JMP,12,6,128,BC_ADDVN,12,0,
+4,BC_TSETV,5,12,3,BC_ADDVN,12,2,4,BC_SUBVN,13,0,7,BC_TSETV,13,12,3,BC_ADDVN,5,
+0,7,BC_ADDVN,4,2,4,BC_JMP,7,112,127,BC_RET0,0,1,0,0,192,2,0,4,
 0
 };
 
@@ -75,7 +68,7 @@ static const struct { const char *name; int ofs; } libbc_map[] = {
 {"table_foreach",136},
 {"table_getn",213},
 {"table_remove",232},
-{"table_move",361},
-{NULL,508}
+{"table_sort",361},
+{NULL,1006}
 };
 
@@ -48,6 +48,11 @@ end
 local function transform_lua(code)
   local fixup = {}
   local n = -30000
+  local uv = ""
+  code = string.gsub(code, "^%s*(local [%w_, ]+)\n", function(decl)
+    uv = decl.."; "  -- Upvalues, set from preceding LJLIB_PUSH.
+    return ""
+  end)
   code = string.gsub(code, "CHECK_(%w*)%((.-)%)", function(tp, var)
     n = n + 1
     fixup[n] = { "CHECK", tp }
@@ -57,7 +62,7 @@ local function transform_lua(code)
     fixup.PAIRS = true
     return format("nil, %s, 0x4dp80", var)
   end)
-  return "return "..code, fixup
+  return uv.."return "..code, fixup
 end
 
 local function read_uleb128(p)
@@ -18,6 +18,7 @@
 --   luajit -jp=-s myapp.lua
 --   luajit -jp=vl myapp.lua
 --   luajit -jp=G,profile.txt myapp.lua
+--   luajit -jp=b64 myapp.lua
 --
 -- The following dump features are available:
 --
@@ -36,6 +37,7 @@
 --   G  Produce raw output suitable for graphical tools (e.g. flame graphs).
 --   m<number> Minimum sample percentage to be shown. Default: 3.
 --   i<number> Sampling interval in milliseconds. Default: 10.
+--   b<number> Sample allocations every <number> KBytes instead. Default: 512.
 --
 ----------------------------------------------------------------------------
 
@@ -246,6 +248,7 @@ end
 local function prof_start(mode)
   local interval = ""
   mode = mode:gsub("i%d*", function(s) interval = s; return "" end)
+  mode = mode:gsub("b%d*", function(s) interval = "a"..s:sub(2); return "" end)
   prof_min = 3
   mode = mode:gsub("m(%d+)", function(s) prof_min = tonumber(s); return "" end)
   prof_depth = 1
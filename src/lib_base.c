@@ -22,6 +22,7 @@
 #include "lj_buf.h"
 #include "lj_str.h"
 #include "lj_tab.h"
+#include "lj_frozen.h"
 #include "lj_meta.h"
 #include "lj_state.h"
 #include "lj_frame.h"
@@ -36,6 +37,7 @@
 #include "lj_strscan.h"
 #include "lj_strfmt.h"
 #include "lj_lib.h"
+#include "luajit.h"
 
 /* -- Base library: checks ------------------------------------------------ */
 
@@ -78,7 +80,25 @@ LJ_STATIC_ASSERT((int)FF_next == FF_next_N);
 
 LJLIB_ASM(next)			LJLIB_REC(.)
 {
-  lj_lib_checktab(L, 1);
+  GCtab *t = lj_lib_checktab(L, 1);
+#if LJ_HASFROZEN
+  if (tabisfrozen(t)) {
+    /* Copying strings may allocate, so collect the results above top. */
+    TValue *o = L->top;
+    cTValue *key = L->base+1 < L->top ? L->base+1 : niltv(L);
+    int more;
+    setnilV(o); setnilV(o+1);
+    L->top += 2;
+    more = lj_frozen_next(L, t, key, o);
+    if (more >= 0) {
+      copyTV(L, L->base-1-LJ_FR2, o);
+      copyTV(L, L->base-LJ_FR2, o+1);
+      return more ? FFH_RES(2) : FFH_RES(1);
+    }
+  }
+#else
+  UNUSED(t);
+#endif
   lj_err_msg(L, LJ_ERR_NEXTIDX);
   return FFH_UNREACHABLE;
 }
@@ -112,8 +132,19 @@ LJLIB_ASM(pairs)		LJLIB_REC(xpairs 0)
 
 LJLIB_NOREGUV LJLIB_ASM(ipairs_aux)	LJLIB_REC(.)
 {
-  lj_lib_checktab(L, 1);
-  lj_lib_checkint(L, 2);
+  GCtab *t = lj_lib_checktab(L, 1);
+  int32_t i = lj_lib_checkint(L, 2) + 1;
+#if LJ_HASFROZEN
+  if (tabisfrozen(t)) {
+    cTValue *v = lj_frozen_getint(t, i);
+    if (!v || tvisnil(v)) return FFH_RES(0);
+    lj_frozen_copy(L, L->base-LJ_FR2, v);
+    setintV(L->base-1-LJ_FR2, i);
+    return FFH_RES(2);
+  }
+#else
+  UNUSED(t); UNUSED(i);
+#endif
   return FFH_UNREACHABLE;
 }
 
@@ -132,6 +163,12 @@ LJLIB_ASM(setmetatable)		LJLIB_REC(.)
 {
   GCtab *t = lj_lib_checktab(L, 1);
   GCtab *mt = lj_lib_checktabornil(L, 2);
+#if LJ_HASFROZEN
+  if (tabisfrozen(t))
+    lj_err_caller(L, LJ_ERR_FROZEN);
+  if (mt && tabisfrozen(mt))
+    lj_err_caller(L, LJ_ERR_FRZMT);
+#endif
   if (!tvisnil(lj_meta_lookup(L, L->base, MM_metatable)))
     lj_err_caller(L, LJ_ERR_PROTMT);
   setgcref(t->metatable, obj2gco(mt));
@@ -184,8 +221,16 @@ LJLIB_CF(setfenv)
 
 LJLIB_ASM(rawget)		LJLIB_REC(.)
 {
-  lj_lib_checktab(L, 1);
-  lj_lib_checkany(L, 2);
+  GCtab *t = lj_lib_checktab(L, 1);
+  cTValue *key = lj_lib_checkany(L, 2);
+#if LJ_HASFROZEN
+  if (tabisfrozen(t)) {
+    copyTV(L, L->base-1-LJ_FR2, lj_frozen_get(L, t, key));
+    return FFH_RES(1);
+  }
+#else
+  UNUSED(t); UNUSED(key);
+#endif
   return FFH_UNREACHABLE;
 }
 
@@ -232,6 +277,19 @@ LJLIB_CF(unpack)
   n = (int32_t)(nu+1);
   if (nu >= LUAI_MAXCSTACK || !lua_checkstack(L, n))
     lj_err_caller(L, LJ_ERR_UNPACK);
+#if LJ_HASFROZEN
+  if (tabisfrozen(t)) {
+    do {
+      cTValue *tv = lj_frozen_getint(t, i);
+      if (tv) {
+	lj_frozen_copy(L, L->top++, tv);
+      } else {
+	setnilV(L->top++);
+      }
+    } while (i++ < e);
+    return n;
+  }
+#endif
   do {
     cTValue *tv = lj_tab_getint(t, i);
     if (tv) {
@@ -458,13 +516,63 @@ LJLIB_CF(gcinfo)
   return 1;
 }
 
+#define GC_STATS	(LUA_GCTRIM+1)  /* Pseudo-option for collectgarbage(). */
+
+/* Return a table with the GC statistics. */
+static void gc_pushstats(lua_State *L)
+{
+  luaJIT_gcstats gs;
+  int i;
+  luaJIT_gc_stats(L, &gs);
+  lua_createtable(L, 0, 12);
+  lua_pushstring(L, gs.mode == LUA_GCGEN ? "generational" : "incremental");
+  lua_setfield(L, -2, "mode");
+  lua_pushnumber(L, (lua_Number)gs.minor);
+  lua_setfield(L, -2, "minor");
+  lua_pushnumber(L, (lua_Number)gs.major);
+  lua_setfield(L, -2, "major");
+  lua_pushnumber(L, gs.minortime);
+  lua_setfield(L, -2, "minortime");
+  lua_pushnumber(L, gs.majortime);
+  lua_setfield(L, -2, "majortime");
+  lua_pushnumber(L, gs.minormax);
+  lua_setfield(L, -2, "minormax");
+  lua_pushnumber(L, gs.majormax);
+  lua_setfield(L, -2, "majormax");
+  lua_pushinteger(L, gs.budget);
+  lua_setfield(L, -2, "budget");
+  lua_pushnumber(L, (lua_Number)gs.mapped);
+  lua_setfield(L, -2, "mapped");
+  lua_pushnumber(L, (lua_Number)gs.released);
+  lua_setfield(L, -2, "released");
+  lua_pushnumber(L, (lua_Number)gs.retained);
+  lua_setfield(L, -2, "retained");
+  lua_createtable(L, LUAJIT_GCHIST, 0);
+  for (i = 0; i < LUAJIT_GCHIST; i++) {
+    lua_pushnumber(L, (lua_Number)gs.hist[i]);
+    lua_rawseti(L, -2, i+1);
+  }
+  lua_setfield(L, -2, "hist");
+}
+
 LJLIB_CF(collectgarbage)
 {
   int opt = lj_lib_checkopt(L, 1, LUA_GCCOLLECT,  /* ORDER LUA_GC* */
-    "\4stop\7restart\7collect\5count\1\377\4step\10setpause\12setstepmul\1\377\11isrunning");
+    "\4stop\7restart\7collect\5count\1\377\4step\10setpause\12setstepmul"
+    "\1\377\11isrunning\14generational\13incremental\6budget\14sweepthreads"
+    "\4trim\5stats");
   int32_t data = lj_lib_optint(L, 2, 0);
   if (opt == LUA_GCCOUNT) {
     setnumV(L->top, (lua_Number)G(L)->gc.total/1024.0);
+  } else if (opt == LUA_GCTRIM) {
+    setnumV(L->top, (lua_Number)lj_gc_trim(G(L))/1024.0);
+  } else if (opt == GC_STATS) {
+    gc_pushstats(L);
+    return 1;
+  } else if (opt == LUA_GCGEN || opt == LUA_GCINC) {
+    int res = lua_gc(L, opt, data);  /* Returns the previous mode. */
+    setstrV(L, L->top, lj_str_newz(L, res == LUA_GCGEN ? "generational" :
+						     "incremental"));
   } else {
     int res = lua_gc(L, opt, data);
     if (opt == LUA_GCSTEP || opt == LUA_GCISRUNNING)
@@ -554,24 +662,16 @@ LJLIB_SET(_VERSION)
 
 #define LJLIB_MODULE_coroutine
 
-LJLIB_CF(coroutine_status)
+LJLIB_CF(coroutine_status)		LJLIB_REC(.)
 {
-  const char *s;
-  lua_State *co;
   if (!(L->top > L->base && tvisthread(L->base)))
     lj_err_arg(L, 1, LJ_ERR_NOCORO);
-  co = threadV(L->base);
-  if (co == L) s = "running";
-  else if (co->status == LUA_YIELD) s = "suspended";
-  else if (co->status != LUA_OK) s = "dead";
-  else if (co->base > tvref(co->stack)+1+LJ_FR2) s = "normal";
-  else if (co->top == co->base) s = "dead";
-  else s = "suspended";
-  lua_pushstring(L, s);
+  lua_pushstring(L,
+    lj_state_costatus_name[lj_state_costatus(L, threadV(L->base))]);
   return 1;
 }
 
-LJLIB_CF(coroutine_running)
+LJLIB_CF(coroutine_running)		LJLIB_REC(.)
 {
 #if LJ_52
   int ismain = lua_pushthread(L);
@@ -9,9 +9,12 @@
 #define lib_debug_c
 #define LUA_LIB
 
+#include <stdio.h>
+
 #include "lua.h"
 #include "lauxlib.h"
 #include "lualib.h"
+#include "luajit.h"
 
 #include "lj_obj.h"
 #include "lj_gc.h"
@@ -443,6 +446,52 @@ LJLIB_CF(debug_reset_counts) {
 
 /* ------------------------------------------------------------------------ */
 
+/* Names of the heap accounting categories. ORDER LUAJIT_HEAP */
+static const char *const debug_heapnames[] = {
+  "string", "upvalue", "thread", "proto", "function", "trace", "cdata",
+  "table", "userdata", "array", "hash", "stack", "other"
+};
+
+LJLIB_CF(debug_heapstats)
+{
+  luaJIT_heapstats hs;
+  int i;
+  luaJIT_heap_stats(L, &hs);
+  lua_createtable(L, 0, LUAJIT_HEAP_MAX+1);
+  lua_createtable(L, 0, LUAJIT_HEAP_MAX);
+  for (i = 0; i < LUAJIT_HEAP_MAX; i++) {
+    lua_pushnumber(L, (lua_Number)hs.bytes[i]);
+    lua_setfield(L, -3, debug_heapnames[i]);
+    if (i <= LUAJIT_HEAP_UDATA) {
+      lua_pushnumber(L, (lua_Number)hs.num[i]);
+      lua_setfield(L, -2, debug_heapnames[i]);
+    }
+  }
+  lua_pushnumber(L, (lua_Number)hs.total);
+  lua_setfield(L, -3, "total");
+  return 2;
+}
+
+static int debug_snapwriter(lua_State *L, const void *p, size_t sz, void *ud)
+{
+  UNUSED(L);
+  return fwrite(p, 1, sz, (FILE *)ud) != sz;
+}
+
+LJLIB_CF(debug_heapsnapshot)
+{
+  const char *fname = luaL_checkstring(L, 1);
+  FILE *fp = fopen(fname, "wb");
+  int ok;
+  if (fp == NULL)
+    return luaL_fileresult(L, 0, fname);
+  ok = luaJIT_heap_snapshot(L, debug_snapwriter, fp) == 0;
+  ok = (fclose(fp) == 0) && ok;
+  return luaL_fileresult(L, ok, fname);
+}
+
+/* ------------------------------------------------------------------------ */
+
 #include "lj_libdef.h"
 
 LUALIB_API int luaopen_debug(lua_State *L)
@@ -191,7 +191,7 @@ LJLIB_CF(jit_util_funcinfo)
   if (pt) {
     BCPos pc = (BCPos)lj_lib_optint(L, 2, 0);
     GCtab *t;
-    lua_createtable(L, 0, 16);  /* Increment hash size if fields are added. */
+    lua_createtable(L, 0, 21);  /* Increment hash size if fields are added. */
     t = tabV(L->top-1);
     setintfield(L, t, "linedefined", pt->firstline);
     setintfield(L, t, "lastlinedefined", pt->firstline + pt->numline);
@@ -203,6 +203,22 @@ LJLIB_CF(jit_util_funcinfo)
     setintfield(L, t, "upvalues", (int32_t)pt->sizeuv);
     if (pc < pt->sizebc)
       setintfield(L, t, "currentline", lj_debug_line(pt, pc));
+#if LJ_HASJIT
+    if (pc < pt->sizebc) {  /* Hot counter site of a loop or function entry. */
+      HotSite *hs = mref(pt->hotsite, HotSite);
+      MSize i;
+      for (i = 0; i < pt->nhotsite; i++)
+	if (hs[i].pos == pc) {
+	  setintfield(L, t, "hotcount", (int32_t)hs[i].count);
+	  setintfield(L, t, "hotlimit", (int32_t)hs[i].limit);
+	  setintfield(L, t, "hottraces", (int32_t)hs[i].ntrace);
+	  setintfield(L, t, "hotaborts", (int32_t)hs[i].nabort);
+	  if (hs[i].nabort)
+	    setintfield(L, t, "hotreason", (int32_t)hs[i].reason);
+	  break;
+	}
+    }
+#endif
     lua_pushboolean(L, (pt->flags & PROTO_VARARG));
     lua_setfield(L, -2, "isvararg");
     lua_pushboolean(L, (pt->flags & PROTO_CHILD));
@@ -428,6 +444,52 @@ LJLIB_CF(jit_util_ircalladdr)
   return 0;
 }
 
+/* local info = jit.util.tabstats() */
+LJLIB_CF(jit_util_tabstats)
+{
+  GCtab *t;
+  lua_createtable(L, 0, 4);  /* Increment hash size if fields are added. */
+  t = tabV(L->top-1);
+#if LJ_HASTABSITE
+  {
+    TabSiteState *ts = tabsite_state(G(L));
+    setnumV(lj_tab_setstr(L, t, lj_str_newlit(L, "learned")),
+	    ts ? (lua_Number)ts->nlearn : 0);
+    setnumV(lj_tab_setstr(L, t, lj_str_newlit(L, "presized")),
+	    ts ? (lua_Number)ts->npresized : 0);
+    setnumV(lj_tab_setstr(L, t, lj_str_newlit(L, "avoided")),
+	    ts ? (lua_Number)ts->navoided : 0);
+  }
+#else
+  UNUSED(t);
+#endif
+  return 1;
+}
+
+/* local info = jit.util.tracestats() */
+LJLIB_CF(jit_util_tracestats)
+{
+  jit_State *J = L2J(L);
+  GCtab *t;
+  size_t szfree = 0;
+  MSize i;
+  for (i = 0; i < J->nmchole; i++)
+    szfree += (size_t)((char *)J->mchole[i].top - (char *)J->mchole[i].bot);
+  lua_createtable(L, 0, 5);  /* Increment hash size if fields are added. */
+  t = tabV(L->top-1);
+  setnumV(lj_tab_setstr(L, t, lj_str_newlit(L, "evicted")),
+	  (lua_Number)J->nevict);
+  setnumV(lj_tab_setstr(L, t, lj_str_newlit(L, "rerecorded")),
+	  (lua_Number)J->nrerecord);
+  setnumV(lj_tab_setstr(L, t, lj_str_newlit(L, "flushed")),
+	  (lua_Number)J->nflush);
+  setnumV(lj_tab_setstr(L, t, lj_str_newlit(L, "mcode")),
+	  (lua_Number)J->szallmcarea);
+  setnumV(lj_tab_setstr(L, t, lj_str_newlit(L, "mcodefree")),
+	  (lua_Number)szfree);
+  return 1;
+}
+
 #endif
 
 #include "lj_libdef.h"
@@ -502,7 +564,7 @@ static int jitopt_param(jit_State *J, const char *str)
 	n = n*10 + (*p++ - '0');
       if (*p) return 0;  /* Malformed number. */
       J->param[i] = n;
-      if (i == JIT_P_hotloop)
+      if (i == JIT_P_hotloop || i == JIT_P_hotsite)
 	lj_dispatch_init_hotcount(J2G(J));
       return 1;  /* Ok. */
     }
@@ -659,6 +721,7 @@ static uint32_t jit_cpudetect(void)
   if (lj_vm_cpuid(0, vendor) && lj_vm_cpuid(1, features)) {
     flags |= ((features[2] >> 0)&1) * JIT_F_SSE3;
     flags |= ((features[2] >> 19)&1) * JIT_F_SSE4_1;
+    flags |= ((features[2] >> 20)&1) * JIT_F_SSE4_2;
     if (vendor[0] >= 7) {
       uint32_t xfeatures[4];
       lj_vm_cpuid(7, xfeatures);
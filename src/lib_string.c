@@ -25,6 +25,7 @@
 #include "lj_bcdump.h"
 #include "lj_char.h"
 #include "lj_strfmt.h"
+#include "lj_strmatch.h"
 #include "lj_lib.h"
 
 /* ------------------------------------------------------------------------ */
@@ -193,55 +194,12 @@ static const char *classend(MatchState *ms, const char *p)
   }
 }
 
-static const unsigned char match_class_map[32] = {
-  0,LJ_CHAR_ALPHA,0,LJ_CHAR_CNTRL,LJ_CHAR_DIGIT,0,0,LJ_CHAR_GRAPH,0,0,0,0,
-  LJ_CHAR_LOWER,0,0,0,LJ_CHAR_PUNCT,0,0,LJ_CHAR_SPACE,0,
-  LJ_CHAR_UPPER,0,LJ_CHAR_ALNUM,LJ_CHAR_XDIGIT,0,0,0,0,0,0,0
-};
-
-static int match_class(int c, int cl)
-{
-  if ((cl & 0xc0) == 0x40) {
-    int t = match_class_map[(cl&0x1f)];
-    if (t) {
-      t = lj_char_isa(c, t);
-      return (cl & 0x20) ? t : !t;
-    }
-    if (cl == 'z') return c == 0;
-    if (cl == 'Z') return c != 0;
-  }
-  return (cl == c);
-}
-
-static int matchbracketclass(int c, const char *p, const char *ec)
-{
-  int sig = 1;
-  if (*(p+1) == '^') {
-    sig = 0;
-    p++;  /* skip the `^' */
-  }
-  while (++p < ec) {
-    if (*p == L_ESC) {
-      p++;
-      if (match_class(c, uchar(*p)))
-	return sig;
-    }
-    else if ((*(p+1) == '-') && (p+2 < ec)) {
-      p+=2;
-      if (uchar(*(p-2)) <= c && c <= uchar(*p))
-	return sig;
-    }
-    else if (uchar(*p) == c) return sig;
-  }
-  return !sig;
-}
-
 static int singlematch(int c, const char *p, const char *ep)
 {
   switch (*p) {
   case '.': return 1;  /* matches any char */
-  case L_ESC: return match_class(c, uchar(*(p+1)));
-  case '[': return matchbracketclass(c, p, ep-1);
+  case L_ESC: return lj_strmatch_class(c, uchar(*(p+1)));
+  case '[': return lj_strmatch_bracket(c, p, ep-1);
   default:  return (uchar(*p) == c);
   }
 }
@@ -364,8 +322,8 @@ static const char *match(MatchState *ms, const char *s, const char *p)
 	lj_err_caller(ms->L, LJ_ERR_STRPATB);
       ep = classend(ms, p);  /* points to what is next */
       previous = (s == ms->src_init) ? '\0' : *(s-1);
-      if (matchbracketclass(uchar(previous), p, ep-1) ||
-	 !matchbracketclass(uchar(*s), p, ep-1)) { s = NULL; break; }
+      if (lj_strmatch_bracket(uchar(previous), p, ep-1) ||
+	 !lj_strmatch_bracket(uchar(*s), p, ep-1)) { s = NULL; break; }
       p=ep;
       goto init;  /* else s = match(ms, s, ep); */
       }
@@ -447,6 +405,29 @@ static int push_captures(MatchState *ms, const char *s, const char *e)
   return nlevels;  /* number of strings pushed */
 }
 
+/* Match a compiled pattern, starting the search at *sp. Returns 1 and
+** the match from *sp to *ep, 0 for no match or -1 if it's too complex.
+*/
+static int match_prog(MatchState *ms, StrMatchProg *prog,
+		      const char **sp, const char **ep)
+{
+  const char *s = ms->src_init;
+  StrMatchRes res;
+  int32_t st = lj_strmatch_exec(prog, s, (MSize)(ms->src_end - s),
+				(MSize)(*sp - s), &res);
+  int i;
+  if (st < 0) return st == STRMATCH_NONE ? 0 : -1;
+  *sp = s + st;
+  *ep = s + res.end;
+  ms->level = prog->ncap;
+  for (i = 0; i < prog->ncap; i++) {
+    ms->capture[i].init = s + res.cap[2*i];
+    ms->capture[i].len = ((prog->poscap >> i) & 1) ? CAP_POSITION :
+			 (ptrdiff_t)res.cap[2*i+1];
+  }
+  return 1;
+}
+
 static int str_find_aux(lua_State *L, int find)
 {
   GCstr *s = lj_lib_checkstr(L, 1);
@@ -474,63 +455,73 @@ static int str_find_aux(lua_State *L, int find)
     }
   } else {  /* Search for pattern. */
     MatchState ms;
+    StrMatchProg *prog = lj_strmatch_get(L, p);
     const char *pstr = strdata(p);
     const char *sstr = strdata(s) + st;
+    const char *q = NULL;
     int anchor = 0;
     if (*pstr == '^') { pstr++; anchor = 1; }
     ms.L = L;
     ms.src_init = strdata(s);
     ms.src_end = strdata(s) + s->len;
-    do {  /* Loop through string and try to match the pattern. */
-      const char *q;
-      ms.level = ms.depth = 0;
-      q = match(&ms, sstr, pstr);
-      if (q) {
-	if (find) {
-	  setintV(L->top++, (int32_t)(sstr-(strdata(s)-1)));
-	  setintV(L->top++, (int32_t)(q-strdata(s)));
-	  return push_captures(&ms, NULL, NULL) + 2;
-	} else {
-	  return push_captures(&ms, sstr, q);
-	}
+    if (!prog || match_prog(&ms, prog, &sstr, &q) < 0) {
+      do {  /* Loop through string and try to match the pattern. */
+	ms.level = ms.depth = 0;
+	if ((q = match(&ms, sstr, pstr)) != NULL) break;
+      } while (sstr++ < ms.src_end && !anchor);
+    }
+    if (q) {
+      if (find) {
+	setintV(L->top++, (int32_t)(sstr-(strdata(s)-1)));
+	setintV(L->top++, (int32_t)(q-strdata(s)));
+	return push_captures(&ms, NULL, NULL) + 2;
+      } else {
+	return push_captures(&ms, sstr, q);
       }
-    } while (sstr++ < ms.src_end && !anchor);
+    }
   }
   setnilV(L->top-1);  /* Not found. */
   return 1;
 }
 
-LJLIB_CF(string_find)		LJLIB_REC(.)
+LJLIB_CF(string_find)		LJLIB_REC(string_find 1)
 {
   return str_find_aux(L, 1);
 }
 
-LJLIB_CF(string_match)
+LJLIB_CF(string_match)		LJLIB_REC(string_find 0)
 {
   return str_find_aux(L, 0);
 }
 
 LJLIB_NOREG LJLIB_CF(string_gmatch_aux)
 {
-  const char *p = strVdata(lj_lib_upvalue(L, 2));
+  GCstr *pat = strV(lj_lib_upvalue(L, 2));
+  const char *p = strdata(pat);
   GCstr *str = strV(lj_lib_upvalue(L, 1));
   const char *s = strdata(str);
   TValue *tvpos = lj_lib_upvalue(L, 3);
   const char *src = s + tvpos->u32.lo;
+  const char *e = NULL;
+  StrMatchProg *prog;
   MatchState ms;
   ms.L = L;
   ms.src_init = s;
   ms.src_end = s + str->len;
-  for (; src <= ms.src_end; src++) {
-    const char *e;
-    ms.level = ms.depth = 0;
-    if ((e = match(&ms, src, p)) != NULL) {
-      int32_t pos = (int32_t)(e - s);
-      if (e == src) pos++;  /* Ensure progress for empty match. */
-      tvpos->u32.lo = (uint32_t)pos;
-      return push_captures(&ms, src, e);
+  /* A leading '^' is not special for gmatch. */
+  if (*p == '^' || !(prog = lj_strmatch_get(L, pat)) || src > ms.src_end ||
+      match_prog(&ms, prog, &src, &e) < 0) {
+    for (; src <= ms.src_end; src++) {
+      ms.level = ms.depth = 0;
+      if ((e = match(&ms, src, p)) != NULL) break;
     }
   }
+  if (e) {
+    int32_t pos = (int32_t)(e - s);
+    if (e == src) pos++;  /* Ensure progress for empty match. */
+    tvpos->u32.lo = (uint32_t)pos;
+    return push_captures(&ms, src, e);
+  }
   return 0;  /* not found */
 }
 
@@ -597,11 +588,12 @@ static void add_value(MatchState *ms, luaL_Buffer *b,
   luaL_addvalue(b);  /* add result to accumulator */
 }
 
-LJLIB_CF(string_gsub)
+LJLIB_CF(string_gsub)		LJLIB_REC(.)
 {
   size_t srcl;
   const char *src = luaL_checklstring(L, 1, &srcl);
-  const char *p = luaL_checkstring(L, 2);
+  GCstr *pat = lj_lib_checkstr(L, 2);
+  const char *p = strdata(pat);
   int  tr = lua_type(L, 3);
   int max_s = luaL_optint(L, 4, (int)(srcl+1));
   int anchor = (*p == '^') ? (p++, 1) : 0;
@@ -616,9 +608,18 @@ LJLIB_CF(string_gsub)
   ms.src_init = src;
   ms.src_end = src+srcl;
   while (n < max_s) {
-    const char *e;
-    ms.level = ms.depth = 0;
-    e = match(&ms, src, p);
+    /* Refetch, since a callback may have evicted the compiled pattern. */
+    StrMatchProg *prog = lj_strmatch_get(L, pat);
+    const char *e = NULL, *q = src;
+    int r;
+    if (prog && (r = match_prog(&ms, prog, &q, &e)) >= 0) {
+      if (!r) break;  /* No more matches. */
+      luaL_addlstring(&b, src, (size_t)(q - src));  /* Skipped part. */
+      src = q;
+    } else {
+      ms.level = ms.depth = 0;
+      e = match(&ms, src, p);
+    }
     if (e) {
       n++;
       add_value(&ms, &b, src, e);
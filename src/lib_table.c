@@ -18,6 +18,8 @@
 #include "lj_err.h"
 #include "lj_buf.h"
 #include "lj_tab.h"
+#include "lj_frozen.h"
+#include "lj_meta.h"
 #include "lj_ff.h"
 #include "lj_lib.h"
 
@@ -57,10 +59,15 @@ LJLIB_LUA(table_getn) /*
 LJLIB_CF(table_maxn)
 {
   GCtab *t = lj_lib_checktab(L, 1);
-  TValue *array = tvref(t->array);
+  TValue *array;
   Node *node;
   lua_Number m = 0;
   ptrdiff_t i;
+#if LJ_HASFROZEN
+  GCtab view;
+  if (tabisfrozen(t)) t = lj_frozen_view(t, &view);
+#endif
+  array = tvref(t->array);
   for (i = (ptrdiff_t)t->asize - 1; i >= 0; i--)
     if (!tvisnil(&array[i])) {
       m = (lua_Number)(int32_t)i;
@@ -129,25 +136,36 @@ LJLIB_LUA(table_remove) /*
   end
 */
 
-LJLIB_LUA(table_move) /*
-  function(a1, f, e, t, a2)
-    CHECK_tab(a1)
-    CHECK_int(f)
-    CHECK_int(e)
-    CHECK_int(t)
-    if a2 == nil then a2 = a1 end
-    CHECK_tab(a2)
-    if e >= f then
-      local d = t - f
-      if t > e or t <= f or a2 ~= a1 then
-	for i=f,e do a2[i+d] = a1[i] end
-      else
-	for i=e,f,-1 do a2[i+d] = a1[i] end
-      end
-    end
-    return a2
-  end
-*/
+LJLIB_CF(table_move)		LJLIB_REC(.)
+{
+  GCtab *a1 = lj_lib_checktab(L, 1);
+  int32_t f = lj_lib_checkint(L, 2);
+  int32_t e = lj_lib_checkint(L, 3);
+  int32_t t = lj_lib_checkint(L, 4);
+  int hasa2 = L->base+4 < L->top && !tvisnil(L->base+4);
+  GCtab *a2 = hasa2 ? lj_lib_checktab(L, 5) : a1;
+  if ((!tabisfrozen(a1) &&
+       lj_meta_fast(L, tabref(a1->metatable), MM_index)) ||
+      (!tabisfrozen(a2) &&
+       lj_meta_fast(L, tabref(a2->metatable), MM_newindex))) {
+    /* Metamethods need a loop of regular loads and stores. */
+    int i2 = hasa2 ? 5 : 1;
+    int64_t d = (int64_t)t - f, i;
+    if (e >= f) {
+      int64_t step = (t > e || t <= f || a1 != a2) ? 1 : -1;
+      for (i = step > 0 ? f : e; i >= f && i <= e; i += step) {
+	lua_pushnumber(L, (lua_Number)(i + d));
+	lua_pushinteger(L, (lua_Integer)i);
+	lua_gettable(L, 1);
+	lua_settable(L, i2);
+      }
+    }
+  } else {
+    lj_tab_move(L, a1, f, e, t, a2);
+  }
+  settabV(L, L->top++, a2);
+  return 1;
+}
 
 LJLIB_CF(table_concat)		LJLIB_REC(.)
 {
@@ -160,7 +178,13 @@ LJLIB_CF(table_concat)		LJLIB_REC(.)
   SBuf *sbx = lj_buf_puttab(sb, t, sep, i, e);
   if (LJ_UNLIKELY(!sbx)) {  /* Error: bad element type. */
     int32_t idx = (int32_t)(intptr_t)sb->w;
-    cTValue *o = lj_tab_getint(t, idx);
+    cTValue *o;
+#if LJ_HASFROZEN
+    if (tabisfrozen(t))
+      o = lj_frozen_getint(t, idx);
+    else
+#endif
+    o = lj_tab_getint(t, idx);
     lj_err_callerv(L, LJ_ERR_TABCAT,
 		   lj_obj_itypename[o ? itypemap(o) : ~LJ_TNIL], idx);
   }
@@ -256,17 +280,86 @@ static void auxsort(lua_State *L, int l, int u)
   }  /* repeat the routine for the larger one */
 }
 
-LJLIB_CF(table_sort)
+/* Sort the slots 1..n with the default order. A comparator is only passed
+** after the Lua part detected an inconsistent order, to throw the error.
+*/
+LJLIB_NOREGUV LJLIB_CF(table_sort_aux)	LJLIB_REC(.)
 {
   GCtab *t = lj_lib_checktab(L, 1);
-  int32_t n = (int32_t)lj_tab_len(t);
-  lua_settop(L, 2);
-  if (!tvisnil(L->base+1))
-    lj_lib_checkfunc(L, 2);
+  int32_t n = lj_lib_checkint(L, 2);
+  if (L->base+2 < L->top && !tvisnil(L->base+2))
+    lj_err_caller(L, LJ_ERR_TABSORT);
+  if (lj_tab_sort(t, (MSize)n)) return 0;
+  setnilV(L->base+1);
+  L->top = L->base+2;
   auxsort(L, 1, n);
   return 0;
 }
 
+/* The comparator is called from Lua, so it can be inlined into traces. */
+LJLIB_PUSH(lastcl)
+LJLIB_LUA(table_sort) /*
+  local sort_aux
+  function(t, cmp)
+    CHECK_tab(t)
+    local n = #t
+    if cmp == nil then return sort_aux(t, n) end
+    CHECK_func(cmp)
+    local stk, sp, l, u = {}, 0, 1, n
+    while true do
+      if u - l < 3 then  -- Like the C code: no order checks up to 3 slots.
+	for i=l+1,u do
+	  local v, j = t[i], i-1
+	  while j >= l and cmp(v, t[j]) do
+	    t[j+1] = t[j]
+	    j = j - 1
+	  end
+	  t[j+1] = v
+	end
+	if sp == 0 then return end
+	l, u = stk[sp-1], stk[sp]
+	sp = sp - 2
+      else
+	local i = l + u
+	i = (i - i % 2) / 2
+	local a, b = t[l], t[u]
+	if cmp(b, a) then t[l] = b; t[u] = a end
+	a, b = t[i], t[l]
+	if cmp(a, b) then
+	  t[i] = b; t[l] = a
+	else
+	  b = t[u]
+	  if cmp(b, a) then t[i] = b; t[u] = a end
+	end
+	local p, j = t[i], u-1
+	t[i] = t[j]; t[j] = p
+	i = l
+	while true do
+	  i = i + 1
+	  while cmp(t[i], p) do
+	    if i >= u then return sort_aux(t, n, cmp) end
+	    i = i + 1
+	  end
+	  j = j - 1
+	  while cmp(p, t[j]) do
+	    if j <= l then return sort_aux(t, n, cmp) end
+	    j = j - 1
+	  end
+	  if j < i then break end
+	  a = t[i]; t[i] = t[j]; t[j] = a
+	end
+	t[u-1] = t[i]; t[i] = p
+	if i - l < u - i then
+	  stk[sp+1] = i+1; stk[sp+2] = u; u = i-1
+	else
+	  stk[sp+1] = l; stk[sp+2] = i-1; l = i+1
+	end
+	sp = sp + 2
+      end
+    end
+  end
+*/
+
 #if LJ_52
 LJLIB_PUSH("n")
 LJLIB_CF(table_pack)
@@ -295,10 +388,55 @@ LJLIB_NOREG LJLIB_CF(table_new)		LJLIB_REC(.)
 
 LJLIB_NOREG LJLIB_CF(table_clear)	LJLIB_REC(.)
 {
-  lj_tab_clear(lj_lib_checktab(L, 1));
+  GCtab *t = lj_lib_checktab(L, 1);
+#if LJ_HASFROZEN
+  if (tabisfrozen(t))
+    lj_err_caller(L, LJ_ERR_FROZEN);
+#endif
+  lj_tab_clear(t);
   return 0;
 }
 
+LJLIB_NOREG LJLIB_CF(table_clone)	LJLIB_REC(.)
+{
+  GCtab *t = lj_lib_checktab(L, 1);
+#if LJ_HASFROZEN
+  if (tabisfrozen(t))
+    t = lj_frozen_thaw(L, t);
+  else
+#endif
+  t = lj_tab_dup(L, t);
+  settabV(L, L->top++, t);
+  lj_gc_check(L);
+  return 1;
+}
+
+LJLIB_NOREG LJLIB_CF(table_fill)	LJLIB_REC(.)
+{
+  GCtab *t = lj_lib_checktab(L, 1);
+  cTValue *v = lj_lib_checkany(L, 2);
+  int32_t i = lj_lib_optint(L, 3, 1);
+  int32_t j = (L->base+3 < L->top && !tvisnil(L->base+3)) ?
+	      lj_lib_checkint(L, 4) : (int32_t)lj_tab_len(t);
+  lj_tab_fill(L, t, i, j, v);
+  L->top = L->base+1;
+  return 1;
+}
+
+#if LJ_HASFROZEN
+LJLIB_NOREG LJLIB_CF(table_freeze)
+{
+  FrozenRegion *fz = lj_frozen_new(L, lj_lib_checktab(L, 1));
+  GCtab *t;
+  /* The state keeps a reference until it's closed. */
+  t = lj_frozen_attach(L, fz);
+  lj_frozen_release(fz);
+  settabV(L, L->top++, t);
+  lj_gc_check(L);
+  return 1;
+}
+#endif
+
 static int luaopen_table_new(lua_State *L)
 {
   return lj_lib_postreg(L, lj_cf_table_new, FF_table_new, "new");
@@ -309,6 +447,23 @@ static int luaopen_table_clear(lua_State *L)
   return lj_lib_postreg(L, lj_cf_table_clear, FF_table_clear, "clear");
 }
 
+static int luaopen_table_clone(lua_State *L)
+{
+  return lj_lib_postreg(L, lj_cf_table_clone, FF_table_clone, "clone");
+}
+
+static int luaopen_table_fill(lua_State *L)
+{
+  return lj_lib_postreg(L, lj_cf_table_fill, FF_table_fill, "fill");
+}
+
+#if LJ_HASFROZEN
+static int luaopen_table_freeze(lua_State *L)
+{
+  return lj_lib_postreg(L, lj_cf_table_freeze, FF_table_freeze, "freeze");
+}
+#endif
+
 /* ------------------------------------------------------------------------ */
 
 #include "lj_libdef.h"
@@ -322,6 +477,12 @@ LUALIB_API int luaopen_table(lua_State *L)
 #endif
   lj_lib_prereg(L, LUA_TABLIBNAME ".new", luaopen_table_new, tabV(L->top-1));
   lj_lib_prereg(L, LUA_TABLIBNAME ".clear", luaopen_table_clear, tabV(L->top-1));
+  lj_lib_prereg(L, LUA_TABLIBNAME ".clone", luaopen_table_clone, tabV(L->top-1));
+  lj_lib_prereg(L, LUA_TABLIBNAME ".fill", luaopen_table_fill, tabV(L->top-1));
+#if LJ_HASFROZEN
+  lj_lib_prereg(L, LUA_TABLIBNAME ".freeze", luaopen_table_freeze,
+		tabV(L->top-1));
+#endif
   return 1;
 }
 
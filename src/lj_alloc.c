@@ -43,6 +43,10 @@
 #define DEFAULT_MMAP_THRESHOLD	((size_t)128U * (size_t)1024U)
 #define MAX_RELEASE_CHECK_RATE	255
 
+#ifdef LUAJIT_ENABLE_SLAB
+#define LJ_ALLOC_SLAB		1
+#endif
+
 /* ------------------- size_t and alignment properties -------------------- */
 
 /* The byte and bit size of a size_t */
@@ -54,6 +58,7 @@
 #define SIZE_T_ZERO		((size_t)0)
 #define SIZE_T_ONE		((size_t)1)
 #define SIZE_T_TWO		((size_t)2)
+#define SIZE_T_FOUR		((size_t)4)
 #define TWO_SIZE_T_SIZES	(SIZE_T_SIZE<<1)
 #define FOUR_SIZE_T_SIZES	(SIZE_T_SIZE<<2)
 #define SIX_SIZE_T_SIZES	(FOUR_SIZE_T_SIZES+TWO_SIZE_T_SIZES)
@@ -209,6 +214,15 @@ static int CALL_MUNMAP(void *ptr, size_t size)
   return 0;
 }
 
+/* Release the physical pages of a committed range, but keep it mapped. */
+static int CALL_MRELEASE(void *ptr, size_t size)
+{
+  DWORD olderr = GetLastError();
+  void *p = LJ_WIN_VALLOC(ptr, size, MEM_RESET, PAGE_READWRITE);
+  SetLastError(olderr);
+  return p ? 0 : -1;
+}
+
 #elif LJ_ALLOC_MMAP
 
 #define MMAP_PROT		(PROT_READ|PROT_WRITE)
@@ -352,6 +366,40 @@ static int CALL_MUNMAP(void *ptr, size_t size)
   return ret;
 }
 
+/* Release the physical pages of a range, but keep it mapped.
+** Prefer MADV_DONTNEED on Linux, since it drops the RSS right away.
+*/
+#if LJ_TARGET_LINUX && defined(MADV_DONTNEED)
+#define MRELEASE_ADVICE		MADV_DONTNEED
+#elif defined(MADV_FREE)
+#define MRELEASE_ADVICE		MADV_FREE
+#elif defined(MADV_DONTNEED)
+#define MRELEASE_ADVICE		MADV_DONTNEED
+#endif
+
+/* Transparent huge pages. Only enabled on request, see lj_alloc_sethuge. */
+#ifdef MADV_HUGEPAGE
+#define LJ_ALLOC_HUGEPAGE	1
+#define HUGEPAGE_SIZE		((size_t)2 << 20)
+
+static void CALL_MHUGE(void *ptr, size_t size)
+{
+  int olderr = errno;
+  madvise(ptr, size, MADV_HUGEPAGE);  /* Ignore result. It's just a hint. */
+  errno = olderr;
+}
+#endif
+
+#ifdef MRELEASE_ADVICE
+static int CALL_MRELEASE(void *ptr, size_t size)
+{
+  int olderr = errno;
+  int ret = madvise(ptr, size, MRELEASE_ADVICE);
+  errno = olderr;
+  return ret;
+}
+#endif
+
 #if LJ_ALLOC_MREMAP
 /* Need to define _GNU_SOURCE to get the mremap prototype. */
 static void *CALL_MREMAP_(void *ptr, size_t osz, size_t nsz, int flags)
@@ -387,6 +435,10 @@ static void *CALL_MREMAP_(void *ptr, size_t osz, size_t nsz, int flags)
 #define CALL_MREMAP(addr, osz, nsz, mv) ((void)osz, MFAIL)
 #endif
 
+#if !LJ_ALLOC_VIRTUALALLOC && !defined(MRELEASE_ADVICE)
+#define CALL_MRELEASE(ptr, size)	((void)(ptr), (void)(size), -1)
+#endif
+
 /* -----------------------  Chunk representations ------------------------ */
 
 struct malloc_chunk {
@@ -441,6 +493,8 @@ typedef unsigned int flag_t;           /* The type of various bit flag sets */
 #define PINUSE_BIT		(SIZE_T_ONE)
 #define CINUSE_BIT		(SIZE_T_TWO)
 #define INUSE_BITS		(PINUSE_BIT|CINUSE_BIT)
+#define RELEASED_BIT		(SIZE_T_FOUR)  /* Free chunk pages released. */
+#define FLAG_BITS		(INUSE_BITS|RELEASED_BIT)
 
 /* Head value for fenceposts */
 #define FENCEPOST_HEAD		(INUSE_BITS|SIZE_T_SIZE)
@@ -448,7 +502,7 @@ typedef unsigned int flag_t;           /* The type of various bit flag sets */
 /* extraction of fields from head words */
 #define cinuse(p)		((p)->head & CINUSE_BIT)
 #define pinuse(p)		((p)->head & PINUSE_BIT)
-#define chunksize(p)		((p)->head & ~(INUSE_BITS))
+#define chunksize(p)		((p)->head & ~(FLAG_BITS))
 
 #define clear_pinuse(p)		((p)->head &= ~PINUSE_BIT)
 #define clear_cinuse(p)		((p)->head &= ~CINUSE_BIT)
@@ -458,7 +512,7 @@ typedef unsigned int flag_t;           /* The type of various bit flag sets */
 #define chunk_minus_offset(p, s)	((mchunkptr)(((char *)(p)) - (s)))
 
 /* Ptr to next or previous physical malloc_chunk. */
-#define next_chunk(p)	((mchunkptr)(((char *)(p)) + ((p)->head & ~INUSE_BITS)))
+#define next_chunk(p)	((mchunkptr)(((char *)(p)) + ((p)->head & ~FLAG_BITS)))
 #define prev_chunk(p)	((mchunkptr)(((char *)(p)) - ((p)->prev_foot) ))
 
 /* extract next chunk's pinuse bit */
@@ -476,6 +530,13 @@ typedef unsigned int flag_t;           /* The type of various bit flag sets */
 #define set_free_with_pinuse(p, s, n)\
   (clear_pinuse(n), set_size_and_pinuse_of_free_chunk(p, s))
 
+/* Set size, pinuse bit and foot of the free remainder r split off the
+** front of free chunk p. Must come before p is set in use. The pages
+** released inside p stay released inside r.
+*/
+#define set_remainder_of_free_chunk(r, s, p)\
+  ((r)->head = (s|PINUSE_BIT|((p)->head & RELEASED_BIT)), set_foot(r, s))
+
 #define is_direct(p)\
   (!((p)->head & PINUSE_BIT) && ((p)->prev_foot & IS_DIRECT_BIT))
 
@@ -527,6 +588,41 @@ typedef struct malloc_segment *msegmentptr;
 #define MAX_SMALL_SIZE		(MIN_LARGE_SIZE - SIZE_T_ONE)
 #define MAX_SMALL_REQUEST  (MAX_SMALL_SIZE - CHUNK_ALIGN_MASK - CHUNK_OVERHEAD)
 
+#if LJ_ALLOC_SLAB
+/* Slab allocator for small objects. See below. */
+#define SLAB_SHIFT		3
+#define SLAB_MAXSIZE		((size_t)256U)
+#define SLAB_NCLASS		(SLAB_MAXSIZE >> SLAB_SHIFT)
+#define SLAB_PAGESIZE		((size_t)4096U)
+#define SLAB_ARENASIZE		((size_t)1024U * (size_t)1024U)
+#define SLAB_ARENAPAGES		(SLAB_ARENASIZE / SLAB_PAGESIZE)
+#define SLAB_MAPWORDS		(SLAB_PAGESIZE >> SLAB_SHIFT >> 5)
+
+struct slab_arena;
+
+typedef struct slab_page {
+  struct slab_page *next, *prev;  /* Pages of a class with free slots. */
+  struct slab_arena *arena;	/* Arena holding this page. */
+  uint16_t size;		/* Slot size. */
+  uint16_t nslots;		/* Number of slots. */
+  uint16_t nfree;		/* Number of free slots. */
+  uint16_t hint;		/* No free slots in freemap words below. */
+  uint32_t freemap[SLAB_MAPWORDS];  /* Occupancy bitmap. Bit set = free. */
+} slab_page;
+
+#define SLAB_HDRSIZE		((sizeof(slab_page) + 15) & ~(size_t)15)
+
+typedef struct slab_arena {
+  struct slab_arena *next, *prev;	/* List of all arenas. */
+  struct slab_arena *anext, *aprev;	/* List of arenas with free pages. */
+  uint32_t nused;		/* Number of pages in use. */
+  uint32_t ntouched;		/* Number of pages ever used. */
+  uint32_t nfree;		/* Number of free pages. */
+  uint32_t nclean;		/* Free pages below this are released. */
+  uint16_t freepage[SLAB_ARENAPAGES];  /* Stack of free page indexes. */
+} slab_arena;
+#endif
+
 struct malloc_state {
   binmap_t   smallmap;
   binmap_t   treemap;
@@ -540,6 +636,15 @@ struct malloc_state {
   tbinptr    treebins[NTREEBINS];
   msegment   seg;
   PRNGState  *prng;
+  size_t     footprint;		/* Bytes mapped from the OS. */
+#if LJ_ALLOC_HUGEPAGE
+  int        hugepage;		/* Use transparent huge pages. */
+#endif
+#if LJ_ALLOC_SLAB
+  slab_page  *slab[SLAB_NCLASS];	/* Pages with free slots per class. */
+  slab_arena *arenas;		/* All slab arenas. */
+  slab_arena *avail;		/* Slab arenas with free pages. */
+#endif
 };
 
 typedef struct malloc_state *mstate;
@@ -835,14 +940,18 @@ static void *direct_alloc(mstate m, size_t nb)
       p->head = psize|CINUSE_BIT;
       chunk_plus_offset(p, psize)->head = FENCEPOST_HEAD;
       chunk_plus_offset(p, psize+SIZE_T_SIZE)->head = 0;
+      m->footprint += mmsize;
+#if LJ_ALLOC_HUGEPAGE
+      if (m->hugepage && mmsize >= HUGEPAGE_SIZE)
+	CALL_MHUGE(mm, mmsize);
+#endif
       return chunk2mem(p);
     }
   }
-  UNUSED(m);
   return NULL;
 }
 
-static mchunkptr direct_resize(mchunkptr oldp, size_t nb)
+static mchunkptr direct_resize(mstate m, mchunkptr oldp, size_t nb)
 {
   size_t oldsize = chunksize(oldp);
   if (is_small(nb)) /* Can't shrink direct regions below small size */
@@ -863,6 +972,7 @@ static mchunkptr direct_resize(mchunkptr oldp, size_t nb)
       newp->head = psize|CINUSE_BIT;
       chunk_plus_offset(newp, psize)->head = FENCEPOST_HEAD;
       chunk_plus_offset(newp, psize+SIZE_T_SIZE)->head = 0;
+      m->footprint += newmmsize - oldmmsize;
       return newp;
     }
   }
@@ -980,6 +1090,24 @@ static void add_segment(mstate m, char *tbase, size_t tsize)
 
 /* -------------------------- System allocation -------------------------- */
 
+#if LJ_ALLOC_HUGEPAGE
+/* Map a huge page aligned segment. Over-allocate and cut off the excess. */
+static void *mmap_huge(mstate m, size_t size)
+{
+  char *mp = (char *)CALL_MMAP(m->prng, size + HUGEPAGE_SIZE);
+  if (mp != CMFAIL) {
+    char *p = (char *)(((uintptr_t)mp + HUGEPAGE_SIZE-1) &
+		       ~(uintptr_t)(HUGEPAGE_SIZE-1));
+    size_t tail = (size_t)((mp + size + HUGEPAGE_SIZE) - (p + size));
+    if (p != mp) CALL_MUNMAP(mp, (size_t)(p - mp));
+    if (tail) CALL_MUNMAP(p + size, tail);
+    CALL_MHUGE(p, size);
+    return p;
+  }
+  return CMFAIL;
+}
+#endif
+
 static void *alloc_sys(mstate m, size_t nb)
 {
   char *tbase = CMFAIL;
@@ -995,11 +1123,21 @@ static void *alloc_sys(mstate m, size_t nb)
   {
     size_t req = nb + TOP_FOOT_SIZE + SIZE_T_ONE;
     size_t rsize = granularity_align(req);
+#if LJ_ALLOC_HUGEPAGE
+    if (m->hugepage)  /* Grow in whole huge pages. */
+      rsize = (req + HUGEPAGE_SIZE-1) & ~(HUGEPAGE_SIZE-1);
+#endif
     if (LJ_LIKELY(rsize > nb)) { /* Fail if wraps around zero */
+#if LJ_ALLOC_HUGEPAGE
+      char *mp = m->hugepage ? (char *)mmap_huge(m, rsize) :
+			       (char *)(CALL_MMAP(m->prng, rsize));
+#else
       char *mp = (char *)(CALL_MMAP(m->prng, rsize));
+#endif
       if (mp != CMFAIL) {
 	tbase = mp;
 	tsize = rsize;
+	m->footprint += rsize;
       }
     }
   }
@@ -1030,7 +1168,7 @@ static void *alloc_sys(mstate m, size_t nb)
       size_t rsize = m->topsize -= nb;
       mchunkptr p = m->top;
       mchunkptr r = m->top = chunk_plus_offset(p, nb);
-      r->head = rsize | PINUSE_BIT;
+      r->head = rsize | PINUSE_BIT | (p->head & RELEASED_BIT);
       set_size_and_pinuse_of_inuse_chunk(m, p, nb);
       return chunk2mem(p);
     }
@@ -1067,6 +1205,7 @@ static size_t release_unused_segments(mstate m)
 	}
 	if (CALL_MUNMAP(base, size) == 0) {
 	  released += size;
+	  m->footprint -= size;
 	  /* unlink obsoleted record */
 	  sp = pred;
 	  sp->next = next;
@@ -1109,6 +1248,7 @@ static int alloc_trim(mstate m, size_t pad)
 
       if (released != 0) {
 	sp->size -= released;
+	m->footprint -= released;
 	init_top(m, m->top, m->topsize - released);
       }
     }
@@ -1124,6 +1264,101 @@ static int alloc_trim(mstate m, size_t pad)
   return (released != 0)? 1 : 0;
 }
 
+/* Release the interior pages of a free chunk and mark it. Keeps the chunk
+** header. Returns the newly released bytes. Or, if release is 0, just
+** returns the bytes still released since an earlier trim.
+**
+** The mark survives splitting off the front of the chunk, but not
+** merging it with a neighbour. Merged chunks count as resident and are
+** released again by the next trim.
+*/
+static size_t trim_chunk(mchunkptr p, size_t psize, int release)
+{
+  char *start = (char *)page_align((size_t)((char *)p + sizeof(tchunk)));
+  char *end = (char *)((size_t)((char *)p + psize) &
+		       ~(size_t)(LJ_PAGESIZE - SIZE_T_ONE));
+  int marked = (p->head & RELEASED_BIT) != 0;
+  if (end <= start || marked == release)
+    return 0;
+  if (release) {
+    if (CALL_MRELEASE(start, (size_t)(end - start)) != 0)
+      return 0;
+    p->head |= RELEASED_BIT;
+  }
+  return (size_t)(end - start);
+}
+
+/* Release the interior pages of all chunks in a tree bin. */
+static size_t trim_tree(tchunkptr t, int release)
+{
+  size_t released = 0;
+  while (t != 0) {
+    tchunkptr u = t;
+    do {  /* Chunks of the same size are linked in a ring. */
+      released += trim_chunk((mchunkptr)u, chunksize(u), release);
+      u = u->fd;
+    } while (u != t);
+    released += trim_tree(t->child[0], release);
+    t = t->child[1];
+  }
+  return released;
+}
+
+#if LJ_ALLOC_SLAB
+/* Release the free pages of all slab arenas. Reused pages drop out of
+** the released part of the free page stack.
+*/
+static size_t trim_slabs(mstate m, int release)
+{
+  size_t released = 0;
+  slab_arena *a;
+  for (a = m->arenas; a != NULL; a = a->next) {
+    if (!release) {
+      released += a->nclean * SLAB_PAGESIZE;
+      continue;
+    }
+    for (; a->nclean < a->nfree; a->nclean++) {
+      CALL_MRELEASE((char *)a + a->freepage[a->nclean] * SLAB_PAGESIZE,
+		    SLAB_PAGESIZE);
+      released += SLAB_PAGESIZE;
+    }
+  }
+  return released;
+}
+#endif
+
+/* Release the pages inside the free chunks of at least one page, i.e.
+** the big chunks in the tree bins, the designated victim chunk and the
+** top chunk, and the free slab pages. Small chunks are skipped. Or, if
+** release is 0, sum up the bytes that are still released.
+*/
+static size_t trim_free(mstate m, int release)
+{
+  size_t released = 0;
+  bindex_t i;
+  for (i = 0; i < NTREEBINS; i++)
+    released += trim_tree(*treebin_at(m, i), release);
+  if (m->dv)
+    released += trim_chunk(m->dv, m->dvsize, release);
+  if (m->top)
+    released += trim_chunk(m->top, m->topsize, release);
+#if LJ_ALLOC_SLAB
+  released += trim_slabs(m, release);
+#endif
+  return released;
+}
+
+/* Return free memory to the OS. Shrinks or unmaps segments, where
+** possible, then releases the pages inside the remaining free memory.
+*/
+static size_t trim_all(mstate m)
+{
+  size_t released = m->footprint;
+  alloc_trim(m, 0);
+  released -= m->footprint;
+  return released + trim_free(m, 1);
+}
+
 /* ---------------------------- malloc support --------------------------- */
 
 /* allocate a large request from the best fitting chunk in a treebin */
@@ -1181,8 +1416,8 @@ static void *tmalloc_large(mstate m, size_t nb)
     if (rsize < MIN_CHUNK_SIZE) {
       set_inuse_and_pinuse(m, v, (rsize + nb));
     } else {
+      set_remainder_of_free_chunk(r, rsize, v);
       set_size_and_pinuse_of_inuse_chunk(m, v, nb);
-      set_size_and_pinuse_of_free_chunk(r, rsize);
       insert_chunk(m, r, rsize);
     }
     return chunk2mem(v);
@@ -1214,8 +1449,8 @@ static void *tmalloc_small(mstate m, size_t nb)
   if (rsize < MIN_CHUNK_SIZE) {
     set_inuse_and_pinuse(m, v, (rsize + nb));
   } else {
+    set_remainder_of_free_chunk(r, rsize, v);
     set_size_and_pinuse_of_inuse_chunk(m, v, nb);
-    set_size_and_pinuse_of_free_chunk(r, rsize);
     replace_dv(m, r, rsize);
   }
   return chunk2mem(v);
@@ -1239,6 +1474,7 @@ void *lj_alloc_create(PRNGState *rs)
     msp->head = (msize|PINUSE_BIT|CINUSE_BIT);
     m->seg.base = tbase;
     m->seg.size = tsize;
+    m->footprint = tsize;
     m->release_checks = MAX_RELEASE_CHECK_RATE;
     init_bins(m);
     mn = next_chunk(mem2chunk(m));
@@ -1258,6 +1494,14 @@ void lj_alloc_destroy(void *msp)
 {
   mstate ms = (mstate)msp;
   msegmentptr sp = &ms->seg;
+#if LJ_ALLOC_SLAB
+  slab_arena *a = ms->arenas;
+  while (a != NULL) {
+    slab_arena *next = a->next;
+    CALL_MUNMAP(a, SLAB_ARENASIZE);
+    a = next;
+  }
+#endif
   while (sp != 0) {
     char *base = sp->base;
     size_t size = sp->size;
@@ -1266,6 +1510,30 @@ void lj_alloc_destroy(void *msp)
   }
 }
 
+size_t lj_alloc_trim(void *msp)
+{
+  return trim_all((mstate)msp);
+}
+
+void lj_alloc_stats(void *msp, size_t *mapped, size_t *released)
+{
+  mstate ms = (mstate)msp;
+  *mapped = ms->footprint;
+  *released = trim_free(ms, 0);
+}
+
+int lj_alloc_sethuge(void *msp, int on)
+{
+#if LJ_ALLOC_HUGEPAGE
+  mstate ms = (mstate)msp;
+  ms->hugepage = on;
+  return 1;
+#else
+  UNUSED(msp);
+  return !on;
+#endif
+}
+
 static LJ_NOINLINE void *lj_alloc_malloc(void *msp, size_t nsize)
 {
   mstate ms = (mstate)msp;
@@ -1327,7 +1595,7 @@ static LJ_NOINLINE void *lj_alloc_malloc(void *msp, size_t nsize)
     if (rsize >= MIN_CHUNK_SIZE) { /* split dv */
       mchunkptr r = ms->dv = chunk_plus_offset(p, nb);
       ms->dvsize = rsize;
-      set_size_and_pinuse_of_free_chunk(r, rsize);
+      set_remainder_of_free_chunk(r, rsize, p);
       set_size_and_pinuse_of_inuse_chunk(ms, p, nb);
     } else { /* exhaust dv */
       size_t dvs = ms->dvsize;
@@ -1341,7 +1609,7 @@ static LJ_NOINLINE void *lj_alloc_malloc(void *msp, size_t nsize)
     size_t rsize = ms->topsize -= nb;
     mchunkptr p = ms->top;
     mchunkptr r = ms->top = chunk_plus_offset(p, nb);
-    r->head = rsize | PINUSE_BIT;
+    r->head = rsize | PINUSE_BIT | (p->head & RELEASED_BIT);
     set_size_and_pinuse_of_inuse_chunk(ms, p, nb);
     mem = chunk2mem(p);
     return mem;
@@ -1361,7 +1629,8 @@ static LJ_NOINLINE void *lj_alloc_free(void *msp, void *ptr)
       if ((prevsize & IS_DIRECT_BIT) != 0) {
 	prevsize &= ~IS_DIRECT_BIT;
 	psize += prevsize + DIRECT_FOOT_PAD;
-	CALL_MUNMAP((char *)p - prevsize, psize);
+	if (CALL_MUNMAP((char *)p - prevsize, psize) == 0)
+	  fm->footprint -= psize;
 	return NULL;
       } else {
 	mchunkptr prev = chunk_minus_offset(p, prevsize);
@@ -1434,7 +1703,7 @@ static LJ_NOINLINE void *lj_alloc_realloc(void *msp, void *ptr, size_t nsize)
 
     /* Try to either shrink or extend into top. Else malloc-copy-free */
     if (is_direct(oldp)) {
-      newp = direct_resize(oldp, nb);  /* this may return NULL. */
+      newp = direct_resize(m, oldp, nb);  /* this may return NULL. */
     } else if (oldsize >= nb) { /* already big enough */
       size_t rsize = oldsize - nb;
       newp = oldp;
@@ -1449,8 +1718,9 @@ static LJ_NOINLINE void *lj_alloc_realloc(void *msp, void *ptr, size_t nsize)
       size_t newsize = oldsize + m->topsize;
       size_t newtopsize = newsize - nb;
       mchunkptr newtop = chunk_plus_offset(oldp, nb);
+      size_t rel = m->top->head & RELEASED_BIT;
       set_inuse(m, oldp, nb);
-      newtop->head = newtopsize |PINUSE_BIT;
+      newtop->head = newtopsize | PINUSE_BIT | rel;
       m->top = newtop;
       m->topsize = newtopsize;
       newp = oldp;
@@ -1470,9 +1740,172 @@ static LJ_NOINLINE void *lj_alloc_realloc(void *msp, void *ptr, size_t nsize)
   }
 }
 
+#if LJ_ALLOC_SLAB
+/* -------------------------- Slab allocator ----------------------------- */
+
+/* Requests up to SLAB_MAXSIZE bytes are served from segregated size
+** classes in multiples of 8 bytes. There's no per-object header. Each
+** 4K page holds slots of a single size class and a bitmap of the free
+** slots. Pages are carved from 1MB arenas, which are mapped directly.
+**
+** The object size is derived from the old size passed to lj_alloc_f,
+** so every object up to SLAB_MAXSIZE bytes must come from a slab.
+** Empty pages go back to their arena. Empty arenas are unmapped, except
+** for the last one. The arena header in the first page keeps a stack of
+** free pages, so they can be released to the OS while still mapped.
+*/
+
+#define slab_class(sz)		(((sz) - 1) >> SLAB_SHIFT)
+#define slab_page_of(p) \
+  ((slab_page *)((uintptr_t)(p) & ~(uintptr_t)(SLAB_PAGESIZE-1)))
+
+/* Get a free page from an arena. */
+static slab_page *slab_newpage(mstate m, size_t size)
+{
+  slab_arena *a = m->avail;
+  slab_page *pg;
+  uint32_t i, n;
+  if (a == NULL) {  /* Map a new arena. Its first page holds the header. */
+    a = (slab_arena *)CALL_MMAP(m->prng, SLAB_ARENASIZE);
+    if (a == MFAIL) return NULL;
+    m->footprint += SLAB_ARENASIZE;
+    a->nfree = a->nclean = 0;
+    a->nused = 0;
+    a->ntouched = 1;
+    a->prev = NULL;
+    a->next = m->arenas;
+    if (a->next) a->next->prev = a;
+    m->arenas = a;
+    a->aprev = NULL;
+    a->anext = NULL;
+    m->avail = a;
+  }
+  if (a->nfree) {
+    pg = (slab_page *)((char *)a + a->freepage[--a->nfree] * SLAB_PAGESIZE);
+    if (a->nclean > a->nfree) a->nclean = a->nfree;
+  } else {
+    pg = (slab_page *)((char *)a + a->ntouched++ * SLAB_PAGESIZE);
+  }
+  if (++a->nused == SLAB_ARENAPAGES-1) {  /* Arena is full. */
+    m->avail = a->anext;
+    if (a->anext) a->anext->aprev = NULL;
+  }
+  pg->arena = a;
+  pg->size = (uint16_t)size;
+  pg->nslots = n = (uint16_t)((SLAB_PAGESIZE - SLAB_HDRSIZE) / size);
+  pg->nfree = (uint16_t)n;
+  pg->hint = 0;
+  for (i = 0; i < SLAB_MAPWORDS; i++, n -= n >= 32 ? 32 : n)
+    pg->freemap[i] = n >= 32 ? ~0u : (1u << n) - 1;
+  pg->next = pg->prev = NULL;
+  return pg;
+}
+
+/* Return an empty page to its arena. */
+static void slab_freepage(mstate m, slab_page *pg)
+{
+  slab_arena *a = pg->arena;
+  if (a->nused-- == SLAB_ARENAPAGES-1) {  /* Arena has free pages again. */
+    a->aprev = NULL;
+    a->anext = m->avail;
+    if (a->anext) a->anext->aprev = a;
+    m->avail = a;
+  }
+  if (a->nused == 0 && (a->next || a->prev)) {  /* Unmap an empty arena. */
+    if (a->anext) a->anext->aprev = a->aprev;
+    if (a->aprev) a->aprev->anext = a->anext; else m->avail = a->anext;
+    if (a->next) a->next->prev = a->prev;
+    if (a->prev) a->prev->next = a->next; else m->arenas = a->next;
+    if (CALL_MUNMAP(a, SLAB_ARENASIZE) == 0)
+      m->footprint -= SLAB_ARENASIZE;
+  } else {
+    a->freepage[a->nfree++] =
+      (uint16_t)(((char *)pg - (char *)a) / SLAB_PAGESIZE);
+  }
+}
+
+static LJ_AINLINE void *slab_malloc(mstate m, size_t nsize)
+{
+  size_t cls = slab_class(nsize);
+  slab_page *pg = m->slab[cls];
+  uint32_t w, b;
+  if (LJ_UNLIKELY(pg == NULL)) {
+    pg = slab_newpage(m, (cls+1) << SLAB_SHIFT);
+    if (pg == NULL) return NULL;
+    m->slab[cls] = pg;
+  }
+  for (w = pg->hint; pg->freemap[w] == 0; w++) ;
+  b = lj_ffs(pg->freemap[w]);
+  pg->freemap[w] &= ~(1u << b);
+  pg->hint = (uint16_t)w;
+  if (--pg->nfree == 0) {  /* Page is full. */
+    m->slab[cls] = pg->next;
+    if (pg->next) pg->next->prev = NULL;
+    pg->next = NULL;
+  }
+  return (char *)pg + SLAB_HDRSIZE + (size_t)(w*32+b) * pg->size;
+}
+
+static LJ_AINLINE void slab_free(mstate m, void *ptr)
+{
+  slab_page *pg = slab_page_of(ptr);
+  uint32_t idx = (uint32_t)((char *)ptr - (char *)pg - SLAB_HDRSIZE) /
+		 pg->size;
+  pg->freemap[idx >> 5] |= 1u << (idx & 31);
+  if ((idx >> 5) < pg->hint) pg->hint = (uint16_t)(idx >> 5);
+  if (pg->nfree++ == 0) {  /* Page has free slots again. */
+    size_t cls = slab_class(pg->size);
+    pg->prev = NULL;
+    pg->next = m->slab[cls];
+    if (pg->next) pg->next->prev = pg;
+    m->slab[cls] = pg;
+  } else if (pg->nfree == pg->nslots && (pg->next || pg->prev)) {
+    /* Free an empty page, unless it's the last one of its class. */
+    if (pg->next) pg->next->prev = pg->prev;
+    if (pg->prev) pg->prev->next = pg->next;
+    else m->slab[slab_class(pg->size)] = pg->next;
+    slab_freepage(m, pg);
+  }
+}
+
+/* Reallocate a slab object. Or a bigger block that's shrunk to a slab. */
+static void *slab_realloc(mstate m, void *ptr, size_t osize, size_t nsize)
+{
+  void *nptr;
+  if (osize <= SLAB_MAXSIZE && nsize <= SLAB_MAXSIZE &&
+      slab_class(osize) == slab_class(nsize))
+    return ptr;  /* Same size class. */
+  nptr = nsize <= SLAB_MAXSIZE ? slab_malloc(m, nsize) :
+				 lj_alloc_malloc(m, nsize);
+  if (nptr != NULL) {
+    memcpy(nptr, ptr, osize < nsize ? osize : nsize);
+    if (osize <= SLAB_MAXSIZE)
+      slab_free(m, ptr);
+    else
+      lj_alloc_free(m, ptr);
+  }
+  return nptr;
+}
+#endif
+
 void *lj_alloc_f(void *msp, void *ptr, size_t osize, size_t nsize)
 {
+#if LJ_ALLOC_SLAB
+  if (ptr == NULL) {
+    if (nsize != 0 && nsize <= SLAB_MAXSIZE)
+      return slab_malloc((mstate)msp, nsize);
+  } else if (osize <= SLAB_MAXSIZE) {
+    if (nsize == 0) {
+      slab_free((mstate)msp, ptr);
+      return NULL;
+    }
+    return slab_realloc((mstate)msp, ptr, osize, nsize);
+  } else if (nsize != 0 && nsize <= SLAB_MAXSIZE) {
+    return slab_realloc((mstate)msp, ptr, osize, nsize);
+  }
+#else
   (void)osize;
+#endif
   if (nsize == 0) {
     return lj_alloc_free(msp, ptr);
   } else if (ptr == NULL) {
@@ -13,6 +13,9 @@ LJ_FUNC void *lj_alloc_create(PRNGState *rs);
 LJ_FUNC void lj_alloc_setprng(void *msp, PRNGState *rs);
 LJ_FUNC void lj_alloc_destroy(void *msp);
 LJ_FUNC void *lj_alloc_f(void *msp, void *ptr, size_t osize, size_t nsize);
+LJ_FUNC size_t lj_alloc_trim(void *msp);
+LJ_FUNC void lj_alloc_stats(void *msp, size_t *mapped, size_t *released);
+LJ_FUNC int lj_alloc_sethuge(void *msp, int on);
 #endif
 
 #endif
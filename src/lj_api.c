@@ -15,6 +15,7 @@
 #include "lj_debug.h"
 #include "lj_str.h"
 #include "lj_tab.h"
+#include "lj_frozen.h"
 #include "lj_func.h"
 #include "lj_udata.h"
 #include "lj_meta.h"
@@ -25,6 +26,7 @@
 #include "lj_vm.h"
 #include "lj_strscan.h"
 #include "lj_strfmt.h"
+#include "luajit.h"
 
 /* -- Common helper functions --------------------------------------------- */
 
@@ -305,6 +307,10 @@ LUA_API int lua_equal(lua_State *L, int idx1, int idx2)
 #endif
   } else if (gcrefeq(o1->gcr, o2->gcr)) {
     return 1;
+#if LJ_HASLAZYSTR
+  } else if (tvisstr(o1)) {
+    return lj_str_eqlazy(strV(o1), strV(o2));
+#endif
   } else if (!tvistabud(o1)) {
     return 0;
   } else {
@@ -827,6 +833,13 @@ LUA_API void lua_rawget(lua_State *L, int idx)
 {
   cTValue *t = index2adr(L, idx);
   lj_checkapi(tvistab(t), "stack slot %d is not a table", idx);
+#if LJ_HASFROZEN
+  if (tabisfrozen(tabV(t))) {
+    cTValue *v = lj_frozen_find(tabV(t), L->top-1);
+    if (v) lj_frozen_copy(L, L->top-1, v); else setnilV(L->top-1);
+    return;
+  }
+#endif
   copyTV(L, L->top-1, lj_tab_get(L, tabV(t), L->top-1));
 }
 
@@ -834,6 +847,14 @@ LUA_API void lua_rawgeti(lua_State *L, int idx, int n)
 {
   cTValue *v, *t = index2adr(L, idx);
   lj_checkapi(tvistab(t), "stack slot %d is not a table", idx);
+#if LJ_HASFROZEN
+  if (tabisfrozen(tabV(t))) {
+    v = lj_frozen_getint(tabV(t), n);
+    if (v) lj_frozen_copy(L, L->top, v); else setnilV(L->top);
+    incr_top(L);
+    return;
+  }
+#endif
   v = lj_tab_getint(tabV(t), n);
   if (v) {
     copyTV(L, L->top, v);
@@ -853,8 +874,8 @@ LUA_API int lua_getmetatable(lua_State *L, int idx)
     mt = tabref(udataV(o)->metatable);
   else
     mt = tabref(basemt_obj(G(L), o));
-  if (mt == NULL)
-    return 0;
+  if (mt == NULL || (tvistab(o) && tabisfrozen(tabV(o))))
+    return 0;  /* The marker metatable of frozen tables is hidden. */
   settabV(L, L->top, mt);
   incr_top(L);
   return 1;
@@ -893,6 +914,18 @@ LUA_API int lua_next(lua_State *L, int idx)
   cTValue *t = index2adr(L, idx);
   int more;
   lj_checkapi(tvistab(t), "stack slot %d is not a table", idx);
+#if LJ_HASFROZEN
+  if (tabisfrozen(tabV(t))) {
+    /* Copying strings may allocate, so keep the key until done. */
+    TValue *o = L->top;
+    copyTV(L, o, o-1);
+    setnilV(o+1);
+    L->top += 2;
+    more = lj_frozen_next(L, tabV(t), o, o);
+    L->top -= 2;
+    if (more > 0) { copyTV(L, o-1, o); copyTV(L, o, o+1); }
+  } else
+#endif
   more = lj_tab_next(tabV(t), L->top-1, L->top-1);
   if (more > 0) {
     incr_top(L);  /* Return new key and value slot. */
@@ -1035,6 +1068,12 @@ LUA_API int lua_setmetatable(lua_State *L, int idx)
     mt = tabV(L->top-1);
   }
   g = G(L);
+#if LJ_HASFROZEN
+  if (tvistab(o) && tabisfrozen(tabV(o)))
+    lj_err_msg(L, LJ_ERR_FROZEN);
+  if (mt && tabisfrozen(mt))
+    lj_err_msg(L, LJ_ERR_FRZMT);
+#endif
   if (tvistab(o)) {
     setgcref(tabV(o)->metatable, obj2gco(mt));
     if (mt)
@@ -1291,12 +1330,109 @@ LUA_API int lua_gc(lua_State *L, int what, int data)
   case LUA_GCISRUNNING:
     res = (g->gc.threshold != LJ_MAX_MEM);
     break;
+  case LUA_GCGEN:
+  case LUA_GCINC:
+    res = lj_gc_setmode(L, what == LUA_GCGEN, (MSize)data) ?
+	  LUA_GCGEN : LUA_GCINC;
+    break;
+  case LUA_GCBUDGET:
+    res = (int)(g->gc.budget);
+    g->gc.budget = data > 0 ? (MSize)data : 0;
+    break;
+  case LUA_GCTRIM:
+    res = (int)(lj_gc_trim(g) >> 10);
+    break;
+  case LUA_GCSWEEPTHREADS:
+    res = (int)(g->gc.sweepthreads);
+    g->gc.sweepthreads = (uint8_t)(data <= 0 ? 0 :
+	data < LJ_GC_SWEEPTHREADS ? data : LJ_GC_SWEEPTHREADS);
+    break;
   default:
     res = -1;  /* Invalid option. */
   }
   return res;
 }
 
+LUA_API void luaJIT_gc_stats(lua_State *L, luaJIT_gcstats *gs)
+{
+  GCStats *st = &G(L)->gc.stats;
+  int i;
+  LJ_STATIC_ASSERT(LUAJIT_GCHIST == LJ_GCHIST);
+  gs->mode = G(L)->gc.gen ? LUA_GCGEN : LUA_GCINC;
+  gs->minor = (size_t)st->minornum;
+  gs->major = (size_t)st->majornum;
+  gs->minortime = (double)st->minortime * 1e-3;
+  gs->majortime = (double)st->majortime * 1e-3;
+  gs->minormax = (double)st->minormax * 1e-3;
+  gs->majormax = (double)st->majormax * 1e-3;
+  gs->budget = (int)G(L)->gc.budget;
+  lj_gc_memstats(G(L), &gs->mapped, &gs->released);
+  gs->retained = gs->mapped > G(L)->gc.total + gs->released ?
+		 gs->mapped - G(L)->gc.total - gs->released : 0;
+  for (i = 0; i < LUAJIT_GCHIST; i++)
+    gs->hist[i] = (size_t)st->hist[i];
+}
+
+LUA_API void luaJIT_heap_stats(lua_State *L, luaJIT_heapstats *hs)
+{
+  GCState *gc = &G(L)->gc;
+  GCSize other = gc->total;
+  int i;
+  LJ_STATIC_ASSERT((int)LUAJIT_HEAP_OTHER == (int)LJ_HEAP__MAX);
+  for (i = 0; i < LJ_HEAP__MAX; i++) {
+    hs->bytes[i] = (size_t)gc->heapbytes[i];
+    hs->num[i] = i < LJ_HEAP_NOBJ ? (size_t)gc->heapnum[i] : 0;
+    other -= gc->heapbytes[i];
+  }
+  hs->bytes[LUAJIT_HEAP_OTHER] = (size_t)other;
+  hs->num[LUAJIT_HEAP_OTHER] = 0;
+  hs->total = (size_t)gc->total;
+}
+
+LUA_API int luaJIT_heap_snapshot(lua_State *L, lua_Writer writer, void *data)
+{
+  lj_gc_fullgc(L);  /* Don't dump garbage. */
+  return lj_gc_snapshot(L, writer, data);
+}
+
+#if LJ_HASFROZEN
+LUA_API luaJIT_frozen *luaJIT_frozen_new(lua_State *L, int idx)
+{
+  cTValue *o = index2adr(L, idx);
+  lj_checkapi(tvistab(o), "stack slot %d is not a table", idx);
+  return lj_frozen_new(L, tabV(o));
+}
+
+LUA_API void luaJIT_frozen_push(lua_State *L, luaJIT_frozen *fz)
+{
+  settabV(L, L->top, lj_frozen_attach(L, fz));
+  incr_top(L);
+}
+
+LUA_API void luaJIT_frozen_release(luaJIT_frozen *fz)
+{
+  lj_frozen_release(fz);
+}
+#else
+LUA_API luaJIT_frozen *luaJIT_frozen_new(lua_State *L, int idx)
+{
+  UNUSED(L); UNUSED(idx);
+  return NULL;  /* Not supported by this build. */
+}
+
+LUA_API void luaJIT_frozen_push(lua_State *L, luaJIT_frozen *fz)
+{
+  UNUSED(fz);
+  setnilV(L->top);
+  incr_top(L);
+}
+
+LUA_API void luaJIT_frozen_release(luaJIT_frozen *fz)
+{
+  UNUSED(fz);
+}
+#endif
+
 LUA_API lua_Alloc lua_getallocf(lua_State *L, void **ud)
 {
   global_State *g = G(L);
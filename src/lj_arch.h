@@ -594,6 +594,47 @@
 #define LJ_HASPROFILE		0
 #endif
 
+/* Enable parallel sweeping of the string table for full GCs. */
+#if !defined(LUAJIT_ENABLE_PSWEEP)
+#define LJ_HASPSWEEP		0
+#elif LJ_TARGET_POSIX
+#define LJ_HASPSWEEP		1
+#define LJ_PSWEEP_PTHREAD	1
+#elif LJ_TARGET_WINDOWS
+#define LJ_HASPSWEEP		1
+#define LJ_PSWEEP_WTHREAD	1
+#else
+#define LJ_HASPSWEEP		0
+#endif
+
+/* Enable lazy (non-interned) long strings. Only the x64 GC64 VM has them. */
+#if defined(LUAJIT_ENABLE_LAZYSTR) && LJ_TARGET_X64 && LJ_GC64
+#define LJ_HASLAZYSTR		1
+#else
+#define LJ_HASLAZYSTR		0
+#endif
+
+/* Enable table presizing from allocation site feedback. */
+#if defined(LUAJIT_DISABLE_TABSITE)
+#define LJ_HASTABSITE		0
+#else
+#define LJ_HASTABSITE		1
+#endif
+
+/* Enable table shapes. Only the GC64 VM has room for them in GCtab. */
+#if LJ_HASJIT && LJ_GC64 && !defined(LUAJIT_DISABLE_TABSHAPE)
+#define LJ_HASTABSHAPE		1
+#else
+#define LJ_HASTABSHAPE		0
+#endif
+
+/* Enable frozen tables. Only the x64 GC64 VM knows how to handle them. */
+#if LJ_TARGET_X64 && LJ_GC64 && !defined(LUAJIT_DISABLE_FROZEN)
+#define LJ_HASFROZEN		1
+#else
+#define LJ_HASFROZEN		0
+#endif
+
 #ifndef LJ_ARCH_HASFPU
 #define LJ_ARCH_HASFPU		1
 #endif
@@ -887,7 +887,7 @@ static int asm_sunk_store(ASMState *as, IRIns *ira, IRIns *irs)
 {
   if (irs->s == 255) {
     if (irs->o == IR_ASTORE || irs->o == IR_HSTORE ||
-	irs->o == IR_FSTORE || irs->o == IR_XSTORE) {
+	irs->o == IR_FSTORE || irs->o == IR_XSTORE || irs->o == IR_USTORE) {
       IRIns *irk = IR(irs->op1);
       if (irk->o == IR_AREF || irk->o == IR_HREFK)
 	irk = IR(irk->op1);
@@ -916,14 +916,18 @@ static void asm_snap_alloc1(ASMState *as, IRRef ref)
 	  asm_snap_alloc1(as, (ir+1)->op2);
       } else
 #endif
-      {  /* Allocate stored values for TNEW, TDUP and CNEW. */
+      {  /* Allocate stored values for TNEW, TDUP, FNEW and CNEW. */
 	IRIns *irs;
-	lj_assertA(ir->o == IR_TNEW || ir->o == IR_TDUP || ir->o == IR_CNEW,
+	lj_assertA(ir->o == IR_TNEW || ir->o == IR_TDUP ||
+		   ir->o == IR_FNEW || ir->o == IR_CNEW,
 		   "sink of IR %04d has bad op %d", ref - REF_BIAS, ir->o);
+	if (ir->o == IR_FNEW)
+	  asm_snap_alloc1(as, ir->op2);  /* Allocate parent closure. */
 	for (irs = IR(as->snapref-1); irs > ir; irs--)
 	  if (irs->r == RID_SINK && asm_sunk_store(as, ir, irs)) {
 	    lj_assertA(irs->o == IR_ASTORE || irs->o == IR_HSTORE ||
-		       irs->o == IR_FSTORE || irs->o == IR_XSTORE,
+		       irs->o == IR_FSTORE || irs->o == IR_XSTORE ||
+		       irs->o == IR_USTORE,
 		       "sunk store IR %04d has bad op %d",
 		       (int)(irs - as->ir) - REF_BIAS, irs->o);
 	    asm_snap_alloc1(as, irs->op2);
@@ -1126,6 +1130,19 @@ static void asm_tdup(ASMState *as, IRIns *ir)
   asm_gencall(as, ci, args);
 }
 
+static void asm_fnew(ASMState *as, IRIns *ir)
+{
+  const CCallInfo *ci = &lj_ir_callinfo[IRCALL_lj_func_newL_closed];
+  IRRef args[3];
+  asm_snap_prep(as);
+  args[0] = ASMREF_L;  /* lua_State *L    */
+  args[1] = ir->op1;   /* GCproto *pt     */
+  args[2] = ir->op2;   /* GCfuncL *parent */
+  as->gcsteps++;
+  asm_setupresult(as, ir, ci);  /* GCfunc * */
+  asm_gencall(as, ci, args);
+}
+
 static void asm_gc_check(ASMState *as);
 
 /* Explicit GC step. */
@@ -1133,7 +1150,7 @@ static void asm_gcstep(ASMState *as, IRIns *ir)
 {
   IRIns *ira;
   for (ira = IR(as->stopins+1); ira < ir; ira++)
-    if ((ira->o == IR_TNEW || ira->o == IR_TDUP ||
+    if ((ira->o == IR_TNEW || ira->o == IR_TDUP || ira->o == IR_FNEW ||
 	 (LJ_HASFFI && (ira->o == IR_CNEW || ira->o == IR_CNEWI))) &&
 	ra_used(ira))
       as->gcsteps++;
@@ -1822,6 +1839,7 @@ static void asm_ir(ASMState *as, IRIns *ir)
   case IR_SNEW: case IR_XSNEW: asm_snew(as, ir); break;
   case IR_TNEW: asm_tnew(as, ir); break;
   case IR_TDUP: asm_tdup(as, ir); break;
+  case IR_FNEW: asm_fnew(as, ir); break;
   case IR_CNEW: case IR_CNEWI:
 #if LJ_HASFFI
     asm_cnew(as, ir);
@@ -2275,7 +2293,7 @@ static void asm_setup_regsp(ASMState *as)
 #endif
     /* fallthrough */
     /* C calls evict all scratch regs and return results in RID_RET. */
-    case IR_SNEW: case IR_XSNEW: case IR_NEWREF: case IR_BUFPUT:
+    case IR_SNEW: case IR_XSNEW: case IR_NEWREF: case IR_BUFPUT: case IR_FNEW:
       if (REGARG_NUMGPR < 3 && as->evenspill < 3)
 	as->evenspill = 3;  /* lj_str_new and lj_tab_newkey need 3 args. */
 #if LJ_TARGET_X86 && LJ_HASFFI
@@ -2410,6 +2428,7 @@ void lj_asm_trace(jit_State *J, GCtrace *T)
 {
   ASMState as_;
   ASMState *as = &as_;
+  MCode *mcres;
 
   /* Remove nops/renames left over from ASM restart due to LJ_TRERR_MCODELM. */
   {
@@ -2441,6 +2460,8 @@ void lj_asm_trace(jit_State *J, GCtrace *T)
   as->mcp = as->mctop;
   as->mclim = as->mcbot + MCLIM_REDZONE;
   asm_setup_target(as);
+  /* Eviction releases the trace mcode up to here, but not stubs above. */
+  mcres = as->mctop;
 
   /*
   ** This is a loop, because the MCode may have to be (re-)assembled
@@ -2559,6 +2580,7 @@ void lj_asm_trace(jit_State *J, GCtrace *T)
   else
     asm_tail_fixup(as, T->link);  /* Note: this may change as->mctop! */
   T->szmcode = (MSize)((char *)as->mctop - (char *)as->mcp);
+  T->szmcres = (MSize)((char *)mcres - (char *)as->mcp);
   asm_snap_fixup_mcofs(as);
 #if LJ_TARGET_MCODE_FIXUP
   asm_mcode_fixup(T->mcode, T->szmcode);
@@ -490,8 +490,10 @@ static void asm_callx(ASMState *as, IRIns *ir)
 static void asm_retf(ASMState *as, IRIns *ir)
 {
   Reg base = ra_alloc1(as, REF_BASE, RSET_GPR);
-  void *pc = ir_kptr(IR(ir->op2));
-  int32_t delta = 1+LJ_FR2+bc_a(*((const BCIns *)pc - 1));
+  void *pc = irt_isguard(ir->t) ? ir_kptr(IR(ir->op2)) : NULL;
+  /* Without a guard, the frames to pop have already been checked. */
+  int32_t delta = pc ? (int32_t)(1+LJ_FR2+bc_a(*((const BCIns *)pc - 1))) :
+		       (int32_t)IR(ir->op2)->i;
   as->topslot -= (BCReg)delta;
   if ((int32_t)as->topslot < 0) as->topslot = 0;
   irt_setmark(IR(REF_BASE)->t);  /* Children must not coalesce with BASE reg. */
@@ -499,10 +501,12 @@ static void asm_retf(ASMState *as, IRIns *ir)
   emit_lso(as, ARMI_STR, base, RID_SP, ra_spill(as, IR(REF_BASE)));
   emit_setgl(as, base, jit_base);
   emit_addptr(as, base, -8*delta);
-  asm_guardcc(as, CC_NE);
-  emit_nm(as, ARMI_CMP, RID_TMP,
-	  ra_allock(as, i32ptr(pc), rset_exclude(RSET_GPR, base)));
-  emit_lso(as, ARMI_LDR, RID_TMP, base, -4);
+  if (pc) {
+    asm_guardcc(as, CC_NE);
+    emit_nm(as, ARMI_CMP, RID_TMP,
+	    ra_allock(as, i32ptr(pc), rset_exclude(RSET_GPR, base)));
+    emit_lso(as, ARMI_LDR, RID_TMP, base, -4);
+  }
 }
 
 /* -- Buffer operations --------------------------------------------------- */
@@ -977,11 +981,14 @@ static void asm_uref(ASMState *as, IRIns *ir)
     Reg uv = ra_scratch(as, RSET_GPR);
     Reg func = ra_alloc1(as, ir->op1, RSET_GPR);
     if (ir->o == IR_UREFC) {
-      asm_guardcc(as, CC_NE);
-      emit_n(as, ARMI_CMP|ARMI_K12|1, RID_TMP);
       emit_opk(as, ARMI_ADD, dest, uv,
 	       (int32_t)offsetof(GCupval, tv), RSET_GPR);
-      emit_lso(as, ARMI_LDRB, RID_TMP, uv, (int32_t)offsetof(GCupval, closed));
+      if (irt_isguard(ir->t)) {  /* Closures created on trace need no check. */
+	asm_guardcc(as, CC_NE);
+	emit_n(as, ARMI_CMP|ARMI_K12|1, RID_TMP);
+	emit_lso(as, ARMI_LDRB, RID_TMP, uv,
+		 (int32_t)offsetof(GCupval, closed));
+      }
     } else {
       emit_lso(as, ARMI_LDR, dest, uv, (int32_t)offsetof(GCupval, v));
     }
@@ -1288,7 +1295,7 @@ static void asm_cnew(ASMState *as, IRIns *ir)
   CTypeID id = (CTypeID)IR(ir->op1)->i;
   CTSize sz;
   CTInfo info = lj_ctype_info(cts, id, &sz);
-  const CCallInfo *ci = &lj_ir_callinfo[IRCALL_lj_mem_newgco];
+  const CCallInfo *ci = &lj_ir_callinfo[IRCALL_lj_cdata_newgco];
   IRRef args[4];
   RegSet allow = (RSET_GPR & ~RSET_SCRATCH);
   RegSet drop = RSET_SCRATCH;
@@ -1328,7 +1335,7 @@ static void asm_cnew(ASMState *as, IRIns *ir)
     return;
   }
 
-  /* Initialize gct and ctypeid. lj_mem_newgco() already sets marked. */
+  /* Initialize gct and ctypeid. lj_cdata_newgco() already sets marked. */
   {
     uint32_t k = emit_isk12(ARMI_MOV, id);
     Reg r = k ? RID_R1 : ra_allock(as, id, allow);
@@ -378,17 +378,21 @@ static void asm_callx(ASMState *as, IRIns *ir)
 static void asm_retf(ASMState *as, IRIns *ir)
 {
   Reg base = ra_alloc1(as, REF_BASE, RSET_GPR);
-  void *pc = ir_kptr(IR(ir->op2));
-  int32_t delta = 1+LJ_FR2+bc_a(*((const BCIns *)pc - 1));
+  void *pc = irt_isguard(ir->t) ? ir_kptr(IR(ir->op2)) : NULL;
+  /* Without a guard, the frames to pop have already been checked. */
+  int32_t delta = pc ? (int32_t)(1+LJ_FR2+bc_a(*((const BCIns *)pc - 1))) :
+		       (int32_t)IR(ir->op2)->i;
   as->topslot -= (BCReg)delta;
   if ((int32_t)as->topslot < 0) as->topslot = 0;
   irt_setmark(IR(REF_BASE)->t);  /* Children must not coalesce with BASE reg. */
   emit_setgl(as, base, jit_base);
   emit_addptr(as, base, -8*delta);
-  asm_guardcc(as, CC_NE);
-  emit_ab(as, PPCI_CMPW, RID_TMP,
-	  ra_allock(as, i32ptr(pc), rset_exclude(RSET_GPR, base)));
-  emit_tai(as, PPCI_LWZ, RID_TMP, base, -8);
+  if (pc) {
+    asm_guardcc(as, CC_NE);
+    emit_ab(as, PPCI_CMPW, RID_TMP,
+	    ra_allock(as, i32ptr(pc), rset_exclude(RSET_GPR, base)));
+    emit_tai(as, PPCI_LWZ, RID_TMP, base, -8);
+  }
 }
 
 /* -- Buffer operations --------------------------------------------------- */
@@ -848,10 +852,14 @@ static void asm_uref(ASMState *as, IRIns *ir)
     Reg uv = ra_scratch(as, RSET_GPR);
     Reg func = ra_alloc1(as, ir->op1, RSET_GPR);
     if (ir->o == IR_UREFC) {
-      asm_guardcc(as, CC_NE);
-      emit_ai(as, PPCI_CMPWI, RID_TMP, 1);
+      if (irt_isguard(ir->t)) {  /* Closures created on trace need no check. */
+	asm_guardcc(as, CC_NE);
+	emit_ai(as, PPCI_CMPWI, RID_TMP, 1);
+      }
       emit_tai(as, PPCI_ADDI, dest, uv, (int32_t)offsetof(GCupval, tv));
-      emit_tai(as, PPCI_LBZ, RID_TMP, uv, (int32_t)offsetof(GCupval, closed));
+      if (irt_isguard(ir->t))
+	emit_tai(as, PPCI_LBZ, RID_TMP, uv,
+		 (int32_t)offsetof(GCupval, closed));
     } else {
       emit_tai(as, PPCI_LWZ, dest, uv, (int32_t)offsetof(GCupval, v));
     }
@@ -1192,7 +1200,7 @@ static void asm_cnew(ASMState *as, IRIns *ir)
   CTypeID id = (CTypeID)IR(ir->op1)->i;
   CTSize sz;
   CTInfo info = lj_ctype_info(cts, id, &sz);
-  const CCallInfo *ci = &lj_ir_callinfo[IRCALL_lj_mem_newgco];
+  const CCallInfo *ci = &lj_ir_callinfo[IRCALL_lj_cdata_newgco];
   IRRef args[4];
   RegSet drop = RSET_SCRATCH;
   lj_assertA(sz != CTSIZE_INVALID || (ir->o == IR_CNEW && ir->op2 != REF_NIL),
@@ -1232,7 +1240,7 @@ static void asm_cnew(ASMState *as, IRIns *ir)
     return;
   }
 
-  /* Initialize gct and ctypeid. lj_mem_newgco() already sets marked. */
+  /* Initialize gct and ctypeid. lj_cdata_newgco() already sets marked. */
   emit_tai(as, PPCI_STB, RID_RET+1, RID_RET, offsetof(GCcdata, gct));
   emit_tai(as, PPCI_STH, RID_TMP, RID_RET, offsetof(GCcdata, ctypeid));
   emit_ti(as, PPCI_LI, RID_RET+1, ~LJ_TCDATA);
@@ -769,23 +769,26 @@ static void asm_callx(ASMState *as, IRIns *ir)
 static void asm_retf(ASMState *as, IRIns *ir)
 {
   Reg base = ra_alloc1(as, REF_BASE, RSET_GPR);
-#if LJ_FR2
-  Reg rpc = ra_scratch(as, rset_exclude(RSET_GPR, base));
-#endif
-  void *pc = ir_kptr(IR(ir->op2));
-  int32_t delta = 1+LJ_FR2+bc_a(*((const BCIns *)pc - 1));
+  void *pc = irt_isguard(ir->t) ? ir_kptr(IR(ir->op2)) : NULL;
+  /* Without a guard, the frames to pop have already been checked. */
+  int32_t delta = pc ? (int32_t)(1+LJ_FR2+bc_a(*((const BCIns *)pc - 1))) :
+		       (int32_t)IR(ir->op2)->i;
   as->topslot -= (BCReg)delta;
   if ((int32_t)as->topslot < 0) as->topslot = 0;
   irt_setmark(IR(REF_BASE)->t);  /* Children must not coalesce with BASE reg. */
   emit_setgl(as, base, jit_base);
   emit_addptr(as, base, -8*delta);
-  asm_guardcc(as, CC_NE);
+  if (pc) {
 #if LJ_FR2
-  emit_rmro(as, XO_CMP, rpc|REX_GC64, base, -8);
-  emit_loadu64(as, rpc, u64ptr(pc));
+    Reg rpc = ra_scratch(as, rset_exclude(RSET_GPR, base));
+    asm_guardcc(as, CC_NE);
+    emit_rmro(as, XO_CMP, rpc|REX_GC64, base, -8);
+    emit_loadu64(as, rpc, u64ptr(pc));
 #else
-  emit_gmroi(as, XG_ARITHi(XOg_CMP), base, -4, ptr2addr(pc));
+    asm_guardcc(as, CC_NE);
+    emit_gmroi(as, XG_ARITHi(XOg_CMP), base, -4, ptr2addr(pc));
 #endif
+  }
 }
 
 /* -- Buffer operations --------------------------------------------------- */
@@ -1313,6 +1316,8 @@ static void asm_hrefk(ASMState *as, IRIns *ir)
       emit_rr(as, XO_MOV, dest|REX_GC64, node);
     }
   }
+  if (!irt_isguard(ir->t))
+    return;  /* Key known to be in this slot (HREFK of TDUP or shape). */
   asm_guardcc(as, CC_NE);
 #if LJ_64
   if (!irt_ispri(irkey->t)) {
@@ -1381,9 +1386,11 @@ static void asm_uref(ASMState *as, IRIns *ir)
     Reg func = ra_alloc1(as, ir->op1, RSET_GPR);
     if (ir->o == IR_UREFC) {
       emit_rmro(as, XO_LEA, dest|REX_GC64, uv, offsetof(GCupval, tv));
-      asm_guardcc(as, CC_NE);
-      emit_i8(as, 1);
-      emit_rmro(as, XO_ARITHib, XOg_CMP, uv, offsetof(GCupval, closed));
+      if (irt_isguard(ir->t)) {  /* Closures created on trace need no check. */
+	asm_guardcc(as, CC_NE);
+	emit_i8(as, 1);
+	emit_rmro(as, XO_ARITHib, XOg_CMP, uv, offsetof(GCupval, closed));
+      }
     } else {
       emit_rmro(as, XO_MOV, dest|REX_GC64, uv, offsetof(GCupval, v));
     }
@@ -1818,7 +1825,7 @@ static void asm_cnew(ASMState *as, IRIns *ir)
   CTypeID id = (CTypeID)IR(ir->op1)->i;
   CTSize sz;
   CTInfo info = lj_ctype_info(cts, id, &sz);
-  const CCallInfo *ci = &lj_ir_callinfo[IRCALL_lj_mem_newgco];
+  const CCallInfo *ci = &lj_ir_callinfo[IRCALL_lj_cdata_newgco];
   IRRef args[4];
   lj_assertA(sz != CTSIZE_INVALID || (ir->o == IR_CNEW && ir->op2 != REF_NIL),
 	     "bad CNEW/CNEWI operands");
@@ -1877,17 +1884,6 @@ static void asm_cnew(ASMState *as, IRIns *ir)
     return;
   }
 
-#ifdef COUNTS
-  /* Increment cdatanum counter by address directly. */
-  emit_i8(as, 1);
-#if LJ_GC64
-  emit_rmro(as, XO_ARITHi8, XOg_ADD|REX_64, RID_DISPATCH,
-	    dispofs(as, &J2G(as->J)->gc.cdatanum));
-#else
-  emit_rmro(as, XO_ARITHi8, XOg_ADD, RID_NONE,
-	    ptr2addr(&J2G(as->J)->gc.cdatanum));
-#endif
-#endif
   /* Combine initialization of marked, gct and ctypeid. */
   emit_movtomro(as, RID_ECX, RID_RET, offsetof(GCcdata, marked));
   emit_gri(as, XG_ARITHi(XOg_OR), RID_ECX,
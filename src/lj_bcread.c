@@ -342,6 +342,7 @@ GCproto *lj_bcread_proto(LexState *ls)
 
   /* Allocate prototype object and initialize its fields. */
   pt = (GCproto *)lj_mem_newgco(ls->L, (MSize)sizept);
+  lj_mem_accnew(G(ls->L), LJ_HEAP_PROTO, sizept);
   pt->gct = ~LJ_TPROTO;
   pt->numparams = (uint8_t)numparams;
   pt->framesize = (uint8_t)framesize;
@@ -354,6 +355,10 @@ GCproto *lj_bcread_proto(LexState *ls)
   pt->sizeuv = (uint8_t)sizeuv;
   pt->flags = (uint8_t)flags;
   pt->trace = 0;
+  pt->nhotsite = 0;
+  setmref(pt->hotsite, NULL);
+  pt->ntabsite = 0;
+  setmref(pt->tabsite, NULL);
   setgcref(pt->chunkname, obj2gco(ls->chunkname));
 
   /* Close potentially uninitialized gap between bc and kgc. */
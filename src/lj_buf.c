@@ -12,6 +12,7 @@
 #include "lj_buf.h"
 #include "lj_str.h"
 #include "lj_tab.h"
+#include "lj_frozen.h"
 #include "lj_strfmt.h"
 
 /* -- Buffer management --------------------------------------------------- */
@@ -245,8 +246,15 @@ SBuf *lj_buf_puttab(SBuf *sb, GCtab *t, GCstr *sep, int32_t i, int32_t e)
   MSize seplen = sep ? sep->len : 0;
   if (i <= e) {
     for (;;) {
-      cTValue *o = lj_tab_getint(t, i);
+      cTValue *o;
       char *w;
+#if LJ_HASFROZEN
+      /* Region strings are only read here, so they need no copying. */
+      if (LJ_UNLIKELY(tabisfrozen(t)))
+	o = lj_frozen_getint(t, i);
+      else
+#endif
+      o = lj_tab_getint(t, i);
       if (!o) {
       badtype:  /* Error: bad element type. */
 	sb->w = (char *)(intptr_t)i;  /* Store failing index. */
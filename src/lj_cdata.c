@@ -40,6 +40,7 @@ GCcdata *lj_cdata_newv(lua_State *L, CTypeID id, CTSize sz, CTSize align)
   cdatav(cd)->extra = extra;
   cdatav(cd)->len = sz;
   g = G(L);
+  lj_mem_accnew(g, LJ_HEAP_CDATA, extra + sz);
   setgcrefr(cd->nextgc, g->gc.root);
   setgcref(g->gc.root, obj2gco(cd));
   newwhite(g, obj2gco(cd));
@@ -52,6 +53,19 @@ GCcdata *lj_cdata_newv(lua_State *L, CTypeID id, CTSize sz, CTSize align)
   return cd;
 }
 
+/* Allocate fixed-size C data object for JIT-compiled code.
+** The caller has to initialize gct and ctypeid.
+*/
+GCcdata * LJ_FASTCALL lj_cdata_newgco(lua_State *L, GCSize size)
+{
+  GCcdata *cd = (GCcdata *)lj_mem_newgco(L, size);
+  lj_mem_accnew(G(L), LJ_HEAP_CDATA, size);
+#ifdef COUNTS
+  G(L)->gc.cdatanum++;
+#endif
+  return cd;
+}
+
 /* Allocate arbitrary C data object. */
 GCcdata *lj_cdata_newx(CTState *cts, CTypeID id, CTSize sz, CTInfo info)
 {
@@ -81,11 +95,13 @@ void LJ_FASTCALL lj_cdata_free(global_State *g, GCcdata *cd)
     CTSize sz = ctype_hassize(ct->info) ? ct->size : CTSIZE_PTR;
     lj_assertG(ctype_hassize(ct->info) || ctype_isfunc(ct->info) ||
 	       ctype_isextern(ct->info), "free of ctype without a size");
+    lj_mem_accfree(g, LJ_HEAP_CDATA, sizeof(GCcdata) + sz);
     lj_mem_free(g, cd, sizeof(GCcdata) + sz);
 #ifdef COUNTS
     g->gc.cdatanum--;
 #endif
   } else {
+    lj_mem_accfree(g, LJ_HEAP_CDATA, sizecdatav(cd));
     lj_mem_free(g, memcdatav(cd), sizecdatav(cd));
 #ifdef COUNTS
     g->gc.cdatanum--;
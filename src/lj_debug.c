@@ -146,8 +146,9 @@ static BCLine debug_frameline(lua_State *L, GCfunc *fn, cTValue *nextframe)
 
 /* -- Variable names ------------------------------------------------------ */
 
-/* Get name of a local variable from slot number and PC. */
-static const char *debug_varname(const GCproto *pt, BCPos pc, BCReg slot)
+/* Get name and PC range of a local variable from slot number and PC. */
+static const char *debug_varinfo(const GCproto *pt, BCPos pc, BCReg slot,
+				 BCPos *startp, BCPos *endp)
 {
   const char *p = (const char *)proto_varinfo(pt);
   if (p) {
@@ -166,6 +167,8 @@ static const char *debug_varname(const GCproto *pt, BCPos pc, BCReg slot)
       if (startpc > pc) break;
       endpc = startpc + lj_buf_ruleb128(&p);
       if (pc < endpc && slot-- == 0) {
+	*startp = startpc;
+	*endp = endpc;
 	if (vn < VARNAME__MAX) {
 #define VARNAMESTR(name, str)	str "\0"
 	  name = VARNAMEDEF(VARNAMESTR);
@@ -179,6 +182,20 @@ static const char *debug_varname(const GCproto *pt, BCPos pc, BCReg slot)
   return NULL;
 }
 
+/* Get name of a local variable from slot number and PC. */
+static const char *debug_varname(const GCproto *pt, BCPos pc, BCReg slot)
+{
+  BCPos startpc, endpc;
+  return debug_varinfo(pt, pc, slot, &startpc, &endpc);
+}
+
+/* Get the PC range of a local variable from slot number and PC. */
+int lj_debug_varrange(const GCproto *pt, BCPos pc, BCReg slot,
+		      BCPos *startp, BCPos *endp)
+{
+  return debug_varinfo(pt, pc, slot, startp, endp) != NULL;
+}
+
 /* Get name of local variable from 1-based slot number and function/frame. */
 static TValue *debug_localname(lua_State *L, const lua_Debug *ar,
 			       const char **name, BCReg slot1)
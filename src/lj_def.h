@@ -56,10 +56,17 @@ typedef unsigned int uintptr_t;
 #define LJ_MAX_UDATA	LJ_MAX_MEM32	/* Max. userdata length. */
 
 #define LJ_MAX_STRTAB	(1<<26)		/* Max. string table size. */
+#ifdef LUAJIT_LAZYSTR_MIN
+#define LJ_LAZYSTR_MIN	LUAJIT_LAZYSTR_MIN
+#else
+#define LJ_LAZYSTR_MIN	65536		/* Min. length of a lazy string. */
+#endif
 #define LJ_MAX_HBITS	26		/* Max. hash bits. */
 #define LJ_MAX_ABITS	28		/* Max. bits of array key. */
 #define LJ_MAX_ASIZE	((1<<(LJ_MAX_ABITS-1))+1)  /* Max. array part size. */
 #define LJ_MAX_COLOSIZE	16		/* Max. elems for colocated array. */
+#define LJ_MAX_SITEASIZE 1025		/* Max. learned array size of a site. */
+#define LJ_MAX_SITEHBITS 10		/* Max. learned hash bits of a site. */
 
 #define LJ_MAX_LINE	LJ_MAX_MEM32	/* Max. source code line number. */
 #define LJ_MAX_XLEVEL	200		/* Max. syntactic nesting level. */
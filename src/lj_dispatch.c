@@ -31,6 +31,7 @@
 #include "lj_profile.h"
 #endif
 #include "lj_vm.h"
+#include "lj_alloc.h"
 #include "luajit.h"
 
 /* Bump GG_NUM_ASMFF in lj_dispatch.h as needed. Ugly. */
@@ -85,7 +86,10 @@ void lj_dispatch_init(GG_State *GG)
 /* Initialize hotcount table. */
 void lj_dispatch_init_hotcount(global_State *g)
 {
-  int32_t hotloop = G2J(g)->param[JIT_P_hotloop];
+  jit_State *J = G2J(g);
+  /* Sample every few iterations if hot counter sites are enabled. */
+  int32_t hotloop = J->param[JIT_P_hotsite] > 0 ? J->param[JIT_P_hotsite] :
+		    J->param[JIT_P_hotloop];
   HotCount start = (HotCount)(hotloop*HOTCOUNT_LOOP - 1);
   HotCount *hotcount = G2GG(g)->hotcount;
   uint32_t i;
@@ -312,6 +316,20 @@ int luaJIT_setmode(lua_State *L, int idx, int mode)
       g->bc_cfunc_ext = BCINS_AD(BC_FUNCC, 0, 0);
     }
     break;
+  case LUAJIT_MODE_HUGEPAGE: {
+    int on = !!(mode & LUAJIT_MODE_ON);
+    int ok = !on;  /* Custom allocators must handle this themselves. */
+#ifndef LUAJIT_USE_SYSMALLOC
+    if (g->allocf == lj_alloc_f)
+      ok = lj_alloc_sethuge(g->allocd, on);
+#endif
+    if (!ok)
+      return 0;  /* Failed. */
+#if LJ_HASJIT
+    G2J(g)->mchuge = on;
+#endif
+    break;
+    }
   default:
     return 0;  /* Failed. */
   }
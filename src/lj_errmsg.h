@@ -21,6 +21,9 @@ ERRDEF(TABOV,	"table overflow")
 ERRDEF(NANIDX,	"table index is NaN")
 ERRDEF(NILIDX,	"table index is nil")
 ERRDEF(NEXTIDX,	"invalid key to " LUA_QL("next"))
+#if LJ_HASFROZEN
+ERRDEF(FROZEN,	"attempt to modify a frozen table")
+#endif
 
 /* Metamethod resolving. */
 ERRDEF(BADCALL,	"attempt to call a %s value")
@@ -82,6 +85,11 @@ ERRDEF(COSUSP,	"cannot resume non-suspended coroutine")
 ERRDEF(TABINS,	"wrong number of arguments to " LUA_QL("insert"))
 ERRDEF(TABCAT,	"invalid value (%s) at index %d in table for " LUA_QL("concat"))
 ERRDEF(TABSORT,	"invalid order function for sorting")
+#if LJ_HASFROZEN
+ERRDEF(FRZVAL,	"cannot freeze a %s value")
+ERRDEF(FRZMETA,	"cannot freeze a table with a metatable")
+ERRDEF(FRZMT,	"cannot use a frozen table as a metatable")
+#endif
 ERRDEF(IOCLFL,	"attempt to use a closed file")
 ERRDEF(IOSTDCL,	"standard file is closed")
 ERRDEF(OSUNIQF,	"unable to generate a unique filename")
@@ -10,10 +10,12 @@
 
 #if LJ_HASJIT
 
+#include "lj_gc.h"
 #include "lj_err.h"
 #include "lj_buf.h"
 #include "lj_str.h"
 #include "lj_tab.h"
+#include "lj_state.h"
 #include "lj_frame.h"
 #include "lj_bc.h"
 #include "lj_ff.h"
@@ -29,6 +31,7 @@
 #include "lj_vm.h"
 #include "lj_strscan.h"
 #include "lj_strfmt.h"
+#include "lj_strmatch.h"
 #include "lj_serialize.h"
 
 /* Some local macros to save typing. Undef'd at the end. */
@@ -239,6 +242,13 @@ static void LJ_FASTCALL recff_setmetatable(jit_State *J, RecordFFData *rd)
   if (tref_istab(tr) && (tref_istab(mt) || (mt && tref_isnil(mt)))) {
     TRef fref, mtref;
     RecordIndex ix;
+#if LJ_HASFROZEN
+    if (tabisfrozen(tabV(&rd->argv[0])) ||
+	(tref_istab(mt) && tabisfrozen(tabV(&rd->argv[1]))))
+      lj_trace_err(J, LJ_TRERR_NYIFRZ);  /* Interpreter will throw. */
+    if (tref_istab(mt))
+      lj_record_frozen(J, mt, 0);
+#endif
     ix.tab = tr;
     copyTV(J->L, &ix.tabv, &rd->argv[0]);
     lj_record_mm_lookup(J, &ix, MM_metatable); /* Guard for no __metatable. */
@@ -261,6 +271,10 @@ static void LJ_FASTCALL recff_rawget(jit_State *J, RecordFFData *rd)
     settabV(J->L, &ix.tabv, tabV(&rd->argv[0]));
     copyTV(J->L, &ix.keyv, &rd->argv[1]);
     J->base[0] = lj_record_idx(J, &ix);
+#if LJ_HASFROZEN
+    if (tref_isnil(J->base[0]) && !tabisfrozen(tabV(&ix.tabv)))
+      lj_record_frozen(J, ix.tab, 0);
+#endif
   }  /* else: Interpreter will throw. */
 }
 
@@ -327,8 +341,11 @@ static void LJ_FASTCALL recff_select(jit_State *J, RecordFFData *rd)
     ptrdiff_t start = lj_ffrecord_select_mode(J, tr, &rd->argv[0]);
     if (start == 0) {  /* select('#', ...) */
       J->base[0] = lj_ir_kint(J, J->maxslot - 1);
-    } else if (tref_isk(tr)) {  /* select(k, ...) */
+    } else if (tref_isk(tr) || tref_isnumber(tr)) {  /* select(k, ...) */
       ptrdiff_t n = (ptrdiff_t)J->maxslot;
+      if (!tref_isk(tr))  /* Specialize to the runtime index. */
+	emitir(IRTGI(IR_EQ), lj_opt_narrow_toint(J, tr),
+	       lj_ir_kint(J, (int32_t)start));
       if (start < 0) start += n;
       else if (start > n) start = n;
       if (start >= 1) {
@@ -442,6 +459,10 @@ static void LJ_FASTCALL recff_ipairs_aux(jit_State *J, RecordFFData *rd)
     ix.key = lj_opt_narrow_toint(J, J->base[1]);
     J->base[0] = ix.key = emitir(IRTI(IR_ADD), ix.key, lj_ir_kint(J, 1));
     J->base[1] = lj_record_idx(J, &ix);
+#if LJ_HASFROZEN
+    if (tref_isnil(J->base[1]) && !tabisfrozen(tabV(&ix.tabv)))
+      lj_record_frozen(J, ix.tab, 0);
+#endif
     rd->nres = tref_isnil(J->base[1]) ? 0 : 2;
   }  /* else: Interpreter will throw. */
 }
@@ -533,6 +554,11 @@ static void LJ_FASTCALL recff_next(jit_State *J, RecordFFData *rd)
   if (tref_istab(tab)) {
     RecordIndex ix;
     cTValue *keyv;
+#if LJ_HASFROZEN
+    if (tabisfrozen(tabV(&rd->argv[0])))
+      lj_trace_err(J, LJ_TRERR_NYIFRZ);
+    lj_record_frozen(J, tab, 0);
+#endif
     ix.tab = tab;
     if (tref_isnil(J->base[1])) {  /* Shortcut for start of traversal. */
       ix.key = lj_ir_kint(J, 0);
@@ -555,6 +581,39 @@ static void LJ_FASTCALL recff_next(jit_State *J, RecordFFData *rd)
 #endif
 }
 
+/* -- Coroutine library fast functions ------------------------------------ */
+
+/* Note: resume, yield and wrap switch stacks and are handled by stitching. */
+
+static void LJ_FASTCALL recff_coroutine_status(jit_State *J, RecordFFData *rd)
+{
+  TRef co = J->base[0];
+  if (tref_istype(co, IRT_THREAD)) {
+    int st = lj_state_costatus(J->L, threadV(&rd->argv[0]));
+    TRef tr = lj_ir_call(J, IRCALL_lj_state_costatus,
+			 emitir(IRT(IR_LREF, IRT_THREAD), 0, 0), co);
+    emitir(IRTGI(IR_EQ), tr, lj_ir_kint(J, st));
+    J->base[0] = lj_ir_kstr(J, lj_str_newz(J->L, lj_state_costatus_name[st]));
+  }  /* else: Interpreter will throw. */
+}
+
+static void LJ_FASTCALL recff_coroutine_running(jit_State *J, RecordFFData *rd)
+{
+  TRef tr = emitir(IRT(IR_LREF, IRT_THREAD), 0, 0);
+  lua_State *mainth = mainthread(J2G(J));
+  int ismain = (J->L == mainth);
+  emitir(IRTG(ismain ? IR_EQ : IR_NE, IRT_THREAD), tr,
+	 lj_ir_kgc(J, obj2gco(mainth), IRT_THREAD));
+#if LJ_52
+  J->base[0] = tr;
+  J->base[1] = ismain ? TREF_TRUE : TREF_FALSE;
+  rd->nres = 2;
+#else
+  J->base[0] = ismain ? TREF_NIL : tr;
+  UNUSED(rd);
+#endif
+}
+
 /* -- Math library fast functions ----------------------------------------- */
 
 static void LJ_FASTCALL recff_math_abs(jit_State *J, RecordFFData *rd)
@@ -957,9 +1016,9 @@ static void LJ_FASTCALL recff_string_find(jit_State *J, RecordFFData *rd)
 #endif
   }
   /* Fixed arg or no pattern matching chars? (Specialized to pattern string.) */
-  if ((J->base[2] && tref_istruecond(J->base[3])) ||
+  if (rd->data && ((J->base[2] && tref_istruecond(J->base[3])) ||
       (emitir(IRTG(IR_EQ, IRT_STR), trpat, lj_ir_kstr(J, pat)),
-       !lj_str_haspattern(pat))) {  /* Search for fixed string. */
+       !lj_str_haspattern(pat)))) {  /* Search for fixed string. */
     TRef trsptr = emitir(IRT(IR_STRREF, IRT_PGC), trstr, trstart);
     TRef trpptr = emitir(IRT(IR_STRREF, IRT_PGC), trpat, tr0);
     TRef trslen = emitir(IRTI(IR_SUB), trlen, trstart);
@@ -980,9 +1039,92 @@ static void LJ_FASTCALL recff_string_find(jit_State *J, RecordFFData *rd)
       J->base[0] = TREF_NIL;
     }
   } else {  /* Search for pattern. */
+    StrMatchProg *prog;
+    StrMatchRes res;
+    TRef tr;
+    int32_t st;
+    if (!rd->data)  /* Specialize to pattern string. */
+      emitir(IRTG(IR_EQ, IRT_STR), trpat, lj_ir_kstr(J, pat));
+    prog = lj_strmatch_get(J->L, pat);
+    if (!prog) {  /* Malformed or too long pattern. */
+      recff_nyiu(J, rd);
+      return;
+    }
+    st = lj_strmatch_exec(prog, strdata(str), str->len, (MSize)start, &res);
+    if (st == STRMATCH_FALLBACK) {
+      recff_nyiu(J, rd);
+      return;
+    }
+    tr = lj_ir_call(J, IRCALL_lj_strmatch_rec, trstr, trstart, trpat);
+    if (st >= 0) {
+      StrMatchRes *r = &strmatch_cache(J2G(J))->res;
+      ptrdiff_t i = 0, ncap = prog->ncap;
+      if (J->baseslot + ncap + 2 > LJ_MAX_JSLOTS)
+	lj_trace_err_info(J, LJ_TRERR_STACKOV);
+      emitir(IRTGI(IR_GE), tr, tr0);
+      if (rd->data) {  /* Return start and end of match for string.find. */
+	J->base[i++] = emitir(IRTI(IR_ADD), tr, lj_ir_kint(J, 1));
+	J->base[i++] = emitir(IRT(IR_XLOAD, IRT_INT),
+			      lj_ir_kptr(J, &r->end), IRXLOAD_VOLATILE);
+      } else if (ncap == 0) {  /* Return whole match for string.match. */
+	TRef tre = emitir(IRT(IR_XLOAD, IRT_INT),
+			  lj_ir_kptr(J, &r->end), IRXLOAD_VOLATILE);
+	TRef trptr = emitir(IRT(IR_STRREF, IRT_PGC), trstr, tr);
+	J->base[i++] = emitir(IRT(IR_SNEW, IRT_STR), trptr,
+			      emitir(IRTI(IR_SUB), tre, tr));
+      }
+      rd->nres = i + ncap;
+      for (; ncap > 0; ncap--, i++) {
+	ptrdiff_t c = prog->ncap - ncap;
+	TRef trpos = emitir(IRT(IR_XLOAD, IRT_INT),
+			    lj_ir_kptr(J, &r->cap[2*c]), IRXLOAD_VOLATILE);
+	if (((prog->poscap >> c) & 1)) {  /* Position capture. */
+	  J->base[i] = emitir(IRTI(IR_ADD), trpos, lj_ir_kint(J, 1));
+	} else {
+	  TRef trcl = emitir(IRT(IR_XLOAD, IRT_INT),
+			     lj_ir_kptr(J, &r->cap[2*c+1]), IRXLOAD_VOLATILE);
+	  TRef trptr = emitir(IRT(IR_STRREF, IRT_PGC), trstr, trpos);
+	  J->base[i] = emitir(IRT(IR_SNEW, IRT_STR), trptr, trcl);
+	}
+      }
+    } else {
+      emitir(IRTGI(IR_EQ), tr, lj_ir_kint(J, STRMATCH_NONE));
+      J->base[0] = TREF_NIL;
+    }
+  }
+}
+
+static void LJ_FASTCALL recff_string_gsub(jit_State *J, RecordFFData *rd)
+{
+  TRef trstr = lj_ir_tostr(J, J->base[0]);
+  TRef trpat = lj_ir_tostr(J, J->base[1]);
+  TRef trrepl = J->base[2], trmax, tr;
+  GCstr *pat = argv2str(J, &rd->argv[1]);
+  StrMatchProg *prog;
+  /* Only handle a string replacement with a compiled pattern. */
+  if (!tref_isstr(trrepl) || !(prog = lj_strmatch_get(J->L, pat)) ||
+      !lj_strmatch_checkrepl(prog, strV(&rd->argv[2]))) {
     recff_nyiu(J, rd);
     return;
   }
+  /* Specialize to pattern and replacement string. */
+  emitir(IRTG(IR_EQ, IRT_STR), trpat, lj_ir_kstr(J, pat));
+  emitir(IRTG(IR_EQ, IRT_STR), trrepl, lj_ir_kstr(J, strV(&rd->argv[2])));
+  if (tref_isnil(J->base[3])) {
+    trmax = emitir(IRTI(IR_FLOAD), trstr, IRFL_STR_LEN);
+    trmax = emitir(IRTI(IR_ADD), trmax, lj_ir_kint(J, 1));
+  } else {
+    trmax = lj_opt_narrow_toint(J, J->base[3]);
+  }
+  J->needsnap = 1;
+  tr = lj_ir_call(J, IRCALL_lj_strmatch_gsub, trstr, trpat, trrepl, trmax);
+  /* Exit to the interpreter if the pattern is too complex. */
+  emitir(IRTG(IR_NE, IRT_STR), tr, lj_ir_knull(J, IRT_STR));
+  J->base[0] = tr;
+  J->base[1] = emitir(IRT(IR_XLOAD, IRT_INT),
+		      lj_ir_kptr(J, &strmatch_cache(J2G(J))->n),
+		      IRXLOAD_VOLATILE);
+  rd->nres = 2;
 }
 
 static void recff_format(jit_State *J, RecordFFData *rd, TRef hdr, int sbufx)
@@ -1453,12 +1595,104 @@ static void LJ_FASTCALL recff_table_clear(jit_State *J, RecordFFData *rd)
 {
   TRef tr = J->base[0];
   if (tref_istab(tr)) {
+#if LJ_HASFROZEN
+    if (tabisfrozen(tabV(&rd->argv[0])))
+      lj_trace_err(J, LJ_TRERR_NYIFRZ);  /* Interpreter will throw. */
+    lj_record_frozen(J, tr, 0);
+#endif
     rd->nres = 0;
     lj_ir_call(J, IRCALL_lj_tab_clear, tr);
     J->needsnap = 1;
   }  /* else: Interpreter will throw. */
 }
 
+static void LJ_FASTCALL recff_table_sort_aux(jit_State *J, RecordFFData *rd)
+{
+  TRef tab = J->base[0], trn = J->base[1];
+  /* Only the native default order. The comparator case is for errors. */
+  if (tref_istab(tab) && tref_isnumber(trn) && !J->base[2] &&
+      lj_tab_sortable(tabV(&rd->argv[0]), (MSize)numberVint(&rd->argv[1]))) {
+    TRef tr = lj_ir_call(J, IRCALL_lj_tab_sort, tab,
+			 lj_opt_narrow_toint(J, trn));
+    emitir(IRTGI(IR_NE), tr, lj_ir_kint(J, 0));
+    J->needsnap = 1;
+    rd->nres = 0;
+  } else {
+    recff_nyiu(J, rd);
+  }
+}
+
+/* Guard against a metatable of a table.move() argument. A frozen source
+** is read directly by lj_tab_move().
+*/
+static int recff_table_nometa(jit_State *J, TRef tr, GCtab *t, int src)
+{
+#if LJ_HASFROZEN
+  if (src && tabisfrozen(t)) {
+    lj_record_frozen(J, tr, 1);
+    return 1;
+  }
+#else
+  UNUSED(src);
+#endif
+  if (tabref(t->metatable))
+    return 0;
+  tr = emitir(IRT(IR_FLOAD, IRT_TAB), tr, IRFL_TAB_META);
+  emitir(IRTG(IR_EQ, IRT_TAB), tr, lj_ir_knull(J, IRT_TAB));
+  return 1;
+}
+
+static void LJ_FASTCALL recff_table_move(jit_State *J, RecordFFData *rd)
+{
+  TRef a1 = J->base[0];
+  if (tref_istab(a1) && J->base[1] && J->base[2] && J->base[3]) {
+    int hasa2 = J->base[4] && !tref_isnil(J->base[4]);
+    TRef a2 = hasa2 ? J->base[4] : a1;
+    if (tref_istab(a2)) {
+      TRef trf, tre, trt;
+      if (!recff_table_nometa(J, a1, tabV(&rd->argv[0]), 1) ||
+	  !recff_table_nometa(J, a2, tabV(&rd->argv[hasa2 ? 4 : 0]), 0)) {
+	recff_nyi(J, rd);  /* Metamethods need the generic loop. */
+	return;
+      }
+      trf = lj_opt_narrow_toint(J, J->base[1]);
+      tre = lj_opt_narrow_toint(J, J->base[2]);
+      trt = lj_opt_narrow_toint(J, J->base[3]);
+      lj_ir_call(J, IRCALL_lj_tab_move, a1, trf, tre, trt, a2);
+      J->base[0] = a2;
+    }
+  }  /* else: Interpreter will throw. */
+}
+
+static void LJ_FASTCALL recff_table_clone(jit_State *J, RecordFFData *rd)
+{
+  TRef tr = J->base[0];
+  if (tref_istab(tr)) {
+#if LJ_HASFROZEN
+    if (tabisfrozen(tabV(&rd->argv[0])))
+      lj_trace_err(J, LJ_TRERR_NYIFRZ);
+    lj_record_frozen(J, tr, 0);
+#endif
+    J->base[0] = lj_ir_call(J, IRCALL_lj_tab_dup, tr);
+  }  /* else: Interpreter will throw. */
+  UNUSED(rd);
+}
+
+static void LJ_FASTCALL recff_table_fill(jit_State *J, RecordFFData *rd)
+{
+  TRef tab = J->base[0];
+  if (tref_istab(tab) && J->base[1]) {
+    TRef tri = (J->base[2] && !tref_isnil(J->base[2])) ?
+	       lj_opt_narrow_toint(J, J->base[2]) : lj_ir_kint(J, 1);
+    TRef trj = (J->base[2] && J->base[3] && !tref_isnil(J->base[3])) ?
+	       lj_opt_narrow_toint(J, J->base[3]) :
+	       emitir(IRTI(IR_ALEN), tab, TREF_NIL);
+    TRef tmp = recff_tmpref(J, J->base[1], IRTMPREF_IN1);
+    lj_ir_call(J, IRCALL_lj_tab_fill, tab, tri, trj, tmp);
+  }  /* else: Interpreter will throw. */
+  UNUSED(rd);
+}
+
 /* -- I/O library fast functions ------------------------------------------ */
 
 /* Get FILE* for I/O function. Any I/O error aborts recording, so there's
@@ -49,6 +49,7 @@ enum {
 #define setframe_gc(f, p, tp)	(setgcVraw((f), (p), (tp)))
 #define setframe_ftsz(f, sz)	((f)->ftsz = (sz))
 #define setframe_pc(f, pc)	((f)->ftsz = (int64_t)(intptr_t)(pc))
+#define FRAME_LINKOFS		0  /* Offset of PC/delta/ft in its slot. */
 #else
 /* One-slot frame info, sufficient for 32 bit PC/GCRef:
 **
@@ -70,6 +71,7 @@ enum {
 #define setframe_gc(f, p, tp)	(setgcref((f)->fr.func, (p)), UNUSED(tp))
 #define setframe_ftsz(f, sz)	((f)->fr.tp.ftsz = (int32_t)(sz))
 #define setframe_pc(f, pc)	(setmref((f)->fr.tp.pcr, (pc)))
+#define FRAME_LINKOFS		((int32_t)offsetof(TValue, fr.tp))
 #endif
 
 #define frame_type(f)		(frame_ftsz(f) & FRAME_TYPE)
@@ -0,0 +1,519 @@
+/*
+** Frozen tables.
+** Copyright (C) 2005-2022 Mike Pall. See Copyright Notice in luajit.h
+*/
+
+#define lj_frozen_c
+#define LUA_CORE
+
+#include <stdlib.h>
+
+#include "lj_obj.h"
+
+#if LJ_HASFROZEN
+
+#include "lj_gc.h"
+#include "lj_err.h"
+#include "lj_str.h"
+#include "lj_tab.h"
+#include "lj_frozen.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define frozen_incref(fz)	_InterlockedIncrement(&(fz)->ref)
+#define frozen_decref(fz)	_InterlockedDecrement(&(fz)->ref)
+#else
+#define frozen_incref(fz)	__sync_add_and_fetch(&(fz)->ref, 1)
+#define frozen_decref(fz)	__sync_sub_and_fetch(&(fz)->ref, 1)
+#endif
+
+/* Regions attached to a state. */
+typedef struct FrozenState {
+  TValue tv;		/* Copy of the last string value looked up. */
+  FrozenRegion **reg;	/* Attached regions. */
+  MSize nreg;		/* Number of attached regions. */
+  MSize sizereg;	/* Size of region vector. */
+} FrozenState;
+
+#define frozen_align(sz)	(((sz) + 7) & ~(size_t)7)
+#define frozen_strsize(len)	frozen_align(lj_str_size((len)))
+
+/* -- Marker metatable ---------------------------------------------------- */
+
+GCtab lj_frozen_mt;
+static Node frozen_nilnode;
+
+/* Initialize the marker metatable. Idempotent, so no locking is needed. */
+static void frozen_initmt(void)
+{
+  GCtab *mt = &lj_frozen_mt;
+  if (!mref(mt->node, Node)) {
+    setnilV(&frozen_nilnode.val);
+    setnilV(&frozen_nilnode.key);
+    mt->gct = ~LJ_TTAB;  /* Neither white nor black, like frozen objects. */
+    /* Only __index and __newindex need a look at the frozen contents. */
+    mt->nomm = (uint8_t)~((1u<<MM_index)|(1u<<MM_newindex));
+    setmref(mt->freetop, &frozen_nilnode);
+    setmref(mt->node, &frozen_nilnode);
+  }
+}
+
+/* -- Lookup -------------------------------------------------------------- */
+
+/* Hash a non-string key. Same as for regular tables. */
+static LJ_AINLINE uint32_t frozen_hashkey(cTValue *key)
+{
+  if (tvisnum(key))
+    return hashrot(key->u32.lo, key->u32.hi << 1);
+  else if (tvisbool(key))
+    return boolV(key);
+  else
+    return hashrot((uint32_t)gcrefu(key->gcr),
+		   (uint32_t)(gcrefu(key->gcr) >> 32));
+}
+
+/* Find a key in a frozen table. Returns a region slot or NULL. */
+cTValue *lj_frozen_find(GCtab *t, cTValue *key)
+{
+  FrozenTab *ft = frozentab(t);
+  Node *n;
+  if (tvisstr(key)) {
+    GCstr *s = strV(key);
+    StrHash h = lj_str_hash(ft->seed, strdata(s), s->len);
+    n = &noderef(ft->node)[h & ft->hmask];
+    do {
+      if (tvisstr(&n->key)) {
+	GCstr *fs = strV(&n->key);
+	if (fs->hash == h && fs->len == s->len &&
+	    memcmp(strdata(fs), strdata(s), s->len) == 0)
+	  return &n->val;
+      }
+    } while ((n = nextnode(n)));
+    return NULL;
+  } else {
+    TValue k;
+    if (tvisint(key)) {
+      setnumV(&k, (lua_Number)intV(key));
+      key = &k;
+    }
+    if (tvisnum(key)) {
+      lua_Number nk = numV(key);
+      int32_t i = lj_num2int(nk);
+      if (nk == (lua_Number)i) {
+	if ((uint32_t)i < ft->asize)
+	  return &mref(ft->array, TValue)[i];
+	setnumV(&k, (lua_Number)i);  /* Canonicalize -0.0 to +0.0. */
+	key = &k;
+      } else if (tvisnan(key)) {
+	return NULL;
+      }
+    } else if (tvisnil(key)) {
+      return NULL;
+    }
+    n = &noderef(ft->node)[frozen_hashkey(key) & ft->hmask];
+    do {
+      if (n->key.u64 == key->u64)
+	return &n->val;
+    } while ((n = nextnode(n)));
+    return NULL;
+  }
+}
+
+/* Find an integer key in a frozen table. */
+cTValue *lj_frozen_getint(GCtab *t, int32_t key)
+{
+  FrozenTab *ft = frozentab(t);
+  TValue k;
+  if ((uint32_t)key < ft->asize)
+    return &mref(ft->array, TValue)[key];
+  setnumV(&k, (lua_Number)key);
+  return lj_frozen_find(t, &k);
+}
+
+/* Copy a value of a frozen table to a state. Region strings must not
+** escape, since they're not interned. So strings are looked up or created
+** in the state.
+*/
+void lj_frozen_copy(lua_State *L, TValue *o, cTValue *v)
+{
+  if (tvisstr(v)) {
+    GCstr *s = strV(v);
+    setstrV(L, o, lj_str_new(L, strdata(s), s->len));
+  } else {
+    copyTV(L, o, v);
+  }
+}
+
+/* Get a value from a frozen table, with the semantics of lj_tab_get(). */
+cTValue *lj_frozen_get(lua_State *L, GCtab *t, cTValue *key)
+{
+  cTValue *v = lj_frozen_find(t, key);
+  if (!v) return niltv(L);
+  if (tvisstr(v)) {
+    FrozenState *fst = mref(G(L)->frozen, FrozenState);
+    lj_assertL(fst, "frozen table without attached region");
+    lj_frozen_copy(L, &fst->tv, v);
+    return &fst->tv;
+  }
+  return v;
+}
+
+/* Replace the key in a TValue with its value. Called from JIT-compiled
+** code via a TMPREF.
+*/
+void lj_frozen_gettv(lua_State *L, GCtab *t, TValue *o)
+{
+  cTValue *v = lj_frozen_find(t, o);
+  if (v)
+    lj_frozen_copy(L, o, v);
+  else
+    setnilV(o);
+}
+
+/* Get the next key/value pair of a frozen table traversal. Same order and
+** return values as lj_tab_next().
+*/
+int lj_frozen_next(lua_State *L, GCtab *t, cTValue *key, TValue *o)
+{
+  FrozenTab *ft = frozentab(t);
+  TValue *array = mref(ft->array, TValue);
+  Node *node = noderef(ft->node);
+  uint32_t idx = 0;
+  if (!tvisnil(key)) {
+    cTValue *v = lj_frozen_find(t, key);
+    if (!v) return -1;  /* Invalid key. */
+    if (v >= array && v < array + ft->asize)
+      idx = (uint32_t)(v - array) + 1;
+    else  /* Assumes: offsetof(Node, val) == 0 */
+      idx = ft->asize + (uint32_t)((const Node *)v - node) + 1;
+  }
+  for (; idx < ft->asize; idx++) {
+    if (!tvisnil(&array[idx])) {
+      setintV(o, idx);
+      lj_frozen_copy(L, o+1, &array[idx]);
+      return 1;
+    }
+  }
+  for (idx -= ft->asize; idx <= ft->hmask; idx++) {
+    Node *n = &node[idx];
+    if (!tvisnil(&n->val)) {
+      lj_frozen_copy(L, o, &n->key);
+      lj_frozen_copy(L, o+1, &n->val);
+      return 1;
+    }
+  }
+  return 0;  /* End of traversal. */
+}
+
+/* Get a read-only view of the contents of a frozen table. Keys and values
+** may be region strings, which must not be copied to a state.
+*/
+GCtab *lj_frozen_view(GCtab *t, GCtab *v)
+{
+  FrozenTab *ft = frozentab(t);
+  *v = ft->t;
+  v->array = ft->array;
+  v->node = ft->node;
+  v->asize = ft->asize;
+  v->hmask = ft->hmask;
+  setgcrefnull(v->metatable);
+  return v;
+}
+
+/* Create a regular table with a shallow copy of a frozen table. */
+GCtab *lj_frozen_thaw(lua_State *L, GCtab *t)
+{
+  FrozenTab *ft = frozentab(t);
+  TValue *array = mref(ft->array, TValue);
+  Node *node = noderef(ft->node);
+  uint32_t i, nh = 0;
+  GCtab *nt;
+  for (i = 0; i <= ft->hmask; i++)
+    nh += !tvisnil(&node[i].val);
+  nt = lj_tab_new(L, ft->asize, hsize2hbits(nh));
+  for (i = 0; i < ft->asize; i++)
+    lj_frozen_copy(L, arrayslot(nt, i), &array[i]);
+  for (i = 0; i <= ft->hmask; i++) {
+    Node *n = &node[i];
+    if (!tvisnil(&n->val)) {
+      TValue k;
+      lj_frozen_copy(L, &k, &n->key);
+      lj_frozen_copy(L, lj_tab_set(L, nt, &k), &n->val);
+    }
+  }
+  return nt;
+}
+
+/* -- Freezing ------------------------------------------------------------ */
+
+/* State for freezing a table graph. */
+typedef struct FreezeState {
+  lua_State *L;
+  GCtab *map;		/* Source object -> offset of frozen object. */
+  GCtab *list;		/* Source tables in order of discovery. */
+  int32_t ntab;		/* Number of source tables. */
+  size_t size;		/* Size of all frozen objects. */
+  char *base;		/* Base of the region. */
+} FreezeState;
+
+/* Get the contents of a source table. */
+static GCtab *freeze_src(GCtab *t, GCtab *v)
+{
+  return tabisfrozen(t) ? lj_frozen_view(t, v) : t;
+}
+
+/* Compute the size of a frozen table. */
+static size_t freeze_tabsize(GCtab *src, uint32_t *nap, uint32_t *nhp)
+{
+  Node *node = noderef(src->node);
+  uint32_t na = src->asize, nh = 0, i;
+  while (na > 0 && tvisnil(arrayslot(src, na-1))) na--;
+  for (i = 0; i <= src->hmask; i++)
+    nh += !tvisnil(&node[i].val);
+  if (nh) nh = 1u << hsize2hbits(nh);
+  *nap = na; *nhp = nh;
+  return sizeof(FrozenTab) + na*sizeof(TValue) + nh*sizeof(Node);
+}
+
+/* Add a key or value to the frozen graph. */
+static void freeze_mark(FreezeState *fs, cTValue *o)
+{
+  lua_State *L = fs->L;
+  if (tvisstr(o) || tvistab(o)) {
+    if (!tvisnil(lj_tab_get(L, fs->map, o)))
+      return;  /* Already seen. */
+    setboolV(lj_tab_set(L, fs->map, o), 1);
+    if (tvisstr(o)) {
+      fs->size += frozen_strsize(strV(o)->len);
+    } else {
+      GCtab *t = tabV(o);
+      if (!tabisfrozen(t) && tabref(t->metatable))
+	lj_err_caller(L, LJ_ERR_FRZMETA);
+      fs->ntab++;
+      settabV(L, lj_tab_setint(L, fs->list, fs->ntab), t);
+      lj_gc_anybarriert(L, fs->list);
+    }
+  } else if (!(tvisnil(o) || tvisnumber(o) || tvisbool(o))) {
+    lj_err_callerv(L, LJ_ERR_FRZVAL, lj_typename(o));
+  }
+}
+
+/* Add the keys and values of a table to the frozen graph. */
+static void freeze_scan(FreezeState *fs, GCtab *t)
+{
+  GCtab view, *src = freeze_src(t, &view);
+  Node *node = noderef(src->node);
+  uint32_t na, nh, i;
+  fs->size += freeze_tabsize(src, &na, &nh);
+  for (i = 0; i < na; i++)
+    freeze_mark(fs, arrayslot(src, i));
+  for (i = 0; i <= src->hmask; i++) {
+    Node *n = &node[i];
+    if (!tvisnil(&n->val)) {
+      freeze_mark(fs, &n->key);
+      freeze_mark(fs, &n->val);
+    }
+  }
+}
+
+/* Get the frozen object for a source object. */
+static GCobj *freeze_obj(FreezeState *fs, cTValue *o)
+{
+  cTValue *tv = lj_tab_get(fs->L, fs->map, o);
+  return (GCobj *)(fs->base + (size_t)numV(tv));
+}
+
+/* Copy a key or value to the region. */
+static void freeze_val(FreezeState *fs, TValue *dst, cTValue *src)
+{
+  if (tvisgcv(src))
+    setgcVraw(dst, freeze_obj(fs, src), itype(src));
+  else if (tvisint(src))
+    setnumV(dst, (lua_Number)intV(src));
+  else
+    *dst = *src;
+}
+
+/* Copy a string to the region. */
+static void freeze_str(FrozenRegion *fz, GCstr *fs, GCstr *s)
+{
+  setgcrefnull(fs->nextgc);
+  fs->marked = LJ_GC_FROZEN;
+  fs->gct = ~LJ_TSTR;
+  fs->reserved = 0;
+  fs->hashalg = 0;
+  fs->len = s->len;
+  fs->hash = fs->sid = lj_str_hash(fz->seed, strdata(s), s->len);
+  memcpy(strdatawr(fs), strdata(s), s->len);
+  strdatawr(fs)[s->len] = '\0';
+}
+
+/* Copy a table to the region. */
+static void freeze_tab(FreezeState *fs, FrozenRegion *fz, GCtab *t)
+{
+  TValue tv;
+  GCtab view, *src = freeze_src(t, &view);
+  Node *snode = noderef(src->node), *node, *freenode;
+  FrozenTab *ft;
+  TValue *array;
+  uint32_t na, nh, i;
+  settabV(fs->L, &tv, t);
+  ft = (FrozenTab *)freeze_obj(fs, &tv);
+  freeze_tabsize(src, &na, &nh);
+  array = (TValue *)(ft+1);
+  node = (Node *)(array+na);
+  /* Empty proxy table. Lookups end up at the marker metatable. */
+  memset(&ft->t, 0, sizeof(GCtab));
+  ft->t.marked = LJ_GC_FROZEN;
+  ft->t.gct = ~LJ_TTAB;
+  setgcref(ft->t.metatable, obj2gco(&lj_frozen_mt));
+  setmref(ft->t.node, &fz->nilnode);
+  setmref(ft->t.freetop, &fz->nilnode);
+  setmref(ft->array, array);
+  ft->asize = na;
+  ft->len = tabisfrozen(t) ? lj_frozen_len(t) : lj_tab_len(t);
+  ft->seed = fz->seed;
+  setmref(ft->region, fz);
+  for (i = 0; i < na; i++)
+    freeze_val(fs, &array[i], arrayslot(src, i));
+  if (!nh) {
+    setmref(ft->node, &fz->nilnode);
+    ft->hmask = 0;
+    return;
+  }
+  setmref(ft->node, node);
+  ft->hmask = nh-1;
+  for (i = 0; i < nh; i++) {
+    setnilV(&node[i].val);
+    setnilV(&node[i].key);
+    setmref(node[i].next, NULL);
+  }
+  freenode = &node[nh-1];
+  for (i = 0; i <= src->hmask; i++) {
+    Node *sn = &snode[i];
+    if (!tvisnil(&sn->val)) {
+      TValue key;
+      Node *n;
+      freeze_val(fs, &key, &sn->key);
+      n = &node[(tvisstr(&key) ? strV(&key)->hash : frozen_hashkey(&key)) &
+		ft->hmask];
+      if (!tvisnil(&n->key)) {  /* Main position taken? Chain a free node. */
+	while (!tvisnil(&freenode->key)) freenode--;
+	setmref(freenode->next, nextnode(n));
+	setmref(n->next, freenode);
+	n = freenode;
+      }
+      n->key = key;
+      freeze_val(fs, &n->val, &sn->val);
+    }
+  }
+}
+
+/* Freeze a table graph into a new region. Returns it with one reference. */
+FrozenRegion *lj_frozen_new(lua_State *L, GCtab *t)
+{
+  FreezeState fs;
+  FrozenRegion *fz;
+  TValue kv[2];
+  size_t ofs;
+  int32_t i;
+  if (tabisfrozen(t)) {  /* Share the region of a frozen root table. */
+    fz = mref(frozentab(t)->region, FrozenRegion);
+    if (mref(fz->root, FrozenTab) == frozentab(t)) {
+      frozen_incref(fz);
+      return fz;
+    }
+  }
+  fs.L = L;
+  fs.map = lj_tab_new(L, 0, 0);
+  settabV(L, L->top, fs.map);
+  fs.list = lj_tab_new(L, 0, 0);
+  settabV(L, L->top+1, fs.list);
+  L->top += 2;
+  fs.ntab = 0;
+  fs.size = 0;
+  /* First pass: check and collect all objects and compute the size. */
+  settabV(L, &kv[0], t);
+  freeze_mark(&fs, &kv[0]);
+  for (i = 1; i <= fs.ntab; i++)
+    freeze_scan(&fs, tabV(lj_tab_getint(fs.list, i)));
+  /* Second pass: lay out and copy all objects. This cannot fail. */
+  ofs = frozen_align(sizeof(FrozenRegion));
+  fz = (FrozenRegion *)malloc(ofs + fs.size);
+  if (!fz) lj_err_mem(L);
+  fz->ref = 1;
+  fz->seed = (uint32_t)(G(L)->str.seed >> 32);
+  fz->size = ofs + fs.size;
+  setnilV(&fz->nilnode.val);
+  setnilV(&fz->nilnode.key);
+  setmref(fz->nilnode.next, NULL);
+  fs.base = (char *)fz;
+  setnilV(&kv[0]);
+  while (lj_tab_next(fs.map, &kv[0], kv) > 0) {
+    setnumV(lj_tab_set(L, fs.map, &kv[0]), (lua_Number)ofs);
+    if (tvisstr(&kv[0])) {
+      GCstr *s = strV(&kv[0]);
+      freeze_str(fz, (GCstr *)(fs.base + ofs), s);
+      ofs += frozen_strsize(s->len);
+    } else {
+      GCtab view;
+      uint32_t na, nh;
+      ofs += freeze_tabsize(freeze_src(tabV(&kv[0]), &view), &na, &nh);
+    }
+  }
+  lj_assertL(ofs == fz->size, "bad frozen region size");
+  for (i = 1; i <= fs.ntab; i++)
+    freeze_tab(&fs, fz, tabV(lj_tab_getint(fs.list, i)));
+  settabV(L, &kv[0], t);
+  setmref(fz->root, freeze_obj(&fs, &kv[0]));
+  L->top -= 2;
+  frozen_initmt();
+  return fz;
+}
+
+/* -- Regions ------------------------------------------------------------- */
+
+/* Attach a region to a state and return its root table. */
+GCtab *lj_frozen_attach(lua_State *L, FrozenRegion *fz)
+{
+  global_State *g = G(L);
+  FrozenState *fst = mref(g->frozen, FrozenState);
+  MSize i;
+  if (!fst) {
+    fst = lj_mem_newt(L, sizeof(FrozenState), FrozenState);
+    setnilV(&fst->tv);
+    fst->reg = NULL;
+    fst->nreg = fst->sizereg = 0;
+    setmref(g->frozen, fst);
+  }
+  for (i = 0; i < fst->nreg; i++)
+    if (fst->reg[i] == fz) goto done;
+  if (fst->nreg == fst->sizereg)
+    lj_mem_growvec(L, fst->reg, fst->sizereg, LJ_MAX_MEM32, FrozenRegion *);
+  frozen_incref(fz);
+  fst->reg[fst->nreg++] = fz;
+done:
+  return &mref(fz->root, FrozenTab)->t;
+}
+
+/* Drop a reference to a region. The last one frees it. */
+void lj_frozen_release(FrozenRegion *fz)
+{
+  if (frozen_decref(fz) == 0)
+    free(fz);
+}
+
+/* Release all regions attached to a state. */
+void lj_frozen_freestate(global_State *g)
+{
+  FrozenState *fst = mref(g->frozen, FrozenState);
+  if (fst) {
+    MSize i;
+    for (i = 0; i < fst->nreg; i++)
+      lj_frozen_release(fst->reg[i]);
+    lj_mem_freevec(g, fst->reg, fst->sizereg, FrozenRegion *);
+    lj_mem_freet(g, fst);
+  }
+}
+
+#endif
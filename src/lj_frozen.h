@@ -0,0 +1,68 @@
+/*
+** Frozen tables.
+** Copyright (C) 2005-2022 Mike Pall. See Copyright Notice in luajit.h
+*/
+
+#ifndef _LJ_FROZEN_H
+#define _LJ_FROZEN_H
+
+#include "lj_obj.h"
+
+#if LJ_HASFROZEN
+
+/*
+** A frozen table graph lives in a single malloc'ed region outside of any
+** heap. It's never written to after it has been built, so any number of
+** independent states may read it at the same time without locking.
+**
+** The VM only sees an empty proxy table with a marker metatable. All
+** lookups miss on the proxy and end up in the metamethod slow paths, which
+** look at the real contents. Region strings are not interned in any state.
+** So they never escape: string keys and values are copied to the reading
+** state on the way out.
+*/
+
+/* Frozen table. */
+typedef struct FrozenTab {
+  GCtab t;		/* Empty proxy table seen by the VM. Must be first. */
+  MRef array;		/* Array part. */
+  MRef node;		/* Hash part. */
+  uint32_t asize;	/* Size of array part (keys [0, asize-1]). */
+  uint32_t hmask;	/* Hash part mask (size of hash part - 1). */
+  MSize len;		/* Length of the source table. */
+  uint32_t seed;	/* String hash seed of the region. */
+  MRef region;		/* Region holding the table. */
+} FrozenTab;
+
+/* Region holding a frozen table graph. */
+typedef struct luaJIT_frozen {
+  volatile long ref;	/* Reference count. */
+  uint32_t seed;	/* String hash seed. */
+  size_t size;		/* Size of the region. */
+  MRef root;		/* Root table. */
+  Node nilnode;		/* Empty hash part (nil key and value). */
+} FrozenRegion;
+
+#define frozentab(t)	((FrozenTab *)(t))
+#define lj_frozen_len(t)	(frozentab(t)->len)
+
+/* Marker metatable of all frozen tables. Never visible to Lua code. */
+LJ_DATA GCtab lj_frozen_mt;
+
+LJ_FUNC FrozenRegion *lj_frozen_new(lua_State *L, GCtab *t);
+LJ_FUNC GCtab *lj_frozen_attach(lua_State *L, FrozenRegion *fz);
+LJ_FUNC void lj_frozen_release(FrozenRegion *fz);
+LJ_FUNC void lj_frozen_freestate(global_State *g);
+
+LJ_FUNC cTValue *lj_frozen_find(GCtab *t, cTValue *key);
+LJ_FUNC cTValue *lj_frozen_getint(GCtab *t, int32_t key);
+LJ_FUNC void lj_frozen_copy(lua_State *L, TValue *o, cTValue *v);
+LJ_FUNC cTValue *lj_frozen_get(lua_State *L, GCtab *t, cTValue *key);
+LJ_FUNC void lj_frozen_gettv(lua_State *L, GCtab *t, TValue *o);
+LJ_FUNC int lj_frozen_next(lua_State *L, GCtab *t, cTValue *key, TValue *o);
+LJ_FUNC GCtab *lj_frozen_thaw(lua_State *L, GCtab *t);
+LJ_FUNC GCtab *lj_frozen_view(GCtab *t, GCtab *v);
+
+#endif
+
+#endif
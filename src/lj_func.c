@@ -12,6 +12,7 @@
 #include "lj_obj.h"
 #include "lj_gc.h"
 #include "lj_func.h"
+#include "lj_tab.h"
 #include "lj_trace.h"
 #include "lj_vm.h"
 
@@ -19,6 +20,13 @@
 
 void LJ_FASTCALL lj_func_freeproto(global_State *g, GCproto *pt)
 {
+#if LJ_HASJIT
+  lj_mem_freevec(g, mref(pt->hotsite, HotSite), pt->nhotsite, HotSite);
+#endif
+#if LJ_HASTABSITE
+  lj_mem_freevec(g, mref(pt->tabsite, TabSite), pt->ntabsite, TabSite);
+#endif
+  lj_mem_accfree(g, LJ_HEAP_PROTO, pt->sizept);
   lj_mem_free(g, pt, pt->sizept);
 }
 
@@ -52,6 +60,7 @@ static GCupval *func_finduv(lua_State *L, TValue *slot)
   }
   /* No matching upvalue found. Create a new one. */
   uv = lj_mem_newt(L, sizeof(GCupval), GCupval);
+  lj_mem_accnew(g, LJ_HEAP_UPVAL, sizeof(GCupval));
   newwhite(g, uv);
   uv->gct = ~LJ_TUPVAL;
   uv->closed = 0;  /* Still open. */
@@ -72,6 +81,7 @@ static GCupval *func_finduv(lua_State *L, TValue *slot)
 static GCupval *func_emptyuv(lua_State *L)
 {
   GCupval *uv = (GCupval *)lj_mem_newgco(L, sizeof(GCupval));
+  lj_mem_accnew(G(L), LJ_HEAP_UPVAL, sizeof(GCupval));
   uv->gct = ~LJ_TUPVAL;
   uv->closed = 1;
   setnilV(&uv->tv);
@@ -103,6 +113,7 @@ void LJ_FASTCALL lj_func_freeuv(global_State *g, GCupval *uv)
 {
   if (!uv->closed)
     unlinkuv(g, uv);
+  lj_mem_accfree(g, LJ_HEAP_UPVAL, sizeof(GCupval));
   lj_mem_freet(g, uv);
 }
 
@@ -111,6 +122,7 @@ void LJ_FASTCALL lj_func_freeuv(global_State *g, GCupval *uv)
 GCfunc *lj_func_newC(lua_State *L, MSize nelems, GCtab *env)
 {
   GCfunc *fn = (GCfunc *)lj_mem_newgco(L, sizeCfunc(nelems));
+  lj_mem_accnew(G(L), LJ_HEAP_FUNC, sizeCfunc(nelems));
   fn->c.gct = ~LJ_TFUNC;
   fn->c.ffid = FF_C;
   fn->c.nupvalues = (uint8_t)nelems;
@@ -127,6 +139,7 @@ static GCfunc *func_newL(lua_State *L, GCproto *pt, GCtab *env)
 {
   uint32_t count;
   GCfunc *fn = (GCfunc *)lj_mem_newgco(L, sizeLfunc((MSize)pt->sizeuv));
+  lj_mem_accnew(G(L), LJ_HEAP_FUNC, sizeLfunc((MSize)pt->sizeuv));
   fn->l.gct = ~LJ_TFUNC;
   fn->l.ffid = FF_LUA;
   fn->l.nupvalues = 0;  /* Set to zero until upvalues are initialized. */
@@ -188,10 +201,38 @@ GCfunc *lj_func_newL_gc(lua_State *L, GCproto *pt, GCfuncL *parent)
   return fn;
 }
 
+#if LJ_HASJIT
+/* Create a new Lua function for a compiled trace. Upvalues of the parent
+** are inherited. Local upvalues are created closed, the trace fills them.
+*/
+GCfunc *lj_func_newL_closed(lua_State *L, GCproto *pt, GCfuncL *parent)
+{
+  GCfunc *fn = func_newL(L, pt, tabref(parent->env));
+  GCRef *puv = parent->uvptr;
+  MSize i, nuv = pt->sizeuv;
+  /* NOBARRIER: The GCfunc is new (marked white). */
+  for (i = 0; i < nuv; i++) {
+    uint32_t v = proto_uv(pt)[i];
+    GCupval *uv;
+    if ((v & PROTO_UV_LOCAL)) {
+      uv = func_emptyuv(L);
+      uv->immutable = ((v / PROTO_UV_IMMUTABLE) & 1);
+      uv->dhash = (uint32_t)(uintptr_t)mref(parent->pc, char) ^ (v << 24);
+    } else {
+      uv = &gcref(puv[v])->uv;
+    }
+    setgcref(fn->l.uvptr[i], obj2gco(uv));
+  }
+  fn->l.nupvalues = (uint8_t)nuv;
+  return fn;
+}
+#endif
+
 void LJ_FASTCALL lj_func_free(global_State *g, GCfunc *fn)
 {
   MSize size = isluafunc(fn) ? sizeLfunc((MSize)fn->l.nupvalues) :
 			       sizeCfunc((MSize)fn->c.nupvalues);
+  lj_mem_accfree(g, LJ_HEAP_FUNC, size);
   lj_mem_free(g, fn, size);
 #ifdef COUNTS
   g->gc.fnum--;
@@ -14,6 +14,8 @@
 #include "lj_err.h"
 #include "lj_buf.h"
 #include "lj_str.h"
+#include "lj_strfmt.h"
+#include "lj_strmatch.h"
 #include "lj_tab.h"
 #include "lj_func.h"
 #include "lj_udata.h"
@@ -28,17 +30,43 @@
 #include "lj_dispatch.h"
 #include "lj_vm.h"
 #include "lj_vmevent.h"
+#include "lj_alloc.h"
+#include "lj_profile.h"
+
+#if LJ_TARGET_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#if LJ_PSWEEP_PTHREAD
+#include <pthread.h>
+#endif
 
 #define GCSTEPSIZE	1024u
 #define GCSWEEPMAX	40
 #define GCSWEEPCOST	10
 #define GCFINALIZECOST	100
+#define GCTABCHUNK	1024u	/* Slots per step for big tables. */
+#define GCBUDGETCHECK	4096u	/* Cost between checks of the time budget. */
+#define GCPSWEEPMIN	4096u	/* Min. string table size for parallel sweep. */
+#define GCTRIMMIN	(1u << 20)  /* Min. free memory for automatic trim. */
+#define GCSTRMIGRATE	64	/* String chains to migrate per GC step. */
 
 /* Macros to set GCobj colors and flags. */
 #define white2gray(x)		((x)->gch.marked &= (uint8_t)~LJ_GC_WHITES)
 #define gray2black(x)		((x)->gch.marked |= LJ_GC_BLACK)
 #define isfinalized(u)		((u)->marked & LJ_GC_FINALIZED)
 
+/* String interning chains by index. The chains of the old table follow
+** the chains of the new table during an incremental resize.
+*/
+#define gc_strnchain(g) \
+  ((g)->str.mask+1 + ((g)->str.oldtab ? (g)->str.oldmask+1 : 0))
+#define gc_strchain(g, i) \
+  ((i) <= (g)->str.mask ? &(g)->str.tab[(i)] : \
+   &(g)->str.oldtab[(i) - (g)->str.mask-1])
+
 /* -- Mark phase ---------------------------------------------------------- */
 
 /* Mark a TValue (if needed). */
@@ -98,16 +126,89 @@ static void gc_mark_gcroot(global_State *g)
       gc_markobj(g, gcref(g->gcroot[i]));
 }
 
-/* Start a GC cycle and mark the root set. */
-static void gc_mark_start(global_State *g)
+/* Mark the pattern strings of the compiled pattern cache. */
+static void gc_mark_strmatch(global_State *g)
+{
+  StrMatchCache *smc = strmatch_cache(g);
+  if (smc) {
+    MSize i;
+    for (i = 0; i < LJ_STRMATCH_CACHE; i++)
+      if (gcref(smc->pat[i]) != NULL)
+	gc_mark_str(gco2str(gcref(smc->pat[i])));
+  }
+}
+
+#if LJ_HASTABSHAPE
+/* Mark the string keys of the table shape transitions. */
+static void gc_mark_tabshape(global_State *g)
+{
+  TabShapeTr *tr = mref(g->tabshape.tr, TabShapeTr);
+  if (tr) {
+    MSize i;
+    for (i = 0; i <= g->tabshape.mask; i++)
+      if (tr[i].parent && tvisstr(&tr[i].key))
+	gc_mark_str(strV(&tr[i].key));
+  }
+}
+#endif
+
+/* Mark the root set. */
+static void gc_mark_root(global_State *g)
 {
-  setgcrefnull(g->gc.gray);
-  setgcrefnull(g->gc.grayagain);
-  setgcrefnull(g->gc.weak);
   gc_markobj(g, mainthread(g));
   gc_markobj(g, tabref(mainthread(g)->env));
   gc_marktv(g, &g->registrytv);
   gc_mark_gcroot(g);
+}
+
+/* Old objects keep their marks in generational mode. A major cycle needs to
+** start from an all-white heap, so they are turned white incrementally,
+** like a sweep, but without freeing anything. The barriers don't need to
+** preserve the invariant meanwhile, since the major cycle marks all
+** objects from scratch.
+*/
+
+/* Turn the strings of one string interning table chain white. */
+static void gc_whitenstr(global_State *g, GCRef *chain)
+{
+  GCobj *o = (GCobj *)(gcrefu(*chain) & ~(uintptr_t)1);  /* Hashalg bit. */
+  for (; o != NULL; o = gcnext(o))
+    makewhite(g, o);
+}
+
+/* Turn up to lim objects of a list white. Returns the next position. */
+static GCRef *gc_whitenlist(global_State *g, GCRef *p, uint32_t lim)
+{
+  GCobj *o;
+  while ((o = gcref(*p)) != NULL && lim-- > 0) {
+    makewhite(g, o);
+    if (o->gch.gct == ~LJ_TTHREAD)  /* Open upvalues, too. */
+      gc_whitenlist(g, &gco2th(o)->openupval, ~(uint32_t)0);
+    p = &o->gch.nextgc;
+  }
+  return p;
+}
+
+/* Turn all objects white and drop the remembered set at once. */
+static void gc_whiten(global_State *g)
+{
+  MSize i;
+  for (i = 0; i < gc_strnchain(g); i++)
+    gc_whitenstr(g, gc_strchain(g, i));
+  gc_whitenlist(g, &g->gc.root, ~(uint32_t)0);
+  setgcrefnull(g->gc.gray);
+  setgcrefnull(g->gc.grayagain);
+  setgcrefnull(g->gc.weak);
+}
+
+/* Start a GC cycle and mark the root set. */
+static void gc_mark_start(global_State *g)
+{
+  setgcrefnull(g->gc.gray);  /* Drops the remembered set, too. */
+  setgcrefnull(g->gc.grayagain);
+  setgcrefnull(g->gc.weak);
+  gc_mark_root(g);
+  g->gc.stats.majornum++;
   g->gc.state = GCSpropagate;
 }
 
@@ -169,8 +270,8 @@ size_t lj_gc_separateudata(global_State *g, int all)
 
 /* -- Propagation phase --------------------------------------------------- */
 
-/* Traverse a table. */
-static int gc_traverse_tab(global_State *g, GCtab *t)
+/* Mark the metatable of a table and check its weakness. */
+static int gc_traverse_tabmode(global_State *g, GCtab *t)
 {
   int weak = 0;
   cTValue *mode;
@@ -199,17 +300,28 @@ static int gc_traverse_tab(global_State *g, GCtab *t)
       }
     }
   }
-  if (weak == LJ_GC_WEAK)  /* Nothing to mark if both keys/values are weak. */
-    return 1;
-  if (!(weak & LJ_GC_WEAKVAL)) {  /* Mark array part. */
-    MSize i, asize = t->asize;
-    for (i = 0; i < asize; i++)
-      gc_marktv(g, arrayslot(t, i));
+  return weak;
+}
+
+/* Traverse the slots [start, end) of a table. Returns a cost estimate.
+** The array slots come first, followed by the nodes of the hash part.
+*/
+static size_t gc_traverse_tabslots(global_State *g, GCtab *t, int weak,
+				   MSize start, MSize end)
+{
+  MSize i, asize = t->asize;
+  size_t m = 0;
+  if (start < asize) {  /* Mark array part. */
+    MSize e = end < asize ? end : asize;
+    if (!(weak & LJ_GC_WEAKVAL))
+      for (i = start; i < e; i++)
+	gc_marktv(g, arrayslot(t, i));
+    m += sizeof(TValue) * (e - start);
+    start = e;
   }
-  if (t->hmask > 0) {  /* Mark hash part. */
-    Node *node = noderef(t->node);
-    MSize i, hmask = t->hmask;
-    for (i = 0; i <= hmask; i++) {
+  if (start < end && t->hmask > 0) {  /* Mark hash part. */
+    Node *node = noderef(t->node) - asize;
+    for (i = start; i < end; i++) {
       Node *n = &node[i];
       if (!tvisnil(&n->val)) {  /* Mark non-empty slot. */
 	lj_assertG(!tvisnil(&n->key), "mark of nil key in non-empty slot");
@@ -217,10 +329,71 @@ static int gc_traverse_tab(global_State *g, GCtab *t)
 	if (!(weak & LJ_GC_WEAKVAL)) gc_marktv(g, &n->val);
       }
     }
+    m += sizeof(Node) * (end - start);
   }
+  return m;
+}
+
+/* Number of slots of a table, as traversed by gc_traverse_tabslots. */
+#define gc_tabslots(t)	((t)->asize + ((t)->hmask ? (t)->hmask+1 : 0))
+
+/* Big tables are traversed in chunks by the incremental collector. The
+** table is turned black before the first chunk, so any store into it
+** triggers the write barrier. The barrier turns it gray and puts it on
+** the grayagain list. Then the rest of the traversal is dropped, since
+** the table is traversed again during the atomic phase anyway.
+**
+** A resize without any store (e.g. growing the array part) may move
+** slots, too. This is detected by comparing the table layout with the
+** layout at the start of the traversal.
+*/
+
+/* Start the resumable traversal of a big, non-weak table. */
+static void gc_traverse_bigstart(global_State *g, GCtab *t)
+{
+  setgcref(g->gc.travtab, obj2gco(t));
+  g->gc.travpos = 0;
+  g->gc.travasize = t->asize;
+  g->gc.travhmask = t->hmask;
+  setmref(g->gc.travnode, noderef(t->node));
+}
+
+/* Traverse a table. */
+static int gc_traverse_tab(global_State *g, GCtab *t, int chunked)
+{
+  int weak = gc_traverse_tabmode(g, t);
+  if (chunked && !weak && gc_tabslots(t) > GCTABCHUNK)
+    gc_traverse_bigstart(g, t);  /* Traverse it in chunks. */
+  else if (weak != LJ_GC_WEAK)  /* Nothing to mark if all weak. */
+    gc_traverse_tabslots(g, t, weak, 0, gc_tabslots(t));
   return weak;
 }
 
+/* Traverse the next chunk of a big table. Returns a cost estimate. */
+static size_t gc_traverse_big(global_State *g)
+{
+  GCtab *t = gco2tab(gcref(g->gc.travtab));
+  MSize pos = g->gc.travpos, end = pos + GCTABCHUNK, n = gc_tabslots(t);
+  if (!isblack(obj2gco(t))) {  /* Already on the grayagain list? */
+    setgcrefnull(g->gc.travtab);
+    return 0;
+  }
+  if (t->asize != g->gc.travasize || t->hmask != g->gc.travhmask ||
+      noderef(t->node) != mref(g->gc.travnode, Node)) {  /* Resized? */
+    black2gray(obj2gco(t));  /* Traverse it again in the atomic phase. */
+    setgcrefr(t->gclist, g->gc.grayagain);
+    setgcref(g->gc.grayagain, obj2gco(t));
+    setgcrefnull(g->gc.travtab);
+    return 0;
+  }
+  if (end >= n) {  /* Last chunk. */
+    end = n;
+    setgcrefnull(g->gc.travtab);
+  }
+  g->gc.travpos = end;
+  return gc_traverse_tabslots(g, t, 0, pos, end);
+}
+
 /* Traverse a function. */
 static void gc_traverse_func(global_State *g, GCfunc *fn)
 {
@@ -320,8 +493,10 @@ static void gc_traverse_thread(global_State *g, lua_State *th)
   lj_state_shrinkstack(th, gc_traverse_frames(g, th));
 }
 
-/* Propagate one gray object. Traverse it and turn it black. */
-static size_t propagatemark(global_State *g)
+/* Propagate one gray object. Traverse it and turn it black.
+** Big tables are only traversed in part, if chunked is set.
+*/
+static size_t propagatemark(global_State *g, int chunked)
 {
   GCobj *o = gcref(g->gc.gray);
   int gct = o->gch.gct;
@@ -330,8 +505,10 @@ static size_t propagatemark(global_State *g)
   setgcrefr(g->gc.gray, o->gch.gclist);  /* Remove from gray list. */
   if (LJ_LIKELY(gct == ~LJ_TTAB)) {
     GCtab *t = gco2tab(o);
-    if (gc_traverse_tab(g, t) > 0)
+    if (gc_traverse_tab(g, t, chunked) > 0)
       black2gray(o);  /* Keep weak tables gray. */
+    else if (gcref(g->gc.travtab) == o)
+      return sizeof(GCtab);  /* Slots are traversed in the next steps. */
     return sizeof(GCtab) + sizeof(TValue) * t->asize +
 			   (t->hmask ? sizeof(Node) * (t->hmask + 1) : 0);
   } else if (LJ_LIKELY(gct == ~LJ_TFUNC)) {
@@ -368,7 +545,7 @@ static size_t gc_propagate_gray(global_State *g)
 {
   size_t m = 0;
   while (gcref(g->gc.gray) != NULL)
-    m += propagatemark(g);
+    m += propagatemark(g, 0);
   return m;
 }
 
@@ -413,7 +590,7 @@ static GCRef *gc_sweep(global_State *g, GCRef *p, uint32_t lim)
     if (((o->gch.marked ^ LJ_GC_WHITES) & ow)) {  /* Black or current white? */
       lj_assertG(!isdead(g, o) || (o->gch.marked & LJ_GC_FIXED),
 		 "sweep of undead object");
-      makewhite(g, o);  /* Value is alive, change to the current white. */
+      sweepwhite(g, o);  /* Value is alive, change to the current white. */
       p = &o->gch.nextgc;
     } else {  /* Otherwise value is dead, free it. */
       lj_assertG(isdead(g, o) || ow == LJ_GC_SFIXED,
@@ -427,8 +604,75 @@ static GCRef *gc_sweep(global_State *g, GCRef *p, uint32_t lim)
   return p;
 }
 
-/* Sweep one string interning table chain. Preserves hashalg bit. */
-static void gc_sweepstr(global_State *g, GCRef *chain)
+#if LJ_HASPSWEEP
+/* The parallel sweep splits the root list at anchors. These are evenly
+** spaced survivors of the last sweep. They stay in the list until the
+** next sweep. New objects are added in front of them. Userdata may be
+** moved to the list of userdata to be finalized, so they are skipped.
+*/
+static void gc_anchorreset(GCSweepAnchors *a)
+{
+  a->n = 0;
+  a->stride = 1;
+  a->count = 0;
+}
+
+/* Sample an object that survived the sweep. */
+static void gc_anchoradd(GCSweepAnchors *a, GCobj *o)
+{
+  if (o->gch.gct == ~LJ_TUDATA || ++a->count < a->stride)
+    return;
+  a->count = 0;
+  if (a->n == LJ_GC_SWEEPANCHORS) {  /* Full: drop every other anchor. */
+    MSize i;
+    for (i = 0; i < LJ_GC_SWEEPANCHORS/2; i++)
+      a->obj[i] = a->obj[2*i+1];
+    a->n = LJ_GC_SWEEPANCHORS/2;
+    a->stride *= 2;
+  }
+  setgcref(a->obj[a->n++], o);
+}
+
+/* Sweep a segment of the root list up to an end object. Dead objects are
+** unlinked to the dead list instead, if it's given. Survivors are sampled
+** as anchors.
+*/
+static GCRef *gc_sweepseg(global_State *g, GCRef *p, GCobj *end, GCRef *dead,
+			  GCSweepAnchors *a)
+{
+  int ow = otherwhite(g);
+  GCobj *o;
+  while ((o = gcref(*p)) != end) {
+    if (o->gch.gct == ~LJ_TTHREAD)  /* Need to sweep open upvalues, too. */
+      gc_sweepseg(g, &gco2th(o)->openupval, NULL, dead, NULL);
+    if (((o->gch.marked ^ LJ_GC_WHITES) & ow)) {  /* Black or current white? */
+      lj_assertG(!isdead(g, o) || (o->gch.marked & LJ_GC_FIXED),
+		 "sweep of undead object");
+      sweepwhite(g, o);  /* Value is alive, change to the current white. */
+      if (a) gc_anchoradd(a, o);
+      p = &o->gch.nextgc;
+    } else {  /* Otherwise value is dead, free it. */
+      lj_assertG(isdead(g, o) || ow == LJ_GC_SFIXED,
+		 "sweep of unlive object");
+      setgcrefr(*p, o->gch.nextgc);
+      if (dead) {  /* Leave it to the caller to free it. */
+	setgcrefr(o->gch.nextgc, *dead);
+	setgcref(*dead, o);
+      } else {
+	if (o == gcref(g->gc.root))
+	  setgcrefr(g->gc.root, o->gch.nextgc);  /* Adjust list anchor. */
+	gc_freefunc[o->gch.gct - ~LJ_TSTR](g, o);
+      }
+    }
+  }
+  return p;
+}
+#endif
+
+/* Sweep one string interning table chain. Preserves hashalg bit.
+** Dead strings are unlinked to the dead list instead, if it's given.
+*/
+static void gc_sweepstr(global_State *g, GCRef *chain, GCRef *dead)
 {
   /* Mask with other white and LJ_GC_FIXED. Or LJ_GC_SFIXED on shutdown. */
   int ow = otherwhite(g);
@@ -441,18 +685,47 @@ static void gc_sweepstr(global_State *g, GCRef *chain)
     if (((o->gch.marked ^ LJ_GC_WHITES) & ow)) {  /* Black or current white? */
       lj_assertG(!isdead(g, o) || (o->gch.marked & LJ_GC_FIXED),
 		 "sweep of undead string");
-      makewhite(g, o);  /* String is alive, change to the current white. */
+      sweepwhite(g, o);  /* String is alive, change to the current white. */
       p = &o->gch.nextgc;
     } else {  /* Otherwise string is dead, free it. */
       lj_assertG(isdead(g, o) || ow == LJ_GC_SFIXED,
 		 "sweep of unlive string");
       setgcrefr(*p, o->gch.nextgc);
-      lj_str_free(g, gco2str(o));
+      if (dead) {  /* Leave it to the caller to free it. */
+	setgcrefr(o->gch.nextgc, *dead);
+	setgcref(*dead, o);
+      } else {
+	lj_str_free(g, gco2str(o));
+      }
     }
   }
   setgcrefp(*chain, (gcrefu(q) | (u & 1)));
 }
 
+/* Sweep young strings. They are unlinked from their hash chains. */
+static void gc_sweepstr_young(global_State *g)
+{
+  int ow = otherwhite(g);
+  GCRef *ystr = mref(g->gc.ystr, GCRef);
+  MSize i, n = g->gc.ystrnum;
+  for (i = 0; i < n; i++) {
+    GCobj *o = gcref(ystr[i]);
+    if (!((o->gch.marked ^ LJ_GC_WHITES) & ow)) {  /* Dead young string? */
+      GCRef *chain = lj_str_chain(g, gco2str(o)->hash);
+      uintptr_t u = gcrefu(*chain);
+      GCobj *p = (GCobj *)(u & ~(uintptr_t)1);
+      if (p == o) {  /* Preserve hashalg bit. */
+	setgcrefp(*chain, (gcrefu(o->gch.nextgc) | (u & 1)));
+      } else {
+	while (gcnext(p) != o) p = gcnext(p);
+	setgcrefr(p->gch.nextgc, o->gch.nextgc);
+      }
+      lj_str_free(g, gco2str(o));
+    }
+  }
+  g->gc.ystrnum = 0;
+}
+
 /* Check whether we can clear a key or a value slot from a table. */
 static int gc_mayclear(cTValue *o, int val)
 {
@@ -608,13 +881,13 @@ void lj_gc_finalize_cdata(lua_State *L)
 /* Free all remaining GC objects. */
 void lj_gc_freeall(global_State *g)
 {
-  MSize i, strmask;
+  MSize i, nchain;
   /* Free everything, except super-fixed objects (the main thread). */
   g->gc.currentwhite = LJ_GC_WHITES | LJ_GC_SFIXED;
   gc_fullsweep(g, &g->gc.root);
-  strmask = g->str.mask;
-  for (i = 0; i <= strmask; i++)  /* Free all string hash chains. */
-    gc_sweepstr(g, &g->str.tab[i]);
+  nchain = gc_strnchain(g);
+  for (i = 0; i < nchain; i++)  /* Free all string hash chains. */
+    gc_sweepstr(g, gc_strchain(g, i), NULL);
 }
 
 /* -- Collector ----------------------------------------------------------- */
@@ -624,6 +897,8 @@ static void atomic(global_State *g, lua_State *L)
 {
   size_t udsize;
 
+  while (gcref(g->gc.travtab) != NULL)
+    gc_traverse_big(g);  /* Finish the traversal of a big table. */
   gc_mark_uv(g);  /* Need to remark open upvalues (the thread may be dead). */
   gc_propagate_gray(g);  /* Propagate any left-overs. */
 
@@ -633,6 +908,10 @@ static void atomic(global_State *g, lua_State *L)
   gc_markobj(g, L);  /* Mark running thread. */
   gc_traverse_curtrace(g);  /* Traverse current trace. */
   gc_mark_gcroot(g);  /* Mark GC roots (again). */
+  gc_mark_strmatch(g);  /* Mark cached patterns. */
+#if LJ_HASTABSHAPE
+  gc_mark_tabshape(g);  /* Mark keys of shape transitions. */
+#endif
   gc_propagate_gray(g);  /* Propagate all of the above. */
 
   setgcrefr(g->gc.gray, g->gc.grayagain);  /* Empty the 2nd chance list. */
@@ -646,7 +925,25 @@ static void atomic(global_State *g, lua_State *L)
   /* All marking done, clear weak tables. */
   gc_clearweak(g, gcref(g->gc.weak));
 
+  if (g->gc.gen) {  /* Old weak tables must be black to trigger the barrier. */
+    GCobj *o;
+    for (o = gcref(g->gc.weak); o != NULL; o = gcref(gco2tab(o)->gclist))
+      gray2black(o);
+#if LJ_HASFFI
+    {
+      CTState *cts = ctype_ctsG(g);
+      if (cts && cts->finalizer && isgray(obj2gco(cts->finalizer)))
+	gray2black(obj2gco(cts->finalizer));  /* Kept gray, but not weak. */
+    }
+#endif
+  }
+
   lj_buf_shrink(L, &g->tmpbuf);  /* Shrink temp buffer. */
+  if (strmatch_cache(g))  /* Ditto for the gsub buffer. */
+    lj_buf_shrink(L, &strmatch_cache(g)->sb);
+#if LJ_HASTABSITE
+  lj_tab_siteclear(g);  /* Recent tables may be swept from now on. */
+#endif
 
   /* Prepare for sweep phase. */
   g->gc.currentwhite = (uint8_t)otherwhite(g);  /* Flip current white. */
@@ -661,11 +958,31 @@ static size_t gc_onestep(lua_State *L)
   global_State *g = G(L);
   switch (g->gc.state) {
   case GCSpause:
+    if (g->gc.gen) {  /* Turn old objects white first. */
+      g->gc.state = GCSwhitenstring;
+      g->gc.sweepstr = 0;
+      return 0;
+    }
     gc_mark_start(g);  /* Start a new GC cycle by marking all GC roots. */
     return 0;
+  case GCSwhitenstring:
+    gc_whitenstr(g, gc_strchain(g, g->gc.sweepstr));  /* One chain. */
+    if (++g->gc.sweepstr >= gc_strnchain(g)) {
+      g->gc.state = GCSwhiten;  /* All string hash chains whitened. */
+      setmref(g->gc.sweep, &g->gc.root);
+    }
+    return GCSWEEPCOST;
+  case GCSwhiten:
+    setmref(g->gc.sweep,
+	    gc_whitenlist(g, mref(g->gc.sweep, GCRef), GCSWEEPMAX));
+    if (gcref(*mref(g->gc.sweep, GCRef)) == NULL)
+      gc_mark_start(g);  /* All-white heap, start marking. */
+    return GCSWEEPMAX*GCSWEEPCOST;
   case GCSpropagate:
+    if (gcref(g->gc.travtab) != NULL)
+      return gc_traverse_big(g);  /* Traverse next chunk of a big table. */
     if (gcref(g->gc.gray) != NULL)
-      return propagatemark(g);  /* Propagate one gray object. */
+      return propagatemark(g, 1);  /* Propagate one gray object. */
     g->gc.state = GCSatomic;  /* End of mark phase. */
     return 0;
   case GCSatomic:
@@ -677,21 +994,38 @@ static size_t gc_onestep(lua_State *L)
     return 0;
   case GCSsweepstring: {
     GCSize old = g->gc.total;
-    gc_sweepstr(g, &g->str.tab[g->gc.sweepstr++]);  /* Sweep one chain. */
-    if (g->gc.sweepstr > g->str.mask)
+    gc_sweepstr(g, gc_strchain(g, g->gc.sweepstr), NULL);  /* One chain. */
+    if (++g->gc.sweepstr >= gc_strnchain(g)) {
       g->gc.state = GCSsweep;  /* All string hash chains sweeped. */
+      g->gc.ystrnum = 0;  /* Young strings may have been freed. */
+    }
     lj_assertG(old >= g->gc.total, "sweep increased memory");
     g->gc.estimate -= old - g->gc.total;
     return GCSWEEPCOST;
     }
   case GCSsweep: {
     GCSize old = g->gc.total;
-    setmref(g->gc.sweep, gc_sweep(g, mref(g->gc.sweep, GCRef), GCSWEEPMAX));
+    GCRef *p = mref(g->gc.sweep, GCRef), *op = p;
+#if LJ_HASPSWEEP
+    if (p == &g->gc.root)  /* Anchors are invalid once the sweep starts. */
+      gc_anchorreset(&g->gc.anchors);
+#endif
+    p = gc_sweep(g, p, GCSWEEPMAX);
+#if LJ_HASPSWEEP
+    if (p != op)  /* Sample the last survivor of each step. */
+      gc_anchoradd(&g->gc.anchors, (GCobj *)((char *)p -
+					     offsetof(GChead, nextgc)));
+#else
+    UNUSED(op);
+#endif
+    setmref(g->gc.sweep, p);
     lj_assertG(old >= g->gc.total, "sweep increased memory");
     g->gc.estimate -= old - g->gc.total;
     if (gcref(*mref(g->gc.sweep, GCRef)) == NULL) {
       if (g->str.num <= (g->str.mask >> 2) && g->str.mask > LJ_MIN_STRTAB*2-1)
 	lj_str_resize(L, g->str.mask >> 1);  /* Shrink string table. */
+      if (g->gc.gen)  /* All survivors are old now. */
+	setgcrefr(g->gc.firstold, g->gc.root);
       if (gcref(g->gc.mmudata)) {  /* Need any finalizations? */
 	g->gc.state = GCSfinalize;
 #if LJ_HASFFI
@@ -728,38 +1062,759 @@ static size_t gc_onestep(lua_State *L)
   }
 }
 
-/* Perform a limited amount of incremental GC steps. */
-int LJ_FASTCALL lj_gc_step(lua_State *L)
+/* -- Generational mode -------------------------------------------------- */
+
+/* Objects surviving a collection in generational mode keep their marks.
+** They are old from then on and only traversed again during the next
+** major cycle, unless the write barrier puts them into the remembered set,
+** i.e. the gray or grayagain list, which is kept between collections.
+**
+** Young objects are linked to the root list in front of gc.firstold.
+** Young strings are kept in a separate vector. A minor collection marks
+** from the roots and the remembered set, but stops at old objects. Then
+** it sweeps only the young objects. Userdata and any objects created
+** during the sweep phase of the last major cycle are left to the next
+** major cycle.
+*/
+
+/* Set the threshold for the next minor collection. */
+static void gc_setminor(global_State *g)
+{
+  GCSize t = g->gc.total + (g->gc.total/100) * g->gc.genminor;
+  g->gc.threshold = t < g->gc.majorthreshold ? t : g->gc.majorthreshold;
+}
+
+/* Set the GC thresholds at the end of a full GC cycle. */
+static void gc_setthreshold(global_State *g)
+{
+  if (g->gc.gen) {
+    g->gc.majorthreshold = (g->gc.estimate/100) * g->gc.pause;
+    gc_setminor(g);
+  } else {
+    g->gc.threshold = (g->gc.estimate/100) * g->gc.pause;
+  }
+}
+
+/* Perform a minor collection. Not incremental, but only for young objects. */
+static void gc_minor(lua_State *L)
 {
   global_State *g = G(L);
-  GCSize lim;
-  int32_t ostate = g->vmstate;
-  setvmstate(g, GC);
+  GCobj *old = gcref(g->gc.firstold);
+  GCRef *p = &g->gc.root;
+  lj_assertG(g->gc.gen && g->gc.state == GCSpause, "bad GC state");
+  g->gc.state = GCSpropagate;
+  setgcrefnull(g->gc.weak);
+  gc_mark_root(g);  /* Old roots are never white, so this is cheap. */
+  gc_propagate_gray(g);  /* Includes the remembered set from the barriers. */
+  g->gc.state = GCSatomic;
+  atomic(g, L);  /* Dead young objects now have the other white. */
+  g->gc.state = GCSsweep;
+  gc_sweepstr_young(g);
+  while (gcref(*p) != NULL && gcref(*p) != old)
+    p = gc_sweep(g, p, 1);
+  if (g->str.num <= (g->str.mask >> 2) && g->str.mask > LJ_MIN_STRTAB*2-1)
+    lj_str_resize(L, g->str.mask >> 1);  /* Shrink string table. */
+  setgcrefr(g->gc.firstold, g->gc.root);
+  g->gc.state = GCSpause;
+  if (gcref(g->gc.mmudata)) {  /* Run finalizers right away. */
+#if LJ_HASFFI
+    g->gc.nocdatafin = 1;
+#endif
+    while (gcref(g->gc.mmudata) != NULL)
+      gc_finalize(L);
+#if LJ_HASFFI
+    if (!g->gc.nocdatafin) lj_tab_rehash(L, ctype_ctsG(g)->finalizer);
+#endif
+  }
+  g->gc.stats.minornum++;
+  gc_setminor(g);
+}
+
+/* Remember a new string for the next minor collection. */
+void LJ_FASTCALL lj_gc_youngstr(lua_State *L, GCstr *s)
+{
+  global_State *g = G(L);
+  if (LJ_UNLIKELY(g->gc.ystrnum >= g->gc.ystrsize)) {
+    GCRef *ystr = mref(g->gc.ystr, GCRef);
+    lj_mem_growvec(L, ystr, g->gc.ystrsize, LJ_MAX_MEM32/sizeof(GCRef), GCRef);
+    setmref(g->gc.ystr, ystr);
+  }
+  setgcref(mref(g->gc.ystr, GCRef)[g->gc.ystrnum++], obj2gco(s));
+}
+
+/* Switch between incremental and generational mode. Returns the old mode. */
+int lj_gc_setmode(lua_State *L, int gen, MSize genminor)
+{
+  global_State *g = G(L);
+  int ogen = g->gc.gen;
+  if (genminor > 0)
+    g->gc.genminor = genminor;
+  if (gen && !ogen) {
+    g->gc.gen = 1;
+    lj_gc_fullgc(L);  /* All survivors of a full GC cycle are old. */
+  } else if (!gen && ogen) {
+    while (g->gc.state != GCSpause)  /* Finish a major cycle, if any. */
+      gc_onestep(L);
+    gc_whiten(g);
+    g->gc.gen = 0;
+    lj_mem_freevec(g, mref(g->gc.ystr, GCRef), g->gc.ystrsize, GCRef);
+    setmref(g->gc.ystr, NULL);
+    g->gc.ystrnum = g->gc.ystrsize = 0;
+    gc_setthreshold(g);
+  }
+  return ogen;
+}
+
+/* -- GC timing ----------------------------------------------------------- */
+
+/* Read a monotonic clock. Returns nanoseconds. */
+static uint64_t gc_clock(void)
+{
+#if LJ_TARGET_WINDOWS
+  static double scale;
+  LARGE_INTEGER t;
+  if (scale == 0) {
+    QueryPerformanceFrequency(&t);
+    scale = 1e9 / (double)t.QuadPart;
+  }
+  QueryPerformanceCounter(&t);
+  return (uint64_t)((double)t.QuadPart * scale);
+#elif defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+  return (uint64_t)clock() * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
+
+/* Account for the time spent in a minor or major collection step. */
+static void gc_stattime(global_State *g, uint64_t t0, int minor)
+{
+  uint64_t t = gc_clock() - t0, us = t / 1000;
+  GCStats *st = &g->gc.stats;
+  uint32_t b = us == 0 ? 0 : us >= (1u << (LJ_GCHIST-2)) ? LJ_GCHIST-1 :
+	       lj_fls((uint32_t)us) + 1;
+  st->hist[b]++;
+  if (minor) {
+    st->minortime += t;
+    if (t > st->minormax) st->minormax = t;
+  } else {
+    st->majortime += t;
+    if (t > st->majormax) st->majormax = t;
+  }
+}
+
+/* -- Parallel sweep ------------------------------------------------------ */
+
+#if LJ_HASPSWEEP
+/* A full GC may sweep on helper threads. Each helper sweeps a disjoint
+** range of string hash chains. If the last sweep left enough anchors,
+** each helper sweeps the root list from one anchor up to the next, too.
+** The main thread sweeps the root list up to the first anchor and the
+** anchors themselves. The allocator isn't thread-safe, so the helpers
+** only unlink dead objects. The main thread frees them after joining
+** them.
+**
+** This is not done for incremental sweeps, since the mutator accesses
+** the string table between the steps.
+*/
+
+/* Sweep job for a helper thread. */
+typedef struct GCSweepJob {
+  global_State *g;
+  MSize start, end;	/* Range of string hash chains. */
+  GCRef dead;		/* List of unlinked dead objects. */
+  GCobj *anchor;	/* Sweep the root list after this anchor or NULL. */
+  GCobj *stop;		/* Next anchor or NULL. */
+  GCRef *last;		/* Last link of the swept root list segment. */
+  GCSweepAnchors anchors;  /* Survivors sampled in the segment. */
+#if LJ_PSWEEP_PTHREAD
+  pthread_t thread;
+#elif LJ_PSWEEP_WTHREAD
+  HANDLE thread;
+#endif
+} GCSweepJob;
+
+/* Sweep a range of string hash chains and a segment of the root list. */
+#if LJ_PSWEEP_PTHREAD
+static void *gc_sweepjob(void *ud)
+#else
+static DWORD WINAPI gc_sweepjob(void *ud)
+#endif
+{
+  GCSweepJob *job = (GCSweepJob *)ud;
+  MSize i;
+  for (i = job->start; i < job->end; i++)
+    gc_sweepstr(job->g, gc_strchain(job->g, i), &job->dead);
+  if (job->anchor)
+    job->last = gc_sweepseg(job->g, &job->anchor->gch.nextgc, job->stop,
+			    &job->dead, &job->anchors);
+  return 0;
+}
+
+/* Pick evenly spaced anchors from the survivors sampled per segment. */
+static void gc_anchormerge(GCSweepAnchors *a, GCSweepAnchors **seg,
+			   MSize nseg)
+{
+  uint64_t total = 0, sum = 0;
+  MSize i, j, k = 1;
+  GCobj *last = NULL;
+  for (i = 0; i < nseg; i++)
+    total += (uint64_t)seg[i]->n * seg[i]->stride;
+  gc_anchorreset(a);
+  for (i = 0; i < nseg; i++) {
+    for (j = 0; j < seg[i]->n; j++) {
+      GCobj *o = gcref(seg[i]->obj[j]);
+      sum += seg[i]->stride;
+      for (; k <= LJ_GC_SWEEPANCHORS &&
+	     sum * (LJ_GC_SWEEPANCHORS+1) >= total * k; k++) {
+	if (o != last)
+	  setgcref(a->obj[a->n++], o);
+	last = o;
+      }
+    }
+  }
+}
+
+/* Sweep the string table and the root list in parallel. */
+static void gc_sweep_parallel(lua_State *L)
+{
+  global_State *g = G(L);
+  GCSweepJob job[LJ_GC_SWEEPTHREADS];
+  GCSweepAnchors a0, *seg[LJ_GC_SWEEPTHREADS+1];
+  GCSize old = g->gc.total;
+  MSize i, n = g->gc.sweepthreads, nstarted, nchain = gc_strnchain(g);
+  MSize na = g->gc.anchors.n;
+  GCobj *stop = NULL;
+  GCRef *p;
+  lj_assertG(mref(g->gc.sweep, GCRef) == &g->gc.root, "bad sweep position");
+  for (i = n; i-- > 0; ) {
+    job[i].g = g;
+    job[i].start = (MSize)((uint64_t)nchain * i / n);
+    job[i].end = (MSize)((uint64_t)nchain * (i+1) / n);
+    setgcrefnull(job[i].dead);
+    job[i].anchor = NULL;
+    if (na > n) {  /* Split the root list. */
+      job[i].anchor = gcref(g->gc.anchors.obj[(i+1) * na / (n+1)]);
+      job[i].stop = stop;
+      stop = job[i].anchor;
+    }
+    gc_anchorreset(&job[i].anchors);
+  }
+  for (nstarted = 0; nstarted < n; nstarted++) {
+#if LJ_PSWEEP_PTHREAD
+    if (pthread_create(&job[nstarted].thread, NULL,
+		       gc_sweepjob, &job[nstarted]) != 0)
+      break;
+#else
+    job[nstarted].thread = CreateThread(NULL, 0, gc_sweepjob,
+					&job[nstarted], 0, NULL);
+    if (job[nstarted].thread == NULL)
+      break;
+#endif
+  }
+  /* Sweep the root list up to the first anchor meanwhile. */
+  gc_anchorreset(&a0);
+  p = gc_sweepseg(g, &g->gc.root, stop, NULL, &a0);
+  for (i = nstarted; i < n; i++)  /* Couldn't start all helpers? */
+    gc_sweepjob(&job[i]);
+  for (i = 0; i < nstarted; i++) {
+#if LJ_PSWEEP_PTHREAD
+    pthread_join(job[i].thread, NULL);
+#else
+    WaitForSingleObject(job[i].thread, INFINITE);
+    CloseHandle(job[i].thread);
+#endif
+  }
+  if (stop) {
+    /* Sweep the anchors last to first. A dead anchor is still linked from
+    ** the end of the segment before it, which may be the anchor before it.
+    */
+    GCRef *tail = job[n-1].last;
+    for (i = n; i-- > 0; ) {
+      GCRef *q = i ? job[i-1].last : p;
+      GCobj *o = job[i].anchor;
+      if (gc_sweep(g, q, 1) == q && tail == &o->gch.nextgc)
+	tail = q;  /* Freed the anchor at the end of the list. */
+    }
+    p = tail;
+  }
+  for (i = 0; i < n; i++) {
+    GCobj *o, *next;
+    for (o = gcref(job[i].dead); o != NULL; o = next) {
+      next = gcnext(o);
+      gc_freefunc[o->gch.gct - ~LJ_TSTR](g, o);
+    }
+  }
+  seg[0] = &a0;
+  for (i = 0; i < n; i++)
+    seg[i+1] = &job[i].anchors;
+  gc_anchormerge(&g->gc.anchors, seg, n+1);
+  setmref(g->gc.sweep, p);
+  lj_assertG(old >= g->gc.total, "sweep increased memory");
+  g->gc.estimate -= old - g->gc.total;
+  g->gc.sweepstr = nchain;
+  g->gc.ystrnum = 0;  /* Young strings may have been freed. */
+  g->gc.state = GCSsweep;  /* Finish the sweep phase in the next step. */
+}
+#endif
+
+/* Perform one step of a full GC cycle. */
+static void gc_fullstep(lua_State *L)
+{
+#if LJ_HASPSWEEP
+  global_State *g = G(L);
+  if (g->gc.state == GCSsweepstring && g->gc.sweepstr == 0 &&
+      g->gc.sweepthreads > 0 && g->str.mask >= GCPSWEEPMIN) {
+    gc_sweep_parallel(L);
+    return;
+  }
+#endif
+  gc_onestep(L);
+}
+
+/* -- Heap trimming ------------------------------------------------------- */
+
+/* Return free memory of the bundled allocator to the OS. */
+size_t lj_gc_trim(global_State *g)
+{
+#ifndef LUAJIT_USE_SYSMALLOC
+  if (g->allocf == lj_alloc_f)
+    return lj_alloc_trim(g->allocd);
+#endif
+  UNUSED(g);
+  return 0;
+}
+
+/* Get the memory mapped by the bundled allocator and the released part. */
+void lj_gc_memstats(global_State *g, size_t *mapped, size_t *released)
+{
+#ifndef LUAJIT_USE_SYSMALLOC
+  if (g->allocf == lj_alloc_f) {
+    lj_alloc_stats(g->allocd, mapped, released);
+    return;
+  }
+#endif
+  UNUSED(g);
+  *mapped = *released = 0;
+}
+
+/* Trim the heap at the end of a GC cycle, if too much memory is free. */
+static void gc_autotrim(global_State *g)
+{
+  size_t mapped, released, used;
+  lj_gc_memstats(g, &mapped, &released);
+  used = (size_t)g->gc.total + released;
+  if (mapped > used + GCTRIMMIN && mapped - used > (mapped/100)*LUAI_GCTRIM)
+    lj_gc_trim(g);
+}
+
+/* -- Heap snapshot ------------------------------------------------------- */
+
+/* The snapshot is a line-oriented text stream:
+**
+**   N <addr> <type> <size> [<info>]   Object with its own size in bytes.
+**   E <from> <to> <label>             Reference between two objects.
+**   R <addr> <label>                  GC root.
+**
+** Objects are enumerated from the GC lists and the string table, so each
+** one is dumped exactly once. Edges from weak table slots are prefixed
+** with '~'. Only a fixed-size buffer is used, no matter how big the heap
+** is. The writer must not call back into the Lua state.
+*/
+
+#define GCSNAPBUF	4096	/* Size of the snapshot output buffer. */
+#define GCSNAPLINE	512	/* Max. length of a snapshot line. */
+#define GCSNAPSTR	40	/* Max. string length dumped for node info. */
+
+typedef struct GCSnap {
+  global_State *g;
+  lua_State *L;
+  lua_Writer writer;
+  void *data;
+  int status;		/* Writer status. Non-zero stops the snapshot. */
+  char *p;		/* Current position in buf. */
+  char buf[GCSNAPBUF];
+} GCSnap;
+
+static const char *const gc_snaptype[] = {
+  "string", "upvalue", "thread", "proto", "function", "trace", "cdata",
+  "table", "userdata"
+};
+
+/* Get space for another line. Flushes the buffer, if needed. */
+static char *gc_snapline(GCSnap *gs)
+{
+  if (gs->p > gs->buf + (GCSNAPBUF - GCSNAPLINE)) {
+    if (gs->status == 0)
+      gs->status = gs->writer(gs->L, gs->buf, (size_t)(gs->p - gs->buf),
+			      gs->data);
+    gs->p = gs->buf;
+  }
+  return gs->p;
+}
+
+static char *gc_snapsize(char *p, uint64_t n)
+{
+  char tmp[24], *q = tmp;
+  do { *q++ = (char)('0' + n % 10); n /= 10; } while (n);
+  while (q > tmp) *p++ = *--q;
+  return p;
+}
+
+/* Write a string preview, quoted and escaped. */
+static char *gc_snapstr(char *p, const char *s, MSize len)
+{
+  MSize i, n = len < GCSNAPSTR ? len : GCSNAPSTR;
+  *p++ = '"';
+  for (i = 0; i < n; i++) {
+    uint8_t c = (uint8_t)s[i];
+    if (c >= 32 && c < 127 && c != '"' && c != '\\') {
+      *p++ = (char)c;
+    } else {
+      *p++ = '\\'; *p++ = 'x';
+      *p++ = "0123456789abcdef"[c >> 4]; *p++ = "0123456789abcdef"[c & 15];
+    }
+  }
+  *p++ = '"';
+  if (n < len) { *p++ = '.'; *p++ = '.'; *p++ = '.'; }
+  return p;
+}
+
+/* Write the location of a prototype. */
+static char *gc_snaploc(char *p, GCproto *pt)
+{
+  GCstr *name = proto_chunkname(pt);
+  p = gc_snapstr(p, strdata(name), name->len);
+  *p++ = ':';
+  return lj_strfmt_wint(p, (int32_t)pt->firstline);
+}
+
+/* Dump an edge to a GC object. */
+static void gc_snapedge(GCSnap *gs, GCobj *from, GCobj *to, int weak,
+			const char *label, cTValue *key)
+{
+  char *p;
+  if (to == NULL) return;
+  p = gc_snapline(gs);
+  *p++ = 'E'; *p++ = ' ';
+  p = lj_strfmt_wptr(p, from); *p++ = ' ';
+  p = lj_strfmt_wptr(p, to); *p++ = ' ';
+  if (weak) *p++ = '~';
+  if (key == NULL) {
+    while (*label) *p++ = *label++;
+  } else if (tvisstr(key)) {  /* Field name. */
+    p = gc_snapstr(p, strVdata(key), strV(key)->len);
+  } else {
+    *p++ = '[';
+    if (tvisint(key)) {
+      p = lj_strfmt_wint(p, intV(key));
+    } else if (tvisnum(key)) {
+      lua_Number n = numV(key);
+      if (n == (lua_Number)(int32_t)n) p = lj_strfmt_wint(p, (int32_t)n);
+      else *p++ = '#';  /* Non-integer keys are not dumped. */
+    } else if (tvisgcv(key)) {
+      p = lj_strfmt_wptr(p, gcV(key));
+    } else {
+      const char *s = tvistrue(key) ? "true" : tvisfalse(key) ? "false" :
+		      "lightuserdata";
+      while (*s) *p++ = *s++;
+    }
+    *p++ = ']';
+  }
+  *p++ = '\n';
+  gs->p = p;
+}
+
+#define gc_snaptv(gs, from, tv, weak, label, key) \
+  { if (tvisgcv(tv)) \
+      gc_snapedge(gs, obj2gco(from), gcV(tv), weak, label, key); }
+
+/* Dump the edges of a table. */
+static uint64_t gc_snaptab(GCSnap *gs, GCtab *t)
+{
+  global_State *g = gs->g;
+  GCtab *mt = tabref(t->metatable);
+  cTValue *mode = lj_meta_fastg(g, mt, MM_mode);
+  int wk = 0, wv = 0;
+  uint64_t sz = (LJ_MAX_COLOSIZE != 0 && t->colo) ?
+		sizetabcolo((uint32_t)t->colo & 0x7f) : sizeof(GCtab);
+  MSize i;
+  if (mode && tvisstr(mode)) {
+    wk = strchr(strVdata(mode), 'k') != NULL;
+    wv = strchr(strVdata(mode), 'v') != NULL;
+  }
+  if (mt) gc_snapedge(gs, obj2gco(t), obj2gco(mt), 0, "metatable", NULL);
+  for (i = 0; i < t->asize; i++) {
+    TValue k;
+    setintV(&k, (int32_t)i);
+    gc_snaptv(gs, t, arrayslot(t, i), wv, NULL, &k);
+  }
+  if (LJ_MAX_COLOSIZE == 0 || t->colo <= 0)
+    sz += sizeof(TValue) * t->asize;
+  if (t->hmask > 0) {
+    Node *node = noderef(t->node);
+    for (i = 0; i <= t->hmask; i++) {
+      Node *n = &node[i];
+      if (!tvisnil(&n->val)) {
+	gc_snaptv(gs, t, &n->key, wk, "key", NULL);
+	gc_snaptv(gs, t, &n->val, wv, NULL, &n->key);
+      }
+    }
+    sz += sizeof(Node) * (t->hmask + 1);
+  }
+  return sz;
+}
+
+/* Dump the edges of any object and return its size, including its parts. */
+static uint64_t gc_snapobj(GCSnap *gs, GCobj *o)
+{
+  global_State *g = gs->g;
+  switch (o->gch.gct) {
+  case ~LJ_TSTR:
+    return lj_str_size(gco2str(o)->len);
+  case ~LJ_TUPVAL:
+    gc_snaptv(gs, o, uvval(gco2uv(o)), 0, "value", NULL);
+    return sizeof(GCupval);
+  case ~LJ_TTHREAD: {
+    lua_State *th = gco2th(o);
+    TValue *tv;
+    for (tv = tvref(th->stack)+1+LJ_FR2; tv < th->top; tv++)
+      gc_snaptv(gs, o, tv, 0, "stack", NULL);
+    gc_snapedge(gs, o, gcref(th->env), 0, "env", NULL);
+    return sizeof(lua_State) + sizeof(TValue) * th->stacksize;
+    }
+  case ~LJ_TPROTO: {
+    GCproto *pt = gco2pt(o);
+    ptrdiff_t i;
+    gc_snapedge(gs, o, obj2gco(proto_chunkname(pt)), 0, "chunkname", NULL);
+    for (i = -(ptrdiff_t)pt->sizekgc; i < 0; i++)
+      gc_snapedge(gs, o, proto_kgc(pt, i), 0, "constant", NULL);
+#if LJ_HASJIT
+    if (pt->trace)
+      gc_snapedge(gs, o, obj2gco(traceref(G2J(g), pt->trace)), 0, "trace",
+		  NULL);
+#endif
+    return pt->sizept;
+    }
+  case ~LJ_TFUNC: {
+    GCfunc *fn = gco2func(o);
+    uint32_t i;
+    gc_snapedge(gs, o, gcref(fn->c.env), 0, "env", NULL);
+    if (isluafunc(fn)) {
+      gc_snapedge(gs, o, obj2gco(funcproto(fn)), 0, "proto", NULL);
+      for (i = 0; i < fn->l.nupvalues; i++)
+	gc_snapedge(gs, o, gcref(fn->l.uvptr[i]), 0, "upvalue", NULL);
+      return sizeLfunc((MSize)fn->l.nupvalues);
+    }
+    for (i = 0; i < fn->c.nupvalues; i++)
+      gc_snaptv(gs, o, &fn->c.upvalue[i], 0, "upvalue", NULL);
+    return sizeCfunc((MSize)fn->c.nupvalues);
+    }
+#if LJ_HASJIT
+  case ~LJ_TTRACE: {
+    GCtrace *T = gco2trace(o);
+    IRRef ref;
+    for (ref = T->nk; ref < REF_TRUE; ref++) {
+      IRIns *ir = &T->ir[ref];
+      if (ir->o == IR_KGC)
+	gc_snapedge(gs, o, ir_kgc(ir), 0, "constant", NULL);
+      if (irt_is64(ir->t) && ir->o != IR_KNULL)
+	ref++;
+    }
+    if (T->link)
+      gc_snapedge(gs, o, obj2gco(traceref(G2J(g), T->link)), 0, "link", NULL);
+    gc_snapedge(gs, o, gcref(T->startpt), 0, "proto", NULL);
+    return ((sizeof(GCtrace)+7)&~7) + (T->nins-T->nk)*sizeof(IRIns) +
+	   T->nsnap*sizeof(SnapShot) + T->nsnapmap*sizeof(SnapEntry);
+    }
+#endif
+#if LJ_HASFFI
+  case ~LJ_TCDATA: {
+    GCcdata *cd = gco2cd(o);
+    CType *ct;
+    if (cdataisv(cd))
+      return sizecdatav(cd);
+    ct = ctype_raw(ctype_ctsG(g), cd->ctypeid);
+    return sizeof(GCcdata) + (ctype_hassize(ct->info) ? ct->size : CTSIZE_PTR);
+    }
+#endif
+  case ~LJ_TTAB:
+    return gc_snaptab(gs, gco2tab(o));
+  case ~LJ_TUDATA: {
+    GCudata *ud = gco2ud(o);
+    gc_snapedge(gs, o, gcref(ud->metatable), 0, "metatable", NULL);
+    gc_snapedge(gs, o, gcref(ud->env), 0, "env", NULL);
+    if (LJ_HASBUFFER && ud->udtype == UDTYPE_BUFFER) {
+      SBufExt *sbx = (SBufExt *)uddata(ud);
+      if (sbufiscow(sbx))
+	gc_snapedge(gs, o, gcref(sbx->cowref), 0, "cow", NULL);
+      gc_snapedge(gs, o, gcref(sbx->dict_str), 0, "dict", NULL);
+      gc_snapedge(gs, o, gcref(sbx->dict_mt), 0, "dict", NULL);
+    }
+    return sizeudata(ud);
+    }
+  default:
+    lj_assertG(0, "bad GC type %d", o->gch.gct);
+    return 0;
+  }
+}
+
+/* Dump a node and its outgoing edges. */
+static void gc_snapnode(GCSnap *gs, GCobj *o)
+{
+  uint64_t sz = gc_snapobj(gs, o);
+  const char *s = gc_snaptype[o->gch.gct - ~LJ_TSTR];
+  char *p = gc_snapline(gs);
+  *p++ = 'N'; *p++ = ' ';
+  p = lj_strfmt_wptr(p, o); *p++ = ' ';
+  while (*s) *p++ = *s++;
+  *p++ = ' ';
+  p = gc_snapsize(p, sz);
+  if (o->gch.gct == ~LJ_TSTR) {
+    *p++ = ' ';
+    p = gc_snapstr(p, strdata(gco2str(o)), gco2str(o)->len);
+  } else if (o->gch.gct == ~LJ_TPROTO) {
+    *p++ = ' ';
+    p = gc_snaploc(p, gco2pt(o));
+  } else if (o->gch.gct == ~LJ_TFUNC && isluafunc(gco2func(o))) {
+    *p++ = ' ';
+    p = gc_snaploc(p, funcproto(gco2func(o)));
+  }
+  *p++ = '\n';
+  gs->p = p;
+}
+
+/* Dump a GC root. */
+static void gc_snaproot(GCSnap *gs, GCobj *o, const char *label)
+{
+  char *p;
+  if (o == NULL) return;
+  p = gc_snapline(gs);
+  *p++ = 'R'; *p++ = ' ';
+  p = lj_strfmt_wptr(p, o); *p++ = ' ';
+  while (*label) *p++ = *label++;
+  *p++ = '\n';
+  gs->p = p;
+}
+
+/* Stream a snapshot of the heap to a writer. Returns the writer status. */
+int lj_gc_snapshot(lua_State *L, lua_Writer writer, void *data)
+{
+  global_State *g = G(L);
+  GCSnap gs;
+  GCobj *o;
+  MSize i;
+  gs.g = g;
+  gs.L = L;
+  gs.writer = writer;
+  gs.data = data;
+  gs.status = 0;
+  memcpy(gs.buf, "LJHEAP 1\n", 9);
+  gs.p = gs.buf + 9;
+  gc_snaproot(&gs, obj2gco(mainthread(g)), "mainthread");
+  if (tvisgcv(&g->registrytv))
+    gc_snaproot(&gs, gcV(&g->registrytv), "registry");
+  for (i = 0; i < GCROOT_MAX; i++)
+    gc_snaproot(&gs, gcref(g->gcroot[i]), "gcroot");
+  for (o = gcref(g->gc.root); o != NULL && gs.status == 0; o = gcnext(o)) {
+    gc_snapnode(&gs, o);
+    if (o->gch.gct == ~LJ_TTHREAD) {  /* Open upvalues are not in the list. */
+      GCobj *uv;
+      for (uv = gcref(gco2th(o)->openupval); uv != NULL; uv = gcnext(uv))
+	gc_snapnode(&gs, uv);
+    }
+  }
+  if ((o = gcref(g->gc.mmudata)) != NULL) {  /* Pending finalizers. */
+    GCobj *root = o;
+    do {
+      o = gcnext(o);
+      gc_snapnode(&gs, o);
+    } while (o != root);
+  }
+  gc_snapnode(&gs, obj2gco(&g->strempty));  /* Not in the string table. */
+  for (i = 0; i < gc_strnchain(g) && gs.status == 0; i++) {
+    o = (GCobj *)(gcrefu(*gc_strchain(g, i)) & ~(uintptr_t)1);
+    for (; o != NULL; o = gcnext(o))
+      gc_snapnode(&gs, o);
+  }
+  if (gs.status == 0 && gs.p > gs.buf)
+    gs.status = writer(L, gs.buf, (size_t)(gs.p - gs.buf), data);
+  return gs.status;
+}
+
+/* -- Collector driver ---------------------------------------------------- */
+
+/* Perform a limited amount of incremental GC steps.
+** With a time budget, the step ends early once the budget is used up.
+** The remaining work is added to the debt and done in the next steps.
+*/
+static int gc_step(lua_State *L, uint64_t t0)
+{
+  global_State *g = G(L);
+  GCSize lim, acc = 0;
+  uint64_t deadline = t0 + (uint64_t)g->gc.budget * 1000;
   lim = (GCSTEPSIZE/100) * g->gc.stepmul;
   if (lim == 0)
     lim = LJ_MAX_MEM;
   if (g->gc.total > g->gc.threshold)
     g->gc.debt += g->gc.total - g->gc.threshold;
   do {
-    lim -= (GCSize)gc_onestep(L);
+    GCSize cost = (GCSize)gc_onestep(L);
+    lim -= cost;
     if (g->gc.state == GCSpause) {
-      g->gc.threshold = (g->gc.estimate/100) * g->gc.pause;
-      g->vmstate = ostate;
+      gc_setthreshold(g);
+      gc_autotrim(g);
       return 1;  /* Finished a GC cycle. */
     }
+    if (g->gc.budget && (acc += cost) >= GCBUDGETCHECK) {
+      acc = 0;
+      if (gc_clock() >= deadline) {  /* Out of time. */
+	if (sizeof(lim) == 8 ? ((int64_t)lim > 0) : ((int32_t)lim > 0))
+	  g->gc.debt += lim;
+	break;
+      }
+    }
   } while (sizeof(lim) == 8 ? ((int64_t)lim > 0) : ((int32_t)lim > 0));
   if (g->gc.debt < GCSTEPSIZE) {
     g->gc.threshold = g->gc.total + GCSTEPSIZE;
-    g->vmstate = ostate;
     return -1;
   } else {
     g->gc.debt -= GCSTEPSIZE;
     g->gc.threshold = g->gc.total;
-    g->vmstate = ostate;
     return 0;
   }
 }
 
+/* Perform a minor collection or a limited amount of incremental GC steps. */
+int LJ_FASTCALL lj_gc_step(lua_State *L)
+{
+  global_State *g = G(L);
+  int32_t ostate = g->vmstate;
+  uint64_t t0;
+  int res;
+  if (LJ_UNLIKELY(g->str.oldtab != NULL))  /* Pending string table resize? */
+    lj_str_migrate(g, GCSTRMIGRATE);
+  if (g->gc.gen && g->gc.state == GCSpause &&
+      g->gc.total < g->gc.majorthreshold) {
+    if (tvref(g->jit_base))  /* Don't run a minor collection on trace. */
+      return -1;
+    setvmstate(g, GC);
+    t0 = gc_clock();
+    gc_minor(L);
+    gc_stattime(g, t0, 1);
+    g->vmstate = ostate;
+    return 1;
+  }
+  setvmstate(g, GC);
+  t0 = gc_clock();
+  res = gc_step(L, t0);
+  gc_stattime(g, t0, 0);
+  g->vmstate = ostate;
+  return res;
+}
+
 /* Ditto, but fix the stack top first. */
 void LJ_FASTCALL lj_gc_step_fixtop(lua_State *L)
 {
@@ -772,12 +1827,15 @@ void LJ_FASTCALL lj_gc_step_fixtop(lua_State *L)
 int LJ_FASTCALL lj_gc_step_jit(global_State *g, MSize steps)
 {
   lua_State *L = gco2th(gcref(g->cur_L));
+  if (g->vmstate > 0)  /* Sample the running trace for eviction. */
+    lj_trace_touch(G2J(g), (TraceNo)g->vmstate);
   L->base = tvref(G(L)->jit_base);
   L->top = curr_topL(L);
   while (steps-- > 0 && lj_gc_step(L) == 0)
     ;
   /* Return 1 to force a trace exit. */
-  return (G(L)->gc.state == GCSatomic || G(L)->gc.state == GCSfinalize);
+  return (G(L)->gc.state == GCSatomic || G(L)->gc.state == GCSfinalize ||
+	  lj_gc_minordue(G(L)));
 }
 #endif
 
@@ -786,38 +1844,52 @@ void lj_gc_fullgc(lua_State *L)
 {
   global_State *g = G(L);
   int32_t ostate = g->vmstate;
+  uint64_t t0 = gc_clock();
   setvmstate(g, GC);
   if (g->gc.state <= GCSatomic) {  /* Caught somewhere in the middle. */
     setmref(g->gc.sweep, &g->gc.root);  /* Sweep everything (preserving it). */
     setgcrefnull(g->gc.gray);  /* Reset lists from partial propagation. */
     setgcrefnull(g->gc.grayagain);
     setgcrefnull(g->gc.weak);
+    setgcrefnull(g->gc.travtab);
     g->gc.state = GCSsweepstring;  /* Fast forward to the sweep phase. */
     g->gc.sweepstr = 0;
   }
   while (g->gc.state == GCSsweepstring || g->gc.state == GCSsweep)
-    gc_onestep(L);  /* Finish sweep. */
+    gc_fullstep(L);  /* Finish sweep. */
   lj_assertG(g->gc.state == GCSfinalize || g->gc.state == GCSpause,
 	     "bad GC state");
   /* Now perform a full GC. */
   g->gc.state = GCSpause;
-  do { gc_onestep(L); } while (g->gc.state != GCSpause);
-  g->gc.threshold = (g->gc.estimate/100) * g->gc.pause;
+  do { gc_fullstep(L); } while (g->gc.state != GCSpause);
+  gc_setthreshold(g);
+  gc_autotrim(g);
+  gc_stattime(g, t0, 0);
   g->vmstate = ostate;
 }
 
 /* -- Write barriers ------------------------------------------------------ */
 
+/* The invariant must hold while marking and all the time in generational
+** mode, since old objects are not traversed by the next minor collection.
+** Except while old objects are turned white before a major cycle.
+*/
+#define gc_keepinvariant(g) \
+  ((g)->gc.state == GCSpropagate || (g)->gc.state == GCSatomic || \
+   ((g)->gc.gen && (g)->gc.state != GCSwhitenstring && \
+    (g)->gc.state != GCSwhiten))
+
 /* Move the GC propagation frontier forward. */
 void lj_gc_barrierf(global_State *g, GCobj *o, GCobj *v)
 {
   lj_assertG(isblack(o) && iswhite(v) && !isdead(g, v) && !isdead(g, o),
 	     "bad object states for forward barrier");
-  lj_assertG(g->gc.state != GCSfinalize && g->gc.state != GCSpause,
+  lj_assertG(g->gc.gen ||
+	     (g->gc.state != GCSfinalize && g->gc.state != GCSpause),
 	     "bad GC state");
   lj_assertG(o->gch.gct != ~LJ_TTAB, "barrier object is not a table");
   /* Preserve invariant during propagation. Otherwise it doesn't matter. */
-  if (g->gc.state == GCSpropagate || g->gc.state == GCSatomic)
+  if (gc_keepinvariant(g))
     gc_mark(g, v);  /* Move frontier forward. */
   else
     makewhite(g, o);  /* Make it white to avoid the following barrier. */
@@ -828,7 +1900,7 @@ void LJ_FASTCALL lj_gc_barrieruv(global_State *g, TValue *tv)
 {
 #define TV2MARKED(x) \
   (*((uint8_t *)(x) - offsetof(GCupval, tv) + offsetof(GCupval, marked)))
-  if (g->gc.state == GCSpropagate || g->gc.state == GCSatomic)
+  if (gc_keepinvariant(g))
     gc_mark(g, gcV(tv));
   else
     TV2MARKED(tv) = (TV2MARKED(tv) & (uint8_t)~LJ_GC_COLORS) | curwhite(g);
@@ -846,7 +1918,7 @@ void lj_gc_closeuv(global_State *g, GCupval *uv)
   setgcrefr(o->gch.nextgc, g->gc.root);
   setgcref(g->gc.root, o);
   if (isgray(o)) {  /* A closed upvalue is never gray, so fix this. */
-    if (g->gc.state == GCSpropagate || g->gc.state == GCSatomic) {
+    if (gc_keepinvariant(g)) {
       gray2black(o);  /* Make it black and preserve invariant. */
       if (tviswhite(&uv->tv))
 	lj_gc_barrierf(g, o, gcV(&uv->tv));
@@ -862,13 +1934,22 @@ void lj_gc_closeuv(global_State *g, GCupval *uv)
 /* Mark a trace if it's saved during the propagation phase. */
 void lj_gc_barriertrace(global_State *g, uint32_t traceno)
 {
-  if (g->gc.state == GCSpropagate || g->gc.state == GCSatomic)
+  if (gc_keepinvariant(g))
     gc_marktrace(g, traceno);
 }
 #endif
 
 /* -- Allocator ----------------------------------------------------------- */
 
+/* Charge an allocation against the allocation profiler sample interval. */
+#if LJ_HASPROFILE
+#define gc_profalloc(g, sz) \
+  { if (LJ_UNLIKELY((sz) >= (g)->gc.profcount)) lj_profile_alloc((g), (sz)); \
+    else (g)->gc.profcount -= (sz); }
+#else
+#define gc_profalloc(g, sz)	{ UNUSED(g); }
+#endif
+
 /* Call pluggable memory allocator to allocate or resize a fragment. */
 void *lj_mem_realloc(lua_State *L, void *p, GCSize osz, GCSize nsz)
 {
@@ -885,6 +1966,8 @@ void *lj_mem_realloc(lua_State *L, void *p, GCSize osz, GCSize nsz)
   g->gc.allocated += nsz;
   g->gc.freed += osz;
 #endif
+  if (nsz > osz)
+    gc_profalloc(g, nsz - osz);
   return p;
 }
 
@@ -901,6 +1984,7 @@ void * LJ_FASTCALL lj_mem_newgco(lua_State *L, GCSize size)
 #ifdef COUNTS
   g->gc.allocated += size;
 #endif
+  gc_profalloc(g, size);
   setgcrefr(o->gch.nextgc, g->gc.root);
   setgcref(g->gc.root, o);
   newwhite(g, o);
@@ -10,7 +10,8 @@
 
 /* Garbage collector states. Order matters. */
 enum {
-  GCSpause, GCSpropagate, GCSatomic, GCSsweepstring, GCSsweep, GCSfinalize
+  GCSpause, GCSwhitenstring, GCSwhiten, GCSpropagate, GCSatomic,
+  GCSsweepstring, GCSsweep, GCSfinalize
 };
 
 /* Bitmasks for marked field of GCobj. */
@@ -23,6 +24,10 @@ enum {
 #define LJ_GC_CDATA_FIN	0x10
 #define LJ_GC_FIXED	0x20
 #define LJ_GC_SFIXED	0x40
+/* Frozen objects live outside of the heap. They are never white, so the
+** collector neither marks nor sweeps them. Never set for cdata (cdataisv).
+*/
+#define LJ_GC_FROZEN	0x80
 
 #define LJ_GC_WHITES	(LJ_GC_WHITE0 | LJ_GC_WHITE1)
 #define LJ_GC_COLORS	(LJ_GC_WHITES | LJ_GC_BLACK)
@@ -35,6 +40,11 @@ enum {
 #define tviswhite(x)	(tvisgcv(x) && iswhite(gcV(x)))
 #define otherwhite(g)	(g->gc.currentwhite ^ LJ_GC_WHITES)
 #define isdead(g, v)	((v)->gch.marked & otherwhite(g) & LJ_GC_WHITES)
+#if LJ_HASFROZEN
+#define tabisfrozen(t)	((t)->marked & LJ_GC_FROZEN)
+#else
+#define tabisfrozen(t)	0
+#endif
 
 #define curwhite(g)	((g)->gc.currentwhite & LJ_GC_WHITES)
 #define newwhite(g, x)	(obj2gco(x)->gch.marked = (uint8_t)curwhite(g))
@@ -43,8 +53,14 @@ enum {
 #define flipwhite(x)	((x)->gch.marked ^= LJ_GC_WHITES)
 #define black2gray(x)	((x)->gch.marked &= (uint8_t)~LJ_GC_BLACK)
 #define fixstring(s)	((s)->marked |= LJ_GC_FIXED)
+/* Sweep survivors keep their marks in generational mode, i.e. turn old. */
+#define sweepwhite(g, x) \
+  { if (!(g)->gc.gen) makewhite(g, x); }
 #define markfinalized(x)	((x)->gch.marked |= LJ_GC_FINALIZED)
 
+/* Max. number of helper threads for a parallel sweep. */
+#define LJ_GC_SWEEPTHREADS	(LJ_HASPSWEEP ? 64 : 0)
+
 /* Collector. */
 LJ_FUNC size_t lj_gc_separateudata(global_State *g, int all);
 LJ_FUNC void lj_gc_finalize_udata(lua_State *L);
@@ -60,6 +76,17 @@ LJ_FUNCA void LJ_FASTCALL lj_gc_step_fixtop(lua_State *L);
 LJ_FUNC int LJ_FASTCALL lj_gc_step_jit(global_State *g, MSize steps);
 #endif
 LJ_FUNC void lj_gc_fullgc(lua_State *L);
+LJ_FUNC int lj_gc_setmode(lua_State *L, int gen, MSize genminor);
+LJ_FUNC size_t lj_gc_trim(global_State *g);
+LJ_FUNC void lj_gc_memstats(global_State *g, size_t *mapped,
+			    size_t *released);
+LJ_FUNC int lj_gc_snapshot(lua_State *L, lua_Writer writer, void *data);
+LJ_FUNC void LJ_FASTCALL lj_gc_youngstr(lua_State *L, GCstr *s);
+
+/* Generational mode: a minor collection is due, but not possible on trace. */
+#define lj_gc_minordue(g) \
+  ((g)->gc.gen && (g)->gc.state == GCSpause && \
+   (g)->gc.total >= (g)->gc.threshold)
 
 /* GC check: drive collector forward if the GC threshold has been reached. */
 #define lj_gc_check(L) \
@@ -83,7 +110,8 @@ static LJ_AINLINE void lj_gc_barrierback(global_State *g, GCtab *t)
   GCobj *o = obj2gco(t);
   lj_assertG(isblack(o) && !isdead(g, o),
 	     "bad object states for backward barrier");
-  lj_assertG(g->gc.state != GCSfinalize && g->gc.state != GCSpause,
+  lj_assertG(g->gc.gen ||
+	     (g->gc.state != GCSfinalize && g->gc.state != GCSpause),
 	     "bad GC state");
   black2gray(o);
   setgcrefr(t->gclist, g->gc.grayagain);
@@ -125,6 +153,14 @@ static LJ_AINLINE void lj_mem_free(global_State *g, void *p, size_t osize)
   g->allocf(g->allocd, p, osize, 0);
 }
 
+/* Heap accounting. */
+#define lj_mem_accnew(g, c, sz) \
+  ((g)->gc.heapbytes[(c)] += (GCSize)(sz), (g)->gc.heapnum[(c)]++)
+#define lj_mem_accfree(g, c, sz) \
+  ((g)->gc.heapbytes[(c)] -= (GCSize)(sz), (g)->gc.heapnum[(c)]--)
+#define lj_mem_accsize(g, c, osz, nsz) \
+  ((g)->gc.heapbytes[(c)] += (GCSize)(nsz) - (GCSize)(osz))
+
 #define lj_mem_newvec(L, n, t)	((t *)lj_mem_new(L, (GCSize)((n)*sizeof(t))))
 #define lj_mem_reallocvec(L, p, on, n, t) \
   ((p) = (t *)lj_mem_realloc(L, p, (on)*sizeof(t), (GCSize)((n)*sizeof(t))))
@@ -18,6 +18,9 @@
 #include "lj_buf.h"
 #include "lj_str.h"
 #include "lj_tab.h"
+#include "lj_func.h"
+#include "lj_state.h"
+#include "lj_frozen.h"
 #include "lj_ir.h"
 #include "lj_jit.h"
 #include "lj_ircall.h"
@@ -32,6 +35,7 @@
 #include "lj_strscan.h"
 #include "lj_serialize.h"
 #include "lj_strfmt.h"
+#include "lj_strmatch.h"
 #include "lj_prng.h"
 
 /* Some local macros to save typing. Undef'd at the end. */
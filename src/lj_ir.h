@@ -120,6 +120,7 @@
   _(XSNEW,	A , ref, ref) \
   _(TNEW,	AW, lit, lit) \
   _(TDUP,	AW, ref, ___) \
+  _(FNEW,	AW, ref, ref) \
   _(CNEW,	AW, ref, ref) \
   _(CNEWI,	NW, ref, ref)  /* CSE is ok, not marked as A. */ \
   \
@@ -189,6 +190,12 @@ IRFPMDEF(FPMENUM)
   IRFPM__MAX
 } IRFPMathOp;
 
+#if LJ_HASTABSHAPE
+#define IRFL_TAB_SHAPE_OFS	offsetof(GCtab, shape)
+#else
+#define IRFL_TAB_SHAPE_OFS	offsetof(GCtab, hmask)  /* Never emitted. */
+#endif
+
 /* FLOAD fields. */
 #define IRFLDEF(_) \
   _(STR_LEN,	offsetof(GCstr, len)) \
@@ -196,12 +203,15 @@ IRFPMDEF(FPMENUM)
   _(FUNC_PC,	offsetof(GCfunc, l.pc)) \
   _(FUNC_FFID,	offsetof(GCfunc, l.ffid)) \
   _(THREAD_ENV,	offsetof(lua_State, env)) \
+  _(THREAD_OPENUPVAL, offsetof(lua_State, openupval)) \
+  _(UPVAL_V,	offsetof(GCupval, v)) \
   _(TAB_META,	offsetof(GCtab, metatable)) \
   _(TAB_ARRAY,	offsetof(GCtab, array)) \
   _(TAB_NODE,	offsetof(GCtab, node)) \
   _(TAB_ASIZE,	offsetof(GCtab, asize)) \
   _(TAB_HMASK,	offsetof(GCtab, hmask)) \
   _(TAB_NOMM,	offsetof(GCtab, nomm)) \
+  _(TAB_SHAPE,	IRFL_TAB_SHAPE_OFS) \
   _(UDATA_META,	offsetof(GCudata, metatable)) \
   _(UDATA_UDTYPE, offsetof(GCudata, udtype)) \
   _(UDATA_FILE,	sizeof(GCudata)) \
@@ -588,6 +598,7 @@ typedef union IRIns {
 #define ir_ktab(ir)	(gco2tab(ir_kgc((ir))))
 #define ir_kfunc(ir)	(gco2func(ir_kgc((ir))))
 #define ir_kcdata(ir)	(gco2cd(ir_kgc((ir))))
+#define ir_kproto(ir)	(gco2pt(ir_kgc((ir))))
 #define ir_knum(ir)	check_exp((ir)->o == IR_KNUM, &(ir)[1].tv)
 #define ir_kint64(ir)	check_exp((ir)->o == IR_KINT64, &(ir)[1].tv)
 #define ir_k64(ir)	check_exp(ir_isk64(ir), &(ir)[1].tv)
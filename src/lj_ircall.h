@@ -125,6 +125,12 @@ typedef struct CCallInfo {
 #define IRCALLCOND_BUFFFI(x)		NULL
 #endif
 
+#if LJ_HASFROZEN
+#define IRCALLCOND_FROZEN(x)		x
+#else
+#define IRCALLCOND_FROZEN(x)		NULL
+#endif
+
 #if LJ_SOFTFP
 #define XA_FP		CCI_XA
 #define XA2_FP		(CCI_XA+CCI_XA)
@@ -155,6 +161,8 @@ typedef struct CCallInfo {
   _(ANY,	lj_str_find,		4,   N, PGC, 0) \
   _(ANY,	lj_str_new,		3,   S, STR, CCI_L|CCI_T) \
   _(ANY,	lj_strscan_num,		2,  FN, INT, 0) \
+  _(ANY,	lj_strmatch_rec,	4,   S, INT, CCI_L|CCI_T) \
+  _(ANY,	lj_strmatch_gsub,	5,   S, STR, CCI_L|CCI_T) \
   _(ANY,	lj_strfmt_int,		2,  FN, STR, CCI_L|CCI_T) \
   _(ANY,	lj_strfmt_num,		2,  FN, STR, CCI_L|CCI_T) \
   _(ANY,	lj_strfmt_char,		2,  FN, STR, CCI_L|CCI_T) \
@@ -185,15 +193,20 @@ typedef struct CCallInfo {
   _(ANY,	lj_tab_new_ah,		3,   A, TAB, CCI_L|CCI_T) \
   _(ANY,	lj_tab_new1,		2,  FA, TAB, CCI_L|CCI_T) \
   _(ANY,	lj_tab_dup,		2,  FA, TAB, CCI_L|CCI_T) \
+  _(ANY,	lj_func_newL_closed,	3,   A, FUNC, CCI_L|CCI_T) \
   _(ANY,	lj_tab_clear,		1,  FS, NIL, 0) \
+  _(ANY,	lj_tab_sort,		2,  FS, INT, 0) \
+  _(ANY,	lj_tab_move,		6,   S, NIL, CCI_L|CCI_T) \
+  _(ANY,	lj_tab_fill,		5,   S, NIL, CCI_L|CCI_T) \
+  _(FROZEN,	lj_frozen_gettv,	3,   S, NIL, CCI_L|CCI_T) \
   _(ANY,	lj_tab_newkey,		3,   S, PGC, CCI_L|CCI_T) \
   _(ANY,	lj_tab_keyindex,	2,  FL, INT, 0) \
   _(ANY,	lj_vm_next,		2,  FL, PTR, 0) \
   _(ANY,	lj_tab_len,		1,  FL, INT, 0) \
+  _(ANY,	lj_state_costatus,	2,  FN, INT, 0) \
   _(ANY,	lj_tab_len_hint,	2,  FL, INT, 0) \
   _(ANY,	lj_gc_step_jit,		2,  FS, NIL, CCI_L) \
   _(ANY,	lj_gc_barrieruv,	2,  FS, NIL, 0) \
-  _(ANY,	lj_mem_newgco,		2,  FA, PGC, CCI_L|CCI_T) \
   _(ANY,	lj_prng_u64d,		1,  FS, NUM, CCI_CASTU64) \
   _(ANY,	lj_vm_modi,		2,  FN, INT, 0) \
   _(ANY,	log10,			1,   N, NUM, XA_FP) \
@@ -254,6 +267,7 @@ typedef struct CCallInfo {
   _(FFI,	lj_carith_powi64,	2,   N, I64, XA2_64|CCI_NOFPRCLOBBER) \
   _(FFI,	lj_carith_powu64,	2,   N, U64, XA2_64|CCI_NOFPRCLOBBER) \
   _(FFI,	lj_cdata_newv,		4,   S, CDATA, CCI_L) \
+  _(FFI,	lj_cdata_newgco,	2,  FA, PGC, CCI_L|CCI_T) \
   _(FFI,	lj_cdata_setfin,	4,   S, NIL, CCI_L) \
   _(FFI,	strlen,			1,   L, INTP, 0) \
   _(FFI,	memcpy,			3,   S, PTR, 0) \
@@ -23,9 +23,10 @@
 #define JIT_F_SSE3		(JIT_F_CPU << 0)
 #define JIT_F_SSE4_1		(JIT_F_CPU << 1)
 #define JIT_F_BMI2		(JIT_F_CPU << 2)
+#define JIT_F_SSE4_2		(JIT_F_CPU << 3)
 
 
-#define JIT_F_CPUSTRING		"\4SSE3\6SSE4.1\4BMI2"
+#define JIT_F_CPUSTRING		"\4SSE3\6SSE4.1\4BMI2\6SSE4.2"
 
 #elif LJ_TARGET_ARM
 
@@ -88,17 +89,19 @@
 #define JIT_F_OPT_SINK		(JIT_F_OPT << 8)
 #define JIT_F_OPT_FUSE		(JIT_F_OPT << 9)
 #define JIT_F_OPT_FMA		(JIT_F_OPT << 10)
+#define JIT_F_OPT_SHAPE		(JIT_F_OPT << 11)
 
 /* Optimizations names for -O. Must match the order above. */
 #define JIT_F_OPTSTRING	\
-  "\4fold\3cse\3dce\3fwd\3dse\6narrow\4loop\3abc\4sink\4fuse\3fma"
+  "\4fold\3cse\3dce\3fwd\3dse\6narrow\4loop\3abc\4sink\4fuse\3fma\5shape"
 
 /* Optimization levels set a fixed combination of flags. */
 #define JIT_F_OPT_0	0
 #define JIT_F_OPT_1	(JIT_F_OPT_FOLD|JIT_F_OPT_CSE|JIT_F_OPT_DCE)
 #define JIT_F_OPT_2	(JIT_F_OPT_1|JIT_F_OPT_NARROW|JIT_F_OPT_LOOP)
 #define JIT_F_OPT_3	(JIT_F_OPT_2|\
-  JIT_F_OPT_FWD|JIT_F_OPT_DSE|JIT_F_OPT_ABC|JIT_F_OPT_SINK|JIT_F_OPT_FUSE)
+  JIT_F_OPT_FWD|JIT_F_OPT_DSE|JIT_F_OPT_ABC|JIT_F_OPT_SINK|JIT_F_OPT_FUSE|\
+  JIT_F_OPT_SHAPE)
 #define JIT_F_OPT_DEFAULT	JIT_F_OPT_3
 /* Note: FMA is not set by default. */
 
@@ -120,10 +123,12 @@
   _(\007, maxside,	100)	/* Max. # of side traces of a root trace. */ \
   _(\007, maxsnap,	500)	/* Max. # of snapshots for a trace. */ \
   _(\011, minstitch,	0)	/* Min. # of IR ins for a stitched trace. */ \
+  _(\005, evict,	25)	/* % of cache to evict when full (or 0). */ \
   \
   _(\007, hotloop,	56)	/* # of iter. to detect a hot loop/call. */ \
   _(\007, hotexit,	10)	/* # of taken exits to start a side trace. */ \
   _(\007, tryside,	4)	/* # of attempts to compile a side trace. */ \
+  _(\007, hotsite,	8)	/* # of iter. per hot site sample (or 0). */ \
   \
   _(\012, instunroll,	4)	/* Max. unroll for instable loops. */ \
   _(\012, loopunroll,	15)	/* Max. unroll for loop ops in side traces. */ \
@@ -184,6 +189,12 @@ typedef struct MCLink {
   size_t size;		/* Size of current area. */
 } MCLink;
 
+/* Free range of machine code left behind by evicted traces. */
+typedef struct MCHole {
+  MCode *bot;		/* Bottom of free range. */
+  MCode *top;		/* Top of free range. */
+} MCHole;
+
 /* Stack snapshot header. */
 typedef struct SnapShot {
   uint32_t mapofs;	/* Offset into snapshot map. */
@@ -285,6 +296,8 @@ typedef struct GCtrace {
   uint8_t topslot;	/* Top stack slot already checked to be allocated. */
   uint8_t linktype;	/* Type of link. */
   uint8_t unused1;
+  MSize szmcres;	/* Size of reserved machine code incl. padding. */
+  uint32_t lastuse;	/* Eviction clock at last use (root trace only). */
 #ifdef LUAJIT_USE_GDBJIT
   void *gdbjit_entry;	/* GDB JIT entry. */
 #endif
@@ -316,6 +329,18 @@ typedef struct HotPenalty {
 #define PENALTY_MAX	60000	/* Maximum penalty value. */
 #define PENALTY_RNDBITS	4	/* # of random bits to add to penalty value. */
 
+/* Hot counter of a loop or function entry. Sampled from the hotcounts. */
+typedef struct HotSite {
+  BCPos pos;		/* Bytecode position of the loop or function entry. */
+  uint32_t count;	/* Sampled hotcount. */
+  uint32_t limit;	/* Hotcount needed to start a root trace. */
+  uint32_t nabort;	/* Number of aborted root traces. */
+  uint32_t ntrace;	/* Number of completed root traces. */
+  uint32_t reason;	/* Last abort reason (really TraceErr). */
+} HotSite;
+
+#define EVICT_SLOTS	64	/* Evicted start PC slots. Power of 2. */
+
 /* Round-robin backpropagation cache for narrowing conversions. */
 typedef struct BPropEntry {
   IRRef1 key;		/* Key: original reference. */
@@ -439,6 +464,7 @@ typedef struct jit_State {
 
   const BCIns *bc_min;	/* Start of allowed bytecode range for root trace. */
   MSize bc_extent;	/* Extent of the range. */
+  ptrdiff_t uvtop;	/* Stack offset above top open upvalue at start. */
 
   TraceState state;	/* Trace compiler state. */
 
@@ -487,6 +513,13 @@ typedef struct jit_State {
   HotPenalty penalty[PENALTY_SLOTS];  /* Penalty slots. */
   uint32_t penaltyslot;	/* Round-robin index into penalty slots. */
 
+  uint32_t evictclock;	/* Eviction clock. Ticks once for every new trace. */
+  MRef evictpc[EVICT_SLOTS];  /* Start PCs of recently evicted root traces. */
+  uint32_t evictslot;	/* Round-robin index into evicted start PCs. */
+  uint32_t nevict;	/* Overall number of evicted traces. */
+  uint32_t nrerecord;	/* Overall number of re-recorded evicted traces. */
+  uint32_t nflush;	/* Overall number of flushes of all traces. */
+
 #ifdef LUAJIT_ENABLE_TABLE_BUMP
   RBCHashEntry rbchash[RBCHASH_SLOTS];  /* Reverse bytecode map. */
 #endif
@@ -505,11 +538,16 @@ typedef struct jit_State {
   BCIns patchins;	/* Instruction for pending re-patch. */
 
   int mcprot;		/* Protection of current mcode area. */
+  int mchuge;		/* Use transparent huge pages for mcode areas. */
   MCode *mcarea;	/* Base of current mcode area. */
   MCode *mctop;		/* Top of current mcode area. */
   MCode *mcbot;		/* Bottom of current mcode area. */
   size_t szmcarea;	/* Size of current mcode area. */
   size_t szallmcarea;	/* Total size of all allocated mcode areas. */
+  MCode *mcchain;	/* Newest mcode area. Links to all older areas. */
+  MCHole *mchole;	/* Free mcode ranges, sorted by address. */
+  MSize nmchole;	/* Number of free mcode ranges. */
+  MSize sizemchole;	/* Size of free mcode range array. */
 #ifdef COUNTS
   size_t tracenum;	/* Overall number of traces. */
   size_t nsnaprestore;	/* Overall number of snap restores. */
@@ -66,6 +66,13 @@ static const uint8_t *lib_read_lfunc(lua_State *L, const uint8_t *p, GCtab *tab)
   pt = lj_bcread_proto(&ls);
   pt->firstline = ~(BCLine)0;
   fn = lj_func_newL_empty(L, pt, tabref(L->env));
+  if (pt->sizeuv) {  /* Upvalues are pushed before, like for C functions. */
+    MSize i;
+    L->top -= pt->sizeuv;
+    /* NOBARRIER: The upvalues are new (marked white). */
+    for (i = 0; i < pt->sizeuv; i++)
+      copyTV(L, uvval(&gcref(fn->l.uvptr[i])->uv), L->top+i);
+  }
   /* NOBARRIER: See below for common barrier. */
   setfuncV(L, lj_tab_setstr(L, tab, name), fn);
   return (const uint8_t *)ls.p;
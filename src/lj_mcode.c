@@ -124,6 +124,16 @@ static int mcode_setprot(void *p, size_t sz, int prot)
   return mprotect(p, sz, prot);
 }
 
+#if LJ_TARGET_LINUX && defined(MADV_HUGEPAGE)
+#define MCODE_HUGEPAGE		((size_t)2 << 20)
+
+/* Ask for transparent huge pages for an mcode area. */
+static void mcode_hugepage(void *p, size_t sz)
+{
+  madvise(p, sz, MADV_HUGEPAGE);  /* Ignore result. It's just a hint. */
+}
+#endif
+
 #else
 
 #error "Missing OS support for explicit placement of executable memory"
@@ -217,7 +227,7 @@ static void *mcode_alloc(jit_State *J, size_t sz)
 #endif
   const uintptr_t range = (1u << (LJ_TARGET_JUMPRANGE-1)) - (1u << 21);
   /* First try a contiguous area below the last one. */
-  uintptr_t hint = J->mcarea ? (uintptr_t)J->mcarea - sz : 0;
+  uintptr_t hint = J->mcchain ? (uintptr_t)J->mcchain - sz : 0;
   int i;
   /* Limit probing iterations, depending on the available pool size. */
   for (i = 0; i < LJ_TARGET_JUMPRANGE; i++) {
@@ -234,6 +244,10 @@ static void *mcode_alloc(jit_State *J, size_t sz)
       hint = lj_prng_u64(&J2G(J)->prng) & ((1u<<LJ_TARGET_JUMPRANGE)-0x10000);
     } while (!(hint + sz < range+range));
     hint = target + hint - range;
+#ifdef MCODE_HUGEPAGE
+    if (J->mchuge)  /* Huge pages need 2MB-aligned areas. */
+      hint &= ~(uintptr_t)(MCODE_HUGEPAGE-1);
+#endif
   }
   lj_trace_err(J, LJ_TRERR_MCODEAL);  /* Give up. OS probably ignores hints? */
   return NULL;
@@ -261,13 +275,92 @@ static void *mcode_alloc(jit_State *J, size_t sz)
 
 /* -- MCode area management ----------------------------------------------- */
 
+/* Get the size of an MCode area. */
+static size_t mcode_areasize(jit_State *J)
+{
+  size_t sz = (size_t)J->param[JIT_P_sizemcode] << 10;
+#ifdef MCODE_HUGEPAGE
+  if (J->mchuge)  /* Round up to full huge pages. */
+    return (sz + MCODE_HUGEPAGE-1) & ~(size_t)(MCODE_HUGEPAGE - 1);
+#endif
+  return (sz + LJ_PAGESIZE-1) & ~(size_t)(LJ_PAGESIZE - 1);
+}
+
+/* Find the MCode area holding an address. */
+static MCode *mcode_findarea(jit_State *J, MCode *ptr)
+{
+  MCode *mc;
+  for (mc = J->mcchain; ; mc = ((MCLink *)mc)->next) {
+    lj_assertJ(mc != NULL, "broken MCode area chain");
+    if (ptr >= mc && ptr < (MCode *)((char *)mc + ((MCLink *)mc)->size))
+      return mc;
+  }
+}
+
+/* Add a free range of MCode. Merge it with adjacent ranges. */
+static void mcode_addhole(jit_State *J, MCode *bot, MCode *top)
+{
+  MCHole *h = J->mchole;
+  MSize i, n = J->nmchole;
+  for (i = 0; i < n && h[i].bot < bot; i++) ;
+  if (i > 0 && h[i-1].top == bot) {  /* Merge with range below. */
+    h[--i].top = top;
+  } else {
+    lj_assertJ(n < J->sizemchole, "no space for free MCode range");
+    memmove(&h[i+1], &h[i], (n-i)*sizeof(MCHole));
+    h[i].bot = bot;
+    h[i].top = top;
+    n++;
+  }
+  if (i+1 < n && h[i+1].bot == h[i].top) {  /* Merge with range above. */
+    h[i].top = h[i+1].top;
+    n--;
+    memmove(&h[i+1], &h[i+2], (n-i-1)*sizeof(MCHole));
+  }
+  if (h[i].bot == J->mctop) {  /* Grow the current range upwards. */
+    J->mctop = h[i].top;
+    n--;
+    memmove(&h[i], &h[i+1], (n-i)*sizeof(MCHole));
+  }
+  J->nmchole = n;
+}
+
+/* Switch to the largest free MCode range, if it's big enough. */
+static int mcode_usehole(jit_State *J, size_t need)
+{
+  MCHole *h = J->mchole;
+  MSize i, best = 0;
+  size_t sz = 0;
+  MCode *obot = J->mcbot, *otop = J->mctop;
+  for (i = 0; i < J->nmchole; i++) {
+    size_t hsz = (size_t)((char *)h[i].top - (char *)h[i].bot);
+    if (hsz > sz) { sz = hsz; best = i; }
+  }
+  if (sz < need)
+    return 0;
+  J->mcbot = h[best].bot;
+  J->mctop = h[best].top;
+  J->mcarea = mcode_findarea(J, J->mcbot);
+  J->szmcarea = ((MCLink *)J->mcarea)->size;
+  J->mcprot = MCPROT_RUN;  /* All areas are executable after lj_mcode_abort. */
+  J->nmchole--;
+  memmove(&h[best], &h[best+1], (J->nmchole-best)*sizeof(MCHole));
+  /* Keep the remainder of the previous range. There's room for it now. */
+  if (otop > obot)
+    mcode_addhole(J, obot, otop);
+  return 1;
+}
+
 /* Allocate a new MCode area. */
 static void mcode_allocarea(jit_State *J)
 {
-  MCode *oldarea = J->mcarea;
-  size_t sz = (size_t)J->param[JIT_P_sizemcode] << 10;
-  sz = (sz + LJ_PAGESIZE-1) & ~(size_t)(LJ_PAGESIZE - 1);
-  J->mcarea = (MCode *)mcode_alloc(J, sz);
+  MCode *oldarea = J->mcchain, *obot = J->mcbot, *otop = J->mctop;
+  size_t sz = mcode_areasize(J);
+  J->mcchain = J->mcarea = (MCode *)mcode_alloc(J, sz);
+#ifdef MCODE_HUGEPAGE
+  if (J->mchuge)
+    mcode_hugepage(J->mcarea, sz);
+#endif
   J->szmcarea = sz;
   J->mcprot = MCPROT_GEN;
   J->mctop = (MCode *)((char *)J->mcarea + J->szmcarea);
@@ -276,14 +369,18 @@ static void mcode_allocarea(jit_State *J)
   ((MCLink *)J->mcarea)->size = sz;
   J->szallmcarea += sz;
   J->mcbot = (MCode *)lj_err_register_mcode(J->mcarea, sz, (uint8_t *)J->mcbot);
+  /* Keep the remainder of the previous range, if there's room for it. */
+  if (oldarea && otop > obot && J->nmchole < J->sizemchole)
+    mcode_addhole(J, obot, otop);
 }
 
 /* Free all MCode areas. */
 void lj_mcode_free(jit_State *J)
 {
-  MCode *mc = J->mcarea;
-  J->mcarea = NULL;
+  MCode *mc = J->mcchain;
+  J->mcchain = J->mcarea = NULL;
   J->szallmcarea = 0;
+  J->nmchole = 0;
   while (mc) {
     MCode *next = ((MCLink *)mc)->next;
     size_t sz = ((MCLink *)mc)->size;
@@ -341,33 +438,48 @@ MCode *lj_mcode_patch(jit_State *J, MCode *ptr, int finish)
       return mc;
     }
     /* Otherwise search through the list of MCode areas. */
-    for (;;) {
-      mc = ((MCLink *)mc)->next;
-      lj_assertJ(mc != NULL, "broken MCode area chain");
-      if (ptr >= mc && ptr < (MCode *)((char *)mc + ((MCLink *)mc)->size)) {
+    mc = mcode_findarea(J, ptr);
 #if LUAJIT_SECURITY_MCODE
-	if (LJ_UNLIKELY(mcode_setprot(mc, ((MCLink *)mc)->size, MCPROT_GEN)))
-	  mcode_protfail(J);
+    if (LJ_UNLIKELY(mcode_setprot(mc, ((MCLink *)mc)->size, MCPROT_GEN)))
+      mcode_protfail(J);
 #endif
-	return mc;
-      }
-    }
+    return mc;
   }
 }
 
+/* -- MCode reuse --------------------------------------------------------- */
+
+/* Make room for n more free ranges of MCode. */
+void lj_mcode_growhole(jit_State *J, MSize n)
+{
+  MSize sz = J->nmchole + n;
+  if (sz > J->sizemchole) {
+    lj_mem_reallocvec(J->L, J->mchole, J->sizemchole, sz, MCHole);
+    J->sizemchole = sz;
+  }
+}
+
+/* Release the MCode of an evicted trace for reuse. */
+void lj_mcode_release(jit_State *J, MCode *ptr, MSize sz)
+{
+  if (sz)
+    mcode_addhole(J, ptr, (MCode *)((char *)ptr + sz));
+}
+
 /* Limit of MCode reservation reached. */
 void lj_mcode_limiterr(jit_State *J, size_t need)
 {
   size_t sizemcode, maxmcode;
   lj_mcode_abort(J);
-  sizemcode = (size_t)J->param[JIT_P_sizemcode] << 10;
-  sizemcode = (sizemcode + LJ_PAGESIZE-1) & ~(size_t)(LJ_PAGESIZE - 1);
+  sizemcode = mcode_areasize(J);
   maxmcode = (size_t)J->param[JIT_P_maxmcode] << 10;
   if ((size_t)need > sizemcode)
     lj_trace_err(J, LJ_TRERR_MCODEOV);  /* Too long for any area. */
-  if (J->szallmcarea + sizemcode > maxmcode)
-    lj_trace_err(J, LJ_TRERR_MCODEAL);
-  mcode_allocarea(J);
+  if (!mcode_usehole(J, need)) {  /* Reuse MCode of evicted traces first. */
+    if (J->szallmcarea + sizemcode > maxmcode)
+      lj_trace_err(J, LJ_TRERR_MCODEAL);
+    mcode_allocarea(J);
+  }
   lj_trace_err(J, LJ_TRERR_MCODELM);  /* Retry with new area. */
 }
 
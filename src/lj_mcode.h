@@ -21,6 +21,8 @@ LJ_FUNC MCode *lj_mcode_reserve(jit_State *J, MCode **lim);
 LJ_FUNC void lj_mcode_commit(jit_State *J, MCode *m);
 LJ_FUNC void lj_mcode_abort(jit_State *J);
 LJ_FUNC MCode *lj_mcode_patch(jit_State *J, MCode *ptr, int finish);
+LJ_FUNC void lj_mcode_growhole(jit_State *J, MSize n);
+LJ_FUNC void lj_mcode_release(jit_State *J, MCode *ptr, MSize sz);
 LJ_FUNC_NORET void lj_mcode_limiterr(jit_State *J, size_t need);
 
 #define lj_mcode_commitbot(J, m)	(J->mcbot = (m))
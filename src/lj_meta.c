@@ -22,6 +22,9 @@
 #include "lj_strscan.h"
 #include "lj_strfmt.h"
 #include "lj_lib.h"
+#if LJ_HASFROZEN
+#include "lj_frozen.h"
+#endif
 
 /* -- Metamethod handling ------------------------------------------------- */
 
@@ -139,7 +142,12 @@ cTValue *lj_meta_tget(lua_State *L, cTValue *o, cTValue *k)
     cTValue *mo;
     if (LJ_LIKELY(tvistab(o))) {
       GCtab *t = tabV(o);
-      cTValue *tv = lj_tab_get(L, t, k);
+      cTValue *tv;
+#if LJ_HASFROZEN
+      if (LJ_UNLIKELY(tabisfrozen(t)))
+	return lj_frozen_get(L, t, k);
+#endif
+      tv = lj_tab_get(L, t, k);
       if (!tvisnil(tv) ||
 	  !(mo = lj_meta_fast(L, tabref(t->metatable), MM_index)))
 	return tv;
@@ -166,7 +174,12 @@ TValue *lj_meta_tset(lua_State *L, cTValue *o, cTValue *k)
     cTValue *mo;
     if (LJ_LIKELY(tvistab(o))) {
       GCtab *t = tabV(o);
-      cTValue *tv = lj_tab_get(L, t, k);
+      cTValue *tv;
+#if LJ_HASFROZEN
+      if (LJ_UNLIKELY(tabisfrozen(t)))
+	lj_err_msg(L, LJ_ERR_FROZEN);
+#endif
+      tv = lj_tab_get(L, t, k);
       if (LJ_LIKELY(!tvisnil(tv))) {
 	t->nomm = 0;  /* Invalidate negative metamethod cache. */
 	lj_gc_anybarriert(L, t);
@@ -329,7 +342,12 @@ TValue * LJ_FASTCALL lj_meta_len(lua_State *L, cTValue *o)
 TValue *lj_meta_equal(lua_State *L, GCobj *o1, GCobj *o2, int ne)
 {
   /* Field metatable must be at same offset for GCtab and GCudata! */
-  cTValue *mo = lj_meta_fast(L, tabref(o1->gch.metatable), MM_eq);
+  cTValue *mo;
+#if LJ_HASLAZYSTR
+  if (o1->gch.gct == ~LJ_TSTR)  /* Different lazy strings. */
+    return (TValue *)(intptr_t)(ne ^ lj_str_eqlazy(gco2str(o1), gco2str(o2)));
+#endif
+  mo = lj_meta_fast(L, tabref(o1->gch.metatable), MM_eq);
   if (mo) {
     TValue *top;
     uint32_t it;
@@ -7,6 +7,7 @@
 #define LUA_CORE
 
 #include "lj_obj.h"
+#include "lj_str.h"
 
 /* Object type names. */
 LJ_DATADEF const char *const lj_obj_typename[] = {  /* ORDER LUA_T */
@@ -25,6 +26,10 @@ int LJ_FASTCALL lj_obj_equal(cTValue *o1, cTValue *o2)
   if (itype(o1) == itype(o2)) {
     if (tvispri(o1))
       return 1;
+#if LJ_HASLAZYSTR
+    if (tvisstr(o1))
+      return lj_str_eqlazy(strV(o1), strV(o2));
+#endif
     if (!tvisnum(o1))
       return gcrefeq(o1->gcr, o2->gcr);
   } else if (!tvisnumber(o1) || !tvisnumber(o2)) {
@@ -315,6 +315,13 @@ typedef struct GCstr {
 #define strref(r)	(&gcref((r))->str)
 #define strdata(s)	((const char *)((s)+1))
 #define strdatawr(s)	((char *)((s)+1))
+
+/* Lazy strings are never interned. All strings of this length are lazy. */
+#if LJ_HASLAZYSTR
+#define strislazy(s)	((s)->len >= LJ_LAZYSTR_MIN)
+#else
+#define strislazy(s)	0
+#endif
 #define strVdata(o)	strdata(strV(o))
 
 /* -- Userdata object ----------------------------------------------------- */
@@ -386,6 +393,10 @@ typedef struct GCproto {
   uint8_t sizeuv;	/* Number of upvalues. */
   uint8_t flags;	/* Miscellaneous flags (see below). */
   uint16_t trace;	/* Anchor for chain of root traces. */
+  MSize nhotsite;	/* Number of hot counter sites. */
+  MRef hotsite;		/* Hot counter sites (HotSite *) or NULL. */
+  MSize ntabsite;	/* Number of learned table allocation sites. */
+  MRef tabsite;		/* Learned table allocation sites (TabSite *). */
   /* ------ The following fields are for debugging/tracebacks only ------ */
   GCRef chunkname;	/* Name of the chunk this function was defined in. */
   BCLine firstline;	/* First line of the function definition. */
@@ -499,6 +510,9 @@ typedef struct GCtab {
   GCHeader;
   uint8_t nomm;		/* Negative cache for fast metamethods. */
   int8_t colo;		/* Array colocation. */
+#if LJ_HASTABSHAPE
+  uint32_t shape;	/* Shape of hash part or 0. Uses GC64 padding. */
+#endif
   MRef array;		/* Array part. */
   GCRef gclist;
   GCRef metatable;	/* Must be at same offset in GCudata. */
@@ -586,6 +600,55 @@ typedef enum {
 #define basemt_obj(g, o)	((g)->gcroot[GCROOT_BASEMT+itypemap(o)])
 #define mmname_str(g, mm)	(strref((g)->gcroot[GCROOT_MMNAME+(mm)]))
 
+/* Heap accounting categories. The object types come first. ORDER LJ_T */
+enum {
+  LJ_HEAP_STR, LJ_HEAP_UPVAL, LJ_HEAP_THREAD, LJ_HEAP_PROTO, LJ_HEAP_FUNC,
+  LJ_HEAP_TRACE, LJ_HEAP_CDATA, LJ_HEAP_TAB, LJ_HEAP_UDATA,
+  LJ_HEAP_ARRAY,	/* Separately allocated array parts of tables. */
+  LJ_HEAP_HASH,		/* Hash parts of tables. */
+  LJ_HEAP_STACK,	/* Stacks of threads. */
+  LJ_HEAP__MAX
+};
+
+#define LJ_HEAP_NOBJ	(LJ_HEAP_UDATA+1)
+
+/* Number of buckets in the GC pause histogram. */
+#define LJ_GCHIST	20
+
+/* Garbage collector statistics. Times are in nanoseconds. */
+typedef struct GCStats {
+  uint64_t minornum;	/* Number of minor collections. */
+  uint64_t majornum;	/* Number of major collections (full cycles). */
+  uint64_t minortime;	/* Total time spent in minor collections. */
+  uint64_t majortime;	/* Total time spent in major collection steps. */
+  uint64_t minormax;	/* Longest minor collection. */
+  uint64_t majormax;	/* Longest major collection step. */
+  uint64_t hist[LJ_GCHIST];  /* Pauses < 1us, < 2us, < 4us, ... */
+} GCStats;
+
+#if LJ_HASPSWEEP
+/* Number of anchors in the root list for the parallel sweep. */
+#define LJ_GC_SWEEPANCHORS	64
+
+/* Evenly spaced objects that survived a sweep of the root list. */
+typedef struct GCSweepAnchors {
+  MSize n;		/* Number of anchors. */
+  uint32_t stride;	/* Survivors per anchor. */
+  uint32_t count;	/* Survivors since the last anchor. */
+  GCRef obj[LJ_GC_SWEEPANCHORS];  /* Anchors in list order. */
+} GCSweepAnchors;
+#endif
+
+#if LJ_HASTABSHAPE
+/* Table shape transitions. See lj_tab.c. */
+typedef struct TabShapeState {
+  MRef tr;		/* Transition hash table (TabShapeTr) or NULL. */
+  MSize mask;		/* Transition hash table mask. */
+  MSize num;		/* Number of transitions. */
+  uint32_t numid;	/* Number of non-root shapes handed out. */
+} TabShapeState;
+#endif
+
 /* Garbage collector state. */
 typedef struct GCState {
   GCSize total;		/* Memory currently allocated. */
@@ -612,6 +675,27 @@ typedef struct GCState {
 #if LJ_64
   MRef lightudseg;	/* Upper bits of lightuserdata segments. */
 #endif
+  GCRef firstold;	/* First old object in root list (generational). */
+  MRef ystr;		/* Vector of young strings (generational). */
+  MSize ystrnum;	/* Number of young strings. */
+  MSize ystrsize;	/* Size of young string vector. */
+  GCSize majorthreshold;  /* Threshold for next major cycle (generational). */
+  MSize genminor;	/* Young generation size in % of live memory. */
+  uint8_t gen;		/* Generational mode. */
+  uint8_t sweepthreads;	/* Number of helper threads for full sweeps. */
+  MSize budget;		/* Time budget per GC step in us (0 = unlimited). */
+#if LJ_HASPSWEEP
+  GCSweepAnchors anchors;  /* Split points of the root list. */
+#endif
+  GCRef travtab;	/* Big table with a resumable traversal. */
+  MSize travpos;	/* Next slot to traverse in travtab. */
+  MSize travasize;	/* Array size of travtab at traversal start. */
+  MSize travhmask;	/* Hash mask of travtab at traversal start. */
+  MRef travnode;	/* Hash part of travtab at traversal start. */
+  GCStats stats;	/* Collection statistics. */
+  GCSize heapbytes[LJ_HEAP__MAX];  /* Live bytes per heap category. */
+  GCSize heapnum[LJ_HEAP_NOBJ];  /* Live objects per object type. */
+  GCSize profcount;	/* Bytes left until next allocation profile sample. */
 #ifdef COUNTS
   ssize_t freed;	/* Total amount of freed memory. */
   ssize_t allocated;	/* Total amount of allocated memory. */
@@ -630,10 +714,13 @@ typedef struct StrInternState {
   GCRef *tab;		/* String hash table anchors. */
   MSize mask;		/* String hash mask (size of hash table - 1). */
   MSize num;		/* Number of strings in hash table. */
+  GCRef *oldtab;	/* Old anchors during an incremental resize or NULL. */
+  MSize oldmask;	/* Old string hash mask. */
+  MSize oldpos;		/* Next old chain to migrate. */
   StrID id;		/* Next string ID. */
   uint8_t idreseed;	/* String ID reseed counter. */
   uint8_t second;	/* String interning table uses secondary hashing. */
-  uint8_t unused1;
+  uint8_t crc;		/* Primary hash uses CRC32 instructions. */
   uint8_t unused2;
   LJ_ALIGN(8) uint64_t seed;	/* Random string seed. */
 } StrInternState;
@@ -669,6 +756,16 @@ typedef struct global_State {
   GCRef cur_L;		/* Currently executing lua_State. */
   MRef jit_base;	/* Current JIT code L->base or NULL. */
   MRef ctype_state;	/* Pointer to C type state. */
+  MRef strmatch;	/* Pointer to compiled pattern cache. */
+#if LJ_HASTABSHAPE
+  TabShapeState tabshape;  /* Table shape transitions. */
+#endif
+#if LJ_HASTABSITE
+  MRef tabsite;		/* Pointer to table allocation site feedback. */
+#endif
+#if LJ_HASFROZEN
+  MRef frozen;		/* Pointer to attached frozen regions. */
+#endif
   PRNGState prng;	/* Global PRNG state. */
   GCRef gcroot[GCROOT_MAX];  /* GC roots. */
 } global_State;
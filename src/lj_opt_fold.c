@@ -163,7 +163,7 @@ typedef IRRef (LJ_FASTCALL *FoldFunc)(jit_State *J);
 #define gcstep_barrier(J, ref) \
   ((ref) < J->chain[IR_LOOP] && \
    (J->chain[IR_SNEW] || J->chain[IR_XSNEW] || \
-    J->chain[IR_TNEW] || J->chain[IR_TDUP] || \
+    J->chain[IR_TNEW] || J->chain[IR_TDUP] || J->chain[IR_FNEW] || \
     J->chain[IR_CNEW] || J->chain[IR_CNEWI] || \
     J->chain[IR_BUFSTR] || J->chain[IR_TOSTR] || J->chain[IR_CALLA]))
 
@@ -2224,11 +2224,32 @@ LJFOLDF(fload_tab_tdup_hmask)
   return NEXTFOLD;
 }
 
+LJFOLD(FLOAD TNEW IRFL_TAB_SHAPE)
+LJFOLDF(fload_tab_tnew_shape)
+{
+#if LJ_HASTABSHAPE
+  if (LJ_LIKELY(J->flags & JIT_F_OPT_FOLD) && lj_opt_fwd_tptr(J, fins->op1))
+    return INTFOLD((int32_t)lj_tab_rootshape(fleft->op2));
+#endif
+  return NEXTFOLD;
+}
+
+LJFOLD(FLOAD TDUP IRFL_TAB_SHAPE)
+LJFOLDF(fload_tab_tdup_shape)
+{
+#if LJ_HASTABSHAPE
+  if (LJ_LIKELY(J->flags & JIT_F_OPT_FOLD) && lj_opt_fwd_tptr(J, fins->op1))
+    return INTFOLD((int32_t)ir_ktab(IR(fleft->op1))->shape);
+#endif
+  return NEXTFOLD;
+}
+
 LJFOLD(HREF any any)
 LJFOLD(FLOAD any IRFL_TAB_ARRAY)
 LJFOLD(FLOAD any IRFL_TAB_NODE)
 LJFOLD(FLOAD any IRFL_TAB_ASIZE)
 LJFOLD(FLOAD any IRFL_TAB_HMASK)
+LJFOLD(FLOAD any IRFL_TAB_SHAPE)
 LJFOLDF(fload_tab_ah)
 {
   TRef tr = lj_opt_cse(J);
@@ -2328,6 +2349,36 @@ LJFOLDF(fload_cdata_ptr_int64_cnew)
   return NEXTFOLD;
 }
 
+/* A closure created on the trace has the prototype and the environment
+** of its parent. Folding these avoids keeping the allocation alive.
+*/
+LJFOLD(FLOAD FNEW IRFL_FUNC_PC)
+LJFOLDF(fload_func_pc_fnew)
+{
+  if (LJ_LIKELY(J->flags & JIT_F_OPT_FOLD))
+    return lj_ir_kptr(J, proto_bc(ir_kproto(IR(fleft->op1))));
+  return NEXTFOLD;
+}
+
+LJFOLD(FLOAD FNEW IRFL_FUNC_FFID)
+LJFOLDF(fload_func_ffid_fnew)
+{
+  if (LJ_LIKELY(J->flags & JIT_F_OPT_FOLD))
+    return INTFOLD(FF_LUA);
+  return NEXTFOLD;
+}
+
+LJFOLD(FLOAD FNEW IRFL_FUNC_ENV)
+LJFOLDF(fload_func_env_fnew)
+{
+  if (LJ_LIKELY(J->flags & JIT_F_OPT_FOLD)) {
+    PHIBARRIER(fleft);
+    fins->op1 = fleft->op2;  /* Load environment of parent. */
+    return RETRYFOLD;
+  }
+  return NEXTFOLD;
+}
+
 LJFOLD(FLOAD any IRFL_STR_LEN)
 LJFOLD(FLOAD any IRFL_FUNC_ENV)
 LJFOLD(FLOAD any IRFL_THREAD_ENV)
@@ -2449,6 +2500,7 @@ LJFOLD(XBAR)
 LJFOLD(RETF any any)  /* Modifies BASE. */
 LJFOLD(TNEW any any)
 LJFOLD(TDUP any)
+LJFOLD(FNEW any any)
 LJFOLD(CNEW any any)
 LJFOLD(XSNEW any any)
 LJFOLDX(lj_ir_emit)
@@ -72,14 +72,23 @@ static AliasRet aa_table(jit_State *J, IRRef ta, IRRef tb)
   return aa_escape(J, taba, tabb);
 }
 
-/* Check whether there's no aliasing table.clear. */
+/* Check whether there's no aliasing table.clear/sort/move/fill. */
 static int fwd_aa_tab_clear(jit_State *J, IRRef lim, IRRef ta)
 {
   IRRef ref = J->chain[IR_CALLS];
   while (ref > lim) {
     IRIns *calls = IR(ref);
-    if (calls->op2 == IRCALL_lj_tab_clear &&
-	(ta == calls->op1 || aa_table(J, ta, calls->op1) != ALIAS_NO))
+    IRRef tb = 0;
+    if (calls->op2 == IRCALL_lj_tab_clear) {
+      tb = calls->op1;
+    } else if (calls->op2 == IRCALL_lj_tab_sort ||
+	       calls->op2 == IRCALL_lj_tab_fill) {
+      for (tb = calls->op1; IR(tb)->o == IR_CARG; tb = IR(tb)->op1)
+	;  /* The table is the first argument. */
+    } else if (calls->op2 == IRCALL_lj_tab_move) {
+      tb = IR(calls->op1)->op2;  /* The destination is the last argument. */
+    }
+    if (tb && (ta == tb || aa_table(J, ta, tb) != ALIAS_NO))
       return 0;  /* Conflict. */
     ref = calls->prev;
   }
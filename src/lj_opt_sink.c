@@ -22,6 +22,11 @@
 static IRIns *sink_checkalloc(jit_State *J, IRIns *irs)
 {
   IRIns *ir = IR(irs->op1);
+  if (irs->o == IR_USTORE) {  /* Upvalue of a new closure? */
+    if (ir->o != IR_UREFC || IR(ir->op1)->o != IR_FNEW)
+      return NULL;
+    return IR(ir->op1);
+  }
   if (!irref_isk(ir->op2))
     return NULL;  /* Non-constant key. */
   if (ir->o == IR_HREFK || ir->o == IR_AREF)
@@ -100,6 +105,10 @@ static void sink_mark_ins(jit_State *J)
       irt_setmark(IR(ir->op2)->t);  /* Mark stored value. */
       break;
       }
+    case IR_FNEW:
+      if (ir->op2 >= REF_FIRST)
+	irt_setmark(IR(ir->op2)->t);  /* Parent is needed to unsink it. */
+      break;
 #if LJ_HASFFI
     case IR_CNEWI:
       if (irt_isphi(ir->t) &&
@@ -151,6 +160,22 @@ static void sink_mark_snap(jit_State *J, SnapShot *snap)
   }
 }
 
+#if !LJ_FR2
+/* Mark closures referenced as frame functions. The slot holds the link. */
+static void sink_mark_frames(jit_State *J)
+{
+  SnapNo i;
+  for (i = 0; i < J->cur.nsnap; i++) {
+    SnapShot *snap = &J->cur.snap[i];
+    SnapEntry *map = &J->cur.snapmap[snap->mapofs];
+    MSize n, nent = snap->nent;
+    for (n = 0; n < nent; n++)
+      if ((map[n] & SNAP_FRAME) && !irref_isk(snap_ref(map[n])))
+	irt_setmark(IR(snap_ref(map[n]))->t);
+  }
+}
+#endif
+
 /* Iteratively remark PHI refs with differing marks or PHI value counts. */
 static void sink_remark_phi(jit_State *J)
 {
@@ -175,7 +200,8 @@ static void sink_sweep_ins(jit_State *J)
   IRIns *ir, *irbase = IR(REF_BASE);
   for (ir = IR(J->cur.nins-1) ; ir >= irbase; ir--) {
     switch (ir->o) {
-    case IR_ASTORE: case IR_HSTORE: case IR_FSTORE: case IR_XSTORE: {
+    case IR_ASTORE: case IR_HSTORE: case IR_FSTORE: case IR_XSTORE:
+    case IR_USTORE: {
       IRIns *ira = sink_checkalloc(J, ir);
       if (ira && !irt_ismarked(ira->t)) {
 	int delta = (int)(ir - ira);
@@ -196,7 +222,7 @@ static void sink_sweep_ins(jit_State *J)
 #if LJ_HASFFI
     case IR_CNEW: case IR_CNEWI:
 #endif
-    case IR_TNEW: case IR_TDUP:
+    case IR_TNEW: case IR_TDUP: case IR_FNEW:
       if (!irt_ismarked(ir->t)) {
 	ir->t.irt &= ~IRT_GUARD;
 	ir->prev = REGSP(RID_SINK, 0);
@@ -242,10 +268,14 @@ void lj_opt_sink(jit_State *J)
   const uint32_t need = (JIT_F_OPT_SINK|JIT_F_OPT_FWD|
 			 JIT_F_OPT_DCE|JIT_F_OPT_CSE|JIT_F_OPT_FOLD);
   if ((J->flags & need) == need &&
-      (J->chain[IR_TNEW] || J->chain[IR_TDUP] ||
+      (J->chain[IR_TNEW] || J->chain[IR_TDUP] || J->chain[IR_FNEW] ||
        (LJ_HASFFI && (J->chain[IR_CNEW] || J->chain[IR_CNEWI])))) {
     if (!J->loopref)
       sink_mark_snap(J, &J->cur.snap[J->cur.nsnap-1]);
+#if !LJ_FR2
+    if (J->chain[IR_FNEW])
+      sink_mark_frames(J);
+#endif
     sink_mark_ins(J);
     if (J->loopref)
       sink_remark_phi(J);
@@ -846,6 +846,12 @@ static void bcemit_comp(FuncState *fs, BinOpr opr, ExpDesc *e1, ExpDesc *e2)
       ins = BCINS_AD(op+(BC_ISEQP-BC_ISEQV), ra, const_pri(e2));
       break;
     case VKSTR:
+#if LJ_HASLAZYSTR
+      if (strislazy(e2->u.sval)) {  /* Needs a content compare. */
+	ins = BCINS_AD(op, ra, expr_toanyreg(fs, e2));
+	break;
+      }
+#endif
       ins = BCINS_AD(op+(BC_ISEQS-BC_ISEQV), ra, const_str(fs, e2));
       break;
     case VKNUM:
@@ -1585,9 +1591,14 @@ static GCproto *fs_finish(LexState *ls, BCLine line)
 
   /* Allocate prototype and initialize its fields. */
   pt = (GCproto *)lj_mem_newgco(L, (MSize)sizept);
+  lj_mem_accnew(G(L), LJ_HEAP_PROTO, sizept);
   pt->gct = ~LJ_TPROTO;
   pt->sizept = (MSize)sizept;
   pt->trace = 0;
+  pt->nhotsite = 0;
+  setmref(pt->hotsite, NULL);
+  pt->ntabsite = 0;
+  setmref(pt->tabsite, NULL);
   pt->flags = (uint8_t)(fs->flags & ~(PROTO_HAS_RETURN|PROTO_FIXUP_RETURN));
   pt->numparams = fs->numparams;
   pt->framesize = fs->framesize;
@@ -26,6 +26,8 @@
 
 #include <sys/time.h>
 #include <signal.h>
+#define profile_lockinit(ps)	UNUSED(ps)
+#define profile_lockfree(ps)	UNUSED(ps)
 #define profile_lock(ps)	UNUSED(ps)
 #define profile_unlock(ps)	UNUSED(ps)
 
@@ -36,6 +38,8 @@
 #if LJ_TARGET_PS3
 #include <sys/timer.h>
 #endif
+#define profile_lockinit(ps)	pthread_mutex_init(&ps->lock, 0)
+#define profile_lockfree(ps)	pthread_mutex_destroy(&ps->lock)
 #define profile_lock(ps)	pthread_mutex_lock(&ps->lock)
 #define profile_unlock(ps)	pthread_mutex_unlock(&ps->lock)
 
@@ -49,6 +53,8 @@
 #include <windows.h>
 #endif
 typedef unsigned int (WINAPI *WMM_TPFUNC)(unsigned int);
+#define profile_lockinit(ps)	InitializeCriticalSection(&ps->lock)
+#define profile_lockfree(ps)	DeleteCriticalSection(&ps->lock)
 #define profile_lock(ps)	EnterCriticalSection(&ps->lock)
 #define profile_unlock(ps)	LeaveCriticalSection(&ps->lock)
 
@@ -61,6 +67,7 @@ typedef struct ProfileState {
   void *data;			/* Profiler callback data. */
   SBuf sb;			/* String buffer for stack dumps. */
   int interval;			/* Sample interval in milliseconds. */
+  GCSize alloc;			/* Sample interval in bytes (0 = timer). */
   int samples;			/* Number of samples for next callback. */
   int vmstate;			/* VM state when profile timer triggered. */
 #if LJ_PROFILE_SIGPROF
@@ -92,6 +99,10 @@ static ProfileState profile_state;
 /* Default sample interval in milliseconds. */
 #define LJ_PROFILE_INTERVAL_DEFAULT	10
 
+/* Default and maximum allocation sample interval in KBytes. */
+#define LJ_PROFILE_ALLOC_DEFAULT	512
+#define LJ_PROFILE_ALLOC_MAX		(1<<20)
+
 /* -- Profiler/hook interaction ------------------------------------------- */
 
 #if !LJ_PROFILE_SIGPROF
@@ -145,13 +156,16 @@ void LJ_FASTCALL lj_profile_interpreter(lua_State *L)
   profile_unlock(ps);
 }
 
-/* Trigger profile hook. Asynchronous call from OS-specific profile timer. */
-static void profile_trigger(ProfileState *ps)
+/*
+** Trigger profile hook. Asynchronous call from OS-specific profile timer
+** or synchronous call from the allocator.
+*/
+static void profile_trigger(ProfileState *ps, int samples)
 {
   global_State *g = ps->g;
   uint8_t mask;
   profile_lock(ps);
-  ps->samples++;  /* Always increment number of samples. */
+  ps->samples += samples;  /* Always increment number of samples. */
   mask = g->hookmask;
   if (!(mask & (HOOK_PROFILE|HOOK_VMEVENT|HOOK_GC))) {  /* Set profile hook. */
     int st = g->vmstate;
@@ -165,6 +179,22 @@ static void profile_trigger(ProfileState *ps)
   profile_unlock(ps);
 }
 
+/* Allocation sample interval exhausted. Called from the allocator. */
+void lj_profile_alloc(global_State *g, GCSize size)
+{
+  ProfileState *ps = &profile_state;
+  GCSize alloc = ps->alloc, n;
+  if (ps->g != g || alloc == 0) {  /* Not profiling allocations. */
+    g->gc.profcount = ~(GCSize)0;
+    return;
+  }
+  n = size - g->gc.profcount;
+  g->gc.profcount = alloc - n % alloc;
+  /* Don't sample allocations made by the profiler callback itself. */
+  if (!(g->hookmask & HOOK_VMEVENT))
+    profile_trigger(ps, 1 + (int)(n / alloc));
+}
+
 /* -- OS-specific profile timer handling ---------------------------------- */
 
 #if LJ_PROFILE_SIGPROF
@@ -173,7 +203,7 @@ static void profile_trigger(ProfileState *ps)
 static void profile_signal(int sig)
 {
   UNUSED(sig);
-  profile_trigger(&profile_state);
+  profile_trigger(&profile_state, 1);
 }
 
 /* Start profiling timer. */
@@ -223,7 +253,7 @@ static void *profile_thread(ProfileState *ps)
     nanosleep(&ts, NULL);
 #endif
     if (ps->abort) break;
-    profile_trigger(ps);
+    profile_trigger(ps, 1);
   }
   return NULL;
 }
@@ -231,7 +261,6 @@ static void *profile_thread(ProfileState *ps)
 /* Start profiling timer thread. */
 static void profile_timer_start(ProfileState *ps)
 {
-  pthread_mutex_init(&ps->lock, 0);
   ps->abort = 0;
   pthread_create(&ps->thread, NULL, (void *(*)(void *))profile_thread, ps);
 }
@@ -241,7 +270,6 @@ static void profile_timer_stop(ProfileState *ps)
 {
   ps->abort = 1;
   pthread_join(ps->thread, NULL);
-  pthread_mutex_destroy(&ps->lock);
 }
 
 #elif LJ_PROFILE_WTHREAD
@@ -257,7 +285,7 @@ static DWORD WINAPI profile_thread(void *psx)
   while (1) {
     Sleep(interval);
     if (ps->abort) break;
-    profile_trigger(ps);
+    profile_trigger(ps, 1);
   }
 #if LJ_TARGET_WINDOWS && !LJ_TARGET_UWP
   ps->wmm_tep(interval);
@@ -281,7 +309,6 @@ static void profile_timer_start(ProfileState *ps)
     }
   }
 #endif
-  InitializeCriticalSection(&ps->lock);
   ps->abort = 0;
   ps->thread = CreateThread(NULL, 0, profile_thread, ps, 0, NULL);
 }
@@ -291,7 +318,6 @@ static void profile_timer_stop(ProfileState *ps)
 {
   ps->abort = 1;
   WaitForSingleObject(ps->thread, INFINITE);
-  DeleteCriticalSection(&ps->lock);
 }
 
 #endif
@@ -304,6 +330,7 @@ LUA_API void luaJIT_profile_start(lua_State *L, const char *mode,
 {
   ProfileState *ps = &profile_state;
   int interval = LJ_PROFILE_INTERVAL_DEFAULT;
+  int alloc = 0;
   while (*mode) {
     int m = *mode++;
     switch (m) {
@@ -313,6 +340,14 @@ LUA_API void luaJIT_profile_start(lua_State *L, const char *mode,
 	interval = interval * 10 + (*mode++ - '0');
       if (interval <= 0) interval = 1;
       break;
+    case 'a':
+      alloc = 0;
+      while (*mode >= '0' && *mode <= '9' && alloc < LJ_PROFILE_ALLOC_MAX)
+	alloc = alloc * 10 + (*mode++ - '0');
+      while (*mode >= '0' && *mode <= '9') mode++;
+      if (alloc <= 0) alloc = LJ_PROFILE_ALLOC_DEFAULT;
+      if (alloc > LJ_PROFILE_ALLOC_MAX) alloc = LJ_PROFILE_ALLOC_MAX;
+      break;
 #if LJ_HASJIT
     case 'l': case 'f':
       L2J(L)->prof_mode = m;
@@ -329,11 +364,16 @@ LUA_API void luaJIT_profile_start(lua_State *L, const char *mode,
   }
   ps->g = G(L);
   ps->interval = interval;
+  ps->alloc = (GCSize)alloc << 10;
   ps->cb = cb;
   ps->data = data;
   ps->samples = 0;
   lj_buf_init(L, &ps->sb);
-  profile_timer_start(ps);
+  profile_lockinit(ps);
+  if (ps->alloc)  /* Sample allocations instead of CPU time. */
+    G(L)->gc.profcount = ps->alloc;
+  else
+    profile_timer_start(ps);
 }
 
 /* Stop profiling. */
@@ -342,7 +382,11 @@ LUA_API void luaJIT_profile_stop(lua_State *L)
   ProfileState *ps = &profile_state;
   global_State *g = ps->g;
   if (G(L) == g) {  /* Only stop profiler if started by this VM. */
-    profile_timer_stop(ps);
+    if (ps->alloc)
+      g->gc.profcount = ~(GCSize)0;
+    else
+      profile_timer_stop(ps);
+    profile_lockfree(ps);
     g->hookmask &= ~HOOK_PROFILE;
     lj_dispatch_update(g);
 #if LJ_HASJIT
@@ -11,6 +11,7 @@
 #if LJ_HASPROFILE
 
 LJ_FUNC void LJ_FASTCALL lj_profile_interpreter(lua_State *L);
+LJ_FUNC void lj_profile_alloc(global_State *g, GCSize size);
 #if !LJ_PROFILE_SIGPROF
 LJ_FUNC void LJ_FASTCALL lj_profile_hook_enter(global_State *g);
 LJ_FUNC void LJ_FASTCALL lj_profile_hook_leave(global_State *g);
@@ -10,11 +10,14 @@
 
 #if LJ_HASJIT
 
+#include "lj_gc.h"
 #include "lj_err.h"
 #include "lj_str.h"
 #include "lj_tab.h"
+#include "lj_frozen.h"
 #include "lj_meta.h"
 #include "lj_frame.h"
+#include "lj_state.h"
 #if LJ_HASFFI
 #include "lj_ctype.h"
 #endif
@@ -219,6 +222,22 @@ static TRef getcurrf(jit_State *J)
   return sloadt(J, -1-LJ_FR2, IRT_FUNC, IRSLOAD_READONLY);
 }
 
+#if LJ_HASLAZYSTR
+/* Guard that a string is not lazy, so that its identity decides equality.
+** Returns 0 if the string is lazy.
+*/
+static int rec_strnotlazy(jit_State *J, TRef tr, GCstr *s)
+{
+  if (strislazy(s))
+    return 0;
+  if (!tref_isk(tr)) {
+    TRef trlen = emitir(IRTI(IR_FLOAD), tr, IRFL_STR_LEN);
+    emitir(IRTGI(IR_ULT), trlen, lj_ir_kint(J, LJ_LAZYSTR_MIN));
+  }
+  return 1;
+}
+#endif
+
 /* Compare for raw object equality.
 ** Returns 0 if the objects are the same.
 ** Returns 1 if they are different, but the same type.
@@ -242,6 +261,12 @@ int lj_record_objcmp(jit_State *J, TRef a, TRef b, cTValue *av, cTValue *bv)
 	return 2;  /* Two different types are never equal. */
       }
     }
+#if LJ_HASLAZYSTR
+    /* Pointer comparisons of different strings need a non-lazy string. */
+    if (ta == IRT_STR && strV(av) != strV(bv) &&
+	!rec_strnotlazy(J, a, strV(av)) && !rec_strnotlazy(J, b, strV(bv)))
+      lj_trace_err(J, LJ_TRERR_NYILAZY);
+#endif
     emitir(IRTG(diff ? IR_NE : IR_EQ, ta), a, b);
   }
   return diff;
@@ -262,6 +287,16 @@ TRef lj_record_constify(jit_State *J, cTValue *o)
     return 0;  /* Can't represent lightuserdata (pointless). */
 }
 
+#if LJ_HASFROZEN
+/* Guard that a table is frozen or not, i.e. has the marker metatable. */
+void lj_record_frozen(jit_State *J, TRef tr, int frozen)
+{
+  TRef mt = emitir(IRT(IR_FLOAD, IRT_TAB), tr, IRFL_TAB_META);
+  emitir(IRTG(frozen ? IR_EQ : IR_NE, IRT_TAB), mt,
+	 lj_ir_kgc(J, obj2gco(&lj_frozen_mt), IRT_TAB));
+}
+#endif
+
 /* Emit a VLOAD with the correct type. */
 TRef lj_record_vload(jit_State *J, TRef ref, MSize idx, IRType t)
 {
@@ -707,12 +742,16 @@ static void rec_isnext(jit_State *J, BCReg ra)
 {
   cTValue *b = &J->L->base[ra-3];
   if (tvisfunc(b) && funcV(b)->c.ffid == FF_next &&
-      tvistab(b+1) && tvisnil(b+2)) {
+      tvistab(b+1) && !tabisfrozen(tabV(b+1)) && tvisnil(b+2)) {
     /* These checks are folded away for a compiled pairs(). */
     TRef func = getslot(J, ra-3);
     TRef trid = emitir(IRT(IR_FLOAD, IRT_U8), func, IRFL_FUNC_FFID);
     emitir(IRTGI(IR_EQ), trid, lj_ir_kint(J, FF_next));
+#if LJ_HASFROZEN
+    lj_record_frozen(J, getslot(J, ra-2), 0);  /* Need lj_frozen_next(). */
+#else
     (void)getslot(J, ra-2); /* Type check for table. */
+#endif
     (void)getslot(J, ra-1); /* Type check for nil key. */
     J->base[ra-1] = lj_ir_kint(J, 0) | TREF_KEYINDEX;
     J->maxslot = ra;
@@ -776,6 +815,10 @@ static TRef rec_call_specialize(jit_State *J, GCfunc *fn, TRef tr)
   TRef kfunc;
   if (isluafunc(fn)) {
     GCproto *pt = funcproto(fn);
+    /* Closure created on the trace? Its prototype is already known. */
+    if (!tref_isk(tr) && IR(tref_ref(tr))->o == IR_FNEW &&
+	ir_kproto(IR(IR(tref_ref(tr))->op1)) == pt)
+      return tr;
     /* Too many closures created? Probably not a monomorphic function. */
     if (pt->flags >= PROTO_CLC_POLY) {  /* Specialize to prototype instead. */
       TRef trpt = emitir(IRT(IR_FLOAD, IRT_PGC), tr, IRFL_FUNC_PC);
@@ -856,11 +899,25 @@ void lj_record_tailcall(jit_State *J, BCReg func, ptrdiff_t nargs)
   rec_call_setup(J, func, nargs);
   if (frame_isvarg(J->L->base - 1)) {
     BCReg cbase = (BCReg)frame_delta(J->L->base - 1);
-    if (--J->framedepth < 0)
-      lj_trace_err(J, LJ_TRERR_NYIRETL);
-    J->baseslot -= (BCReg)cbase;
-    J->base -= cbase;
-    func += cbase;
+    if (J->framedepth > 0) {
+      J->framedepth--;
+      J->baseslot -= (BCReg)cbase;
+      J->base -= cbase;
+      func += cbase;
+    } else {  /* Tailcall from vararg function to lower frame. */
+      cTValue *tv = &J->L->base[func];
+      TRef fr;
+      /* NYI: no snapshot to exit to before the header of a fast function. */
+      if (!(tvisfunc(tv) && isluafunc(funcV(tv))))
+	lj_trace_err(J, LJ_TRERR_NYIRETL);
+      fr = emitir(IRTI(IR_SLOAD), LJ_FR2, IRSLOAD_READONLY|IRSLOAD_FRAME);
+      emitir(IRTGI(IR_EQ), fr,
+	     lj_ir_kint(J, (int32_t)frame_ftsz(J->L->base-1)));
+      /* Pop the vararg frame. The callee is moved down to the new base. */
+      emitir(IRT(IR_RETF, IRT_PGC), fr, lj_ir_kint(J, (int32_t)cbase));
+      J->retdepth++;
+      J->needsnap = 1;
+    }
   }
   /* Move func + args down. */
   if (LJ_FR2 && J->baseslot == 2)
@@ -900,7 +957,7 @@ static TRef rec_cat(jit_State *J, BCReg baseslot, BCReg topslot);
 /* Record return. */
 void lj_record_ret(jit_State *J, BCReg rbase, ptrdiff_t gotresults)
 {
-  TValue *frame = J->L->base - 1;
+  TValue *frame = J->L->base - 1, *vframe = NULL;
   ptrdiff_t i;
   for (i = 0; i < gotresults; i++)
     (void)getslot(J, rbase+i);  /* Ensure all results have a reference. */
@@ -919,7 +976,7 @@ void lj_record_ret(jit_State *J, BCReg rbase, ptrdiff_t gotresults)
   }
   /* Return to lower frame via interpreter for unhandled cases. */
   if (J->framedepth == 0 && J->pt && bc_isret(bc_op(*J->pc)) &&
-       (!frame_islua(frame) ||
+       (!frame_islua(frame_isvarg(frame) ? frame_prevd(frame) : frame) ||
 	(J->parent == 0 && J->exitno == 0 &&
 	 !bc_isret(bc_op(J->cur.startins))))) {
     /* NYI: specialize to frame type and return directly, not via RET*. */
@@ -931,12 +988,15 @@ void lj_record_ret(jit_State *J, BCReg rbase, ptrdiff_t gotresults)
   }
   if (frame_isvarg(frame)) {
     BCReg cbase = (BCReg)frame_delta(frame);
-    if (--J->framedepth < 0)  /* NYI: return of vararg func to lower frame. */
-      lj_trace_err(J, LJ_TRERR_NYIRETL);
-    lj_assertJ(J->baseslot > 1+LJ_FR2, "bad baseslot for return");
-    rbase += cbase;
-    J->baseslot -= (BCReg)cbase;
-    J->base -= cbase;
+    if (J->framedepth > 0) {
+      J->framedepth--;
+      lj_assertJ(J->baseslot > 1+LJ_FR2, "bad baseslot for return");
+      rbase += cbase;
+      J->baseslot -= (BCReg)cbase;
+      J->base -= cbase;
+    } else {  /* Return of vararg func to lower frame. Both are popped below. */
+      vframe = frame;
+    }
     frame = frame_prevd(frame);
   }
   if (frame_islua(frame)) {  /* Return to Lua frame. */
@@ -972,7 +1032,21 @@ void lj_record_ret(jit_State *J, BCReg rbase, ptrdiff_t gotresults)
     } else {  /* Return to lower frame. Guard for the target we return to. */
       TRef trpt = lj_ir_kgc(J, obj2gco(pt), IRT_PROTO);
       TRef trpc = lj_ir_kptr(J, (void *)frame_pc(frame));
-      emitir(IRTG(IR_RETF, IRT_PGC), trpt, trpc);
+      if (vframe) {  /* Check both frames first, then pop them at once. */
+	BCReg vbase = (BCReg)frame_delta(vframe);
+	TRef fr = emitir(IRTI(IR_SLOAD), LJ_FR2, IRSLOAD_READONLY|IRSLOAD_FRAME);
+	TRef tr;
+	emitir(IRTGI(IR_EQ), fr, lj_ir_kint(J, (int32_t)frame_ftsz(vframe)));
+	tr = emitir(IRT(IR_SUB, IRT_IGC), REF_BASE, fr);
+	tr = emitir(IRT(IR_ADD, IRT_PGC), tr,
+		    lj_ir_kint(J, FRAME_VARG-8+FRAME_LINKOFS));
+	tr = emitir(IRT(IR_XLOAD, IRT_PGC), tr, 0);
+	emitir(IRTG(IR_EQ, IRT_PGC), tr, trpc);
+	emitir(IRT(IR_RETF, IRT_PGC), trpt,
+	       lj_ir_kint(J, (int32_t)(vbase+cbase+1+LJ_FR2)));
+      } else {
+	emitir(IRTG(IR_RETF, IRT_PGC), trpt, trpc);
+      }
       J->retdepth++;
       J->needsnap = 1;
       lj_assertJ(J->baseslot == 1+LJ_FR2, "bad baseslot for return");
@@ -1059,6 +1133,13 @@ int lj_record_mm_lookup(jit_State *J, RecordIndex *ix, MMS mm)
   RecordIndex mix;
   GCtab *mt;
   if (tref_istab(ix->tab)) {
+#if LJ_HASFROZEN
+    if (tabisfrozen(tabV(&ix->tabv))) {  /* The marker has no metamethods. */
+      lj_record_frozen(J, ix->tab, 1);
+      ix->mt = TREF_NIL;
+      return 0;
+    }
+#endif
     mt = tabref(tabV(&ix->tabv)->metatable);
     mix.tab = emitir(IRT(IR_FLOAD, IRT_TAB), ix->tab, IRFL_TAB_META);
   } else if (tref_isudata(ix->tab)) {
@@ -1117,6 +1198,12 @@ nocheck:
     mix.val = 0;
     mix.idxchain = 0;
     ix->mobj = lj_record_idx(J, &mix);
+#if LJ_HASFROZEN
+    /* The marker lacks these, but frozen tables need the slow path. */
+    if (tref_isnil(ix->mobj) && tref_istab(ix->tab) &&
+	(mm == MM_index || mm == MM_metatable))
+      lj_record_frozen(J, ix->tab, 0);
+#endif
     return !tref_isnil(ix->mobj);  /* 1 if metamethod found, 0 if not. */
   }
   return 0;  /* No metamethod. */
@@ -1404,6 +1491,11 @@ static TRef rec_idx_key(jit_State *J, RecordIndex *ix, IRRef *rbref,
 {
   TRef key;
   GCtab *t = tabV(&ix->tabv);
+#if LJ_HASLAZYSTR
+  /* Hash lookups compare string keys by identity. */
+  if (tvisstr(&ix->keyv) && !rec_strnotlazy(J, ix->key, strV(&ix->keyv)))
+    lj_trace_err(J, LJ_TRERR_NYILAZY);
+#endif
   ix->oldv = lj_tab_get(J->L, t, &ix->keyv);  /* Lookup previous value. */
   *rbref = 0;
   rbguard->irt = 0;
@@ -1459,6 +1551,16 @@ static TRef rec_idx_key(jit_State *J, RecordIndex *ix, IRRef *rbref,
       TRef node, kslot, hm;
       *rbref = J->cur.nins;  /* Mark possible rollback point. */
       *rbguard = J->guardemit;
+#if LJ_HASTABSHAPE
+      if (t->shape && (J->flags & JIT_F_OPT_SHAPE)) {
+	/* Same shape, same node for the key. No need to check the key. */
+	hm = emitir(IRTI(IR_FLOAD), ix->tab, IRFL_TAB_SHAPE);
+	emitir(IRTGI(IR_EQ), hm, lj_ir_kint(J, (int32_t)t->shape));
+	node = emitir(IRT(IR_FLOAD, IRT_PGC), ix->tab, IRFL_TAB_NODE);
+	kslot = lj_ir_kslot(J, key, (IRRef)(hslot / sizeof(Node)));
+	return emitir(IRT(IR_HREFK, IRT_PGC), node, kslot);
+      }
+#endif
       hm = emitir(IRTI(IR_FLOAD), ix->tab, IRFL_TAB_HMASK);
       emitir(IRTGI(IR_EQ), hm, lj_ir_kint(J, (int32_t)t->hmask));
       node = emitir(IRT(IR_FLOAD, IRT_PGC), ix->tab, IRFL_TAB_NODE);
@@ -1488,6 +1590,32 @@ static int nommstr(jit_State *J, TRef key)
 }
 
 /* Record indexed load/store. */
+#if LJ_HASFROZEN
+/* Record a load from a frozen table. Stores are left to the interpreter. */
+static TRef rec_idx_frozen(jit_State *J, RecordIndex *ix)
+{
+  cTValue *v;
+  TRef key, tmp;
+  if (ix->val)
+    lj_trace_err(J, LJ_TRERR_NYIFRZ);
+  v = lj_frozen_find(tabV(&ix->tabv), &ix->keyv);
+  if (tref_isk(ix->tab) && tref_isk(ix->key)) {  /* Constant result. */
+    TRef tr;
+    if (!v) return TREF_NIL;
+    if (tvisstr(v))
+      return lj_ir_kstr(J, lj_str_new(J->L, strVdata(v), strV(v)->len));
+    if ((tr = lj_record_constify(J, v)) != 0) return tr;
+  }
+  lj_record_frozen(J, ix->tab, 1);
+  key = ix->key;
+  if (!LJ_DUALNUM && tref_isinteger(key))
+    key = emitir(IRTN(IR_CONV), key, IRCONV_NUM_INT);
+  tmp = emitir(IRT(IR_TMPREF, IRT_PGC), key, IRTMPREF_IN1|IRTMPREF_OUT1);
+  lj_ir_call(J, IRCALL_lj_frozen_gettv, ix->tab, tmp);
+  return lj_record_vload(J, tmp, 0, v ? itype2irt(v) : IRT_NIL);
+}
+#endif
+
 TRef lj_record_idx(jit_State *J, RecordIndex *ix)
 {
   TRef xref;
@@ -1548,6 +1676,11 @@ TRef lj_record_idx(jit_State *J, RecordIndex *ix)
     }
   }
 
+#if LJ_HASFROZEN
+  if (tabisfrozen(tabV(&ix->tabv)))
+    return rec_idx_frozen(J, ix);
+#endif
+
   /* Record the key lookup. */
   xref = rec_idx_key(J, ix, &rbref, &rbguard);
   xrefop = IR(tref_ref(xref))->o;
@@ -1735,18 +1868,41 @@ static int rec_upvalue_constify(jit_State *J, GCupval *uvp)
   return 0;
 }
 
+/* Reference a local upvalue of a closure created on the trace. */
+static TRef rec_upvalue_fnew(jit_State *J, TRef fn, uint32_t uv)
+{
+  GCproto *pt = ir_kproto(IR(IR(tref_ref(fn))->op1));
+  uint32_t dhash = (uint32_t)(uintptr_t)pt ^ (proto_uv(pt)[uv] << 24);
+  /* It's always closed, so the check for an open upvalue can be omitted. */
+  return emitir(IRT(IR_UREFC, IRT_PGC), fn,
+		(uv << 8) | (hashrot(dhash, dhash + HASH_BIAS) & 0xff));
+}
+
 /* Record upvalue load/store. */
 static TRef rec_upvalue(jit_State *J, uint32_t uv, TRef val)
 {
   GCupval *uvp = &gcref(J->fn->l.uvptr[uv])->uv;
   TRef fn = getcurrf(J);
   IRRef uref;
-  int needbarrier = 0;
+  int needbarrier = 0, inherited = 0;
+  /* Closures created on the trace inherit the other upvalues of the parent. */
+  while (!tref_isk(fn) && IR(tref_ref(fn))->o == IR_FNEW) {
+    IRIns *ir = IR(tref_ref(fn));
+    uint32_t v = proto_uv(ir_kproto(IR(ir->op1)))[uv];
+    if ((v & PROTO_UV_LOCAL)) {
+      uref = tref_ref(rec_upvalue_fnew(J, fn, uv));
+      needbarrier = 1;
+      goto access;
+    }
+    fn = TREF(ir->op2, IRT_FUNC);
+    uv = v;
+    inherited = 1;
+  }
   if (rec_upvalue_constify(J, uvp)) {  /* Try to constify immutable upvalue. */
     TRef tr, kfunc;
     lj_assertJ(val == 0, "bad usage");
     if (!tref_isk(fn)) {  /* Late specialization of current function. */
-      if (J->pt->flags >= PROTO_CLC_POLY)
+      if (inherited || J->pt->flags >= PROTO_CLC_POLY)
 	goto noconstify;
       kfunc = lj_ir_kfunc(J, J->fn);
       emitir(IRTG(IR_EQ, IRT_FUNC), fn, kfunc);
@@ -1792,6 +1948,7 @@ noconstify:
     needbarrier = 1;
     uref = tref_ref(emitir(IRTG(IR_UREFC, IRT_PGC), fn, uv));
   }
+access:
   if (val == 0) {  /* Upvalue load */
     IRType t = itype2irt(uvval(uvp));
     TRef res = emitir(IRTG(IR_ULOAD, t), uref, 0);
@@ -1809,6 +1966,111 @@ noconstify:
   }
 }
 
+/* -- Record closures ----------------------------------------------------- */
+
+/* Check that no other closure may share the upvalue for slot s.
+**
+** The interpreter shares one open upvalue between all closures created
+** for the same instance of a local. A closure created on the trace gets
+** a private closed copy instead. That's only indistinguishable if no
+** other FNEW in the scope of the local captures the slot and if an
+** enclosing loop closes the slot before it iterates again. Without debug
+** info, the scope is the whole prototype.
+*/
+static int rec_fnew_private(jit_State *J, BCReg s)
+{
+  GCproto *pt = J->pt;
+  const BCIns *bc = proto_bc(pt);
+  BCPos p = proto_bcpos(pt, J->pc), pos, e = pt->sizebc;
+  BCPos vstart = 0, vend = pt->sizebc;
+  lj_debug_varrange(pt, p, s, &vstart, &vend);
+  for (pos = 0; pos < pt->sizebc; pos++) {
+    BCIns ins = bc[pos];
+    BCOp op = bc_op(ins);
+    if (op == BC_JFORL || op == BC_JITERL || op == BC_JLOOP) {
+      ins = traceref(J, bc_d(ins))->startins;
+      op = bc_op(ins);
+    }
+    if (op == BC_FNEW && pos != p && pos >= vstart && pos < vend) {
+      GCproto *fpt = gco2pt(proto_kgc(pt, ~(ptrdiff_t)bc_d(ins)));
+      MSize i;
+      for (i = 0; i < fpt->sizeuv; i++) {
+	uint32_t v = proto_uv(fpt)[i];
+	if ((v & PROTO_UV_LOCAL) && (v & 0xff) == s)
+	  return 0;
+      }
+    } else if (bcmode_d(op) == BCMjump && pos > p && pos < e &&
+	       (BCPos)((int32_t)pos+1+bc_j(ins)) <= p) {
+      e = pos;  /* Innermost backward jump around the FNEW. */
+    }
+  }
+  if (e == pt->sizebc)
+    return 1;  /* Not in a loop. */
+  for (pos = p+1; pos <= e; pos++) {  /* Find the UCLO closing the slot. */
+    BCIns ins = bc[pos];
+    if (bc_op(ins) == BC_UCLO && bc_a(ins) <= s &&
+	(bc_j(ins) == 0 || (BCPos)((int32_t)pos+1+bc_j(ins)) <= p))
+      return 1;
+  }
+  return 0;
+}
+
+/* Record closure creation. Local upvalues are created closed and are
+** initialized with the current slot values. This is only valid for
+** immutable locals, which can't be changed by anyone afterwards, and
+** which aren't captured by any other closure.
+*/
+static TRef rec_fnew(jit_State *J, BCReg ra, GCproto *pt)
+{
+  TRef tr;
+  MSize i;
+  for (i = 0; i < pt->sizeuv; i++) {
+    uint32_t v = proto_uv(pt)[i];
+    if ((v & (PROTO_UV_LOCAL|PROTO_UV_IMMUTABLE)) == PROTO_UV_LOCAL)
+      lj_trace_err(J, LJ_TRERR_NYIUV);
+    if ((v & PROTO_UV_LOCAL) && !rec_fnew_private(J, (BCReg)(v & 0xff)))
+      lj_trace_err(J, LJ_TRERR_NYIUVSH);
+  }
+  tr = emitir(IRTG(IR_FNEW, IRT_FUNC), lj_ir_kgc(J, obj2gco(pt), IRT_PROTO),
+	      getcurrf(J));
+  for (i = 0; i < pt->sizeuv; i++) {
+    uint32_t v = proto_uv(pt)[i];
+    if ((v & PROTO_UV_LOCAL)) {
+      BCReg s = (v & 0xff);
+      /* A local function captures the slot it's about to be stored in. */
+      TRef val = s == ra ? tr : getslot(J, s);
+      if (!tref_isnil(val)) {
+	if (!LJ_DUALNUM && tref_isinteger(val))
+	  val = emitir(IRTN(IR_CONV), val, IRCONV_NUM_INT);
+	emitir(IRT(IR_USTORE, tref_type(val)), rec_upvalue_fnew(J, tr, i), val);
+      }
+    }
+  }
+  return tr;
+}
+
+/* Record upvalue closing. Closures created on the trace never have open
+** upvalues. So this only needs to check that no open upvalues created
+** outside of the trace point to the closed slots.
+*/
+static void rec_uclo(jit_State *J, BCReg ra)
+{
+  TRef tr;
+  if (J->uvtop > savestack(J->L, J->L->base + ra))
+    lj_trace_err(J, LJ_TRERR_NYIUCLO);
+  tr = emitir(IRT(IR_FLOAD, IRT_PGC), emitir(IRT(IR_LREF, IRT_THREAD), 0, 0),
+	      IRFL_THREAD_OPENUPVAL);
+  if (J->uvtop) {  /* Check that the topmost open upvalue is below. */
+    emitir(IRTG(IR_NE, IRT_PGC), tr, lj_ir_knull(J, IRT_PGC));
+    tr = emitir(IRT(IR_FLOAD, IRT_PGC), tr, IRFL_UPVAL_V);
+    emitir(IRTG(IR_LT, IRT_IGC), emitir(IRT(IR_SUB, IRT_IGC), tr, REF_BASE),
+	   lj_ir_kint(J, (int32_t)(J->baseslot + ra - 1 - LJ_FR2) * 8));
+  } else {  /* Check that there are no open upvalues. */
+    emitir(IRTG(IR_EQ, IRT_PGC), tr, lj_ir_knull(J, IRT_PGC));
+  }
+  /* Note: the slots stay live. E.g. UCLO 0 is followed by RET1 1. */
+}
+
 /* -- Record calls to Lua functions --------------------------------------- */
 
 /* Check unroll limits for calls. */
@@ -1838,7 +2100,8 @@ static void check_call_unroll(jit_State *J, TraceNo lnk)
       if (lnk) {  /* Possible tail- or up-recursion. */
 	lj_trace_flush(J, lnk);  /* Flush trace that only returns. */
 	/* Set a small, pseudo-random hotcount for a quick retry of JFUNC*. */
-	hotcount_set(J2GG(J), J->pc+1, lj_prng_u64(&J2G(J)->prng) & 15u);
+	lj_trace_hotretry(J, J->pt, J->pc,
+			  (HotCount)(lj_prng_u64(&J2G(J)->prng) & 15u));
       }
       lj_trace_err(J, LJ_TRERR_CUNROLL);
     }
@@ -1954,35 +2217,14 @@ static void rec_varg(jit_State *J, BCReg dst, ptrdiff_t nresults)
   } else {  /* Unknown number of varargs passed to trace. */
     TRef fr = emitir(IRTI(IR_SLOAD), LJ_FR2, IRSLOAD_READONLY|IRSLOAD_FRAME);
     int32_t frofs = 8*(1+LJ_FR2+numparams)+FRAME_VARG;
-    if (nresults >= 0) {  /* Known fixed number of results. */
-      ptrdiff_t i;
-      if (nvararg > 0) {
-	ptrdiff_t nload = nvararg >= nresults ? nresults : nvararg;
-	TRef vbase;
-	if (nvararg >= nresults)
-	  emitir(IRTGI(IR_GE), fr, lj_ir_kint(J, frofs+8*(int32_t)nresults));
-	else
-	  emitir(IRTGI(IR_EQ), fr,
-		 lj_ir_kint(J, (int32_t)frame_ftsz(J->L->base-1)));
-	vbase = emitir(IRT(IR_SUB, IRT_IGC), REF_BASE, fr);
-	vbase = emitir(IRT(IR_ADD, IRT_PGC), vbase, lj_ir_kint(J, frofs-8*(1+LJ_FR2)));
-	for (i = 0; i < nload; i++) {
-	  IRType t = itype2irt(&J->L->base[i-1-LJ_FR2-nvararg]);
-	  J->base[dst+i] = lj_record_vload(J, vbase, (MSize)i, t);
-	}
-      } else {
-	emitir(IRTGI(IR_LE), fr, lj_ir_kint(J, frofs));
-	nvararg = 0;
-      }
-      for (i = nvararg; i < nresults; i++)
-	J->base[dst+i] = TREF_NIL;
-      if (dst + (BCReg)nresults > J->maxslot)
-	J->maxslot = dst + (BCReg)nresults;
-    } else if (select_detect(J)) {  /* y = select(x, ...) */
+    if (nresults < 0 && select_detect(J)) {  /* y = select(x, ...) */
       TRef tridx = J->base[dst-1];
       TRef tr = TREF_NIL;
       ptrdiff_t idx = lj_ffrecord_select_mode(J, tridx, &J->L->base[dst-1]);
-      if (idx < 0) goto nyivarg;
+      if (idx < 0) {
+	setintV(&J->errinfo, BC_VARG);
+	lj_trace_err_info(J, LJ_TRERR_NYIBC);
+      }
       if (idx != 0 && !tref_isinteger(tridx))
 	tridx = emitir(IRTGI(IR_CONV), tridx, IRCONV_INT_NUM|IRCONV_INDEX);
       if (idx != 0 && tref_isk(tridx)) {
@@ -2020,16 +2262,62 @@ static void rec_varg(jit_State *J, BCReg dst, ptrdiff_t nresults)
       J->base[dst-2-LJ_FR2] = tr;
       J->maxslot = dst-1-LJ_FR2;
       J->bcskip = 2;  /* Skip CALLM + select. */
-    } else {
-    nyivarg:
-      setintV(&J->errinfo, BC_VARG);
-      lj_trace_err_info(J, LJ_TRERR_NYIBC);
+    } else {  /* Known fixed number of results or all varargs. */
+      ptrdiff_t i;
+      int multres = nresults < 0;
+      if (multres) {  /* Specialize to the number of varargs passed. */
+	nresults = nvararg > 0 ? nvararg : 0;
+	J->maxslot = dst + (BCReg)nresults;
+	if (J->baseslot + J->maxslot >= LJ_MAX_JSLOTS)
+	  lj_trace_err(J, LJ_TRERR_STACKOV);
+      }
+      if (nvararg > 0) {
+	ptrdiff_t nload = nvararg >= nresults ? nresults : nvararg;
+	TRef vbase;
+	if (nvararg >= nresults && !multres)
+	  emitir(IRTGI(IR_GE), fr, lj_ir_kint(J, frofs+8*(int32_t)nresults));
+	else
+	  emitir(IRTGI(IR_EQ), fr,
+		 lj_ir_kint(J, (int32_t)frame_ftsz(J->L->base-1)));
+	vbase = emitir(IRT(IR_SUB, IRT_IGC), REF_BASE, fr);
+	vbase = emitir(IRT(IR_ADD, IRT_PGC), vbase, lj_ir_kint(J, frofs-8*(1+LJ_FR2)));
+	for (i = 0; i < nload; i++) {
+	  IRType t = itype2irt(&J->L->base[i-1-LJ_FR2-nvararg]);
+	  J->base[dst+i] = lj_record_vload(J, vbase, (MSize)i, t);
+	}
+      } else {
+	emitir(IRTGI(IR_LE), fr, lj_ir_kint(J, frofs));
+	nvararg = 0;
+      }
+      for (i = nvararg; i < nresults; i++)
+	J->base[dst+i] = TREF_NIL;
+      if (dst + (BCReg)nresults > J->maxslot)
+	J->maxslot = dst + (BCReg)nresults;
     }
   }
 }
 
 /* -- Record allocations -------------------------------------------------- */
 
+#if LJ_HASTABSITE
+/* Count an allocation from a presized site, like tab_siteadd() does. */
+static void rec_tabsite(jit_State *J)
+{
+  TabSiteState *ts = tabsite_state(J2G(J));
+  TabSite *s = ts ? lj_tab_sitefind(J->pt, proto_bcpos(J->pt, J->pc)) : NULL;
+  if (s) {
+    TRef ptr = lj_ir_kptr(J, &ts->npresized);
+    TRef tr = emitir(IRT(IR_XLOAD, IRT_UINTP), ptr, 0);
+    tr = emitir(IRT(IR_ADD, IRT_UINTP), tr, lj_ir_kintp(J, 1));
+    emitir(IRT(IR_XSTORE, IRT_UINTP), ptr, tr);
+    ptr = lj_ir_kptr(J, &ts->navoided);
+    tr = emitir(IRT(IR_XLOAD, IRT_UINTP), ptr, 0);
+    tr = emitir(IRT(IR_ADD, IRT_UINTP), tr, lj_ir_kintp(J, s->nrehash));
+    emitir(IRT(IR_XSTORE, IRT_UINTP), ptr, tr);
+  }
+}
+#endif
+
 static TRef rec_tnew(jit_State *J, uint32_t ah)
 {
   uint32_t asize = ah & 0x7ff;
@@ -2037,6 +2325,9 @@ static TRef rec_tnew(jit_State *J, uint32_t ah)
   TRef tr;
   if (asize == 0x7ff) asize = 0x801;
   tr = emitir(IRTG(IR_TNEW, IRT_TAB), asize, hbits);
+#if LJ_HASTABSITE
+  rec_tabsite(J);
+#endif
 #ifdef LUAJIT_ENABLE_TABLE_BUMP
   J->rbchash[(tr & (RBCHASH_SLOTS-1))].ref = tref_ref(tr);
   setmref(J->rbchash[(tr & (RBCHASH_SLOTS-1))].pc, J->pc);
@@ -2452,6 +2743,9 @@ void lj_record_ins(jit_State *J)
   case BC_USETV: case BC_USETS: case BC_USETN: case BC_USETP:
     rec_upvalue(J, ra, rc);
     break;
+  case BC_FNEW:
+    rc = rec_fnew(J, ra, gco2pt(proto_kgc(J->pt, ~(ptrdiff_t)rc)));
+    break;
 
   /* -- Table ops --------------------------------------------------------- */
 
@@ -2473,6 +2767,11 @@ void lj_record_ins(jit_State *J)
   case BC_TGETR: case BC_TSETR:
     ix.idxchain = 0;
     rc = lj_record_idx(J, &ix);
+#if LJ_HASFROZEN
+    /* A raw miss on the empty proxy of a frozen table would be wrong. */
+    if (op == BC_TGETR && tref_isnil(rc) && !tabisfrozen(tabV(&ix.tabv)))
+      lj_record_frozen(J, ix.tab, 0);
+#endif
     break;
 
   case BC_TSETM:
@@ -2485,6 +2784,9 @@ void lj_record_ins(jit_State *J)
   case BC_TDUP:
     rc = emitir(IRTG(IR_TDUP, IRT_TAB),
 		lj_ir_ktab(J, gco2tab(proto_kgc(J->pt, ~(ptrdiff_t)rc))), 0);
+#if LJ_HASTABSITE
+    rec_tabsite(J);
+#endif
 #ifdef LUAJIT_ENABLE_TABLE_BUMP
     J->rbchash[(rc & (RBCHASH_SLOTS-1))].ref = tref_ref(rc);
     setmref(J->rbchash[(rc & (RBCHASH_SLOTS-1))].pc, pc);
@@ -2590,6 +2892,9 @@ void lj_record_ins(jit_State *J)
     if (ra < J->maxslot)
       J->maxslot = ra;  /* Shrink used slots. */
     break;
+  case BC_UCLO:
+    rec_uclo(J, ra);
+    break;
 
   case BC_ISNEXT:
     rec_isnext(J, ra);
@@ -2623,9 +2928,6 @@ void lj_record_ins(jit_State *J)
       lj_ffrecord_func(J);
       break;
     }
-    /* fallthrough */
-  case BC_UCLO:
-  case BC_FNEW:
     setintV(&J->errinfo, (int32_t)op);
     lj_trace_err_info(J, LJ_TRERR_NYIBC);
     break;
@@ -2747,6 +3049,10 @@ void lj_record_setup(jit_State *J)
 
   J->bc_min = NULL;  /* Means no limit. */
   J->bc_extent = ~(MSize)0;
+  if (gcref(J->L->openupval))  /* Open upvalues not created by the trace. */
+    J->uvtop = savestack(J->L, uvval(gco2uv(gcref(J->L->openupval)))+1);
+  else
+    J->uvtop = 0;
 
   /* Emit instructions for fixed references. Also triggers initial IR alloc. */
   emitir_raw(IRT(IR_BASE, IRT_PGC), J->parent, J->exitno);
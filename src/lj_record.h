@@ -31,6 +31,9 @@ LJ_FUNC int lj_record_objcmp(jit_State *J, TRef a, TRef b,
 LJ_FUNC void lj_record_stop(jit_State *J, TraceLink linktype, TraceNo lnk);
 LJ_FUNC TRef lj_record_constify(jit_State *J, cTValue *o);
 LJ_FUNC TRef lj_record_vload(jit_State *J, TRef ref, MSize idx, IRType t);
+#if LJ_HASFROZEN
+LJ_FUNC void lj_record_frozen(jit_State *J, TRef tr, int frozen);
+#endif
 
 LJ_FUNC void lj_record_call(jit_State *J, BCReg func, ptrdiff_t nargs);
 LJ_FUNC void lj_record_tailcall(jit_State *J, BCReg func, ptrdiff_t nargs);
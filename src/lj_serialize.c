@@ -9,10 +9,12 @@
 #include "lj_obj.h"
 
 #if LJ_HASBUFFER
+#include "lj_gc.h"
 #include "lj_err.h"
 #include "lj_buf.h"
 #include "lj_str.h"
 #include "lj_tab.h"
+#include "lj_frozen.h"
 #include "lj_udata.h"
 #if LJ_HASFFI
 #include "lj_ctype.h"
@@ -188,6 +190,10 @@ static char *serialize_put(char *w, SBufExt *sbx, cTValue *o)
   } else if (tvistab(o)) {
     const GCtab *t = tabV(o);
     uint32_t narray = 0, nhash = 0, one = 2;
+#if LJ_HASFROZEN
+    GCtab view;
+    if (tabisfrozen(t)) t = lj_frozen_view(tabV(o), &view);
+#endif
     if (sbx->depth <= 0) lj_err_caller(sbufL(sbx), LJ_ERR_BUFFER_DEPTH);
     sbx->depth--;
     if (t->asize > 0) {  /* Determine max. length of array part. */
@@ -12,6 +12,7 @@
 
 #include "lj_gc.h"
 #include "lj_tab.h"
+#include "lj_func.h"
 #include "lj_state.h"
 #include "lj_frame.h"
 #include "lj_bc.h"
@@ -486,7 +487,7 @@ static TRef snap_pref(jit_State *J, GCtrace *T, SnapEntry *map, MSize nmax,
 static int snap_sunk_store2(GCtrace *T, IRIns *ira, IRIns *irs)
 {
   if (irs->o == IR_ASTORE || irs->o == IR_HSTORE ||
-      irs->o == IR_FSTORE || irs->o == IR_XSTORE) {
+      irs->o == IR_FSTORE || irs->o == IR_XSTORE || irs->o == IR_USTORE) {
     IRIns *irk = &T->ir[irs->op1];
     if (irk->o == IR_AREF || irk->o == IR_HREFK)
       irk = &T->ir[irk->op1];
@@ -559,7 +560,7 @@ void lj_snap_replay(jit_State *J, GCtrace *T)
       if (regsp_reg(ir->r) == RID_SUNK) {
 	if (J->slot[snap_slot(sn)] != snap_slot(sn)) continue;
 	pass23 = 1;
-	lj_assertJ(ir->o == IR_TNEW || ir->o == IR_TDUP ||
+	lj_assertJ(ir->o == IR_TNEW || ir->o == IR_TDUP || ir->o == IR_FNEW ||
 		   ir->o == IR_CNEW || ir->o == IR_CNEWI,
 		   "sunk parent IR %04d has bad op %d", refp - REF_BIAS, ir->o);
 	if (ir->op1 >= T->nk) snap_pref(J, T, map, nent, seen, ir->op1);
@@ -614,7 +615,7 @@ void lj_snap_replay(jit_State *J, GCtrace *T)
 	    if (irs->r == RID_SINK && snap_sunk_store(T, ir, irs)) {
 	      IRIns *irr = &T->ir[irs->op1];
 	      TRef val, key = irr->op2, tmp = tr;
-	      if (irr->o != IR_FREF) {
+	      if (irr->o != IR_FREF && irr->o != IR_UREFC) {
 		IRIns *irk = &T->ir[key];
 		if (irr->o == IR_HREFK)
 		  key = lj_ir_kslot(J, snap_replay_const(J, &T->ir[irk->op1]),
@@ -811,7 +812,7 @@ static void snap_unsink(jit_State *J, GCtrace *T, ExitState *ex,
 			SnapNo snapno, BloomFilter rfilt,
 			IRIns *ir, TValue *o)
 {
-  lj_assertJ(ir->o == IR_TNEW || ir->o == IR_TDUP ||
+  lj_assertJ(ir->o == IR_TNEW || ir->o == IR_TDUP || ir->o == IR_FNEW ||
 	     ir->o == IR_CNEW || ir->o == IR_CNEWI,
 	     "sunk allocation with bad op %d", ir->o);
 #if LJ_HASFFI
@@ -866,7 +867,22 @@ static void snap_unsink(jit_State *J, GCtrace *T, ExitState *ex,
     }
   } else
 #endif
-  {
+  if (ir->o == IR_FNEW) {
+    IRIns *irs, *irlast = &T->ir[T->snap[snapno].ref];
+    TValue tmp;
+    GCfunc *fn;
+    snap_restoreval(J, T, ex, snapno, rfilt, ir->op2, &tmp);
+    fn = lj_func_newL_closed(J->L, ir_kproto(&T->ir[ir->op1]),
+			     &funcV(&tmp)->l);
+    setfuncV(J->L, o, fn);
+    for (irs = ir+1; irs < irlast; irs++)
+      if (irs->r == RID_SINK && snap_sunk_store(T, ir, irs)) {
+	GCupval *uv = &gcref(fn->l.uvptr[T->ir[irs->op1].op2 >> 8])->uv;
+	lj_assertJ(irs->o == IR_USTORE, "sunk store with bad op %d", irs->o);
+	/* NOBARRIER: The upvalue is new (marked white). */
+	snap_restoreval(J, T, ex, snapno, rfilt, irs->op2, &uv->tv);
+      }
+  } else {
     IRIns *irs, *irlast;
     GCtab *t = ir->o == IR_TNEW ? lj_tab_new(J->L, ir->op1, ir->op2) :
 				  lj_tab_dup(J->L, ir_ktab(&T->ir[ir->op1]));
@@ -14,7 +14,11 @@
 #include "lj_err.h"
 #include "lj_buf.h"
 #include "lj_str.h"
+#include "lj_strmatch.h"
 #include "lj_tab.h"
+#if LJ_HASFROZEN
+#include "lj_frozen.h"
+#endif
 #include "lj_func.h"
 #include "lj_meta.h"
 #include "lj_state.h"
@@ -66,6 +70,8 @@ static void resizestack(lua_State *L, MSize n)
   st = (TValue *)lj_mem_realloc(L, tvref(L->stack),
 				(MSize)(oldsize*sizeof(TValue)),
 				(MSize)(realsize*sizeof(TValue)));
+  lj_mem_accsize(G(L), LJ_HEAP_STACK, oldsize*sizeof(TValue),
+		 realsize*sizeof(TValue));
   setmref(L->stack, st);
   delta = (char *)st - (char *)oldst;
   setmref(L->maxstack, st + n);
@@ -127,6 +133,8 @@ void LJ_FASTCALL lj_state_growstack1(lua_State *L)
 static void stack_init(lua_State *L1, lua_State *L)
 {
   TValue *stend, *st = lj_mem_newvec(L, LJ_STACK_START+LJ_STACK_EXTRA, TValue);
+  lj_mem_accsize(G(L), LJ_HEAP_STACK, 0,
+		 (LJ_STACK_START+LJ_STACK_EXTRA)*sizeof(TValue));
   setmref(L1->stack, st);
   L1->stacksize = LJ_STACK_START + LJ_STACK_EXTRA;
   stend = st + L1->stacksize;
@@ -173,7 +181,19 @@ static void close_state(lua_State *L)
   lj_ctype_freestate(g);
 #endif
   lj_str_freetab(g);
+  lj_strmatch_freecache(g);
+#if LJ_HASTABSHAPE
+  lj_tab_freeshape(g);
+#endif
+#if LJ_HASTABSITE
+  lj_tab_freesite(g);
+#endif
+#if LJ_HASFROZEN
+  lj_frozen_freestate(g);
+#endif
+  lj_mem_freevec(g, mref(g->gc.ystr, GCRef), g->gc.ystrsize, GCRef);
   lj_buf_free(g, &g->tmpbuf);
+  lj_mem_accsize(g, LJ_HEAP_STACK, L->stacksize*sizeof(TValue), 0);
   lj_mem_freevec(g, tvref(L->stack), L->stacksize, TValue);
 #if LJ_64
   if (mref(g->gc.lightudseg, uint32_t)) {
@@ -184,6 +204,14 @@ static void close_state(lua_State *L)
   lj_assertG(g->gc.total == sizeof(GG_State),
 	     "memory leak of %lld bytes",
 	     (long long)(g->gc.total - sizeof(GG_State)));
+#ifdef LUA_USE_ASSERT
+  {
+    int i;
+    for (i = 0; i < LJ_HEAP__MAX; i++)
+      lj_assertG(g->gc.heapbytes[i] == 0, "heap accounting leak in category %d",
+		 i);
+  }
+#endif
 #ifndef LUAJIT_USE_SYSMALLOC
   if (g->allocf == lj_alloc_f)
     lj_alloc_destroy(g->allocd);
@@ -255,7 +283,13 @@ LUA_API lua_State *lua_newstate(lua_Alloc allocf, void *allocd)
 #endif
   g->gc.pause = LUAI_GCPAUSE;
   g->gc.stepmul = LUAI_GCMUL;
+  g->gc.genminor = LUAI_GCMINOR;
+  g->gc.profcount = ~(GCSize)0;
   lj_dispatch_init((GG_State *)L);
+#if !LJ_TARGET_CONSOLE
+  if (getenv("LUAJIT_HUGEPAGE"))
+    luaJIT_setmode(L, 0, LUAJIT_MODE_HUGEPAGE|LUAJIT_MODE_ON);
+#endif
   L->status = LUA_ERRERR+1;  /* Avoid touching the stack upon memory error. */
   if (lj_vm_cpcall(L, NULL, NULL, cpluaopen) != 0) {
     /* Memory allocation error: free partial state. */
@@ -310,6 +344,7 @@ LUA_API void lua_close(lua_State *L)
 lua_State *lj_state_new(lua_State *L)
 {
   lua_State *L1 = lj_mem_newobj(L, lua_State);
+  lj_mem_accnew(G(L), LJ_HEAP_THREAD, sizeof(lua_State));
   L1->gct = ~LJ_TTHREAD;
   L1->dummy_ffid = FF_C;
   L1->status = LUA_OK;
@@ -328,6 +363,21 @@ lua_State *lj_state_new(lua_State *L)
   return L1;
 }
 
+LJ_DATADEF const char *const lj_state_costatus_name[] = {  /* ORDER COSTATUS */
+  "running", "suspended", "normal", "dead"
+};
+
+/* Get status of coroutine co, as seen from the running coroutine L. */
+int LJ_FASTCALL lj_state_costatus(lua_State *L, lua_State *co)
+{
+  if (co == L) return LJ_COSTATUS_RUNNING;
+  else if (co->status == LUA_YIELD) return LJ_COSTATUS_SUSPENDED;
+  else if (co->status != LUA_OK) return LJ_COSTATUS_DEAD;
+  else if (co->base > tvref(co->stack)+1+LJ_FR2) return LJ_COSTATUS_NORMAL;
+  else if (co->top == co->base) return LJ_COSTATUS_DEAD;
+  else return LJ_COSTATUS_SUSPENDED;
+}
+
 void LJ_FASTCALL lj_state_free(global_State *g, lua_State *L)
 {
   lj_assertG(L != mainthread(g), "free of main thread");
@@ -335,6 +385,8 @@ void LJ_FASTCALL lj_state_free(global_State *g, lua_State *L)
     setgcrefnull(g->cur_L);
   lj_func_closeuv(L, tvref(L->stack));
   lj_assertG(gcref(L->openupval) == NULL, "stale open upvalues");
+  lj_mem_accsize(g, LJ_HEAP_STACK, L->stacksize*sizeof(TValue), 0);
+  lj_mem_accfree(g, LJ_HEAP_THREAD, sizeof(lua_State));
   lj_mem_freevec(g, tvref(L->stack), L->stacksize, TValue);
   lj_mem_freet(g, L);
 #ifdef COUNTS
@@ -27,11 +27,20 @@ static LJ_AINLINE void lj_state_checkstack(lua_State *L, MSize need)
 }
 
 LJ_FUNC lua_State *lj_state_new(lua_State *L);
+LJ_FUNC int LJ_FASTCALL lj_state_costatus(lua_State *L, lua_State *co);
 LJ_FUNC void LJ_FASTCALL lj_state_free(global_State *g, lua_State *L);
 #if LJ_64 && !LJ_GC64 && !(defined(LUAJIT_USE_VALGRIND) && defined(LUAJIT_USE_SYSMALLOC))
 LJ_FUNC lua_State *lj_state_newstate(lua_Alloc f, void *ud);
 #endif
 
+/* Coroutine status, as seen from another coroutine. ORDER COSTATUS */
+enum {
+  LJ_COSTATUS_RUNNING, LJ_COSTATUS_SUSPENDED, LJ_COSTATUS_NORMAL,
+  LJ_COSTATUS_DEAD
+};
+
+LJ_DATA const char *const lj_state_costatus_name[LJ_COSTATUS_DEAD+1];
+
 #define LJ_ALLOCF_INTERNAL	((lua_Alloc)(void *)(uintptr_t)(1237<<4))
 
 #endif
@@ -12,6 +12,42 @@
 #include "lj_str.h"
 #include "lj_char.h"
 #include "lj_prng.h"
+#include "lj_vm.h"
+
+/* Full-content CRC32 primary hash on x64 with SSE4.2, selected at runtime. */
+#if LJ_TARGET_X64 && (defined(__GNUC__) || defined(_MSC_VER)) && \
+    !defined(LUAJIT_DISABLE_STRHASH_CRC)
+#define LJ_STR_HASHCRC		1
+#include <nmmintrin.h>
+#ifdef __GNUC__
+#define LJ_STR_CRCFUNC		__attribute__((target("sse4.2")))
+#else
+#define LJ_STR_CRCFUNC
+#endif
+#define crc_getu64(p) \
+  ((uint64_t)_mm_cvtsi128_si64(_mm_loadl_epi64((const __m128i *)(p))))
+#else
+#define LJ_STR_HASHCRC		0
+#endif
+#if LJ_TARGET_X64
+#include <emmintrin.h>
+#endif
+
+/* AVX2 substring search on x64, selected at runtime. */
+#if LJ_TARGET_X64 && (defined(__GNUC__) || defined(_MSC_VER)) && \
+    !defined(LUAJIT_DISABLE_STRFIND_AVX2)
+#define LJ_STR_FINDAVX2		1
+#include <immintrin.h>
+#ifdef __GNUC__
+#define LJ_STR_AVX2FUNC		__attribute__((target("avx2")))
+#else
+#define LJ_STR_AVX2FUNC
+#endif
+/* Same for all states. Set once by lj_str_init. */
+static int str_findavx2;
+#else
+#define LJ_STR_FINDAVX2		0
+#endif
 
 /* -- String helpers ------------------------------------------------------ */
 
@@ -19,6 +55,7 @@
 int32_t LJ_FASTCALL lj_str_cmp(GCstr *a, GCstr *b)
 {
   MSize i, n = a->len > b->len ? b->len : a->len;
+  if (a == b) return 0;
   for (i = 0; i < n; i += 4) {
     /* Note: innocuous access up to end of string + 3. */
     uint32_t va = *(const uint32_t *)(strdata(a)+i);
@@ -38,21 +75,143 @@ int32_t LJ_FASTCALL lj_str_cmp(GCstr *a, GCstr *b)
   return (int32_t)(a->len - b->len);
 }
 
+#if LJ_HASLAZYSTR
+/* Compare strings for equality. Different objects are only equal if lazy. */
+int LJ_FASTCALL lj_str_eqlazy(const GCstr *a, const GCstr *b)
+{
+  return a == b ||
+	 (strislazy(a) && a->len == b->len && a->hash == b->hash &&
+	  memcmp(strdata(a), strdata(b), a->len) == 0);
+}
+#endif
+
+/* Find fixed string p inside string s. Scalar search with memchr. */
+static const char *str_find_scalar(const char *s, const char *p,
+				   MSize slen, MSize plen)
+{
+  if (plen <= slen) {
+    int c = *(const uint8_t *)p++;
+    plen--; slen -= plen;
+    while (slen) {
+      const char *q = (const char *)memchr(s, c, slen);
+      if (!q) break;
+      if (memcmp(q+1, p, plen) == 0) return q;
+      q++; slen -= (MSize)(q-s); s = q;
+    }
+  }
+  return NULL;
+}
+
+#if LJ_TARGET_X64
+/* Verify a candidate. Inlined, since a call spills the SIMD registers. */
+static LJ_AINLINE int str_find_eq(const char *a, const char *b, MSize n)
+{
+  MSize i;
+  for (i = 0; i < n; i++)
+    if (a[i] != b[i]) return 0;
+  return 1;
+}
+
+/*
+** Two-byte filter search: compare the first and the last char of p at 16
+** positions at once. Only the candidates passing both are verified. This
+** avoids the degradation of memchr+memcmp when the first char is common.
+** Needs plen >= 2. The remaining less than 16 positions are done by the
+** scalar search.
+*/
+static const char *str_find_sse2(const char *s, const char *p,
+				 MSize slen, MSize plen)
+{
+  const __m128i first = _mm_set1_epi8(p[0]);
+  const __m128i last = _mm_set1_epi8(p[plen-1]);
+  const char *q = s, *qe = s + (slen - plen + 1);  /* Caveat: unaligned! */
+  for (; qe - q >= 16; q += 16) {
+    uint32_t m = (uint32_t)_mm_movemask_epi8(_mm_and_si128(
+      _mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i *)q)),
+      _mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i *)(q+plen-1)))));
+    for (; m; m &= m-1) {
+      const char *r = q + lj_ffs(m);
+      if (str_find_eq(r+1, p+1, plen-2)) return r;
+    }
+  }
+  return str_find_scalar(q, p, (MSize)(s+slen-q), plen);
+}
+#endif
+
+#if LJ_STR_FINDAVX2
+/* Ditto, with AVX2 at 32 positions at once. */
+#define str_find_avx2cmp(q) \
+  _mm256_and_si256( \
+    _mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i *)(q))), \
+    _mm256_cmpeq_epi8(last, \
+		      _mm256_loadu_si256((const __m256i *)((q)+plen-1))))
+
+static LJ_NOINLINE LJ_STR_AVX2FUNC const char *str_find_avx2(const char *s,
+	const char *p, MSize slen, MSize plen)
+{
+  const __m256i first = _mm256_set1_epi8(p[0]);
+  const __m256i last = _mm256_set1_epi8(p[plen-1]);
+  const char *q = s, *qe = s + (slen - plen + 1);  /* Caveat: unaligned! */
+  while (qe - q >= 32) {
+    uint32_t m;
+    for (; qe - q >= 64; q += 64) {  /* Skip blocks without candidates. */
+      __m256i ab = _mm256_or_si256(str_find_avx2cmp(q),
+				   str_find_avx2cmp(q+32));
+      if (!_mm256_testz_si256(ab, ab)) break;
+    }
+    if (qe - q < 32) break;
+    m = (uint32_t)_mm256_movemask_epi8(str_find_avx2cmp(q));
+    for (; m; m &= m-1) {
+      const char *r = q + lj_ffs(m);
+      if (str_find_eq(r+1, p+1, plen-2)) return r;
+    }
+    q += 32;
+  }
+  return str_find_sse2(q, p, (MSize)(s+slen-q), plen);
+}
+#undef str_find_avx2cmp
+
+/* Check for AVX2 support by the CPU and the OS. */
+static int str_cpuavx2(void)
+{
+  uint32_t f[4];
+  uint64_t xcr0;
+  if (!(lj_vm_cpuid(0, f) && f[0] >= 7 && lj_vm_cpuid(1, f) &&
+	(f[2] & 0x18000000u) == 0x18000000u))  /* Need OSXSAVE and AVX. */
+    return 0;
+#ifdef __GNUC__
+  {
+    uint32_t lo, hi;
+    __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0"  /* xgetbv */
+			 : "=a" (lo), "=d" (hi) : "c" (0));
+    xcr0 = ((uint64_t)hi << 32) | lo;
+  }
+#else
+  xcr0 = _xgetbv(0);
+#endif
+  if ((xcr0 & 6) != 6)  /* OS must save the XMM and YMM state. */
+    return 0;
+  lj_vm_cpuid(7, f);
+  return (f[1] >> 5) & 1;
+}
+#endif
+
 /* Find fixed string p inside string s. */
 const char *lj_str_find(const char *s, const char *p, MSize slen, MSize plen)
 {
   if (plen <= slen) {
     if (plen == 0) {
       return s;
+#if LJ_TARGET_X64
+    } else if (plen >= 2 && slen - plen >= 16) {
+#if LJ_STR_FINDAVX2
+      if (str_findavx2 && slen - plen >= 32)
+	return str_find_avx2(s, p, slen, plen);
+#endif
+      return str_find_sse2(s, p, slen, plen);
+#endif
     } else {
-      int c = *(const uint8_t *)p++;
-      plen--; slen -= plen;
-      while (slen) {
-	const char *q = (const char *)memchr(s, c, slen);
-	if (!q) break;
-	if (memcmp(q+1, p, plen) == 0) return q;
-	q++; slen -= (MSize)(q-s); s = q;
-      }
+      return str_find_scalar(s, p, slen, plen);
     }
   }
   return NULL;
@@ -95,6 +254,60 @@ static StrHash hash_sparse(uint64_t seed, const char *str, MSize len)
   return h;
 }
 
+#if LJ_STR_HASHCRC
+/*
+** Keyed CRC32 string hash over the full contents of a short string. At
+** most four CRC32 instructions in two independent lanes. From 32 bytes on
+** hash_sparse is faster, since it only reads a few words. CRC32 is linear,
+** so this is no better than hash_sparse against crafted collisions. It only
+** keeps apart short strings which differ in bytes hash_sparse doesn't read.
+** Attacked chains still switch over to hash_dense.
+*/
+#define LJ_STR_CRCMAX	32	/* Use hash_crc below this length. */
+
+static LJ_NOINLINE LJ_STR_CRCFUNC StrHash hash_crc(uint64_t seed,
+						    const char *str, MSize len)
+{
+  const char *pe = str+len;
+  uint64_t a = (uint32_t)seed, b = (uint32_t)(seed >> 32) ^ len;
+  if (len >= 8) {  /* Caveat: unaligned access! Words may overlap. */
+    a = _mm_crc32_u64(a, crc_getu64(str));
+    b = _mm_crc32_u64(b, crc_getu64(pe-8));
+    if (len > 16) {
+      a = _mm_crc32_u64(a, crc_getu64(str+8));
+      b = _mm_crc32_u64(b, crc_getu64(pe-16));
+    }
+  } else if (len >= 4) {
+    a = _mm_crc32_u32((uint32_t)a, lj_getu32(str));
+    b = _mm_crc32_u32((uint32_t)b, lj_getu32(pe-4));
+  } else {
+    a = _mm_crc32_u32((uint32_t)a, *(const uint8_t *)str |
+      (*(const uint8_t *)(str+(len>>1)) << 8) |
+      (*(const uint8_t *)(pe-1) << 16));
+  }
+  b ^= a; b -= lj_rol((StrHash)a, 11);
+  a ^= b; a -= lj_rol((StrHash)b, 25);
+  return (StrHash)a;
+}
+#endif
+
+/* Primary string hash. */
+static LJ_AINLINE StrHash hash_primary(global_State *g,
+				       const char *str, MSize len)
+{
+#if LJ_STR_HASHCRC
+  if (LJ_LIKELY(g->str.crc) && len < LJ_STR_CRCMAX)
+    return hash_crc(g->str.seed, str, len);
+#endif
+  return hash_sparse(g->str.seed, str, len);
+}
+
+/* Hash a string with a given seed, independent of any state. */
+StrHash lj_str_hash(uint64_t seed, const char *str, MSize len)
+{
+  return hash_sparse(seed, str, len);
+}
+
 #if LUAJIT_SECURITY_STRHASH
 /* Keyed dense ARX string hash. Linear time. */
 static LJ_NOINLINE StrHash hash_dense(uint64_t seed, StrHash h,
@@ -123,22 +336,97 @@ static LJ_NOINLINE StrHash hash_dense(uint64_t seed, StrHash h,
 
 /* -- String interning ---------------------------------------------------- */
 
+/* Compare string contents for equality. Caveat: unaligned access! */
+static LJ_AINLINE int str_eq(const char *a, const char *b, MSize len)
+{
+  MSize i;
+#if LJ_TARGET_X64
+  if (len >= 16) {  /* SSE2 is always available on x64. */
+    for (i = 0; i < len-16; i += 16)
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(
+	    _mm_loadu_si128((const __m128i *)(a+i)),
+	    _mm_loadu_si128((const __m128i *)(b+i)))) != 0xffff)
+	return 0;
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(
+	     _mm_loadu_si128((const __m128i *)(a+len-16)),
+	     _mm_loadu_si128((const __m128i *)(b+len-16)))) == 0xffff;
+  }
+#endif
+  if (len >= 4) {
+    for (i = 0; i < len-4; i += 4)
+      if (lj_getu32(a+i) != lj_getu32(b+i))
+	return 0;
+    return lj_getu32(a+len-4) == lj_getu32(b+len-4);
+  }
+  return a[0] == b[0] && a[len>>1] == b[len>>1] && a[len-1] == b[len-1];
+}
+
 #define LJ_STR_MAXCOLL		32
+#define LJ_STR_MIGRATE		4	/* Chains to migrate per new string. */
 
-/* Resize the string interning hash table (grow and shrink). */
+/* Migrate up to n chains from the old to the new string interning table.
+** Not done while sweeping or whitening, since these cover both tables in
+** order.
+** Returns 1 if no incremental resize is pending (anymore).
+*/
+int LJ_FASTCALL lj_str_migrate(global_State *g, MSize n)
+{
+  GCRef *oldtab = g->str.oldtab;
+  if (oldtab && g->gc.state != GCSsweepstring &&
+      g->gc.state != GCSwhitenstring) {
+    MSize i = g->str.oldpos, mask = g->str.mask;
+    MSize end = g->str.oldmask - i < n ? g->str.oldmask+1 : i+n;
+    lj_assertG(!g->str.second, "secondary hash during incremental resize");
+    for (; i < end; i++) {
+      GCobj *o = gcref(oldtab[i]);
+      setgcrefnull(oldtab[i]);
+      while (o != NULL) {
+	GCobj *next = gcnext(o);
+	GCRef *chain = &g->str.tab[gco2str(o)->hash & mask];
+	/* NOBARRIER: The string table is a GC root. */
+	setgcrefr(o->gch.nextgc, *chain);
+	setgcref(*chain, o);
+	o = next;
+      }
+    }
+    g->str.oldpos = end;
+    if (end > g->str.oldmask) {  /* All chains migrated? */
+      lj_mem_freevec(g, oldtab, g->str.oldmask+1, GCRef);
+      g->str.oldtab = NULL;
+    }
+  }
+  return g->str.oldtab == NULL;
+}
+
+/* Resize the string interning hash table (grow and shrink).
+** Normally the new table only replaces the old one and the chains are
+** migrated incrementally. Secondary hashing needs a full rehash.
+*/
 void lj_str_resize(lua_State *L, MSize newmask)
 {
   global_State *g = G(L);
-  GCRef *newtab, *oldtab = g->str.tab;
+  GCRef *newtab, *oldtab;
   MSize i;
 
   /* No resizing during GC traversal or if already too big. */
-  if (g->gc.state == GCSsweepstring || newmask >= LJ_MAX_STRTAB-1)
+  if (g->gc.state == GCSsweepstring || g->gc.state == GCSwhitenstring ||
+      newmask >= LJ_MAX_STRTAB-1)
     return;
 
+  lj_str_migrate(g, ~(MSize)0);  /* Finish a pending resize first. */
+  oldtab = g->str.tab;
   newtab = lj_mem_newvec(L, newmask+1, GCRef);
   memset(newtab, 0, (newmask+1)*sizeof(GCRef));
 
+  if (!g->str.second && oldtab != NULL) {  /* Start incremental resize. */
+    g->str.oldtab = oldtab;
+    g->str.oldmask = g->str.mask;
+    g->str.oldpos = 0;
+    g->str.tab = newtab;
+    g->str.mask = newmask;
+    return;
+  }
+
 #if LUAJIT_SECURITY_STRHASH
   /* Check which chains need secondary hashes. */
   if (g->str.second) {
@@ -148,7 +436,7 @@ void lj_str_resize(lua_State *L, MSize newmask)
       GCobj *o = (GCobj *)(gcrefu(oldtab[i]) & ~(uintptr_t)1);
       while (o) {
 	GCstr *s = gco2str(o);
-	MSize hash = s->hashalg ? hash_sparse(g->str.seed, strdata(s), s->len) :
+	MSize hash = s->hashalg ? hash_primary(g, strdata(s), s->len) :
 				  s->hash;
 	hash &= newmask;
 	setgcrefp(newtab[hash], gcrefu(newtab[hash]) + 1);
@@ -184,7 +472,7 @@ void lj_str_resize(lua_State *L, MSize newmask)
 	  u = gcrefu(newtab[hash]);
 	}
       } else {  /* String hashed with secondary hash. */
-	MSize shash = hash_sparse(g->str.seed, strdata(s), s->len);
+	MSize shash = hash_primary(g, strdata(s), s->len);
 	u = gcrefu(newtab[shash & newmask]);
 	if (u & 1) {
 	  hash &= newmask;
@@ -235,7 +523,7 @@ static LJ_NOINLINE GCstr *lj_str_rehash_chain(lua_State *L, StrHash hashc,
       if (((o->gch.marked ^ LJ_GC_WHITES) & ow)) {  /* String alive? */
 	lj_assertG(!isdead(g, o) || (o->gch.marked & LJ_GC_FIXED),
 		   "sweep of undead string");
-	makewhite(g, o);
+	sweepwhite(g, o);
       } else {  /* Free dead string. */
 	lj_assertG(isdead(g, o) || ow == LJ_GC_SFIXED,
 		   "sweep of unlive string");
@@ -277,7 +565,9 @@ static GCstr *lj_str_alloc(lua_State *L, const char *str, MSize len,
 {
   GCstr *s = lj_mem_newt(L, lj_str_size(len), GCstr);
   global_State *g = G(L);
+  GCRef *chain;
   uintptr_t u;
+  lj_mem_accnew(g, LJ_HEAP_STR, lj_str_size(len));
   newwhite(g, s);
   s->gct = ~LJ_TSTR;
   s->len = len;
@@ -300,41 +590,75 @@ static GCstr *lj_str_alloc(lua_State *L, const char *str, MSize len,
   *(uint32_t *)(strdatawr(s)+(len & ~(MSize)3)) = 0;
   memcpy(strdatawr(s), str, len);
   /* Add to string hash table. */
-  hash &= g->str.mask;
-  u = gcrefu(g->str.tab[hash]);
+  chain = lj_str_chain(g, hash);
+  u = gcrefu(*chain);
   setgcrefp(s->nextgc, (u & ~(uintptr_t)1));
   /* NOBARRIER: The string table is a GC root. */
-  setgcrefp(g->str.tab[hash], ((uintptr_t)s | (u & 1)));
+  setgcrefp(*chain, ((uintptr_t)s | (u & 1)));
 #ifdef COUNTS
   g->strnum++;
 #endif
+  if (LJ_UNLIKELY(g->str.oldtab != NULL))
+    lj_str_migrate(g, LJ_STR_MIGRATE);
   if (g->str.num++ > g->str.mask)  /* Allow a 100% load factor. */
     lj_str_resize(L, (g->str.mask<<1)+1);  /* Grow string table. */
+  if (LJ_UNLIKELY(g->gc.gen))
+    lj_gc_youngstr(L, s);
   return s;  /* Return newly interned string. */
 }
 
+#if LJ_HASLAZYSTR
+/* Create a lazy string. It's not interned and needs no full-content hash.
+** The constant-time hash is used as its ID, so that equal lazy strings
+** end up in the same table hash chain.
+*/
+static LJ_NOINLINE GCstr *lj_str_newlazy(lua_State *L, const char *str,
+					 MSize len)
+{
+  global_State *g = G(L);
+  GCstr *s = (GCstr *)lj_mem_newgco(L, lj_str_size(len));
+  lj_mem_accnew(g, LJ_HEAP_STR, lj_str_size(len));
+  s->gct = ~LJ_TSTR;
+  s->len = len;
+  s->hash = hash_sparse(g->str.seed, str, len);
+  s->sid = (StrID)s->hash;
+  s->reserved = 0;
+  s->hashalg = 0;
+  /* Clear last 4 bytes of allocated memory. Implies zero-termination, too. */
+  *(uint32_t *)(strdatawr(s)+(len & ~(MSize)3)) = 0;
+  memcpy(strdatawr(s), str, len);
+  return s;
+}
+#endif
+
 /* Intern a string and return string object. */
 GCstr *lj_str_new(lua_State *L, const char *str, size_t lenx)
 {
   global_State *g = G(L);
   if (lenx-1 < LJ_MAX_STR-1) {
     MSize len = (MSize)lenx;
-    StrHash hash = hash_sparse(g->str.seed, str, len);
+    StrHash hash;
     MSize coll = 0;
     int hashalg = 0;
+    GCobj *o;
+#if LJ_HASLAZYSTR
+    if (LJ_UNLIKELY(len >= LJ_LAZYSTR_MIN))
+      return lj_str_newlazy(L, str, len);
+#endif
+    hash = hash_primary(g, str, len);
     /* Check if the string has already been interned. */
-    GCobj *o = gcref(g->str.tab[hash & g->str.mask]);
+    o = gcref(*lj_str_chain(g, hash));
 #if LUAJIT_SECURITY_STRHASH
     if (LJ_UNLIKELY((uintptr_t)o & 1)) {  /* Secondary hash for this chain? */
       hashalg = 1;
       hash = hash_dense(g->str.seed, hash, str, len);
-      o = (GCobj *)(gcrefu(g->str.tab[hash & g->str.mask]) & ~(uintptr_t)1);
+      o = (GCobj *)(gcrefu(*lj_str_chain(g, hash)) & ~(uintptr_t)1);
     }
 #endif
     while (o != NULL) {
       GCstr *sx = gco2str(o);
       if (sx->hash == hash && sx->len == len) {
-	if (memcmp(str, strdata(sx), len) == 0) {
+	if (str_eq(str, strdata(sx), len)) {
 	  if (isdead(g, o)) flipwhite(o);  /* Resurrect if dead. */
 	  return sx;  /* Return existing string. */
 	}
@@ -345,7 +669,8 @@ GCstr *lj_str_new(lua_State *L, const char *str, size_t lenx)
     }
 #if LUAJIT_SECURITY_STRHASH
     /* Rehash chain if there are too many collisions. */
-    if (LJ_UNLIKELY(coll > LJ_STR_MAXCOLL) && !hashalg) {
+    if (LJ_UNLIKELY(coll > LJ_STR_MAXCOLL) && !hashalg &&
+	lj_str_migrate(g, ~(MSize)0)) {  /* Not during a pending resize. */
       return lj_str_rehash_chain(L, hash, str, len);
     }
 #endif
@@ -360,10 +685,13 @@ GCstr *lj_str_new(lua_State *L, const char *str, size_t lenx)
 
 void LJ_FASTCALL lj_str_free(global_State *g, GCstr *s)
 {
-  g->str.num--;
+  if (!strislazy(s)) {
+    g->str.num--;
 #ifdef COUNTS
-  g->strnum--;
+    g->strnum--;
 #endif
+  }
+  lj_mem_accfree(g, LJ_HEAP_STR, lj_str_size(s->len));
   lj_mem_free(g, s, lj_str_size(s->len));
 }
 
@@ -371,6 +699,15 @@ void LJ_FASTCALL lj_str_init(lua_State *L)
 {
   global_State *g = G(L);
   g->str.seed = lj_prng_u64(&g->prng);
+#if LJ_STR_HASHCRC
+  {  /* Same check as for JIT_F_SSE4_2. Must not change once set. */
+    uint32_t features[4];
+    g->str.crc = lj_vm_cpuid(1, features) && ((features[2] >> 20)&1);
+  }
+#endif
+#if LJ_STR_FINDAVX2
+  str_findavx2 = str_cpuavx2();
+#endif
   lj_str_resize(L, LJ_MIN_STRTAB-1);
 }
 
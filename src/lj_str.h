@@ -15,14 +15,32 @@ LJ_FUNC int32_t LJ_FASTCALL lj_str_cmp(GCstr *a, GCstr *b);
 LJ_FUNC const char *lj_str_find(const char *s, const char *f,
 				MSize slen, MSize flen);
 LJ_FUNC int lj_str_haspattern(GCstr *s);
+#if LJ_HASLAZYSTR
+LJ_FUNC int LJ_FASTCALL lj_str_eqlazy(const GCstr *a, const GCstr *b);
+#endif
 
 /* String interning. */
 LJ_FUNC void lj_str_resize(lua_State *L, MSize newmask);
+LJ_FUNC int LJ_FASTCALL lj_str_migrate(global_State *g, MSize n);
 LJ_FUNCA GCstr *lj_str_new(lua_State *L, const char *str, size_t len);
 LJ_FUNC void LJ_FASTCALL lj_str_free(global_State *g, GCstr *s);
 LJ_FUNC void LJ_FASTCALL lj_str_init(lua_State *L);
+LJ_FUNC StrHash lj_str_hash(uint64_t seed, const char *str, MSize len);
 #define lj_str_freetab(g) \
-  (lj_mem_freevec(g, g->str.tab, g->str.mask+1, GCRef))
+  { if (g->str.oldtab) \
+      lj_mem_freevec(g, g->str.oldtab, g->str.oldmask+1, GCRef); \
+    lj_mem_freevec(g, g->str.tab, g->str.mask+1, GCRef); }
+
+/* Get the interning chain anchor for a hash. During an incremental resize
+** the old chains below the migration position have moved to the new table.
+*/
+static LJ_AINLINE GCRef *lj_str_chain(global_State *g, StrHash hash)
+{
+  if (LJ_UNLIKELY(g->str.oldtab != NULL) &&
+      (hash & g->str.oldmask) >= g->str.oldpos)
+    return &g->str.oldtab[hash & g->str.oldmask];
+  return &g->str.tab[hash & g->str.mask];
+}
 
 #define lj_str_newz(L, s)	(lj_str_new(L, s, strlen(s)))
 #define lj_str_newlit(L, s)	(lj_str_new(L, "" s, sizeof(s)-1))
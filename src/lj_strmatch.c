@@ -0,0 +1,553 @@
+/*
+** String pattern compiler and matcher.
+** Copyright (C) 2005-2022 Mike Pall. See Copyright Notice in luajit.h
+**
+** Portions taken verbatim or adapted from the Lua interpreter.
+** Copyright (C) 1994-2008 Lua.org, PUC-Rio. See Copyright Notice in lua.h
+*/
+
+#define lj_strmatch_c
+#define LUA_CORE
+
+#include "lj_obj.h"
+#include "lj_gc.h"
+#include "lj_buf.h"
+#include "lj_str.h"
+#include "lj_char.h"
+#include "lj_strfmt.h"
+#include "lj_strmatch.h"
+
+/*
+** A constant Lua pattern is compiled once into a linear array of items.
+** Every single char class is turned into a 256 bit char set and the
+** captures are resolved at compile time. The matcher is a backtracking
+** matcher like match() in lib_string.c, but it never re-parses the
+** pattern and only recurses for repetitions.
+**
+** Patterns which would raise an error, when the Lua matcher reaches the
+** offending part, are not compiled. The caller has to use the Lua matcher
+** for those. This keeps errors lazy, as before. Ditto for matches which
+** hit the nesting limit.
+*/
+
+#define L_ESC		'%'
+#define uchar(c)	((unsigned char)(c))
+
+#define LJ_STRMATCH_MAXITEM	128	/* Max. number of compiled items. */
+
+/* -- Char classes -------------------------------------------------------- */
+
+static const unsigned char match_class_map[32] = {
+  0,LJ_CHAR_ALPHA,0,LJ_CHAR_CNTRL,LJ_CHAR_DIGIT,0,0,LJ_CHAR_GRAPH,0,0,0,0,
+  LJ_CHAR_LOWER,0,0,0,LJ_CHAR_PUNCT,0,0,LJ_CHAR_SPACE,0,
+  LJ_CHAR_UPPER,0,LJ_CHAR_ALNUM,LJ_CHAR_XDIGIT,0,0,0,0,0,0,0
+};
+
+/* Check whether char c matches the class escape %cl. */
+int lj_strmatch_class(int c, int cl)
+{
+  if ((cl & 0xc0) == 0x40) {
+    int t = match_class_map[(cl&0x1f)];
+    if (t) {
+      t = lj_char_isa(c, t);
+      return (cl & 0x20) ? t : !t;
+    }
+    if (cl == 'z') return c == 0;
+    if (cl == 'Z') return c != 0;
+  }
+  return (cl == c);
+}
+
+/* Check whether char c matches the bracket class [...] from p to ec. */
+int lj_strmatch_bracket(int c, const char *p, const char *ec)
+{
+  int sig = 1;
+  if (*(p+1) == '^') {
+    sig = 0;
+    p++;  /* skip the `^' */
+  }
+  while (++p < ec) {
+    if (*p == L_ESC) {
+      p++;
+      if (lj_strmatch_class(c, uchar(*p)))
+	return sig;
+    }
+    else if ((*(p+1) == '-') && (p+2 < ec)) {
+      p+=2;
+      if (uchar(*(p-2)) <= c && c <= uchar(*p))
+	return sig;
+    }
+    else if (uchar(*p) == c) return sig;
+  }
+  return !sig;
+}
+
+/* -- Pattern compiler ---------------------------------------------------- */
+
+#define sm_inset(set, c)	(((set)[(c) >> 5] >> ((c) & 31)) & 1)
+
+/* Find the end of a single char class. Returns NULL if it's malformed. */
+static const char *sm_classend(const char *p)
+{
+  switch (*p++) {
+  case L_ESC:
+    return *p == '\0' ? NULL : p+1;
+  case '[':
+    if (*p == '^') p++;
+    do {  /* Look for a ']'. */
+      if (*p == '\0') return NULL;
+      if (*(p++) == L_ESC && *p != '\0') p++;  /* Skip escapes. */
+    } while (*p != ']');
+    return p+1;
+  default:
+    return p;
+  }
+}
+
+/* Compute the char set of the single char class from p to ep. */
+static void sm_classset(uint32_t *set, const char *p, const char *ep)
+{
+  int c;
+  memset(set, 0, 8*sizeof(uint32_t));
+  for (c = 0; c < 256; c++) {
+    int m;
+    switch (*p) {
+    case '.': m = 1; break;
+    case L_ESC: m = lj_strmatch_class(c, uchar(*(p+1))); break;
+    case '[': m = lj_strmatch_bracket(c, p, ep-1); break;
+    default: m = (uchar(*p) == c); break;
+    }
+    if (m) set[c >> 5] |= 1u << (c & 31);
+  }
+}
+
+/* Return the only char of a char set or -1. */
+static int sm_setchar(const uint32_t *set)
+{
+  int i, c = -1;
+  for (i = 0; i < 8; i++) {
+    if (set[i]) {
+      if (c >= 0 || (set[i] & (set[i]-1))) return -1;
+      c = (i << 5) + (int)lj_ffs(set[i]);
+    }
+  }
+  return c;
+}
+
+/* Compile a pattern. Returns NULL if it's malformed or too long. */
+static StrMatchProg *sm_compile(lua_State *L, GCstr *pat)
+{
+  StrMatchItem item[LJ_STRMATCH_MAXITEM], *ip = item;
+  StrMatchProg *prog;
+  const char *p = strdata(pat);
+  uint8_t open[LUA_MAXCAPTURES];  /* Stack of unfinished captures. */
+  uint32_t closed = 0, poscap = 0;
+  MSize i, nopen = 0, ncap = 0, sz;
+  int anchor = 0;
+  if (*p == '^') { p++; anchor = 1; }
+  for (;; ip++) {
+    if (ip >= item + LJ_STRMATCH_MAXITEM)
+      return NULL;  /* Too long. */
+    ip->rep = SMR_ONE;
+    ip->a = ip->b = 0;
+    switch (*p) {
+    case '\0':  /* End of pattern. */
+      if (nopen) return NULL;  /* Unfinished capture. */
+      ip->op = SM_END;
+      goto done;
+    case '(':
+      if (ncap >= LUA_MAXCAPTURES) return NULL;
+      ip->a = (uint8_t)ncap;
+      if (*(p+1) == ')') {  /* Position capture? */
+	ip->op = SM_POS;
+	poscap |= 1u << ncap;
+	closed |= 1u << ncap;
+	p += 2;
+      } else {
+	ip->op = SM_OPEN;
+	open[nopen++] = (uint8_t)ncap;
+	p++;
+      }
+      ncap++;
+      continue;
+    case ')':
+      if (!nopen) return NULL;  /* No capture to close. */
+      ip->op = SM_CLOSE;
+      ip->a = open[--nopen];
+      closed |= 1u << ip->a;
+      p++;
+      continue;
+    case '$':
+      if (*(p+1) != '\0') break;  /* Otherwise a plain char. */
+      ip->op = SM_EOS;
+      p++;
+      continue;
+    case L_ESC:
+      if (*(p+1) == 'b') {  /* Balanced match. */
+	if (*(p+2) == '\0' || *(p+3) == '\0') return NULL;
+	ip->op = SM_BAL;
+	ip->a = uchar(*(p+2));
+	ip->b = uchar(*(p+3));
+	p += 4;
+	continue;
+      } else if (*(p+1) == 'f') {  /* Frontier. */
+	const char *ep;
+	p += 2;
+	if (*p != '[' || !(ep = sm_classend(p))) return NULL;
+	ip->op = SM_FRONT;
+	sm_classset(ip->set, p, ep);
+	p = ep;
+	continue;
+      } else if (lj_char_isdigit(uchar(*(p+1)))) {  /* Back reference. */
+	int l = *(p+1) - '1';
+	/* Must refer to a finished capture. Position captures never match. */
+	if (l < 0 || (MSize)l >= ncap || !((closed >> l) & 1) ||
+	    ((poscap >> l) & 1))
+	  return NULL;
+	ip->op = SM_REF;
+	ip->a = (uint8_t)l;
+	p += 2;
+	continue;
+      }
+      break;
+    default:
+      break;
+    }
+    {  /* Single char class with an optional repetition. */
+      const char *ep = sm_classend(p);
+      if (!ep) return NULL;
+      ip->op = SM_SET;
+      sm_classset(ip->set, p, ep);
+      switch (*ep) {
+      case '?': ip->rep = SMR_OPT; ep++; break;
+      case '*': ip->rep = SMR_STAR; ep++; break;
+      case '+': ip->rep = SMR_PLUS; ep++; break;
+      case '-': ip->rep = SMR_MIN; ep++; break;
+      default: break;
+      }
+      p = ep;
+    }
+  }
+done:
+  sz = (MSize)(sizeof(StrMatchProg) + (ip - item)*sizeof(StrMatchItem));
+  prog = lj_mem_newt(L, sz, StrMatchProg);
+  prog->size = sz;
+  prog->anchor = (uint8_t)anchor;
+  prog->ncap = (uint8_t)ncap;
+  prog->poscap = poscap;
+  memcpy(prog->item, item, (ip - item + 1)*sizeof(StrMatchItem));
+  /* Every match starts with a char from the first consuming item? */
+  prog->first = 0xff;
+  prog->prefixlen = 0;
+  for (i = 0; item[i].op == SM_OPEN || item[i].op == SM_POS; i++) ;
+  if (item[i].op == SM_SET &&
+      (item[i].rep == SMR_ONE || item[i].rep == SMR_PLUS)) {
+    prog->first = (uint8_t)i;
+    /* Collect a literal prefix. Captures in between don't consume chars. */
+    for (; prog->prefixlen < LJ_STRMATCH_PREFIX; i++) {
+      int c;
+      if (item[i].op == SM_OPEN || item[i].op == SM_POS ||
+	  item[i].op == SM_CLOSE)
+	continue;
+      if (item[i].op != SM_SET ||
+	  !(item[i].rep == SMR_ONE || item[i].rep == SMR_PLUS) ||
+	  (c = sm_setchar(item[i].set)) < 0)
+	break;
+      prog->prefix[prog->prefixlen++] = (char)c;
+      if (item[i].rep == SMR_PLUS) break;
+    }
+  }
+  return prog;
+}
+
+/* -- Matcher ------------------------------------------------------------- */
+
+typedef struct StrMatchState {
+  const char *src_init;	/* Start of source string. */
+  const char *src_end;	/* End of source string. */
+  int32_t *cap;		/* Capture positions. */
+  int complex;		/* Nesting limit hit. */
+} StrMatchState;
+
+/*
+** Match items starting at s. The nesting depth is counted exactly like
+** match() does, so the nesting limit is hit in the same cases.
+*/
+static const char *sm_match(StrMatchState *ms, const char *s,
+			    const StrMatchItem *ip, int depth)
+{
+  const char *src_end = ms->src_end;
+  if (++depth > LJ_MAX_XLEVEL) goto complex;
+  for (;; ip++) {
+    switch (ip->op) {
+    case SM_END:
+      return s;
+    case SM_SET:
+      if (ip->rep == SMR_ONE) {
+	if (s < src_end && sm_inset(ip->set, uchar(*s))) { s++; continue; }
+	return NULL;
+      } else if (ip->rep == SMR_OPT) {
+	if (s < src_end && sm_inset(ip->set, uchar(*s))) {
+	  const char *res = sm_match(ms, s+1, ip+1, depth);
+	  if (res || ms->complex) return res;
+	}
+	continue;
+      } else if (ip->rep == SMR_MIN) {
+	for (;;) {
+	  const char *res = sm_match(ms, s, ip+1, depth);
+	  if (res || ms->complex) return res;
+	  if (s < src_end && sm_inset(ip->set, uchar(*s))) s++;
+	  else return NULL;
+	}
+      } else {  /* SMR_STAR or SMR_PLUS: maximum expansion. */
+	const char *e = s;
+	const StrMatchItem *np = ip+1;
+	while (e < src_end && sm_inset(ip->set, uchar(*e))) e++;
+	if (ip->rep == SMR_PLUS) {
+	  if (e == s) return NULL;
+	  s++;  /* Need at least one repetition. */
+	}
+	if (depth >= LJ_MAX_XLEVEL) goto complex;  /* Would recurse. */
+	if (np->op == SM_END) return e;
+	for (;; e--) {
+	  /* Skip the call if the next item can't match. */
+	  if (!(np->op == SM_SET && np->rep != SMR_OPT &&
+		np->rep != SMR_STAR && np->rep != SMR_MIN &&
+		!(e < src_end && sm_inset(np->set, uchar(*e))))) {
+	    const char *res = sm_match(ms, e, np, depth);
+	    if (res || ms->complex) return res;
+	  }
+	  if (e == s) return NULL;
+	}
+      }
+    case SM_EOS:
+      if (s != src_end) return NULL;
+      continue;
+    case SM_POS:
+      ms->cap[2*ip->a] = (int32_t)(s - ms->src_init);
+      ms->cap[2*ip->a+1] = 0;
+      if (++depth > LJ_MAX_XLEVEL) goto complex;
+      continue;
+    case SM_OPEN:
+      ms->cap[2*ip->a] = (int32_t)(s - ms->src_init);
+      if (++depth > LJ_MAX_XLEVEL) goto complex;
+      continue;
+    case SM_CLOSE:
+      ms->cap[2*ip->a+1] = (int32_t)(s - ms->src_init) - ms->cap[2*ip->a];
+      if (++depth > LJ_MAX_XLEVEL) goto complex;
+      continue;
+    case SM_REF: {
+      MSize len = (MSize)ms->cap[2*ip->a+1];
+      if ((MSize)(src_end - s) >= len &&
+	  memcmp(ms->src_init + ms->cap[2*ip->a], s, len) == 0) {
+	s += len;
+	continue;
+      }
+      return NULL;
+      }
+    case SM_BAL: {
+      int cont = 1;
+      if (s >= src_end || uchar(*s) != ip->a) return NULL;
+      while (++s < src_end) {
+	if (uchar(*s) == ip->b) {
+	  if (--cont == 0) break;
+	} else if (uchar(*s) == ip->a) {
+	  cont++;
+	}
+      }
+      if (s >= src_end) return NULL;  /* String ends out of balance. */
+      s++;
+      continue;
+      }
+    default: {  /* SM_FRONT. */
+      int prev = s == ms->src_init ? 0 : uchar(*(s-1));
+      int cur = s < src_end ? uchar(*s) : 0;
+      if (sm_inset(ip->set, prev) || !sm_inset(ip->set, cur)) return NULL;
+      continue;
+      }
+    }
+  }
+complex:
+  ms->complex = 1;
+  return NULL;
+}
+
+/* Skip to the next position where a match could start. */
+static const char *sm_skip(const StrMatchProg *prog, const char *s,
+			   const char *e)
+{
+  if (prog->prefixlen >= 2) {
+    return lj_str_find(s, prog->prefix, (MSize)(e-s), prog->prefixlen);
+  } else if (prog->prefixlen) {
+    return (const char *)memchr(s, uchar(prog->prefix[0]), (size_t)(e-s));
+  } else {
+    const uint32_t *set = prog->item[prog->first].set;
+    for (; s < e; s++)
+      if (sm_inset(set, uchar(*s))) return s;
+    return NULL;
+  }
+}
+
+/* Match a compiled pattern against a string, starting at offset init.
+** Returns the start of the match, STRMATCH_NONE or STRMATCH_FALLBACK.
+*/
+int32_t lj_strmatch_exec(const StrMatchProg *prog, const char *str,
+			 MSize len, MSize init, StrMatchRes *res)
+{
+  StrMatchState ms;
+  const char *s = str + init;
+  ms.src_init = str;
+  ms.src_end = str + len;
+  ms.cap = res->cap;
+  ms.complex = 0;
+  for (;;) {
+    const char *e;
+    if (!prog->anchor && prog->first != 0xff &&
+	(s = sm_skip(prog, s, ms.src_end)) == NULL)
+      return STRMATCH_NONE;
+    if ((e = sm_match(&ms, s, prog->item, 0)) != NULL) {
+      res->start = (int32_t)(s - str);
+      res->end = (int32_t)(e - str);
+      return res->start;
+    }
+    if (ms.complex)
+      return STRMATCH_FALLBACK;
+    if (prog->anchor || s >= ms.src_end)
+      return STRMATCH_NONE;
+    s++;
+  }
+}
+
+/* -- Pattern cache ------------------------------------------------------- */
+
+/* Get the compiled pattern for a pattern string or NULL. */
+StrMatchProg *lj_strmatch_get(lua_State *L, GCstr *pat)
+{
+  global_State *g = G(L);
+  StrMatchCache *smc = strmatch_cache(g);
+  StrMatchProg *prog;
+  MSize idx = pat->sid & (LJ_STRMATCH_CACHE-1);
+  if (LJ_UNLIKELY(!smc)) {
+    smc = lj_mem_newt(L, sizeof(StrMatchCache), StrMatchCache);
+    memset(smc, 0, sizeof(StrMatchCache));
+    lj_buf_init(L, &smc->sb);
+    setmref(g->strmatch, smc);
+  } else if (gcref(smc->pat[idx]) == obj2gco(pat)) {
+    return smc->prog[idx];
+  }
+  prog = sm_compile(L, pat);  /* Failures are cached, too. */
+  if (smc->prog[idx])
+    lj_mem_free(g, smc->prog[idx], smc->prog[idx]->size);
+  /* NOBARRIER: The cached patterns are marked in the atomic GC phase. */
+  setgcref(smc->pat[idx], obj2gco(pat));
+  smc->prog[idx] = prog;
+  return prog;
+}
+
+/* Free the pattern cache. */
+void lj_strmatch_freecache(global_State *g)
+{
+  StrMatchCache *smc = strmatch_cache(g);
+  if (smc) {
+    MSize i;
+    for (i = 0; i < LJ_STRMATCH_CACHE; i++)
+      if (smc->prog[i])
+	lj_mem_free(g, smc->prog[i], smc->prog[i]->size);
+    lj_buf_free(g, &smc->sb);
+    lj_mem_freet(g, smc);
+  }
+}
+
+/* -- JIT helpers --------------------------------------------------------- */
+
+#if LJ_HASJIT
+/* Match a pattern from a trace. The captures are left in the cache. */
+int32_t lj_strmatch_rec(lua_State *L, GCstr *s, int32_t init, GCstr *pat)
+{
+  StrMatchProg *prog = lj_strmatch_get(L, pat);
+  lj_assertL(prog != NULL, "uncompiled pattern on trace");
+  return lj_strmatch_exec(prog, strdata(s), s->len, (MSize)init,
+			  &strmatch_cache(G(L))->res);
+}
+
+/* Check whether the replacement string only refers to valid captures. */
+int lj_strmatch_checkrepl(const StrMatchProg *prog, GCstr *repl)
+{
+  const char *r = strdata(repl), *re = r + repl->len;
+  for (; r < re; r++)
+    if (*r == L_ESC && lj_char_isdigit(uchar(*++r)) && *r != '0' &&
+	*r - '1' >= (prog->ncap ? prog->ncap : 1))
+      return 0;
+  return 1;
+}
+
+/* Append the replacement for a match. Same as add_s() in lib_string.c. */
+static void sm_putrepl(SBuf *sb, const StrMatchProg *prog, GCstr *repl,
+		       const char *src, const StrMatchRes *res)
+{
+  const char *r = strdata(repl), *re = r + repl->len;
+  while (r < re) {
+    const char *q = (const char *)memchr(r, L_ESC, (size_t)(re - r));
+    if (!q) q = re;
+    lj_buf_putmem(sb, r, (MSize)(q - r));
+    if (q >= re) break;
+    r = q+1;  /* Note: reads the terminating NUL for a trailing '%'. */
+    if (!lj_char_isdigit(uchar(*r))) {
+      lj_buf_putb(sb, *r);
+    } else if (*r == '0' || prog->ncap == 0) {
+      lj_buf_putmem(sb, src + res->start, (MSize)(res->end - res->start));
+    } else {
+      int i = *r - '1';
+      if (((prog->poscap >> i) & 1))
+	lj_strfmt_putint(sb, res->cap[2*i] + 1);
+      else
+	lj_buf_putmem(sb, src + res->cap[2*i], (MSize)res->cap[2*i+1]);
+    }
+    r++;
+  }
+}
+
+/* Substitute a pattern with a replacement string from a trace.
+** Returns NULL if the trace has to exit to use the Lua matcher.
+** The number of substitutions is left in the cache.
+**
+** This uses a separate buffer, so it can be a CALLS. The result string
+** alone may be unused, but the call must not be eliminated.
+*/
+GCstr *lj_strmatch_gsub(lua_State *L, GCstr *s, GCstr *pat, GCstr *repl,
+			int32_t max)
+{
+  StrMatchProg *prog = lj_strmatch_get(L, pat);
+  StrMatchCache *smc = strmatch_cache(G(L));
+  SBuf *sb = &smc->sb;
+  const char *src = strdata(s);
+  MSize pos = 0, len = s->len;
+  int32_t n = 0;
+  lj_assertL(prog != NULL, "uncompiled pattern on trace");
+  setsbufL(sb, L);
+  lj_buf_reset(sb);
+  while (n < max) {
+    int32_t st = lj_strmatch_exec(prog, src, len, pos, &smc->res);
+    if (st < 0) {
+      if (st == STRMATCH_FALLBACK) return NULL;
+      break;
+    }
+    n++;
+    lj_buf_putmem(sb, src + pos, (MSize)st - pos);  /* Unmatched part. */
+    sm_putrepl(sb, prog, repl, src, &smc->res);
+    if (smc->res.end > st) {
+      pos = (MSize)smc->res.end;
+    } else if ((MSize)st < len) {  /* Empty match: copy one char. */
+      lj_buf_putb(sb, src[st]);
+      pos = (MSize)st + 1;
+    } else {
+      pos = len;
+      break;
+    }
+    if (prog->anchor) break;
+  }
+  lj_buf_putmem(sb, src + pos, len - pos);
+  smc->n = n;
+  return lj_buf_str(L, sb);
+}
+#endif
@@ -0,0 +1,86 @@
+/*
+** String pattern compiler and matcher.
+** Copyright (C) 2005-2022 Mike Pall. See Copyright Notice in luajit.h
+*/
+
+#ifndef _LJ_STRMATCH_H
+#define _LJ_STRMATCH_H
+
+#include "lj_obj.h"
+
+/* Compiled pattern item types. */
+enum {
+  SM_END,		/* End of pattern: match succeeded. */
+  SM_SET,		/* Single char from set, with repetition. */
+  SM_EOS,		/* End of string ('$' at the end of the pattern). */
+  SM_OPEN,		/* Start of capture. */
+  SM_POS,		/* Position capture. */
+  SM_CLOSE,		/* End of capture. */
+  SM_REF,		/* Back reference to a capture (%1-%9). */
+  SM_BAL,		/* Balanced match (%bxy). */
+  SM_FRONT		/* Frontier (%f[set]). */
+};
+
+/* Repetition of SM_SET items. */
+enum { SMR_ONE, SMR_OPT, SMR_STAR, SMR_PLUS, SMR_MIN };
+
+/* Compiled pattern item. */
+typedef struct StrMatchItem {
+  uint8_t op;		/* Item type (SM_*). */
+  uint8_t rep;		/* Repetition (SMR_*). */
+  uint8_t a, b;		/* Capture index or %b delimiters. */
+  uint32_t set[8];	/* Char set for SM_SET and SM_FRONT. */
+} StrMatchItem;
+
+#define LJ_STRMATCH_PREFIX	16	/* Max. length of literal prefix. */
+
+/* Compiled pattern. */
+typedef struct StrMatchProg {
+  MSize size;		/* Size of the allocation. */
+  uint8_t anchor;	/* Pattern is anchored with '^'. */
+  uint8_t ncap;		/* Number of captures. */
+  uint8_t first;	/* Index of first item consuming a char or 0xff. */
+  uint8_t prefixlen;	/* Length of literal prefix. */
+  uint32_t poscap;	/* Bitmap of position captures. */
+  char prefix[LJ_STRMATCH_PREFIX];  /* Literal prefix of every match. */
+  StrMatchItem item[1];	/* Pattern items, terminated with SM_END. */
+} StrMatchProg;
+
+/* Result of matching a compiled pattern. All positions are offsets. */
+typedef struct StrMatchRes {
+  int32_t start, end;	/* Whole match. */
+  int32_t cap[2*LUA_MAXCAPTURES];  /* Start and length of each capture. */
+} StrMatchRes;
+
+/* Return codes of lj_strmatch_exec besides the start of the match. */
+#define STRMATCH_NONE		-1	/* No match. */
+#define STRMATCH_FALLBACK	-2	/* Too complex, use the Lua matcher. */
+
+#define LJ_STRMATCH_CACHE	32	/* Size of pattern cache (pow2). */
+
+/* Cache of compiled patterns, keyed by the pattern string. */
+typedef struct StrMatchCache {
+  GCRef pat[LJ_STRMATCH_CACHE];	/* Pattern strings. Marked by the GC. */
+  StrMatchProg *prog[LJ_STRMATCH_CACHE];  /* Compiled patterns. */
+  StrMatchRes res;	/* Result of last match from a trace. */
+  int32_t n;		/* Number of substitutions of last gsub from a trace. */
+  SBuf sb;		/* Buffer for gsub from a trace. Not the tmpbuf. */
+} StrMatchCache;
+
+#define strmatch_cache(g)	(mref((g)->strmatch, StrMatchCache))
+
+LJ_FUNC int lj_strmatch_class(int c, int cl);
+LJ_FUNC int lj_strmatch_bracket(int c, const char *p, const char *ec);
+LJ_FUNC StrMatchProg *lj_strmatch_get(lua_State *L, GCstr *pat);
+LJ_FUNC int32_t lj_strmatch_exec(const StrMatchProg *prog, const char *str,
+				 MSize len, MSize init, StrMatchRes *res);
+LJ_FUNC void lj_strmatch_freecache(global_State *g);
+#if LJ_HASJIT
+LJ_FUNC int32_t lj_strmatch_rec(lua_State *L, GCstr *s, int32_t init,
+				GCstr *pat);
+LJ_FUNC GCstr *lj_strmatch_gsub(lua_State *L, GCstr *s, GCstr *pat,
+				GCstr *repl, int32_t max);
+LJ_FUNC int lj_strmatch_checkrepl(const StrMatchProg *prog, GCstr *repl);
+#endif
+
+#endif
@@ -12,7 +12,13 @@
 #include "lj_obj.h"
 #include "lj_gc.h"
 #include "lj_err.h"
+#include "lj_str.h"
 #include "lj_tab.h"
+#include "lj_frozen.h"
+#if LJ_HASTABSITE
+#include "lj_bc.h"
+#include "lj_frame.h"
+#endif
 
 /* -- Object hashing ------------------------------------------------------ */
 
@@ -31,6 +37,126 @@ static Node *hashkey(const GCtab *t, cTValue *key)
   /* Only hash 32 bits of lightuserdata on a 64 bit CPU. Good enough? */
 }
 
+/* Compare a string key. Equal lazy strings may be different objects. */
+#if LJ_HASLAZYSTR
+#define tab_streq(a, b) \
+  ((a) == (b) || (strislazy((b)) && lj_str_eqlazy((a), (b))))
+#else
+#define tab_streq(a, b)	((a) == (b))
+#endif
+
+#if LJ_HASTABSHAPE
+#define settabshape(t, s)	((t)->shape = (s))
+#else
+#define settabshape(t, s)	UNUSED(t)
+#endif
+
+/* -- Allocation site feedback ------------------------------------------- */
+
+#if LJ_HASTABSITE
+/*
+** Most tables start out empty and grow by repeated rehashing. Remember the
+** TNEW or TDUP instruction which created a recent table. When the table is
+** rehashed, raise the sizes of the instruction to the new sizes. TNEW has
+** the sizes in its operand. TDUP gets a bigger template table. Both the
+** interpreter and the JIT compiler then allocate presized tables.
+**
+** Only allocations by the interpreter are tracked. The recent allocations
+** are cleared by the atomic phase of the GC, so the tables and prototypes
+** they point to are never dead. Each prototype keeps a list of its
+** presized sites, so allocations from them can be counted, by traces, too.
+*/
+
+#define tab_sitealloc(ts, t) \
+  (&(ts)->alloc[(u32ptr((t)) >> 5) & (LJ_TAB_SITEALLOC-1)])
+
+/* Find a presized site of a prototype. */
+TabSite *lj_tab_sitefind(GCproto *pt, BCPos pos)
+{
+  TabSite *s = mref(pt->tabsite, TabSite);
+  MSize lo = 0, hi = pt->ntabsite;
+  while (lo < hi) {
+    MSize mid = (lo + hi) >> 1;
+    if (s[mid].pos < pos) lo = mid+1; else hi = mid;
+  }
+  return (lo < pt->ntabsite && s[lo].pos == pos) ? &s[lo] : NULL;
+}
+
+/* Add a presized site to a prototype or update it. */
+static void tab_siteset(lua_State *L, GCproto *pt, BCPos pos,
+			uint32_t nrehash)
+{
+  TabSite *s = lj_tab_sitefind(pt, pos);
+  if (!s) {
+    MSize n = pt->ntabsite, i;
+    s = mref(pt->tabsite, TabSite);
+    lj_mem_reallocvec(L, s, n, n+1, TabSite);
+    for (i = n; i > 0 && s[i-1].pos > pos; i--)
+      s[i] = s[i-1];
+    s[i].pos = pos;
+    pt->ntabsite = n+1;
+    setmref(pt->tabsite, s);
+    s = &s[i];
+  }
+  s->nrehash = nrehash;
+}
+
+/* Remember the TNEW or TDUP instruction which allocated a table. */
+static void tab_siteadd(lua_State *L, GCtab *t)
+{
+  global_State *g = G(L);
+  void *cf = cframe_raw(L->cframe);
+  GCfunc *fn;
+  if (!cf || tvref(g->jit_base))
+    return;  /* L->base is stale on trace. */
+  fn = frame_func(L->base-1);
+  if (isluafunc(fn)) {
+    GCproto *pt = funcproto(fn);
+    const BCIns *pc = cframe_pc(cf);
+    /* Only if the interpreter is executing TNEW/TDUP of this function. */
+    if ((uintptr_t)pc - (uintptr_t)proto_bc(pt) - sizeof(BCIns) <
+	  pt->sizebc*sizeof(BCIns) &&
+	(bc_op(pc[-1]) == BC_TNEW || bc_op(pc[-1]) == BC_TDUP)) {
+      TabSiteState *ts = tabsite_state(g);
+      TabSiteAlloc *sa;
+      TabSite *s;
+      if (LJ_UNLIKELY(!ts)) {
+	ts = lj_mem_newt(L, sizeof(TabSiteState), TabSiteState);
+	memset(ts, 0, sizeof(TabSiteState));
+	setmref(g->tabsite, ts);
+      }
+      sa = tab_sitealloc(ts, t);
+      sa->t = t;
+      sa->pt = pt;
+      sa->pc = pc;
+      sa->nrehash = 0;
+      s = lj_tab_sitefind(pt, proto_bcpos(pt, pc) - 1);
+      if (s) {  /* Allocated with learned sizes? */
+	sa->nrehash = s->nrehash;
+	ts->npresized++;
+	ts->navoided += s->nrehash;
+      }
+    }
+  }
+}
+
+/* Forget all recent allocations. */
+void lj_tab_siteclear(global_State *g)
+{
+  TabSiteState *ts = tabsite_state(g);
+  if (ts)
+    memset(ts->alloc, 0, sizeof(ts->alloc));
+}
+
+/* Free allocation site feedback. */
+void lj_tab_freesite(global_State *g)
+{
+  TabSiteState *ts = tabsite_state(g);
+  if (ts)
+    lj_mem_free(g, ts, sizeof(TabSiteState));
+}
+#endif
+
 /* -- Table creation and destruction -------------------------------------- */
 
 /* Create new hash part for table. */
@@ -43,9 +169,11 @@ static LJ_AINLINE void newhpart(lua_State *L, GCtab *t, uint32_t hbits)
     lj_err_msg(L, LJ_ERR_TABOV);
   hsize = 1u << hbits;
   node = lj_mem_newvec(L, hsize, Node);
+  lj_mem_accsize(G(L), LJ_HEAP_HASH, 0, hsize*sizeof(Node));
   setmref(t->node, node);
   setfreetop(t, node, &node[hsize]);
   t->hmask = hsize-1;
+  settabshape(t, lj_tab_rootshape(hbits));
 }
 
 /*
@@ -86,6 +214,7 @@ static GCtab *newtab(lua_State *L, uint32_t asize, uint32_t hbits)
     Node *nilnode;
     lj_assertL((sizeof(GCtab) & 7) == 0, "bad GCtab size");
     t = (GCtab *)lj_mem_newgco(L, sizetabcolo(asize));
+    lj_mem_accnew(G(L), LJ_HEAP_TAB, sizetabcolo(asize));
     t->gct = ~LJ_TTAB;
     t->nomm = (uint8_t)~0;
     t->colo = (int8_t)asize;
@@ -93,6 +222,7 @@ static GCtab *newtab(lua_State *L, uint32_t asize, uint32_t hbits)
     setgcrefnull(t->metatable);
     t->asize = asize;
     t->hmask = 0;
+    settabshape(t, 0);
     nilnode = &G(L)->nilnode;
     setmref(t->node, nilnode);
 #if LJ_GC64
@@ -101,6 +231,7 @@ static GCtab *newtab(lua_State *L, uint32_t asize, uint32_t hbits)
   } else {  /* Otherwise separately allocate the array part. */
     Node *nilnode;
     t = lj_mem_newobj(L, GCtab);
+    lj_mem_accnew(G(L), LJ_HEAP_TAB, sizeof(GCtab));
     t->gct = ~LJ_TTAB;
     t->nomm = (uint8_t)~0;
     t->colo = 0;
@@ -108,6 +239,7 @@ static GCtab *newtab(lua_State *L, uint32_t asize, uint32_t hbits)
     setgcrefnull(t->metatable);
     t->asize = 0;  /* In case the array allocation fails. */
     t->hmask = 0;
+    settabshape(t, 0);
     nilnode = &G(L)->nilnode;
     setmref(t->node, nilnode);
 #if LJ_GC64
@@ -117,6 +249,7 @@ static GCtab *newtab(lua_State *L, uint32_t asize, uint32_t hbits)
       if (asize > LJ_MAX_ASIZE)
 	lj_err_msg(L, LJ_ERR_TABOV);
       setmref(t->array, lj_mem_newvec(L, asize, TValue));
+      lj_mem_accsize(G(L), LJ_HEAP_ARRAY, 0, asize*sizeof(TValue));
       t->asize = asize;
     }
   }
@@ -144,6 +277,9 @@ GCtab *lj_tab_new(lua_State *L, uint32_t asize, uint32_t hbits)
   GCtab *t = newtab(L, asize, hbits);
   clearapart(t);
   if (t->hmask > 0) clearhpart(t);
+#if LJ_HASTABSITE
+  tab_siteadd(L, t);
+#endif
   return t;
 }
 
@@ -191,6 +327,9 @@ GCtab * LJ_FASTCALL lj_tab_dup(lua_State *L, const GCtab *kt)
     Node *knode = noderef(kt->node);
     ptrdiff_t d = (char *)node - (char *)knode;
     setfreetop(t, node, (Node *)((char *)getfreetop(kt, knode) + d));
+#if LJ_HASTABSHAPE
+    t->shape = kt->shape;
+#endif
     for (i = 0; i <= hmask; i++) {
       Node *kn = &knode[i];
       Node *n = &node[i];
@@ -200,6 +339,9 @@ GCtab * LJ_FASTCALL lj_tab_dup(lua_State *L, const GCtab *kt)
       setmref(n->next, next == NULL? next : (Node *)((char *)next + d));
     }
   }
+#if LJ_HASTABSITE
+  tab_siteadd(L, t);
+#endif
   return t;
 }
 
@@ -210,6 +352,7 @@ void LJ_FASTCALL lj_tab_clear(GCtab *t)
   if (t->hmask > 0) {
     Node *node = noderef(t->node);
     setfreetop(t, node, &node[t->hmask+1]);
+    settabshape(t, lj_tab_rootshape(lj_fls(t->hmask)+1));
     clearhpart(t);
   }
 }
@@ -217,14 +360,21 @@ void LJ_FASTCALL lj_tab_clear(GCtab *t)
 /* Free a table. */
 void LJ_FASTCALL lj_tab_free(global_State *g, GCtab *t)
 {
-  if (t->hmask > 0)
+  if (t->hmask > 0) {
+    lj_mem_accsize(g, LJ_HEAP_HASH, (t->hmask+1)*sizeof(Node), 0);
     lj_mem_freevec(g, noderef(t->node), t->hmask+1, Node);
-  if (t->asize > 0 && LJ_MAX_COLOSIZE != 0 && t->colo <= 0)
+  }
+  if (t->asize > 0 && LJ_MAX_COLOSIZE != 0 && t->colo <= 0) {
+    lj_mem_accsize(g, LJ_HEAP_ARRAY, t->asize*sizeof(TValue), 0);
     lj_mem_freevec(g, tvref(t->array), t->asize, TValue);
-  if (LJ_MAX_COLOSIZE != 0 && t->colo)
+  }
+  if (LJ_MAX_COLOSIZE != 0 && t->colo) {
+    lj_mem_accfree(g, LJ_HEAP_TAB, sizetabcolo((uint32_t)t->colo & 0x7f));
     lj_mem_free(g, t, sizetabcolo((uint32_t)t->colo & 0x7f));
-  else
+  } else {
+    lj_mem_accfree(g, LJ_HEAP_TAB, sizeof(GCtab));
     lj_mem_freet(g, t);
+  }
 #ifdef COUNTS
   g->gc.tabnum--;
 #endif
@@ -247,12 +397,15 @@ void lj_tab_resize(lua_State *L, GCtab *t, uint32_t asize, uint32_t hbits)
       /* A colocated array must be separated and copied. */
       TValue *oarray = tvref(t->array);
       array = lj_mem_newvec(L, asize, TValue);
+      lj_mem_accsize(G(L), LJ_HEAP_ARRAY, 0, asize*sizeof(TValue));
       t->colo = (int8_t)(t->colo | 0x80);  /* Mark as separated (colo < 0). */
       for (i = 0; i < oldasize; i++)
 	copyTV(L, &array[i], &oarray[i]);
     } else {
       array = (TValue *)lj_mem_realloc(L, tvref(t->array),
 			  oldasize*sizeof(TValue), asize*sizeof(TValue));
+      lj_mem_accsize(G(L), LJ_HEAP_ARRAY, oldasize*sizeof(TValue),
+		     asize*sizeof(TValue));
     }
     setmref(t->array, array);
     t->asize = asize;
@@ -270,6 +423,7 @@ void lj_tab_resize(lua_State *L, GCtab *t, uint32_t asize, uint32_t hbits)
     setmref(t->freetop, &g->nilnode);
 #endif
     t->hmask = 0;
+    settabshape(t, 0);
   }
   if (asize < oldasize) {  /* Array part shrinks? */
     TValue *array = tvref(t->array);
@@ -279,9 +433,12 @@ void lj_tab_resize(lua_State *L, GCtab *t, uint32_t asize, uint32_t hbits)
       if (!tvisnil(&array[i]))
 	copyTV(L, lj_tab_setinth(L, t, (int32_t)i), &array[i]);
     /* Physically shrink only separated arrays. */
-    if (LJ_MAX_COLOSIZE != 0 && t->colo <= 0)
+    if (LJ_MAX_COLOSIZE != 0 && t->colo <= 0) {
       setmref(t->array, lj_mem_realloc(L, array,
 	      oldasize*sizeof(TValue), asize*sizeof(TValue)));
+      lj_mem_accsize(G(L), LJ_HEAP_ARRAY, oldasize*sizeof(TValue),
+		     asize*sizeof(TValue));
+    }
   }
   if (oldhmask > 0) {  /* Reinsert pairs from old hash part. */
     global_State *g;
@@ -292,10 +449,72 @@ void lj_tab_resize(lua_State *L, GCtab *t, uint32_t asize, uint32_t hbits)
 	copyTV(L, lj_tab_set(L, t, &n->key), &n->val);
     }
     g = G(L);
+    lj_mem_accsize(g, LJ_HEAP_HASH, (oldhmask+1)*sizeof(Node), 0);
     lj_mem_freevec(g, oldnode, oldhmask+1, Node);
   }
 }
 
+#if LJ_HASTABSITE
+/* Raise the sizes of the site which allocated a table that was resized. */
+static void tab_sitegrow(lua_State *L, GCtab *t)
+{
+  TabSiteState *ts = tabsite_state(G(L));
+  TabSiteAlloc *sa;
+  BCIns *pc;
+  uint32_t asize, hbits;
+  if (!ts || (sa = tab_sitealloc(ts, t))->t != t)
+    return;
+  sa->nrehash++;
+  pc = (BCIns *)sa->pc - 1;
+  asize = t->asize < LJ_MAX_SITEASIZE ? t->asize : LJ_MAX_SITEASIZE;
+  hbits = t->hmask > 0 ? lj_fls(t->hmask)+1 : 0;
+  if (hbits > LJ_MAX_SITEHBITS) hbits = LJ_MAX_SITEHBITS;
+  if (bc_op(*pc) == BC_TNEW) {
+    uint32_t ah = bc_d(*pc), oasize = ah & 0x7ff, ohbits = ah >> 11;
+    if (oasize == 0x7ff) oasize = 0x801;
+    if (asize <= oasize && hbits <= ohbits)
+      return;
+    if (asize < oasize) asize = oasize;
+    if (hbits < ohbits) hbits = ohbits;
+    setbc_d(pc, asize | (hbits << 11));
+  } else {
+    /*
+    ** Replace the template with a bigger copy. Traces keep the old one,
+    ** since they rely on the layout of TDUP. Keys with nil values must be
+    ** preserved, too (see lj_opt_fwd_hrefk). Their placeholder values must
+    ** stay in the hash part, so don't learn for nil-valued number keys.
+    */
+    GCRef *kref = &mref(sa->pt->k, GCRef)[~(ptrdiff_t)bc_d(*pc)];
+    GCtab *kt = gco2tab(gcref(*kref)), *nt;
+    uint32_t khbits = kt->hmask > 0 ? lj_fls(kt->hmask)+1 : 0;
+    Node *node = noderef(kt->node);
+    uint32_t i, hmask;
+    if (asize <= kt->asize && hbits <= khbits)
+      return;
+    for (i = 0, hmask = kt->hmask; i <= hmask; i++)
+      if (tvisnum(&node[i].key) && tvisnil(&node[i].val))
+	return;
+    if (asize < kt->asize) asize = kt->asize;
+    if (hbits < khbits) hbits = khbits;
+    nt = lj_tab_dup(L, kt);
+    nt->nomm = kt->nomm;
+    node = noderef(nt->node);
+    for (i = 0, hmask = nt->hmask; i <= hmask; i++)
+      if (!tvisnil(&node[i].key) && tvisnil(&node[i].val))
+	settabV(L, &node[i].val, nt);
+    lj_tab_resize(L, nt, asize, hbits);
+    node = noderef(nt->node);
+    for (i = 0, hmask = nt->hmask; i <= hmask; i++)
+      if (tvistab(&node[i].val))  /* Templates only hold constants. */
+	setnilV(&node[i].val);
+    setgcref(*kref, obj2gco(nt));
+    lj_gc_objbarrier(L, sa->pt, nt);
+  }
+  ts->nlearn++;
+  tab_siteset(L, sa->pt, proto_bcpos(sa->pt, sa->pc) - 1, sa->nrehash);
+}
+#endif
+
 static uint32_t countint(cTValue *key, uint32_t *bins)
 {
   lj_assertX(!tvisint(key), "bad integer key");
@@ -371,6 +590,9 @@ static void rehashtab(lua_State *L, GCtab *t, cTValue *ek)
   na = bestasize(bins, &asize);
   total -= na;
   lj_tab_resize(L, t, asize, hsize2hbits(total));
+#if LJ_HASTABSITE
+  tab_sitegrow(L, t);
+#endif
 }
 
 #if LJ_HASFFI
@@ -383,6 +605,9 @@ void lj_tab_rehash(lua_State *L, GCtab *t)
 void lj_tab_reasize(lua_State *L, GCtab *t, uint32_t nasize)
 {
   lj_tab_resize(L, t, nasize+1, t->hmask > 0 ? lj_fls(t->hmask)+1 : 0);
+#if LJ_HASTABSITE
+  tab_sitegrow(L, t);
+#endif
 }
 
 /* -- Table getters ------------------------------------------------------- */
@@ -404,7 +629,7 @@ cTValue *lj_tab_getstr(GCtab *t, const GCstr *key)
 {
   Node *n = hashstr(t, key);
   do {
-    if (tvisstr(&n->key) && strV(&n->key) == key)
+    if (tvisstr(&n->key) && tab_streq(strV(&n->key), key))
       return &n->val;
   } while ((n = nextnode(n)));
   return NULL;
@@ -442,12 +667,111 @@ cTValue *lj_tab_get(lua_State *L, GCtab *t, cTValue *key)
   return niltv(L);
 }
 
+/* -- Table shapes -------------------------------------------------------- */
+
+#if LJ_HASTABSHAPE
+/*
+** The shape of a table stands for the layout of its hash part: which key
+** is in which node. Two tables with the same (non-zero) shape have the
+** same layout. A trace guards on the shape and then accesses the node of
+** a constant key without checking the key.
+**
+** Key insertion is a deterministic function of the layout and the key, as
+** long as it doesn't run into a dead key (a node with a key, but a nil
+** value). The shape after an insertion is looked up in a global table of
+** transitions, keyed by the shape before the insertion and the new key.
+** An unknown shape is 0. It stays that way until the table is resized or
+** cleared. Dead keys, big hash parts and keys which may be collected and
+** reused (any GC object except strings) all lead to an unknown shape.
+**
+** Shape ids are never reused. The transition table is flushed when it is
+** full. Only equal layouts created afterwards get different shapes then.
+*/
+
+/* Resize or flush the transition table. */
+static void tab_shapegrow(lua_State *L, TabShapeState *ss)
+{
+  TabShapeTr *otr = mref(ss->tr, TabShapeTr), *tr;
+  MSize osize = otr ? ss->mask+1 : 0, nsize, i;
+  if (osize >= 2*LJ_TAB_SHAPETR) {  /* Full: flush it. */
+    memset(otr, 0, osize*sizeof(TabShapeTr));
+    ss->num = 0;
+    return;
+  }
+  nsize = osize ? 2*osize : 64;
+  tr = lj_mem_newvec(L, nsize, TabShapeTr);
+  memset(tr, 0, nsize*sizeof(TabShapeTr));
+  for (i = 0; i < osize; i++) {  /* Reinsert old transitions. */
+    TabShapeTr *e = &otr[i];
+    if (e->parent) {
+      uint32_t h = hashrot(e->parent + e->key.u32.lo, e->key.u32.hi);
+      while (tr[h & (nsize-1)].parent) h++;
+      tr[h & (nsize-1)] = *e;
+    }
+  }
+  if (otr) lj_mem_freevec(G(L), otr, osize, TabShapeTr);
+  setmref(ss->tr, tr);
+  ss->mask = nsize-1;
+}
+
+/* Get the shape after inserting a key into a table with a known shape. */
+static uint32_t tab_shapenext(lua_State *L, uint32_t parent, cTValue *key)
+{
+  TabShapeState *ss = &G(L)->tabshape;
+  TabShapeTr *tr = mref(ss->tr, TabShapeTr), *e;
+  uint32_t h;
+  if (tvisgcv(key) && !tvisstr(key))
+    return 0;  /* Address of object may be reused after it's collected. */
+  h = hashrot(parent + key->u32.lo, key->u32.hi);
+  if (tr) {
+    for (;; h++) {
+      e = &tr[h & ss->mask];
+      if (e->parent == parent && e->key.u64 == key->u64)
+	return e->child;
+      if (e->parent == 0) break;
+    }
+  }
+  if (ss->numid >= ~(uint32_t)LJ_TAB_SHAPEHBITS)
+    return 0;  /* Out of shape ids. */
+  if (!tr || 2*ss->num >= ss->mask) {
+    tab_shapegrow(L, ss);
+    tr = mref(ss->tr, TabShapeTr);
+    h = hashrot(parent + key->u32.lo, key->u32.hi);
+    while (tr[h & ss->mask].parent) h++;
+  }
+  e = &tr[h & ss->mask];
+  e->key.u64 = key->u64;
+  e->parent = parent;
+  e->child = LJ_TAB_SHAPEHBITS + ++ss->numid;
+  ss->num++;
+  return e->child;
+}
+
+/* Free the transition table. */
+void lj_tab_freeshape(global_State *g)
+{
+  TabShapeState *ss = &g->tabshape;
+  if (mref(ss->tr, TabShapeTr))
+    lj_mem_freevec(g, mref(ss->tr, TabShapeTr), ss->mask+1, TabShapeTr);
+}
+#endif
+
 /* -- Table setters ------------------------------------------------------- */
 
 /* Insert new key. Use Brent's variation to optimize the chain length. */
 TValue *lj_tab_newkey(lua_State *L, GCtab *t, cTValue *key)
 {
   Node *n = hashkey(t, key);
+#if LJ_HASTABSHAPE
+  uint32_t shape = t->shape;
+#endif
+#if LJ_HASFROZEN
+  if (LJ_UNLIKELY(tabisfrozen(t)))
+    lj_err_msg(L, LJ_ERR_FROZEN);
+#endif
+#if LJ_HASTABSHAPE
+  t->shape = 0;  /* Unknown until the key is in place. */
+#endif
   if (!tvisnil(&n->val) || t->hmask == 0) {
     Node *nodebase = noderef(t->node);
     Node *collide, *freenode = getfreetop(t, nodebase);
@@ -475,6 +799,9 @@ TValue *lj_tab_newkey(lua_State *L, GCtab *t, cTValue *key)
       /* Rechain pseudo-resurrected string keys with colliding hashes. */
       while (nextnode(freenode)) {
 	Node *nn = nextnode(freenode);
+#if LJ_HASTABSHAPE
+	if (tvisnil(&nn->val)) shape = 0;  /* Dead key may be rechained. */
+#endif
 	if (!tvisnil(&nn->val) && hashkey(t, &nn->key) == n) {
 	  freenode->next = nn->next;
 	  nn->next = n->next;
@@ -498,6 +825,9 @@ TValue *lj_tab_newkey(lua_State *L, GCtab *t, cTValue *key)
 		freenode = nn;
 	      }
 	    } else {
+#if LJ_HASTABSHAPE
+	      shape = 0;
+#endif
 	      freenode = nn;
 	    }
 	  }
@@ -512,9 +842,18 @@ TValue *lj_tab_newkey(lua_State *L, GCtab *t, cTValue *key)
       n = freenode;
     }
   }
+#if LJ_HASTABSHAPE
+  else if (!tvisnil(&n->key)) {
+    shape = 0;  /* Reusing the node of a dead key. */
+  }
+#endif
   n->key.u64 = key->u64;
   if (LJ_UNLIKELY(tvismzero(&n->key)))
     n->key.u64 = 0;
+#if LJ_HASTABSHAPE
+  if (shape)
+    t->shape = tab_shapenext(L, shape, &n->key);
+#endif
   lj_gc_anybarriert(L, t);
   lj_assertL(tvisnil(&n->val), "new hash slot is not empty");
   return &n->val;
@@ -538,7 +877,7 @@ TValue *lj_tab_setstr(lua_State *L, GCtab *t, const GCstr *key)
   TValue k;
   Node *n = hashstr(t, key);
   do {
-    if (tvisstr(&n->key) && strV(&n->key) == key)
+    if (tvisstr(&n->key) && tab_streq(strV(&n->key), key))
       return &n->val;
   } while ((n = nextnode(n)));
   setstrV(L, &k, key);
@@ -633,7 +972,8 @@ int lj_tab_next(GCtab *t, cTValue *key, TValue *o)
       return 1;
     }
   }
-  return (int32_t)idx < 0 ? -1 : 0;  /* Invalid key or end of traversal. */
+  /* Invalid key or end of traversal. Frozen tables need lj_frozen_next(). */
+  return (int32_t)idx < 0 || tabisfrozen(t) ? -1 : 0;
 }
 
 /* -- Table length calculation -------------------------------------------- */
@@ -679,7 +1019,12 @@ MSize LJ_FASTCALL lj_tab_len(GCtab *t)
     return (MSize)lo;
   }
   /* Without a hash part, there's an implicit nil after the last element. */
-  return t->hmask ? tab_len_slow(t, hi) : (MSize)hi;
+  if (t->hmask) return tab_len_slow(t, hi);
+#if LJ_HASFROZEN
+  /* The proxy of a frozen table is empty, but knows the length. */
+  if (LJ_UNLIKELY(hi == 0 && tabisfrozen(t))) return lj_frozen_len(t);
+#endif
+  return (MSize)hi;
 }
 
 #if LJ_HASJIT
@@ -697,3 +1042,198 @@ MSize LJ_FASTCALL lj_tab_len_hint(GCtab *t, size_t hint)
 }
 #endif
 
+
+/* -- Bulk operations ----------------------------------------------------- */
+
+/* Move a1[f..e] to a2[t..t+e-f]. Like a loop of raw loads and stores, in
+** the right direction for overlapping ranges. Ranges within the array
+** parts are moved in bulk. Either way, a single barrier suffices.
+*/
+void lj_tab_move(lua_State *L, GCtab *a1, int32_t f, int32_t e, int32_t t,
+		 GCtab *a2)
+{
+  int64_t d = (int64_t)t - f, i;
+#if LJ_HASFROZEN
+  if (LJ_UNLIKELY(tabisfrozen(a2)))
+    lj_err_msg(L, LJ_ERR_FROZEN);
+#endif
+  if (e < f) return;
+  if (f >= 0 && (uint32_t)e < a1->asize && t >= 0 && e+d < a2->asize) {
+    memmove(arrayslot(a2, t), arrayslot(a1, f),
+	    ((size_t)e - f + 1) * sizeof(TValue));
+  } else {
+    int64_t step = (t > e || t <= f || a1 != a2) ? 1 : -1;
+    for (i = step > 0 ? f : e; i >= f && i <= e; i += step) {
+      cTValue *o;
+      int64_t k = i + d;
+      TValue tv, *dst;
+#if LJ_HASFROZEN
+      if (LJ_UNLIKELY(tabisfrozen(a1))) {
+	o = lj_frozen_getint(a1, (int32_t)i);
+	if (o) lj_frozen_copy(L, &tv, o); else setnilV(&tv);
+      } else
+#endif
+      {
+	o = lj_tab_getint(a1, (int32_t)i);
+	if (o) copyTV(L, &tv, o); else setnilV(&tv);
+      }
+      if (k == (int32_t)k) {
+	dst = lj_tab_setint(L, a2, (int32_t)k);
+      } else {
+	TValue key;
+	setnumV(&key, (lua_Number)k);
+	dst = lj_tab_set(L, a2, &key);
+      }
+      copyTV(L, dst, &tv);
+    }
+  }
+  lj_gc_anybarriert(L, a2);
+}
+
+/* Set t[i..j] to v with raw stores. Grows the array part, if the range
+** starts inside or right after it.
+*/
+void lj_tab_fill(lua_State *L, GCtab *t, int32_t i, int32_t j, cTValue *v)
+{
+#if LJ_HASFROZEN
+  if (LJ_UNLIKELY(tabisfrozen(t)))
+    lj_err_msg(L, LJ_ERR_FROZEN);
+#endif
+  if (i > j) return;
+  if ((uint32_t)j >= t->asize && (uint32_t)i <= t->asize+1 &&
+      j < LJ_MAX_ASIZE-1 && !tvisnil(v))
+    lj_tab_reasize(L, t, (uint32_t)j);
+  if (i >= 0 && (uint32_t)j < t->asize) {
+    TValue *o = arrayslot(t, i), *oe = arrayslot(t, j);
+    for (; o <= oe; o++)
+      copyTV(L, o, v);
+  } else {
+    int64_t k;
+    for (k = i; k <= j; k++)
+      copyTV(L, lj_tab_setint(L, t, (int32_t)k), v);
+  }
+  lj_gc_barriert(L, t, v);
+}
+
+/* -- Table sorting ------------------------------------------------------- */
+
+/* The default order of table.sort() can be done natively, if the slots
+** hold only numbers or only strings. These can't have metamethods, can't
+** throw and are totally ordered (NaNs are excluded). So this is used by
+** the interpreter and called from traces, too.
+*/
+
+#define TAB_SORT_INS	12	/* Use insertion sort below this size. */
+
+/* Check whether the slots 1..n of a table can be sorted natively.
+** Returns 1 for numbers, 2 for strings and 0 otherwise.
+*/
+int lj_tab_sortable(GCtab *t, MSize n)
+{
+  cTValue *a = arrayslot(t, 1);
+  MSize i;
+  if (n == 0 || n >= t->asize) return 0;  /* Only sort the array part. */
+  if (tvisstr(a)) {
+    for (i = 1; i < n; i++)
+      if (!tvisstr(&a[i])) return 0;
+    return 2;
+  }
+  for (i = 0; i < n; i++)
+    if (!(tvisint(&a[i]) || (tvisnum(&a[i]) && !tvisnan(&a[i])))) return 0;
+  return 1;
+}
+
+static LJ_AINLINE int tab_sortlt(cTValue *x, cTValue *y, int isstr)
+{
+  return isstr ? lj_str_cmp(strV(x), strV(y)) < 0 :
+		 numberVnum(x) < numberVnum(y);
+}
+
+static LJ_AINLINE void tab_sortswap(TValue *a, MSize i, MSize j)
+{
+  TValue tmp = a[i]; a[i] = a[j]; a[j] = tmp;
+}
+
+static LJ_AINLINE void tab_siftdown(TValue *a, MSize p, MSize n, int isstr)
+{
+  TValue v = a[p];
+  MSize c;
+  while ((c = 2*p+1) < n) {
+    if (c+1 < n && tab_sortlt(&a[c], &a[c+1], isstr)) c++;
+    if (!tab_sortlt(&v, &a[c], isstr)) break;
+    a[p] = a[c];
+    p = c;
+  }
+  a[p] = v;
+}
+
+/* Introsort: quicksort with a heapsort fallback for bad pivots. */
+static LJ_AINLINE void tab_sortk(TValue *a, MSize n, int isstr)
+{
+  struct { MSize lo, hi, depth; } stk[32];
+  MSize sp = 0, lo = 0, hi = n-1, depth = 2*lj_fls(n);
+  for (;;) {
+    if (hi - lo < TAB_SORT_INS) {  /* Insertion sort for small ranges. */
+      MSize i;
+      for (i = lo+1; i <= hi; i++) {
+	TValue v = a[i];
+	MSize j = i;
+	for (; j > lo && tab_sortlt(&v, &a[j-1], isstr); j--)
+	  a[j] = a[j-1];
+	a[j] = v;
+      }
+    } else if (depth == 0) {  /* Too many bad pivots: heapsort the range. */
+      MSize i, m = hi-lo+1;
+      TValue *b = a+lo;
+      for (i = m >> 1; i > 0; i--)
+	tab_siftdown(b, i-1, m, isstr);
+      while (m > 1) {
+	tab_sortswap(b, 0, --m);
+	tab_siftdown(b, 0, m, isstr);
+      }
+    } else {  /* Partition around the median of three. */
+      MSize i = lo, j = hi, mid = lo + ((hi-lo) >> 1);
+      TValue p;
+      if (tab_sortlt(&a[mid], &a[lo], isstr)) tab_sortswap(a, lo, mid);
+      if (tab_sortlt(&a[hi], &a[mid], isstr)) {
+	tab_sortswap(a, mid, hi);
+	if (tab_sortlt(&a[mid], &a[lo], isstr)) tab_sortswap(a, lo, mid);
+      }
+      p = a[mid];
+      for (;;) {  /* a[lo] <= p <= a[hi] stop both scans. */
+	do i++; while (tab_sortlt(&a[i], &p, isstr));
+	do j--; while (tab_sortlt(&p, &a[j], isstr));
+	if (i >= j) break;
+	tab_sortswap(a, i, j);
+      }
+      /* Push the larger part and continue with the smaller one. */
+      stk[sp].depth = --depth;
+      if (j - lo < hi - j) {
+	stk[sp].lo = j+1; stk[sp].hi = hi;
+	hi = j;
+      } else {
+	stk[sp].lo = lo; stk[sp].hi = j;
+	lo = j+1;
+      }
+      sp++;
+      continue;
+    }
+    if (sp == 0) break;
+    sp--;
+    lo = stk[sp].lo; hi = stk[sp].hi; depth = stk[sp].depth;
+  }
+}
+
+/* Sort the slots 1..n of a table with the default order, if possible.
+** Returns 0 and leaves the table untouched otherwise.
+** NOBARRIER: This only permutes values already stored in the table.
+*/
+int LJ_FASTCALL lj_tab_sort(GCtab *t, MSize n)
+{
+  int kind = lj_tab_sortable(t, n);
+  if (kind == 2)
+    tab_sortk(arrayslot(t, 1), n, 1);
+  else if (kind)
+    tab_sortk(arrayslot(t, 1), n, 0);
+  return kind;
+}
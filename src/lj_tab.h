@@ -52,6 +52,56 @@ static LJ_AINLINE Node *hashmask(const GCtab *t, uint32_t hash)
 
 #define hsize2hbits(s)	((s) ? ((s)==1 ? 1 : 1+lj_fls((uint32_t)((s)-1))) : 0)
 
+#if LJ_HASTABSHAPE
+/* Table shape transition. */
+typedef struct TabShapeTr {
+  TValue key;		/* Inserted key. Strings are marked by the GC. */
+  uint32_t parent;	/* Shape before the insertion or 0 if unused. */
+  uint32_t child;	/* Shape after the insertion. */
+} TabShapeTr;
+
+#define LJ_TAB_SHAPEHBITS	8	/* Max. hash bits for a table shape. */
+#define LJ_TAB_SHAPETR		8192	/* Max. number of transitions. */
+
+/* Empty hash parts of each size have a fixed shape. */
+#define lj_tab_rootshape(hbits) \
+  ((hbits) <= LJ_TAB_SHAPEHBITS ? (uint32_t)(hbits) : 0)
+
+LJ_FUNC void lj_tab_freeshape(global_State *g);
+#endif
+
+#if LJ_HASTABSITE
+#define LJ_TAB_SITEALLOC	64	/* Recent allocations (pow2). */
+
+/* Table recently allocated by a TNEW or TDUP instruction. */
+typedef struct TabSiteAlloc {
+  GCtab *t;		/* Table or NULL. */
+  GCproto *pt;		/* Prototype holding the instruction. */
+  const BCIns *pc;	/* PC following the instruction. */
+  uint32_t nrehash;	/* Rehashes so far, including the ones saved. */
+} TabSiteAlloc;
+
+/* Site which has been presized. Sorted by position in pt->tabsite. */
+typedef struct TabSite {
+  BCPos pos;		/* Bytecode position of the TNEW or TDUP. */
+  uint32_t nrehash;	/* Rehashes saved per allocation. */
+} TabSite;
+
+/* Allocation site feedback. The counters are incremented by traces, too. */
+typedef struct TabSiteState {
+  TabSiteAlloc alloc[LJ_TAB_SITEALLOC];  /* Cleared by each GC cycle. */
+  uint64_t nlearn;	/* Number of times a site was presized. */
+  uintptr_t npresized;	/* Allocations from presized sites. */
+  uintptr_t navoided;	/* Rehashes avoided by presizing (estimate). */
+} TabSiteState;
+
+#define tabsite_state(g)	(mref((g)->tabsite, TabSiteState))
+
+LJ_FUNC TabSite *lj_tab_sitefind(GCproto *pt, BCPos pos);
+LJ_FUNC void lj_tab_siteclear(global_State *g);
+LJ_FUNC void lj_tab_freesite(global_State *g);
+#endif
+
 LJ_FUNCA GCtab *lj_tab_new(lua_State *L, uint32_t asize, uint32_t hbits);
 LJ_FUNC GCtab *lj_tab_new_ah(lua_State *L, int32_t a, int32_t h);
 #if LJ_HASJIT
@@ -92,5 +142,11 @@ LJ_FUNCA MSize LJ_FASTCALL lj_tab_len(GCtab *t);
 #if LJ_HASJIT
 LJ_FUNC MSize LJ_FASTCALL lj_tab_len_hint(GCtab *t, size_t hint);
 #endif
+LJ_FUNC void lj_tab_move(lua_State *L, GCtab *a1, int32_t f, int32_t e,
+			 int32_t t, GCtab *a2);
+LJ_FUNC void lj_tab_fill(lua_State *L, GCtab *t, int32_t i, int32_t j,
+			 cTValue *v);
+LJ_FUNC int lj_tab_sortable(GCtab *t, MSize n);
+LJ_FUNC int LJ_FASTCALL lj_tab_sort(GCtab *t, MSize n);
 
 #endif
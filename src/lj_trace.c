@@ -129,6 +129,7 @@ GCtrace * LJ_FASTCALL lj_trace_alloc(lua_State *L, GCtrace *T)
 	      T->nsnapmap*sizeof(SnapEntry);
   GCtrace *T2 = lj_mem_newt(L, (MSize)sz, GCtrace);
   char *p = (char *)T2 + sztr;
+  lj_mem_accnew(G(L), LJ_HEAP_TRACE, sz);
   T2->gct = ~LJ_TTRACE;
   T2->marked = 0;
   T2->traceno = 0;
@@ -172,15 +173,16 @@ static void trace_save(jit_State *J, GCtrace *T)
 void LJ_FASTCALL lj_trace_free(global_State *g, GCtrace *T)
 {
   jit_State *J = G2J(g);
+  size_t sz = ((sizeof(GCtrace)+7)&~7) + (T->nins-T->nk)*sizeof(IRIns) +
+	      T->nsnap*sizeof(SnapShot) + T->nsnapmap*sizeof(SnapEntry);
   if (T->traceno) {
     lj_gdbjit_deltrace(J, T);
     if (T->traceno < J->freetrace)
       J->freetrace = T->traceno;
     setgcrefnull(J->trace[T->traceno]);
   }
-  lj_mem_free(g, T,
-    ((sizeof(GCtrace)+7)&~7) + (T->nins-T->nk)*sizeof(IRIns) +
-    T->nsnap*sizeof(SnapShot) + T->nsnapmap*sizeof(SnapEntry));
+  lj_mem_accfree(g, LJ_HEAP_TRACE, sz);
+  lj_mem_free(g, T, sz);
 #ifdef COUNTS
   J->tracenum--;
 #endif
@@ -289,6 +291,7 @@ int lj_trace_flushall(lua_State *L)
   ptrdiff_t i;
   if ((J2G(J)->hookmask & HOOK_GC))
     return 1;
+  J->nflush++;
   for (i = (ptrdiff_t)J->sizetrace-1; i > 0; i--) {
     GCtrace *T = traceref(J, i);
     if (T) {
@@ -301,8 +304,9 @@ int lj_trace_flushall(lua_State *L)
   }
   J->cur.traceno = 0;
   J->freetrace = 0;
-  /* Clear penalty cache. */
+  /* Clear penalty cache and recently evicted traces. */
   memset(J->penalty, 0, sizeof(J->penalty));
+  memset(J->evictpc, 0, sizeof(J->evictpc));
   /* Free the whole machine code and invalidate all exit stub groups. */
   lj_mcode_free(J);
   memset(J->exitstubgroup, 0, sizeof(J->exitstubgroup));
@@ -312,6 +316,166 @@ int lj_trace_flushall(lua_State *L)
   return 0;
 }
 
+/* -- Trace eviction ------------------------------------------------------ */
+
+/*
+** When the trace cache runs out of trace numbers or machine code, the least
+** recently used root traces are evicted together with their side traces,
+** instead of flushing all traces. Any trace linking to an evicted trace
+** is evicted, too. The machine code of evicted traces is reused.
+**
+** The eviction clock ticks once for every new trace. A root trace stores
+** the clock of the last observed use of itself or one of its side traces:
+** creation, a new side trace, a trace exit or a GC step on trace. Trace
+** entries are not counted to keep the machine code unchanged.
+*/
+
+/* States of root traces during an eviction round. */
+enum { EVICT_NONE, EVICT_KEEP, EVICT_GROUP, EVICT_DONE };
+
+/* Get the eviction age of a root trace. Negative ages are pinned. */
+static int32_t evict_age(jit_State *J, TraceNo traceno)
+{
+  return (int32_t)(J->evictclock - traceref(J, traceno)->lastuse);
+}
+
+/* Evict a root trace and its side traces. Returns the amount reclaimed. */
+static MSize evict_family(jit_State *J, GCtrace *T, int mcode)
+{
+  TraceNo traceno = T->traceno, next = T->nextside;
+  MSize n = 0;
+  setmref(J->evictpc[J->evictslot], mref(T->startpc, const BCIns));
+  J->evictslot = (J->evictslot + 1) & (EVICT_SLOTS-1);
+  trace_flushroot(J, T);
+  for (;;) {
+    n += mcode ? T->szmcres : 1;
+    lj_gdbjit_deltrace(J, T);
+    lj_mcode_release(J, T->mcode, T->szmcres);
+    T->traceno = T->link = 0;  /* Blacklist the link for cont_stitch. */
+    setgcrefnull(J->trace[traceno]);
+    if (traceno < J->freetrace)
+      J->freetrace = traceno;
+    J->nevict++;
+    if (!next) break;
+    traceno = next;
+    T = traceref(J, traceno);
+    next = T->nextside;
+  }
+  return n;
+}
+
+/* Evict cold trace families. Returns 0 if nothing could be evicted. */
+static int trace_evict(jit_State *J, int mcode)
+{
+  MSize i, n = J->sizetrace, nroot = 0, need, got = 0;
+  int32_t pct = J->param[JIT_P_evict];
+  uint32_t *buf, *fam, *mark, *first, *edge, *cand, *stack;
+  if (pct <= 0 || n < 2)
+    return 0;
+  if (pct > 100) pct = 100;
+  if (mcode)  /* Bytes of machine code or number of traces. */
+    need = (MSize)(((uint64_t)J->szallmcarea * (uint32_t)pct) / 100);
+  else
+    need = (n-1) * (MSize)pct / 100;
+  if (need == 0) need = 1;
+  buf = lj_mem_newvec(J->L, 6*n+1, uint32_t);
+  lj_mcode_growhole(J, n+1);
+  fam = buf; mark = buf+n; first = buf+2*n; edge = buf+3*n+1;
+  cand = buf+4*n+1; stack = buf+5*n+1;
+  memset(buf, 0, (3*n+1)*sizeof(uint32_t));
+  /* Map traces to their root trace. Dead traces wait for the GC sweep. */
+  for (i = 1; i < n; i++) {
+    GCtrace *T = traceref(J, i);
+    if (T && T != &J->cur && T->root == 0 && !isdead(J2G(J), obj2gco(T))) {
+      TraceNo side;
+      cand[nroot++] = i;
+      for (side = i; side; side = traceref(J, side)->nextside)
+	fam[side] = i;
+    }
+  }
+  /* Trace links become edges from the target root to the source root. */
+  for (i = 1; i < n; i++) {
+    TraceNo lnk = fam[i] ? traceref(J, i)->link : 0;
+    if (fam[lnk] && fam[lnk] != fam[i])
+      first[fam[lnk]]++;
+  }
+  for (i = 0; i < n; i++)
+    first[i+1] += first[i];
+  for (i = 1; i < n; i++) {
+    TraceNo lnk = fam[i] ? traceref(J, i)->link : 0;
+    if (fam[lnk] && fam[lnk] != fam[i])
+      edge[--first[fam[lnk]]] = fam[i];
+  }
+  /* Sort root traces by age, oldest first. */
+  {
+    MSize gap, j;
+    for (gap = nroot/2; gap > 0; gap /= 2)
+      for (i = gap; i < nroot; i++) {
+	uint32_t r = cand[i];
+	int32_t age = evict_age(J, r);
+	for (j = i; j >= gap && evict_age(J, cand[j-gap]) < age; j -= gap)
+	  cand[j] = cand[j-gap];
+	cand[j] = r;
+      }
+  }
+  /* Keep the most recently used half and all traces needed right now. */
+  for (i = nroot - nroot/2; i < nroot; i++)
+    mark[cand[i]] = EVICT_KEEP;
+  if (J->parent < n)
+    mark[fam[J->parent]] = EVICT_KEEP;
+  if (J->parent == 0 && J->exitno < n)  /* Predecessor of stitched trace. */
+    mark[fam[J->exitno]] = EVICT_KEEP;
+  if (J->cur.traceno && J->cur.link < n)
+    mark[fam[J->cur.link]] = EVICT_KEEP;
+  if (J->patchpc && bc_d(J->patchins) < n)
+    mark[fam[bc_d(J->patchins)]] = EVICT_KEEP;
+  /* Evict the oldest root traces together with all traces linking to them. */
+  for (i = 0; i < nroot && got < need; i++) {
+    MSize k, top = 1;
+    if (mark[cand[i]] != EVICT_NONE)
+      continue;
+    mark[cand[i]] = EVICT_GROUP;
+    stack[0] = cand[i];
+    for (k = 0; k < top; k++) {
+      uint32_t e, f = stack[k];
+      for (e = first[f]; e < first[f+1]; e++) {
+	uint32_t g = edge[e];
+	if (mark[g] == EVICT_NONE) {
+	  mark[g] = EVICT_GROUP;
+	  stack[top++] = g;
+	} else if (mark[g] == EVICT_KEEP) {
+	  goto keep;
+	}
+      }
+    }
+    for (k = 0; k < top; k++) {
+      mark[stack[k]] = EVICT_DONE;
+      got += evict_family(J, traceref(J, stack[k]), mcode);
+    }
+    continue;
+  keep:
+    for (k = 1; k < top; k++)
+      mark[stack[k]] = EVICT_NONE;
+    mark[cand[i]] = EVICT_KEEP;
+  }
+  lj_mem_freevec(J2G(J), buf, 6*n+1, uint32_t);
+  return got != 0;
+}
+
+/* Check whether a new root trace replaces a recently evicted one. */
+static void evict_rerecord(jit_State *J, const BCIns *pc)
+{
+  uint32_t i;
+  for (i = 0; i < EVICT_SLOTS; i++)
+    if (mref(J->evictpc[i], const BCIns) == pc) {
+      setmref(J->evictpc[i], NULL);
+      J->nrerecord++;
+      /* Evicted too early. Pin it until a full cache of traces is created. */
+      J->cur.lastuse += (uint32_t)J->param[JIT_P_maxtrace];
+      break;
+    }
+}
+
 /* Initialize JIT compiler state. */
 void lj_trace_initstate(global_State *g)
 {
@@ -368,12 +532,115 @@ void lj_trace_freestate(global_State *g)
   }
 #endif
   lj_mcode_free(J);
+  lj_mem_freevec(g, J->mchole, J->sizemchole, MCHole);
   lj_mem_freevec(g, J->snapmapbuf, J->sizesnapmap, SnapEntry);
   lj_mem_freevec(g, J->snapbuf, J->sizesnap, SnapShot);
   lj_mem_freevec(g, J->irbuf + J->irbotlim, J->irtoplim - J->irbotlim, IRIns);
   lj_mem_freevec(g, J->trace, J->sizetrace, GCRef);
 }
 
+/* -- Hot counter sites --------------------------------------------------- */
+
+/*
+** The hotcounts are shared by all bytecodes hashing to the same slot. With
+** -Ohotsite=N, a slot only samples N loop iterations (2*N calls) and the
+** sample is credited to the loop or function entry of the prototype that
+** triggered it. Loops hashing to the same slot still share its samples,
+** but each one needs its own count to start a trace and keeps its own
+** limit and penalties.
+**
+** The hotcount limit of a site is adaptive: aborted root traces raise it
+** with the usual penalty scheme, completed root traces lower it, so the
+** site is compiled again quickly after a flush or an eviction.
+*/
+
+/* Check for a bytecode that triggers hotcount events. */
+static int hotsite_isbc(BCOp op, BCPos pos)
+{
+  return (op >= BC_FORL && op <= BC_JLOOP) || op == BC_ITERN ||
+	 (pos == 0 && op >= BC_FUNCF && op <= BC_JFUNCF);
+}
+
+/* Create the hot counter sites of a prototype. */
+static HotSite *hotsite_new(jit_State *J, lua_State *L, GCproto *pt)
+{
+  BCIns *bc = proto_bc(pt);
+  HotSite *hs;
+  MSize pos, n = 0;
+  for (pos = 0; pos < pt->sizebc; pos++)
+    if (hotsite_isbc(bc_op(bc[pos]), pos)) n++;
+  if (n == 0)
+    return NULL;
+  hs = lj_mem_newvec(L, n, HotSite);
+  memset(hs, 0, n*sizeof(HotSite));
+  for (n = 0, pos = 0; pos < pt->sizebc; pos++)
+    if (hotsite_isbc(bc_op(bc[pos]), pos)) {
+      hs[n].pos = pos;
+      hs[n++].limit = (uint32_t)J->param[JIT_P_hotloop]*HOTCOUNT_LOOP;
+    }
+  pt->nhotsite = n;
+  setmref(pt->hotsite, hs);
+  return hs;
+}
+
+/* Find the hot counter site for a bytecode. Returns NULL if there's none. */
+static HotSite *hotsite_find(jit_State *J, GCproto *pt, const BCIns *pc)
+{
+  HotSite *hs = mref(pt->hotsite, HotSite);
+  BCPos pos = proto_bcpos(pt, pc);
+  MSize lo = 0, hi = pt->nhotsite;
+  if (J->param[JIT_P_hotsite] <= 0 || pos >= pt->sizebc)
+    return NULL;
+  while (lo < hi) {  /* Sites are sorted by bytecode position. */
+    MSize mid = (lo+hi) >> 1;
+    if (hs[mid].pos < pos) lo = mid+1; else hi = mid;
+  }
+  return (lo < pt->nhotsite && hs[lo].pos == pos) ? &hs[lo] : NULL;
+}
+
+/* Retry a loop or function entry on one of the next hotcount events. */
+void lj_trace_hotretry(jit_State *J, GCproto *pt, const BCIns *pc,
+		       HotCount val)
+{
+  HotSite *hs = hotsite_find(J, pt, pc);
+  if (hs) hs->count = hs->limit;
+  hotcount_set(J2GG(J), pc+1, val);
+}
+
+/* Reset the hotcount and sample it for its site. Returns the site or NULL. */
+static HotSite *hotsite_sample(jit_State *J, const BCIns *pc)
+{
+  int32_t n = J->param[JIT_P_hotsite];
+  GCfunc *fn = curr_func(J->L);
+  HotSite *hs = NULL;
+  if (n > 0 && isluafunc(fn)) {
+    GCproto *pt = funcproto(fn);
+    /* Only create the sites in the hot path, once per prototype. */
+    if (mref(pt->hotsite, HotSite) || hotsite_new(J, J->L, pt))
+      hs = hotsite_find(J, pt, pc);
+  }
+  if (hs) {
+    hotcount_set(J2GG(J), pc+1, n*HOTCOUNT_LOOP - 1);
+    hs->count += (uint32_t)n*HOTCOUNT_LOOP;
+    return hs;
+  }
+  hotcount_set(J2GG(J), pc+1, J->param[JIT_P_hotloop]*HOTCOUNT_LOOP);
+  return NULL;
+}
+
+/* Lower the hotcount limit of a site after a completed root trace. */
+static void hotsite_stop(jit_State *J, GCproto *pt, const BCIns *pc)
+{
+  HotSite *hs = hotsite_find(J, pt, pc);
+  if (hs) {
+    uint32_t lim = (uint32_t)J->param[JIT_P_hotloop]*HOTCOUNT_LOOP;
+    uint32_t minlim = (uint32_t)J->param[JIT_P_hotsite]*HOTCOUNT_LOOP;
+    if (hs->limit < lim) lim = hs->limit;
+    hs->limit = lim/2 > minlim ? lim/2 : minlim;
+    hs->ntrace++;
+  }
+}
+
 /* -- Penalties and blacklisting ------------------------------------------ */
 
 /* Blacklist a bytecode instruction. */
@@ -391,26 +658,35 @@ static void blacklist_pc(GCproto *pt, BCIns *pc)
 /* Penalize a bytecode instruction. */
 static void penalty_pc(jit_State *J, GCproto *pt, BCIns *pc, TraceError e)
 {
+  HotSite *hs = hotsite_find(J, pt, pc);
   uint32_t i, val = PENALTY_MIN;
   for (i = 0; i < PENALTY_SLOTS; i++)
-    if (mref(J->penalty[i].pc, const BCIns) == pc) {  /* Cache slot found? */
-      /* First try to bump its hotcount several times. */
-      val = ((uint32_t)J->penalty[i].val << 1) +
-	    (lj_prng_u64(&J2G(J)->prng) & ((1u<<PENALTY_RNDBITS)-1));
-      if (val > PENALTY_MAX) {
-	blacklist_pc(pt, pc);  /* Blacklist it, if that didn't help. */
-	return;
-      }
-      goto setpenalty;
+    if (mref(J->penalty[i].pc, const BCIns) == pc)  /* Cache slot found? */
+      break;
+  if (hs) {  /* The site remembers all penalties, the cache may not. */
+    hs->nabort++;
+    hs->reason = e;
+  }
+  if (hs ? hs->nabort > 1 : i < PENALTY_SLOTS) {
+    /* First try to bump its hotcount several times. */
+    val = ((hs ? hs->limit : (uint32_t)J->penalty[i].val) << 1) +
+	  (lj_prng_u64(&J2G(J)->prng) & ((1u<<PENALTY_RNDBITS)-1));
+    if (val > PENALTY_MAX) {
+      blacklist_pc(pt, pc);  /* Blacklist it, if that didn't help. */
+      return;
     }
-  /* Assign a new penalty cache slot. */
-  i = J->penaltyslot;
-  J->penaltyslot = (J->penaltyslot + 1) & (PENALTY_SLOTS-1);
-  setmref(J->penalty[i].pc, pc);
-setpenalty:
+  }
+  if (i == PENALTY_SLOTS) {  /* Assign a new penalty cache slot. */
+    i = J->penaltyslot;
+    J->penaltyslot = (J->penaltyslot + 1) & (PENALTY_SLOTS-1);
+    setmref(J->penalty[i].pc, pc);
+  }
   J->penalty[i].val = (uint16_t)val;
   J->penalty[i].reason = e;
-  hotcount_set(J2GG(J), pc+1, val);
+  if (hs)  /* The hotcount keeps sampling for the site. */
+    hs->limit = val;
+  else
+    hotcount_set(J2GG(J), pc+1, val);
 }
 
 /* -- Trace compiler state machine ---------------------------------------- */
@@ -439,9 +715,12 @@ static void trace_start(jit_State *J)
   if (LJ_UNLIKELY(traceno == 0)) {  /* No free trace? */
     lj_assertJ((J2G(J)->hookmask & HOOK_GC) == 0,
 	       "recorder called from GC hook");
-    lj_trace_flushall(J->L);
-    J->state = LJ_TRACE_IDLE;  /* Silently ignored. */
-    return;
+    if (!trace_evict(J, 0)) {
+      lj_trace_flushall(J->L);
+      J->state = LJ_TRACE_IDLE;  /* Silently ignored. */
+      return;
+    }
+    traceno = trace_findfree(J);  /* Reuse an evicted trace number. */
   }
   setgcrefp(J->trace[traceno], &J->cur);
 
@@ -545,7 +824,18 @@ static void trace_stop(jit_State *J)
   /* Commit new mcode only after all patching is done. */
   lj_mcode_commit(J, J->cur.mcode);
   J->postproc = LJ_POST_NONE;
+  J->evictclock++;
+  if (J->cur.root) {
+    lj_trace_touch(J, J->cur.root);
+  } else {
+    J->cur.lastuse = J->evictclock;
+    evict_rerecord(J, pc);
+  }
   trace_save(J, T);
+  if (op == BC_FORL || op == BC_LOOP || op == BC_ITERL || op == BC_FUNCF ||
+      op == BC_ITERN) {
+    hotsite_stop(J, pt, pc);
+  }
 
   L = J->L;
   lj_vmevent_send(L, TRACE,
@@ -589,17 +879,18 @@ static int trace_abort(jit_State *J)
   }
   if (tvisnumber(L->top-1))
     e = (TraceError)numberVint(L->top-1);
-  if (e == LJ_TRERR_MCODELM) {
+  if (e == LJ_TRERR_MCODELM ||
+      (e == LJ_TRERR_MCODEAL && trace_evict(J, 1))) {
     L->top--;  /* Remove error object */
     J->state = LJ_TRACE_ASM;
-    return 1;  /* Retry ASM with new MCode area. */
+    return 1;  /* Retry ASM with new MCode area or evicted MCode. */
   }
   /* Penalize or blacklist starting bytecode instruction. */
   if (J->parent == 0 && !bc_isret(bc_op(J->cur.startins))) {
     if (J->exitno == 0) {
       BCIns *startpc = mref(J->cur.startpc, BCIns);
-      if (e == LJ_TRERR_RETRY)
-	hotcount_set(J2GG(J), startpc+1, 1);  /* Immediate retry. */
+      if (e == LJ_TRERR_RETRY)  /* Immediate retry. */
+	lj_trace_hotretry(J, &gcref(J->cur.startpt)->pt, startpc, 1);
       else
 	penalty_pc(J, &gcref(J->cur.startpt)->pt, startpc, e);
     } else {
@@ -769,10 +1060,11 @@ void LJ_FASTCALL lj_trace_hot(jit_State *J, const BCIns *pc)
   /* Note: pc is the interpreter bytecode PC here. It's offset by 1. */
   ERRNO_SAVE
   /* Reset hotcount. */
-  hotcount_set(J2GG(J), pc, J->param[JIT_P_hotloop]*HOTCOUNT_LOOP);
+  HotSite *hs = hotsite_sample(J, pc-1);
   /* Only start a new trace if not recording or inside __gc call or vmevent. */
-  if (J->state == LJ_TRACE_IDLE &&
+  if (J->state == LJ_TRACE_IDLE && (!hs || hs->count >= hs->limit) &&
       !(J2G(J)->hookmask & (HOOK_GC|HOOK_VMEVENT))) {
+    if (hs) hs->count = 0;
     J->parent = 0;  /* Root trace. */
     J->exitno = 0;
     J->state = LJ_TRACE_START;
@@ -891,6 +1183,7 @@ int LJ_FASTCALL lj_trace_exit(jit_State *J, void *exptr)
   J->parent = trace_exit_find(J, (MCode *)(intptr_t)ex->gpr[EXITSTATE_PCREG]);
 #endif
   T = traceref(J, J->parent); UNUSED(T);
+  lj_trace_touch(J, J->parent);
 #ifdef EXITSTATE_CHECKEXIT
   if (J->exitno == T->nsnap) {  /* Treat stack check like a parent exit. */
     lj_assertJ(T->root != 0, "stack check in root trace");
@@ -923,7 +1216,8 @@ int LJ_FASTCALL lj_trace_exit(jit_State *J, void *exptr)
     return -exitcode;
   } else if (LJ_HASPROFILE && (G(L)->hookmask & HOOK_PROFILE)) {
     /* Just exit to interpreter. */
-  } else if (G(L)->gc.state == GCSatomic || G(L)->gc.state == GCSfinalize) {
+  } else if (G(L)->gc.state == GCSatomic || G(L)->gc.state == GCSfinalize ||
+	     lj_gc_minordue(G(L))) {
     if (!(G(L)->hookmask & HOOK_GC))
       lj_gc_step(L);  /* Exited because of GC: drive GC forward. */
   } else {
@@ -32,6 +32,10 @@ LJ_FUNC int lj_trace_flushall(lua_State *L);
 LJ_FUNC void lj_trace_initstate(global_State *g);
 LJ_FUNC void lj_trace_freestate(global_State *g);
 
+/* Hot counter sites. */
+LJ_FUNC void lj_trace_hotretry(jit_State *J, GCproto *pt, const BCIns *pc,
+			       HotCount val);
+
 /* Event handling. */
 LJ_FUNC void lj_trace_ins(jit_State *J, const BCIns *pc);
 LJ_FUNCA void LJ_FASTCALL lj_trace_hot(jit_State *J, const BCIns *pc);
@@ -41,6 +45,15 @@ LJ_FUNCA int LJ_FASTCALL lj_trace_exit(jit_State *J, void *exptr);
 LJ_FUNC uintptr_t LJ_FASTCALL lj_trace_unwind(jit_State *J, uintptr_t addr, ExitNo *ep);
 #endif
 
+/* Note the use of a trace for eviction. Tracked per root trace. */
+static LJ_AINLINE void lj_trace_touch(jit_State *J, TraceNo traceno)
+{
+  GCtrace *T = traceref(J, traceno);
+  if (T->root) T = traceref(J, T->root);
+  if (T && (int32_t)(J->evictclock - T->lastuse) > 0)
+    T->lastuse = J->evictclock;
+}
+
 /* Signal asynchronous abort of trace or end of trace. */
 #define lj_trace_abort(g)	(G2J(g)->state &= ~LJ_TRACE_ACTIVE)
 #define lj_trace_end(J)		(J->state = LJ_TRACE_END)
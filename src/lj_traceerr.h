@@ -27,12 +27,17 @@ TREDEF(CUNROLL,	"call unroll limit reached")
 TREDEF(DOWNREC,	"down-recursion, restarting")
 TREDEF(NYIFFU,	"NYI: unsupported variant of FastFunc %s")
 TREDEF(NYIRETL,	"NYI: return to lower frame")
+TREDEF(NYIUV,	"NYI: closure with mutable upvalue")
+TREDEF(NYIUVSH,	"NYI: closure with shared upvalue")
+TREDEF(NYIUCLO,	"NYI: close upvalue of outer trace frame")
 
 /* Recording indexed load/store. */
 TREDEF(STORENN,	"store with nil or NaN key")
 TREDEF(NOMM,	"missing metamethod")
 TREDEF(IDXLOOP,	"looping index lookup")
 TREDEF(NYITMIX,	"NYI: mixed sparse/dense table")
+TREDEF(NYILAZY,	"NYI: lazy string key or comparison")
+TREDEF(NYIFRZ,	"NYI: frozen table operation")
 
 /* Recording C data operations. */
 TREDEF(NOCACHE,	"symbol not in cache")
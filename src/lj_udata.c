@@ -15,6 +15,7 @@ GCudata *lj_udata_new(lua_State *L, MSize sz, GCtab *env)
 {
   GCudata *ud = lj_mem_newt(L, sizeof(GCudata) + sz, GCudata);
   global_State *g = G(L);
+  lj_mem_accnew(g, LJ_HEAP_UDATA, sizeof(GCudata) + sz);
   newwhite(g, ud);  /* Not finalized. */
   ud->gct = ~LJ_TUDATA;
   ud->udtype = UDTYPE_USERDATA;
@@ -36,6 +37,7 @@ void LJ_FASTCALL lj_udata_free(global_State *g, GCudata *ud)
 #ifdef COUNTS
   g->gc.udatanum--;
 #endif
+  lj_mem_accfree(g, LJ_HEAP_UDATA, sizeudata(ud));
   lj_mem_free(g, ud, sizeudata(ud));
 }
 
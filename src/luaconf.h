@@ -98,6 +98,8 @@
 #define LUAI_MAXCSTACK	8000	/* Max. # of stack slots for a C func (<10K). */
 #define LUAI_GCPAUSE	200	/* Pause GC until memory is at 200%. */
 #define LUAI_GCMUL	200	/* Run GC at 200% of allocation speed. */
+#define LUAI_GCMINOR	20	/* Minor GC after 20% growth (generational). */
+#define LUAI_GCTRIM	50	/* Trim heap if over 50% of it is free. */
 #define LUA_MAXCAPTURES	32	/* Max. pattern captures. */
 
 /* Configuration for the frontend (the luajit executable). */
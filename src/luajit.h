@@ -51,6 +51,8 @@ enum {
 
   LUAJIT_MODE_WRAPCFUNC = 0x10,	/* Set wrapper mode for C function calls. */
 
+  LUAJIT_MODE_HUGEPAGE,		/* Use transparent huge pages. */
+
   LUAJIT_MODE_MAX
 };
 
@@ -73,6 +75,54 @@ LUA_API void luaJIT_profile_stop(lua_State *L);
 LUA_API const char *luaJIT_profile_dumpstack(lua_State *L, const char *fmt,
 					     int depth, size_t *len);
 
+/* Garbage collector statistics. Times are in microseconds. */
+#define LUAJIT_GCHIST	20	/* Pause histogram: < 1us, < 2us, < 4us, ... */
+
+typedef struct luaJIT_gcstats {
+  int mode;			/* LUA_GCINC or LUA_GCGEN. */
+  size_t minor, major;		/* Number of minor/major collections. */
+  double minortime, majortime;	/* Total time spent collecting. */
+  double minormax, majormax;	/* Longest pause. */
+  int budget;			/* Time budget per GC step (0 = unlimited). */
+  size_t mapped;		/* Bytes mapped by the bundled allocator. */
+  size_t released;		/* Free bytes currently released to the OS. */
+  size_t retained;		/* Free bytes still held by the allocator. */
+  size_t hist[LUAJIT_GCHIST];	/* Number of pauses per duration bucket. */
+} luaJIT_gcstats;
+
+LUA_API void luaJIT_gc_stats(lua_State *L, luaJIT_gcstats *gs);
+
+/* Heap accounting categories. */
+enum {
+  LUAJIT_HEAP_STR, LUAJIT_HEAP_UPVAL, LUAJIT_HEAP_THREAD, LUAJIT_HEAP_PROTO,
+  LUAJIT_HEAP_FUNC, LUAJIT_HEAP_TRACE, LUAJIT_HEAP_CDATA, LUAJIT_HEAP_TAB,
+  LUAJIT_HEAP_UDATA,
+  LUAJIT_HEAP_ARRAY,		/* Separately allocated array parts. */
+  LUAJIT_HEAP_HASH,		/* Hash parts. */
+  LUAJIT_HEAP_STACK,		/* Thread stacks. */
+  LUAJIT_HEAP_OTHER,		/* Everything else, e.g. buffers. */
+  LUAJIT_HEAP_MAX
+};
+
+typedef struct luaJIT_heapstats {
+  size_t total;			/* Total bytes allocated. */
+  size_t bytes[LUAJIT_HEAP_MAX];  /* Live bytes per category. */
+  size_t num[LUAJIT_HEAP_MAX];	/* Live objects (0 for non-objects). */
+} luaJIT_heapstats;
+
+LUA_API void luaJIT_heap_stats(lua_State *L, luaJIT_heapstats *hs);
+LUA_API int luaJIT_heap_snapshot(lua_State *L, lua_Writer writer, void *data);
+
+/* Frozen tables. A frozen table graph can be shared by any number of states,
+** even across threads. Each state holds a reference until it's closed.
+** luaJIT_frozen_new() returns NULL, if this build lacks frozen tables.
+*/
+typedef struct luaJIT_frozen luaJIT_frozen;
+
+LUA_API luaJIT_frozen *luaJIT_frozen_new(lua_State *L, int idx);
+LUA_API void luaJIT_frozen_push(lua_State *L, luaJIT_frozen *fz);
+LUA_API void luaJIT_frozen_release(luaJIT_frozen *fz);
+
 /* Enforce (dynamic) linker error for version mismatches. Call from main. */
 LUA_API void LUAJIT_VERSION_SYM(void);
 